@@ -1,130 +1,673 @@
-#include <drivers/bus/pci.h>
-#include <drivers/gfx/vbe.h>
-#include <drivers/ioapic.h>
-#include <drivers/lapic.h>
+#include <arch/amd64/cpu.h>
+#include <fs/multiboot2.h>
 #include <kernel/common.h>
 #include <kernel/kassert.h>
+#include <kernel/kprint.h>
+#include <kernel/lock.h>
 #include <kernel/util.h>
+#include <mm/bootmem.h>
 #include <mm/page.h>
 #include <mm/types.h>
+#include <errno.h>
 #include <stdint.h>
 
-static uint64_t __pml4[512]   __attribute__((aligned(PAGE_SIZE)));
-static uint64_t __pdpt[512]   __attribute__((aligned(PAGE_SIZE)));
-static uint64_t __pd[512 * 2] __attribute__((aligned(PAGE_SIZE)));
+static uint64_t __pml4[512]         __attribute__((aligned(PAGE_SIZE)));
+static uint64_t __pdpt[512]         __attribute__((aligned(PAGE_SIZE)));
+static uint64_t __pd[512 * 2]       __attribute__((aligned(PAGE_SIZE)));
+static uint64_t __ident_pdpt[512]   __attribute__((aligned(PAGE_SIZE)));
+static uint64_t __ident_pd[512 * 2] __attribute__((aligned(PAGE_SIZE)));
+static uint64_t __dm_pdpt[512]      __attribute__((aligned(PAGE_SIZE)));
+static uint64_t __io_pdpt[512]      __attribute__((aligned(PAGE_SIZE)));
 static uint64_t __pml4_;
+static bool     __dm_1gb_pages;
+static spinlock_t __pt_pool_lock; /* protects the page-table page pool */
 
 #define PML4_ATOEI(addr) (((addr) >> 39) & 0x1FF)
 #define PDPT_ATOEI(addr) (((addr) >> 30) & 0x1FF)
 #define PD_ATOEI(addr)   (((addr) >> 21) & 0x1FF)
 #define PT_ATOEI(addr)   (((addr) >> 12) & 0x1FF)
 #define V_TO_P(addr)     ((uint64_t)addr - KVSTART + KPSTART)
+#define P_TO_V(addr)     ((uint64_t)(addr) + KVSTART - KPSTART)
+
+#define SIZE_2MB (1UL << 21)
+#define SIZE_1GB (1UL << 30)
+
+static void __enable_pge(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+    if (edx & CPUID_EDX_PGE)
+        amd64_set_cr4(amd64_get_cr4() | CR4_PGE);
+}
+
+void mm_native_init_pat(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+    /* without PAT, `MM_WC` degrades to write-through which is still correct */
+    if (!(edx & CPUID_EDX_PAT))
+        return;
+
+    /* nothing is mapped with the new types yet but make sure
+     * no stale cache lines or translations survive the switch */
+    cpu_wbinvd();
+    set_msr(IA32_PAT, MM_PAT_LAYOUT);
+    cpu_wbinvd();
+    amd64_flush_tlb_all();
+}
 
 int mm_native_init(void)
 {
-    kmemset(__pml4, 0, sizeof(__pml4));
-    kmemset(__pdpt, 0, sizeof(__pdpt));
-    kmemset(__pd,   0, sizeof(__pd));
+    kmemset(__pml4,       0, sizeof(__pml4));
+    kmemset(__pdpt,       0, sizeof(__pdpt));
+    kmemset(__pd,         0, sizeof(__pd));
+    kmemset(__ident_pdpt, 0, sizeof(__ident_pdpt));
+    kmemset(__ident_pd,   0, sizeof(__ident_pd));
+    kmemset(__dm_pdpt,    0, sizeof(__dm_pdpt));
+    kmemset(__io_pdpt,    0, sizeof(__io_pdpt));
+    spin_init(&__pt_pool_lock);
 
     /* map also the lower part of the address space so our boot stack still works
-     * It only has to work until we switch to init task */
-    __pml4[PML4_ATOEI(KVSTART)] = __pml4[0] = V_TO_P(&__pdpt) | MM_PRESENT | MM_READWRITE;
+     * It only has to work until we switch to init task
+     *
+     * The identity map uses its own tables because unlike the kernel mappings
+     * it must not be global: user address spaces reuse these addresses */
+    __pml4[0] = V_TO_P(&__ident_pdpt) | MM_PRESENT | MM_READWRITE;
+    __pml4[PML4_ATOEI(KVSTART)] = V_TO_P(&__pdpt) | MM_PRESENT | MM_READWRITE;
+
+    /* the direct map and the I/O window are filled later but their PML4 entries
+     * are installed now so that every address space built from `__pml4` shares them */
+    __pml4[PML4_ATOEI(KDMSTART)] = V_TO_P(&__dm_pdpt) | MM_PRESENT | MM_READWRITE;
+    __pml4[PML4_ATOEI(KIOSTART)] = V_TO_P(&__io_pdpt) | MM_PRESENT | MM_READWRITE;
 
     /* map the first 2GB of address space */
-    for (size_t i = 0; i < 512 * 2; ++i)
-        __pd[i] = (i * (1 << 21)) | MM_PRESENT | MM_READWRITE | MM_2MB;
+    for (size_t i = 0; i < 512 * 2; ++i) {
+        __ident_pd[i] = (i * (1 << 21)) | MM_PRESENT | MM_READWRITE | MM_2MB;
+        __pd[i]       = (i * (1 << 21)) | MM_PRESENT | MM_READWRITE | MM_2MB | MM_GLOBAL;
+    }
 
-    for (size_t i = 0; i < 2; ++i)
-        __pdpt[PDPT_ATOEI(KVSTART) + i] = __pdpt[i] = V_TO_P(&__pd[i * 512]) | MM_PRESENT | MM_READWRITE;
+    for (size_t i = 0; i < 2; ++i) {
+        __ident_pdpt[i]                = V_TO_P(&__ident_pd[i * 512]) | MM_PRESENT | MM_READWRITE;
+        __pdpt[PDPT_ATOEI(KVSTART) + i] = V_TO_P(&__pd[i * 512])       | MM_PRESENT | MM_READWRITE;
+    }
 
     amd64_set_cr3(V_TO_P(__pml4));
+    __enable_pge();
+    mm_native_init_pat();
+
+    return 0;
+}
+
+static void __dm_map_range(uint32_t type, uint64_t addr, size_t len)
+{
+    /* reserved ranges hold device memory which ioremap() maps uncached,
+     * a write-back alias of it in the direct map would break that */
+    switch (type) {
+        case MULTIBOOT_MEMORY_AVAILABLE:
+        case MULTIBOOT_MEMORY_ACPI_RECLAIMABLE:
+        case MULTIBOOT_MEMORY_NVS:
+            break;
+
+        default:
+            return;
+    }
+
+    uint64_t start = ROUND_DOWN(addr, SIZE_2MB);
+    uint64_t end   = ROUND_UP(addr + len, SIZE_2MB);
+
+    if (end > KDMSIZE) {
+        kprint("mmu - memory above 0x%x is not direct mapped\n", KDMSIZE);
+        end = KDMSIZE;
+    }
+
+    while (start < end) {
+        uint64_t *pdpte = &__dm_pdpt[PDPT_ATOEI(start)];
+
+        /* an earlier range already mapped this gigabyte with a 1 GB page */
+        if ((*pdpte & MM_PRESENT) && (*pdpte & MM_1GB)) {
+            start = ROUND_DOWN(start, SIZE_1GB) + SIZE_1GB;
+            continue;
+        }
+
+        if (__dm_1gb_pages && !(*pdpte & MM_PRESENT) &&
+            (start % SIZE_1GB) == 0 && end - start >= SIZE_1GB)
+        {
+            *pdpte = start | MM_PRESENT | MM_READWRITE | MM_1GB | MM_GLOBAL;
+            start += SIZE_1GB;
+            continue;
+        }
+
+        /* the direct map doesn't exist yet so the page directory
+         * must be accessed through the kernel image mapping (first 2 GB) */
+        if (!(*pdpte & MM_PRESENT)) {
+            uint64_t pd = mm_bootmem_alloc_block(1);
+
+            kassert(pd != INVALID_ADDRESS);
+            kassert(pd + PAGE_SIZE <= 512 * 2 * SIZE_2MB);
+
+            kmemset((void *)P_TO_V(pd), 0, PAGE_SIZE);
+            *pdpte = pd | MM_PRESENT | MM_READWRITE;
+        }
+
+        uint64_t *pd = (uint64_t *)P_TO_V(*pdpte & ~(PAGE_SIZE - 1));
+
+        if (!(pd[PD_ATOEI(start)] & MM_PRESENT))
+            pd[PD_ATOEI(start)] = start | MM_PRESENT | MM_READWRITE | MM_2MB | MM_GLOBAL;
+
+        start += SIZE_2MB;
+    }
+}
+
+int mm_native_init_direct_map(void *arg)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0x80000000, 0, &eax, &ebx, &ecx, &edx);
+
+    if (eax >= 0x80000001) {
+        cpuid(0x80000001, 0, &eax, &ebx, &ecx, &edx);
+        __dm_1gb_pages = !!(edx & CPUID_EXT_EDX_1GB);
+    }
+
+    /* Map RAM and the ACPI ranges (tables and NVS) but not reserved ranges or holes,
+     * those are device memory. The ranges are rounded to 2 MB so holes between them
+     * (e.g. the PCI hole) are never mapped with 1 GB pages */
+    multiboot2_map_memory(arg, __dm_map_range);
+
+    kprint("mmu - physical memory direct mapped to 0x%x using %s pages\n",
+            KDMSTART, __dm_1gb_pages ? "1 GB" : "2 MB");
+
     return 0;
 }
 
+bool amd64_is_direct_mapped(uint64_t paddr, size_t len)
+{
+    uint64_t end = paddr + len;
+    size_t size;
+
+    if (end < paddr || end > KDMSIZE)
+        return false;
+
+    for (uint64_t addr = paddr; addr < end; addr = ROUND_DOWN(addr, size) + size) {
+        if (!amd64_lookup_page(__pml4, KDMSTART + addr, &size))
+            return false;
+    }
+
+    return true;
+}
+
+void mm_native_init_ap(void)
+{
+    amd64_set_cr3(V_TO_P(__pml4));
+    __enable_pge();
+    mm_native_init_pat();
+}
+
+/* Page-table pages
+ *
+ * Every table (PML4, PDPT, PD, PT) is a single 4 KB frame and the number of present
+ * entries in it is kept in `page_t::pt_count`. When the last entry of a table is
+ * cleared, the table is unlinked from its parent and freed.
+ *
+ * An empty table is all zeroes so freed tables are kept in a small pool and reused
+ * without clearing them again. Only a pool miss goes to the page allocator. The pool
+ * is shared by every address space and protected by `__pt_pool_lock`.
+ *
+ * The boot-time tables (kernel image, direct map) are not counted and never freed.
+ * The kernel-half PDPTs are shared by every PML4 so they're never freed either */
+#define PT_POOL_SIZE 64
+
+static uint64_t __pt_pool[PT_POOL_SIZE];
+static size_t   __pt_pool_count;
+
+static const int __shift[4] = { 39, 30, 21, 12 };
+
+static inline size_t __index(uint64_t vaddr, int level)
+{
+    return (vaddr >> __shift[level]) & 0x1ff;
+}
+
+static inline page_t *__pt_page(uint64_t *table)
+{
+    page_t *page = mm_get_page(amd64_v_to_p(table));
+
+    kassert(page != NULL);
+
+    return page;
+}
+
+static uint64_t __pt_alloc(void)
+{
+    uint64_t addr  = INVALID_ADDRESS;
+    uint64_t flags = spin_lock_irqsave(&__pt_pool_lock);
+
+    if (__pt_pool_count > 0)
+        addr = __pt_pool[--__pt_pool_count];
+
+    spin_unlock_irqrestore(&__pt_pool_lock, flags);
+
+    if (addr == INVALID_ADDRESS) {
+        if ((addr = mm_block_try_alloc(MM_ZONE_NORMAL, 0, MM_NO_FLAGS)) == INVALID_ADDRESS)
+            return INVALID_ADDRESS;
+
+        kmemset(amd64_p_to_v(addr), 0, PAGE_SIZE);
+    }
+
+    mm_get_page(addr)->pt_count = 0;
+
+    return addr;
+}
+
+static void __pt_free(uint64_t addr)
+{
+    uint64_t flags = spin_lock_irqsave(&__pt_pool_lock);
+
+    if (__pt_pool_count < PT_POOL_SIZE) {
+        __pt_pool[__pt_pool_count++] = addr;
+        addr = INVALID_ADDRESS;
+    }
+
+    spin_unlock_irqrestore(&__pt_pool_lock, flags);
+
+    if (addr != INVALID_ADDRESS)
+        mm_page_free(addr);
+}
+
 static uint64_t __alloc_page_directory_entry(void)
 {
-    uint64_t addr = mm_block_alloc(MM_ZONE_NORMAL, 1, MM_NO_FLAGS);
-    kmemset((void *)amd64_p_to_v(addr), 0, PAGE_SIZE);
+    uint64_t addr = __pt_alloc();
+
+    return (addr == INVALID_ADDRESS) ? INVALID_ADDRESS : addr | MM_PRESENT | MM_READWRITE;
+}
+
+/* set the entry `idx` of `table` and update the entry count of `table` */
+static inline void __set_entry(uint64_t *table, size_t idx, uint64_t entry)
+{
+    if (!(table[idx] & MM_PRESENT))
+        __pt_page(table)->pt_count++;
+
+    table[idx] = entry;
+}
+
+/* return the table that entry `idx` of `table` points to, allocating it if necessary
+ *
+ * return NULL if the table couldn't be allocated */
+static uint64_t *__get_table(uint64_t *table, size_t idx)
+{
+    if (!(table[idx] & MM_PRESENT)) {
+        uint64_t entry = __alloc_page_directory_entry();
+
+        if (entry == INVALID_ADDRESS)
+            return NULL;
+
+        __set_entry(table, idx, entry);
+    }
+
+    kassert(!(table[idx] & MM_2MB));
+
+    return amd64_p_to_v(MM_ENTRY_ADDR(table[idx]));
+}
+
+/* clear the entry of `vaddr` in `tables[level]` and free the tables that became empty
+ *
+ * `tables` holds the path from the PML4 (`tables[0]`) down to `tables[level]` */
+static void __clear_entry(uint64_t **tables, int level, uint64_t vaddr)
+{
+    for (;;) {
+        uint64_t *table = tables[level];
+        page_t *page    = __pt_page(table);
+
+        kassert(page->pt_count > 0);
+
+        table[__index(vaddr, level)] = 0;
+
+        if (--page->pt_count > 0 || level == 0)
+            return;
+
+        if (level == 1 && vaddr >= KSPACE_START)
+            return;
+
+        __pt_free(amd64_v_to_p(table));
+        level--;
+    }
+}
+
+/* a mapping failed below `tables[level]`, free that table if the mapping allocated it
+ * (only then it's empty) and the tables above it that become empty */
+static void __put_tables(uint64_t **tables, int level, uint64_t vaddr)
+{
+    if (level == 0 || __pt_page(tables[level])->pt_count > 0)
+        return;
+
+    if (level == 1 && vaddr >= KSPACE_START)
+        return;
+
+    __clear_entry(tables, level - 1, vaddr);
+    __pt_free(amd64_v_to_p(tables[level]));
+}
+
+/* walk the tables of `vaddr` and return the level of the leaf entry or -1 if it's not mapped */
+static int __walk(uint64_t **tables, uint64_t vaddr)
+{
+    for (int level = 0; ; ++level) {
+        uint64_t e = tables[level][__index(vaddr, level)];
 
-    return addr | MM_PRESENT | MM_READWRITE;
+        if (!(e & MM_PRESENT))
+            return -1;
+
+        if (level == 3 || (level > 0 && (e & MM_2MB)))
+            return level;
+
+        tables[level + 1] = amd64_p_to_v(MM_ENTRY_ADDR(e));
+    }
+}
+
+/* get the tables down to `tables[depth]` for `vaddr`, allocating the missing ones
+ *
+ * return 0 on success
+ * return -ENOMEM if a table couldn't be allocated, the new tables have been freed */
+static int __get_tables(uint64_t **tables, int depth, uint64_t vaddr, int flags)
+{
+    for (int level = 0; level < depth; ++level) {
+        uint64_t *table = tables[level];
+        size_t idx      = __index(vaddr, level);
+
+        if (!(tables[level + 1] = __get_table(table, idx))) {
+            __put_tables(tables, level, vaddr);
+            return -ENOMEM;
+        }
+
+        table[idx] |= flags & MM_TABLE_FLAGS;
+    }
+
+    return 0;
 }
 
-void amd64_map_page_to_dir(uint64_t *pml4, uint64_t paddr, uint64_t vaddr, int flags)
+int amd64_map_page_to_dir(uint64_t *pml4, uint64_t paddr, uint64_t vaddr, int flags)
 {
     kassert(PAGE_ALIGNED(paddr) && paddr != INVALID_ADDRESS);
     kassert(PAGE_ALIGNED(vaddr) && vaddr != INVALID_ADDRESS);
 
-    uint64_t pml4i = (vaddr >> 39) & 0x1ff;
-    uint64_t pdpti = (vaddr >> 30) & 0x1ff;
-    uint64_t pdi   = (vaddr >> 21) & 0x1ff;
-    uint64_t pti   = (vaddr >> 12) & 0x1ff;
+    uint64_t *tables[4] = { pml4 };
+    uint64_t pti        = __index(vaddr, 3);
+
+    /* kernel half is shared by all address spaces */
+    if (vaddr >= KSPACE_START)
+        flags |= MM_GLOBAL;
+
+    if (__get_tables(tables, 3, vaddr, flags) < 0)
+        return -ENOMEM;
 
-    if (!(pml4[pml4i] & MM_PRESENT))
-        pml4[pml4i] = __alloc_page_directory_entry();
-    pml4[pml4i] |= flags;
+    uint64_t *pt = tables[3];
+    uint64_t old = pt[pti];
+    __set_entry(pt, pti, paddr | flags | MM_PRESENT);
 
-    uint64_t *pdpt = amd64_p_to_v(pml4[pml4i] & ~0xfff);
+    /* CR3 reload doesn't drop global entries so a changed mapping must be
+     * invalidated explicitly (a no-op if `pml4` is not the active directory) */
+    if ((old & MM_PRESENT) && old != pt[pti])
+        amd64_invlpg(vaddr);
 
-    if (!(pdpt[pdpti] & MM_PRESENT))
-        pdpt[pdpti] = __alloc_page_directory_entry();
-    pdpt[pdpti] |= flags;
+    return 0;
+}
+
+int amd64_map_page(uint64_t paddr, uint64_t vaddr, int flags)
+{
+    return amd64_map_page_to_dir(amd64_p_to_v(amd64_get_cr3()), paddr, vaddr, flags);
+}
+
+uint64_t amd64_unmap_page_from_dir(uint64_t *pml4, uint64_t vaddr)
+{
+    uint64_t *tables[4] = { pml4 };
+    int level           = __walk(tables, vaddr);
 
-    uint64_t *pd = amd64_p_to_v(pdpt[pdpti] & ~0xfff);
+    if (level < 0)
+        return INVALID_ADDRESS;
 
-    if (!(pd[pdi] & MM_PRESENT))
-        pd[pdi] = __alloc_page_directory_entry();
-    pd[pdi] |= flags;
+    uint64_t paddr = MM_ENTRY_ADDR(tables[level][__index(vaddr, level)]);
 
-    uint64_t *pt = amd64_p_to_v(pd[pdi] & ~0xfff);
-    pt[pti]      = paddr | flags | MM_PRESENT;
+    __clear_entry(tables, level, vaddr);
+    amd64_invlpg(vaddr);
+
+    return paddr;
 }
 
-void amd64_map_page(uint64_t paddr, uint64_t vaddr, int flags)
+uint64_t amd64_unmap_page(uint64_t vaddr)
 {
-    amd64_map_page_to_dir(amd64_p_to_v(amd64_get_cr3()), paddr, vaddr, flags);
+    return amd64_unmap_page_from_dir(amd64_p_to_v(amd64_get_cr3()), vaddr);
 }
 
-void *amd64_build_dir(void)
+uint64_t amd64_lookup_page(uint64_t *pml4, uint64_t vaddr, size_t *size)
 {
-    uint64_t pml4_p  = mm_page_alloc(MM_ZONE_NORMAL, 0);
-    uint64_t *pml4_v = amd64_p_to_v(pml4_p);
+    uint64_t *table = pml4;
 
-	kassert(pml4_p != INVALID_ADDRESS);
+    for (int level = 0; ; ++level) {
+        uint64_t e = table[__index(vaddr, level)];
 
-    for (size_t i = 0; i < 511; ++i)
-        pml4_v[i] = 0;
+        if (!(e & MM_PRESENT) || level == 3 || (level > 0 && (e & MM_2MB))) {
+            if (size)
+                *size = 1UL << __shift[level];
 
-	// map kernel to address space
-    pml4_v[PML4_ATOEI(KVSTART)] = __pml4[PML4_ATOEI(KVSTART)];
+            return (e & MM_PRESENT) ? e : 0;
+        }
+
+        table = amd64_p_to_v(MM_ENTRY_ADDR(e));
+    }
+}
+
+int amd64_map_large_page_to_dir(uint64_t *pml4, uint64_t paddr, uint64_t vaddr, int flags)
+{
+    kassert((paddr % SIZE_2MB) == 0 && (vaddr % SIZE_2MB) == 0);
+
+    uint64_t *tables[4] = { pml4 };
+
+    if (vaddr >= KSPACE_START)
+        flags |= MM_GLOBAL;
+
+    if (__get_tables(tables, 2, vaddr, flags) < 0)
+        return -ENOMEM;
+
+    uint64_t *pd = tables[2];
+
+    kassert(!(pd[PD_ATOEI(vaddr)] & MM_PRESENT));
+    __set_entry(pd, PD_ATOEI(vaddr), paddr | flags | MM_PRESENT | MM_2MB);
+
+    return 0;
+}
+
+void amd64_split_large_page(uint64_t *pml4, uint64_t vaddr)
+{
+    uint64_t *tables[4] = { pml4 };
+
+    kassert(__walk(tables, vaddr) == 2);
 
-	// TODO: device subsystem
-    unsigned long lapic  = lapic_get_base();
-    unsigned long ioapic = ioapic_get_base();
+    uint64_t *pde  = &tables[2][PD_ATOEI(vaddr)];
+    uint64_t paddr = MM_ENTRY_ADDR(*pde);
+    uint64_t flags = *pde & (PAGE_SIZE - 1) & ~MM_2MB;
+    uint64_t pt_p  = __pt_alloc();
+    uint64_t *pt;
 
-    kassert(lapic  != INVALID_ADDRESS);
-    kassert(ioapic != INVALID_ADDRESS);
+    /* not called on the fault path, unmapping part of a huge page can't fail yet */
+    kassert(pt_p != INVALID_ADDRESS);
+    pt = amd64_p_to_v(pt_p);
 
-    amd64_map_page_to_dir(pml4_v, lapic,  lapic,  MM_PRESENT | MM_READWRITE);
-    amd64_map_page_to_dir(pml4_v, ioapic, ioapic, MM_PRESENT | MM_READWRITE);
+    for (size_t i = 0; i < 512; ++i)
+        pt[i] = (paddr + i * PAGE_SIZE) | flags;
 
-    pci_dev_t *dev = pci_get_dev(VBE_VENDOR_ID, VBE_DEVICE_ID);
+    __pt_page(pt)->pt_count = 512;
 
-    if (dev) {
-        void *vga_mem = (uint8_t *)((uint64_t)dev->bar0 - 8);
+    /* the PD keeps the same number of entries, one leaf is replaced by a table */
+    *pde = pt_p | (flags & MM_TABLE_FLAGS);
+    amd64_invlpg(vaddr);
+}
+
+void amd64_merge_large_page(uint64_t *pml4, uint64_t paddr, uint64_t vaddr, int flags,
+                            void (*put)(uint64_t paddr))
+{
+    uint64_t *tables[4] = { pml4 };
+
+    kassert((paddr % SIZE_2MB) == 0 && (vaddr % SIZE_2MB) == 0);
+    kassert(__walk(tables, vaddr) == 3);
+
+    uint64_t *pt = tables[3];
+
+    /* the PD keeps the same number of entries, a table is replaced by one leaf */
+    tables[2][PD_ATOEI(vaddr)] = paddr | flags | MM_PRESENT | MM_2MB;
+
+    for (size_t i = 0; i < 512; ++i)
+        amd64_invlpg(vaddr + i * PAGE_SIZE);
 
-		for (size_t i = 0; i < 4096; ++i) {
-            amd64_map_page_to_dir(
-                pml4_v,
-                (uint64_t)vga_mem,
-                (uint64_t)vga_mem,
-                MM_PRESENT | MM_READWRITE
-            );
-		}
+    for (size_t i = 0; i < 512; ++i) {
+        if (pt[i] & MM_PRESENT)
+            put(MM_ENTRY_ADDR(pt[i]));
+
+        pt[i] = 0;
     }
 
+    /* pooled tables must be all zeroes */
+    __pt_free(amd64_v_to_p(pt));
+}
+
+size_t amd64_dir_table_pages(uint64_t *pml4)
+{
+    size_t count = 1;
+
+    for (size_t pml4i = 0; pml4i < PML4_ATOEI(KSPACE_START); ++pml4i) {
+        if (!(pml4[pml4i] & MM_PRESENT))
+            continue;
+
+        uint64_t *pdpt = amd64_p_to_v(MM_ENTRY_ADDR(pml4[pml4i]));
+        count++;
+
+        for (size_t pdpti = 0; pdpti < 512; ++pdpti) {
+            if (!(pdpt[pdpti] & MM_PRESENT) || (pdpt[pdpti] & MM_1GB))
+                continue;
+
+            uint64_t *pd = amd64_p_to_v(MM_ENTRY_ADDR(pdpt[pdpti]));
+            count++;
+
+            for (size_t pdi = 0; pdi < 512; ++pdi) {
+                if ((pd[pdi] & MM_PRESENT) && !(pd[pdi] & MM_2MB))
+                    count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+void amd64_map_kernel_range(uint64_t paddr, uint64_t vaddr, size_t len, int flags)
+{
+    kassert(PAGE_ALIGNED(paddr) && PAGE_ALIGNED(vaddr) && PAGE_ALIGNED(len));
+    kassert(vaddr >= KSPACE_START);
+
+    flags |= MM_PRESENT | MM_GLOBAL;
+
+    while (len > 0) {
+        uint64_t *pml4e = &__pml4[PML4_ATOEI(vaddr)];
+
+        /* new kernel-half PML4 entries would not be seen by existing address spaces */
+        kassert(*pml4e & MM_PRESENT);
+
+        uint64_t *pdpt = amd64_p_to_v(MM_ENTRY_ADDR(*pml4e));
+
+        if (__dm_1gb_pages && len >= SIZE_1GB &&
+            (paddr % SIZE_1GB) == 0 && (vaddr % SIZE_1GB) == 0)
+        {
+            kassert(!(pdpt[PDPT_ATOEI(vaddr)] & MM_PRESENT));
+            __set_entry(pdpt, PDPT_ATOEI(vaddr), paddr | flags | MM_1GB);
+
+            paddr += SIZE_1GB, vaddr += SIZE_1GB, len -= SIZE_1GB;
+            continue;
+        }
+
+        /* the kernel-half tables are allocated at boot and when ioremap() maps
+         * a new region, running out of memory there isn't recoverable yet */
+        uint64_t *pd = __get_table(pdpt, PDPT_ATOEI(vaddr));
+        kassert(pd != NULL);
+
+        if (len >= SIZE_2MB && (paddr % SIZE_2MB) == 0 && (vaddr % SIZE_2MB) == 0) {
+            kassert(!(pd[PD_ATOEI(vaddr)] & MM_PRESENT));
+            __set_entry(pd, PD_ATOEI(vaddr), paddr | flags | MM_2MB);
+
+            paddr += SIZE_2MB, vaddr += SIZE_2MB, len -= SIZE_2MB;
+            continue;
+        }
+
+        uint64_t *pt = __get_table(pd, PD_ATOEI(vaddr));
+
+        kassert(pt != NULL);
+        kassert(!(pt[PT_ATOEI(vaddr)] & MM_PRESENT));
+        __set_entry(pt, PT_ATOEI(vaddr), paddr | flags);
+
+        paddr += PAGE_SIZE, vaddr += PAGE_SIZE, len -= PAGE_SIZE;
+    }
+}
+
+void amd64_unmap_kernel_range(uint64_t vaddr, size_t len)
+{
+    kassert(PAGE_ALIGNED(vaddr) && PAGE_ALIGNED(len));
+    kassert(vaddr >= KSPACE_START);
+
+    while (len > 0) {
+        uint64_t *tables[4] = { __pml4 };
+        int level           = __walk(tables, vaddr);
+        size_t size         = 1UL << __shift[level];
+
+        kassert(level > 0 && len >= size);
+
+        __clear_entry(tables, level, vaddr);
+        amd64_invlpg(vaddr);
+
+        vaddr += size, len -= size;
+    }
+}
+
+void *amd64_build_dir(void)
+{
+    uint64_t pml4_p  = __pt_alloc();
+    uint64_t *pml4_v;
+
+    if (pml4_p == INVALID_ADDRESS)
+        return NULL;
+
+    pml4_v = amd64_p_to_v(pml4_p);
+
+    for (size_t i = 0; i < PML4_ATOEI(KSPACE_START); ++i)
+        pml4_v[i] = 0;
+
+	// map kernel to address space
+	//
+	// all kernel-half PML4 entries (kernel image, direct map and I/O window) are created at boot
+	// and never change so copying them is enough to keep every address space in sync
+    for (size_t i = PML4_ATOEI(KSPACE_START); i < 512; ++i)
+        pml4_v[i] = __pml4[i];
+
     return pml4_v;
 }
 
+void amd64_destroy_dir(uint64_t *pml4)
+{
+    /* all user mappings must have been removed which also freed the tables */
+    for (size_t i = 0; i < PML4_ATOEI(KSPACE_START); ++i)
+        kassert(!(pml4[i] & MM_PRESENT));
+
+    __pt_free(amd64_v_to_p(pml4));
+}
+
+/* a partial copy of an address space isn't unwound yet, running out of memory is fatal */
+static uint64_t __dup_table_entry(void)
+{
+    uint64_t entry = __alloc_page_directory_entry();
+
+    kassert(entry != INVALID_ADDRESS);
+
+    return entry | MM_USER;
+}
+
 void *amd64_duplicate_dir(void)
 {
     uint64_t *pml4_cv = amd64_build_dir();             // copy, virtual
@@ -133,12 +676,15 @@ void *amd64_duplicate_dir(void)
     uint64_t *pd_ov   = NULL, *pd_cv   = NULL;
     uint64_t *pt_ov   = NULL, *pt_cv   = NULL;
 
+    if (!pml4_cv)
+        return NULL;
+
     // map all user pages, kernel stays untouched
-    for (size_t pml4i = 0; pml4i < 511; ++pml4i) {
+    for (size_t pml4i = 0; pml4i < PML4_ATOEI(KSPACE_START); ++pml4i) {
         if (pml4_ov[pml4i] & MM_PRESENT) {
 
             // create new pml4 entry and set up pdpt pointers
-            pml4_cv[pml4i] = __alloc_page_directory_entry() | MM_PRESENT | MM_USER;
+            __set_entry(pml4_cv, pml4i, __dup_table_entry());
             pdpt_ov        = amd64_p_to_v(pml4_ov[pml4i] & ~(PAGE_SIZE - 1));
             pdpt_cv        = amd64_p_to_v(pml4_cv[pml4i] & ~(PAGE_SIZE - 1));
 
@@ -147,7 +693,7 @@ void *amd64_duplicate_dir(void)
                 if (pdpt_ov[pdpti] & MM_PRESENT) {
 
                     // create new pdpt entry and set up pd pointers
-                    pdpt_cv[pdpti] = __alloc_page_directory_entry() | MM_PRESENT | MM_USER;
+                    __set_entry(pdpt_cv, pdpti, __dup_table_entry());
                     pd_ov          = amd64_p_to_v(pdpt_ov[pdpti] & ~(PAGE_SIZE - 1));
                     pd_cv          = amd64_p_to_v(pdpt_cv[pdpti] & ~(PAGE_SIZE - 1));
 
@@ -162,23 +708,29 @@ void *amd64_duplicate_dir(void)
                     for (size_t pdi = 0; pdi < 512; ++pdi)  {
                         if (pd_ov[pdi] & MM_PRESENT) {
 
-                            // 2MB pages should not be mapped like 4KB pages
-                            if ((pd_ov[pdi] & MM_2MB)) {
-                                pd_ov[pdi] &= ~(PAGE_SIZE - 1); // reset flags
-                                pd_ov[pdi] |= (MM_COW | MM_READONLY | MM_PRESENT | MM_USER | MM_2MB);
-                                pd_cv[pdi]  = pd_ov[pdi];
-                            }
+                            // frames are shared and copied in 4 KB pages, a 2 MB page
+                            // is split so its pages can be copied one by one
+                            if ((pd_ov[pdi] & MM_2MB))
+                                amd64_split_large_page(pml4_ov, (pml4i << 39) | (pdpti << 30) | (pdi << 21));
 
                             // create new pd entry and set up pt pointers
-                            pd_cv[pdi] = __alloc_page_directory_entry() | MM_PRESENT | MM_USER;
+                            __set_entry(pd_cv, pdi, __dup_table_entry());
                             pt_ov      = amd64_p_to_v(pd_ov[pdi] & ~(PAGE_SIZE - 1));
                             pt_cv      = amd64_p_to_v(pd_cv[pdi] & ~(PAGE_SIZE - 1));
 
                             for (size_t pti = 0; pti < 512; ++pti) {
                                 if (pt_ov[pti] & MM_PRESENT) {
+                                    uint64_t borrowed = pt_ov[pti] & MM_BORROWED;
+
                                     pt_ov[pti] &= ~(PAGE_SIZE - 1); // reset flags
-                                    pt_ov[pti] |= (MM_COW | MM_READONLY | MM_PRESENT | MM_USER);
-                                    pt_cv[pti]  = pt_ov[pti];
+                                    pt_ov[pti] |= (MM_COW | MM_READONLY | MM_PRESENT | MM_USER | borrowed);
+                                    __set_entry(pt_cv, pti, pt_ov[pti]);
+
+                                    // the frame is freed by the last address space that unmaps it,
+                                    // the frames of a mapped object belong to the object
+                                    if (!borrowed)
+                                        __atomic_fetch_add(&mm_get_page(MM_ENTRY_ADDR(pt_ov[pti]))->cow_shares,
+                                                           1, __ATOMIC_RELAXED);
                                 }
                             }
                         }
@@ -1,7 +1,9 @@
 #include <arch/amd64/cpu.h>
 #include <arch/amd64/mmu.h>
 #include <kernel/kprint.h>
+#include <kernel/irq.h>
 #include <kernel/percpu.h>
+#include <mm/vma.h>
 
 uint32_t amd64_page_fault_handler(void *ctx)
 {
@@ -14,6 +16,16 @@ uint32_t amd64_page_fault_handler(void *ctx)
     asm volatile ("mov %%cr3, %0" : "=r"(cr3));
     asm volatile ("mov %%cr2, %0" : "=r"(cr2));
 
+    /* demand paging: the first touch of a page of a VMA lands here
+     *
+     * only faults from user mode are resolved, the kernel accesses user memory
+     * through mm_get_user_page() so a kernel fault on a user address is a bug */
+    mm_as_t *as = mm_as_current();
+
+    if (as && (error & 0x4) && cr2 < USPACE_END &&
+        !mm_handle_fault(as, cr2, (error >> 1) & 0x1, error & 0x1))
+        return IRQ_HANDLED;
+
     unsigned long pml4i = (cr2 >> 39) & 0x1ff;
     unsigned long pdpti = (cr2 >> 30) & 0x1ff;
     unsigned long pdi   = (cr2 >> 21) & 0x1ff;
@@ -64,6 +76,7 @@ error:;
 
     kprint("cpuid:            0x%08x %10u\n", get_thiscpu_id(), get_thiscpu_id());
     kprint("cr3:              0x%08x %10u\n", cr3, cr3);
+    kprint("page tables:      %u KB\n", amd64_dir_table_pages(amd64_p_to_v(cr3)) * (PAGE_SIZE / 1024));
 
     amd64_dump_registers(cpu_state);
 
@@ -9,6 +9,7 @@
 #include <lib/list.h>
 #include <mm/heap.h>
 #include <mm/slab.h>
+#include <mm/types.h>
 #include <errno.h>
 
 #define PCI_CONFIG_ADDR        0xcf8
@@ -278,3 +279,31 @@ uint8_t pci_find_irq_route(uint8_t bus, uint8_t dev, uint8_t pin)
     errno = ENOENT;
     return PCI_NO_ROUTE;
 }
+
+static uint32_t __get_bar(pci_dev_t *dev, int bar)
+{
+    kassert(bar >= 0 && bar <= 5);
+
+    return __get_pci_field_u32(dev->bus, dev->dev, dev->func, PCI_OFF_BAR0 + bar * 4);
+}
+
+uint64_t pci_bar_address(pci_dev_t *dev, int bar)
+{
+    uint32_t low = __get_bar(dev, bar);
+
+    kassert(!(low & PCI_BAR_IO));
+
+    if (!(low & PCI_BAR_64BIT))
+        return low & PCI_BAR_MEM_MASK;
+
+    return ((uint64_t)__get_bar(dev, bar + 1) << 32) | (low & PCI_BAR_MEM_MASK);
+}
+
+int pci_bar_cache_mode(pci_dev_t *dev, int bar)
+{
+    uint32_t low = __get_bar(dev, bar);
+
+    kassert(!(low & PCI_BAR_IO));
+
+    return (low & PCI_BAR_PREFETCH) ? MM_WC : MM_UC;
+}
@@ -6,6 +6,7 @@
 #include <mm/mmu.h>
 #include <mm/page.h>
 #include <mm/types.h>
+#include <mm/vregion.h>
 #include <kernel/io.h>
 #include <kernel/kassert.h>
 #include <kernel/kprint.h>
@@ -127,10 +128,12 @@ void vbe_init(void)
 
     if (dev) {
         lfb     = true;
-        vga_mem = (uint8_t *)((uint64_t)dev->bar0 - 8);
 
-        for (uint64_t i = 0, ptr = (uint64_t)vga_mem; i < PAGE_SIZE; ++i, ptr += PAGE_SIZE)
-            amd64_map_page(ptr, ptr, MM_PRESENT | MM_READWRITE);
+        /* the linear framebuffer is a prefetchable BAR so it's mapped write-combining:
+         * glyph stores and scroll copies are then merged into full bus bursts
+         * instead of being pushed out one uncached store at a time */
+        vga_mem = ioremap(pci_bar_address(dev, 0), PAGE_SIZE * PAGE_SIZE, pci_bar_cache_mode(dev, 0));
+        kassert(vga_mem != NULL);
     }
 
     vbe_clear_screen();
@@ -6,6 +6,7 @@
 #include <kernel/kprint.h>
 #include <kernel/pic.h>
 #include <mm/types.h>
+#include <mm/vregion.h>
 
 #define MAX_IOAPIC          20
 #define IOAPIC_IOREGSEL   0x00
@@ -51,8 +52,9 @@ void ioapic_initialize_all(void)
     for (int i = 0; i < io_apic.num_apics; ++i) {
         kprint("ioapic - initializing I/O APIC %d\n", io_apic.apics[i].id);
 
-        uint8_t *ioapic_v = (uint8_t *)io_apic.apics[i].base;
-        amd64_map_page((uint64_t)ioapic_v, (uint64_t)ioapic_v, MM_PRESENT | MM_READWRITE);
+        uint8_t *ioapic_v = ioremap((uint64_t)io_apic.apics[i].base, PAGE_SIZE, MM_UC);
+        kassert(ioapic_v != NULL);
+        io_apic.apics[i].mapped = ioapic_v;
 
         uint32_t id  = __read_reg(ioapic_v, IOAPIC_REG_ID);
         uint32_t ver = __read_reg(ioapic_v, IOAPIC_REG_VER);
@@ -77,6 +79,7 @@ void ioapic_register_dev(uint8_t ioapic_id, uint32_t ioapic_addr, uint32_t intr_
 
     io_apic.apics[ioapic_id].id        = ioapic_id;
     io_apic.apics[ioapic_id].base      = (uint8_t *)(uint64_t)ioapic_addr;
+    io_apic.apics[ioapic_id].mapped    = NULL;
     io_apic.apics[ioapic_id].intr_base = intr_base;
 
     io_apic.num_apics++;
@@ -87,8 +90,7 @@ void ioapic_enable_irq(unsigned cpu, unsigned irq)
     kprint("ioapic - enable irq line %u for cpu %u\n", irq, cpu);
 
     unsigned offset   = IOAPIC_REG_TABLE + 2 * (irq - VECNUM_IRQ_START);
-    uint8_t *ioapic_v = (uint8_t *)io_apic.apics[cpu].base;
-    amd64_map_page((uint64_t)ioapic_v, (uint64_t)ioapic_v, MM_PRESENT | MM_READWRITE);
+    uint8_t *ioapic_v = io_apic.apics[cpu].mapped;
 
     __write_reg(ioapic_v, offset + 0, irq);
     __write_reg(ioapic_v, offset + 1, cpu << 24);
@@ -8,6 +8,7 @@
 #include <kernel/irq.h>
 #include <kernel/kassert.h>
 #include <mm/types.h>
+#include <mm/vregion.h>
 #include <errno.h>
 
 /* Local APIC general defines */
@@ -120,9 +121,12 @@ void lapic_initialize(void)
         set_msr(IA32_APIC_BASE, msr);
     }
 
-    /* Because the Local APIC is above 2GB, we must explicitly map it to address space  */
-    lapic_base = (uint8_t *)lapic_addr;
-    amd64_map_page(lapic_addr, (uint64_t)lapic_base, MM_PRESENT | MM_READWRITE);
+    /* all CPUs see their own Local APIC at the same physical address
+     * so the mapping is created only once, by BSP */
+    if (!lapic_base)
+        lapic_base = ioremap(lapic_addr, PAGE_SIZE, MM_UC);
+
+    kassert(lapic_base != NULL);
 
     kprint("lapic - base address 0x%x\n", (uint64_t)lapic_base);
 
@@ -1,6 +1,11 @@
+#include <arch/amd64/mmu.h>
 #include <fs/binfmt.h>
+#include <kernel/common.h>
 #include <kernel/kpanic.h>
+#include <kernel/util.h>
 #include <mm/heap.h>
+#include <mm/types.h>
+#include <errno.h>
 
 static list_head_t loaders;
 
@@ -37,3 +42,74 @@ bool binfmt_load(file_t *file, int argc, char **argv)
 
     return false;
 }
+
+/* read `len` bytes of `file` at `off` to the pages of `vaddr`
+ *
+ * the pages are written through the direct map so the segment doesn't have to be writable */
+static int __read_segment(file_t *file, mm_as_t *as, uint64_t vaddr, size_t len, off_t off)
+{
+    ssize_t ret;
+
+    while (len) {
+        size_t size    = MIN(PAGE_SIZE - (vaddr % PAGE_SIZE), len);
+        uint64_t paddr = mm_get_user_page(as, vaddr, 0);
+
+        if (paddr == INVALID_ADDRESS)
+            return -EFAULT;
+
+        // file offsets are relative to the file position
+        if ((ret = file_read(file, off - file->f_pos, size, amd64_p_to_v(paddr))) < 0)
+            return ret;
+
+        vaddr += size, off += size, len -= size;
+    }
+
+    return 0;
+}
+
+int binfmt_map_segment(file_t *file, mm_as_t *as, uint64_t vaddr, size_t filesz,
+                       size_t memsz, off_t off, int prot)
+{
+    if (!file || !as || filesz > memsz || off < 0 || (vaddr % PAGE_SIZE) != (uint64_t)off % PAGE_SIZE)
+        return -EINVAL;
+
+    uint64_t start    = ROUND_DOWN(vaddr, PAGE_SIZE);
+    uint64_t file_end = filesz ? ROUND_UP(vaddr + filesz, PAGE_SIZE) : start;
+    uint64_t mem_end  = ROUND_UP(vaddr + memsz, PAGE_SIZE);
+    bool zero_tail    = filesz && memsz > filesz && (vaddr + filesz) % PAGE_SIZE;
+    uint64_t paddr;
+    int ret = 0;
+
+    if (filesz) {
+        /* The tail of the last file page belongs to bss and it's cleared through
+         * a write fault that gives the mapping its own copy of the page. A read-only
+         * segment can't take one so it's read into anonymous memory instead */
+        if (!zero_tail || (prot & MM_PROT_WRITE))
+            ret = file_mmap(file, as, start, file_end - start, prot, MM_VMA_PRIVATE, off - (vaddr - start));
+
+        if (ret == -ENOSYS || ret == -ENOTSUP || (zero_tail && !(prot & MM_PROT_WRITE))) {
+            if ((ret = mm_map_anon(as, start, file_end - start, prot)) == 0 &&
+                (ret = __read_segment(file, as, vaddr, filesz, off)) < 0)
+                (void)mm_unmap(as, start, file_end - start);
+
+            zero_tail = false;
+        }
+
+        if (ret < 0)
+            return ret;
+    }
+
+    if (zero_tail) {
+        if ((paddr = mm_get_user_page(as, vaddr + filesz, 1)) == INVALID_ADDRESS) {
+            (void)mm_unmap(as, start, file_end - start);
+            return -EFAULT;
+        }
+
+        kmemset(amd64_p_to_v(paddr), 0, PAGE_SIZE - ((vaddr + filesz) % PAGE_SIZE));
+    }
+
+    if (mem_end > file_end && (ret = mm_map_anon(as, file_end, mem_end - file_end, prot)) < 0)
+        (void)mm_unmap(as, start, file_end - start);
+
+    return ret;
+}
@@ -23,7 +23,7 @@ static int cdev_alloc_devnum(void)
 int cdev_init(void)
 {
     dentry_t *dntr = NULL;
-    path_t *path   = NULL;
+    path_t path;
     int ret        = 0;
 
     if (!(cdev_cache = mm_cache_create(sizeof(cdev_t))))
@@ -32,9 +32,9 @@ int cdev_init(void)
     if (!(bm_devnums = bm_alloc_bitmap(256)))
         return -ENOMEM;
 
-    path = vfs_path_lookup("/dev", LOOKUP_OPEN);
+    (void)vfs_path_walk("/dev", LOOKUP_OPEN, &path);
 
-    if (path->p_status == LOOKUP_STAT_ENOENT) {
+    if (path.p_status == LOOKUP_STAT_ENOENT) {
         kprint("char - failed to find /dev, unable to initialize cdev subsystem!\n");
         ret = -ENOENT;
         goto end;
@@ -45,21 +45,21 @@ int cdev_init(void)
         goto end;
     }
 
-    if (!path->p_dentry->d_inode) {
+    if (!path.p_dentry->d_inode) {
         ret = -EINVAL;
         goto end;
     }
 
-    if (!path->p_dentry->d_inode->i_iops->mkdir) {
+    if (!path.p_dentry->d_inode->i_iops->mkdir) {
         ret = -ENOSYS;
         goto end;
     }
 
-    if ((ret = path->p_dentry->d_inode->i_iops->mkdir(path->p_dentry, dntr, 0)) < 0)
+    if ((ret = path.p_dentry->d_inode->i_iops->mkdir(path.p_dentry, dntr, 0)) < 0)
         kprint("char - failed to create /dev/char!\n");
 
 end:
-    vfs_path_release(path);
+    vfs_path_put(&path);
     return ret;
 }
 
@@ -1,10 +1,14 @@
 #include <fs/fs.h>
 #include <fs/dentry.h>
+#include <kernel/compiler.h>
+#include <kernel/kassert.h>
 #include <kernel/kpanic.h>
 #include <kernel/kprint.h>
+#include <kernel/lock.h>
 #include <kernel/util.h>
 #include <lib/hashmap.h>
 #include <lib/list.h>
+#include <mm/page.h>
 #include <mm/slab.h>
 #include <errno.h>
 #include <stdbool.h>
@@ -12,32 +16,310 @@
 #define DENTRY_HM_LEN 32
 #define USE_CACHE(flags) (!((bool)(flags & DNTR_NO_CACHE)))
 
+#define DCACHE_BUCKETS 1024
+
+/* a lockless lookup gives up on chains longer than this, the chain may have been
+ * relinked under it */
+#define DCACHE_LOCKLESS_CHAIN 64
+
+/* dentries evicted by the shrinker before it checks how many pages were released */
+#define DCACHE_SCAN_BATCH 32
+
 static mm_cache_t *dentry_cache = NULL;
 
+/* `__dcache_lock` protects the hash table, the LRU list and the `d_state` and `d_count`
+ * updates made by the cache. It's never held while memory is allocated or freed */
+static list_head_t   __dcache[DCACHE_BUCKETS];
+static list_head_t   __dcache_lru;  /* most recently used first */
+static size_t        __dcache_unused;
+static spinlock_t    __dcache_lock;
+static mm_shrinker_t __dcache_shrinker;
+static seqcount_t    __dcache_seq;  /* bumped when a dentry is unhashed */
+
+static struct {
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t misses;
+    uint64_t evictions;
+} __dcache_stats;
+
+#define STAT_INC(stat) __atomic_fetch_add(&__dcache_stats.stat, 1, __ATOMIC_RELAXED)
+
+static inline dname_t __dname(const char *name)
+{
+    size_t len = kstrlen(name);
+
+    return (dname_t){ .name = name, .len = len, .hash = dname_hash(name, len) };
+}
+
+/* mix the hash of the name with the parent pointer */
+static uint32_t __dcache_hash(dentry_t *parent, uint32_t name_hash)
+{
+    uint64_t hash = ((uint64_t)name_hash ^ (uint64_t)parent) * 0x9e3779b97f4a7c15ULL;
+
+    return hash >> 32;
+}
+
+static inline list_head_t *__dcache_bucket(uint32_t hash)
+{
+    return &__dcache[hash & (DCACHE_BUCKETS - 1)];
+}
+
+/* `__dcache_find()` and the LRU functions are called with `__dcache_lock` held */
+static dentry_t *__dcache_find(dentry_t *parent, const dname_t *name, uint32_t hash)
+{
+    list_head_t *bucket = __dcache_bucket(hash);
+
+    if (name->len >= DENTRY_NAME_MAXLEN)
+        return NULL;
+
+    FOREACH((*bucket), iter) {
+        dentry_t *dntr = container_of(iter, dentry_t, d_hash_list);
+
+        if (dntr->d_hash != hash || dntr->d_parent != parent || dntr->d_name[name->len] != '\0')
+            continue;
+
+        if (!kmemcmp(dntr->d_name, (void *)name->name, name->len))
+            return dntr;
+    }
+
+    return NULL;
+}
+
+/* insert `dntr` to the head of `bucket` so that a lockless reader sees either the old
+ * chain or the new chain with `dntr` fully initialized */
+static void __dcache_hash_add(list_head_t *bucket, dentry_t *dntr)
+{
+    list_head_t *node = &dntr->d_hash_list;
+
+    node->next = bucket->next;
+    node->prev = bucket;
+    bucket->next->prev = node;
+
+    __atomic_store_n(&bucket->next, node, __ATOMIC_RELEASE);
+}
+
+static inline bool __dcache_is_bucket(list_head_t *node)
+{
+    return node >= &__dcache[0] && node < &__dcache[DCACHE_BUCKETS];
+}
+
+static void __dcache_lru_add(dentry_t *dntr)
+{
+    if (!(dntr->d_state & DCACHE_RECLAIM) || (dntr->d_state & DCACHE_LRU))
+        return;
+
+    list_append(&__dcache_lru, &dntr->d_lru);
+    dntr->d_state |= DCACHE_LRU;
+    __dcache_unused++;
+}
+
+static void __dcache_lru_del(dentry_t *dntr)
+{
+    if (!(dntr->d_state & DCACHE_LRU))
+        return;
+
+    list_remove(&dntr->d_lru);
+    list_init(&dntr->d_lru);
+    dntr->d_state &= ~DCACHE_LRU;
+    __dcache_unused--;
+}
+
+/* drop the reference a cached child holds to `parent` */
+static void __dcache_put_parent(dentry_t *parent)
+{
+    if (parent && --parent->d_count == 1)
+        __dcache_lru_add(parent);
+}
+
+/* remove `dntr` from the hash table, called with `__dcache_lock` held
+ *
+ * return true if the dentry was hashed */
+static bool __dcache_unhash(dentry_t *dntr)
+{
+    if (!(dntr->d_state & DCACHE_HASHED))
+        return false;
+
+    write_seqcount_begin(&__dcache_seq);
+    write_seqcount_begin(&dntr->d_seq);
+
+    list_remove(&dntr->d_hash_list);
+    dntr->d_state &= ~DCACHE_HASHED;
+
+    write_seqcount_end(&dntr->d_seq);
+    write_seqcount_end(&__dcache_seq);
+
+    __dcache_lru_del(dntr);
+    __dcache_put_parent(dntr->d_parent);
+
+    return true;
+}
+
+static void __dcache_trim(void)
+{
+    size_t unused = READ_ONCE(__dcache_unused);
+
+    if (unused > DCACHE_MAX_UNUSED)
+        (void)dentry_cache_shrink(unused - DCACHE_MAX_UNUSED);
+}
+
+static dentry_t *__dcache_get(dentry_t *parent, const dname_t *name)
+{
+    uint32_t hash = __dcache_hash(parent, name->hash);
+    dentry_t *dntr;
+
+    spin_lock(&__dcache_lock);
+
+    if ((dntr = __dcache_find(parent, name, hash)))
+        dntr->d_state |= DCACHE_REFERENCED;
+
+    spin_unlock(&__dcache_lock);
+
+    return dntr;
+}
+
+/* evict unused dentries until the slab has returned `nr` pages to the page allocator
+ *
+ * A page is returned only when all of its dentries are gone so the LRU is scanned
+ * in batches until enough pages have been released or it runs out */
+static size_t __dcache_scan(size_t nr)
+{
+    size_t before = mm_cache_pages(dentry_cache);
+    size_t now;
+
+    while ((now = mm_cache_pages(dentry_cache)) + nr > before &&
+           dentry_cache_shrink(DCACHE_SCAN_BATCH))
+        ;
+
+    return now < before ? before - now : 0;
+}
+
 int dentry_init(void)
 {
     if (!(dentry_cache = mm_cache_create(sizeof(dentry_t))))
         kpanic("failed to initialize slab cache for dentries!");
 
+    for (size_t i = 0; i < DCACHE_BUCKETS; ++i)
+        list_init(&__dcache[i]);
+
+    list_init(&__dcache_lru);
+    spin_init(&__dcache_lock);
+    seqcount_init(&__dcache_seq);
+
+    __dcache_shrinker.scan = __dcache_scan;
+    mm_register_shrinker(&__dcache_shrinker);
+
     return 0;
 }
 
 static dentry_t *__dentry_alloc(char *name, bool cache)
 {
-    (void)name;
+    (void)name, (void)cache;
 
     dentry_t *dntr = NULL;
 
     if (!(dntr = mm_cache_alloc_entry(dentry_cache)))
         return NULL;
 
-    // don't cache this dentry to global dentry cache (used for . and ..)
-    if (!cache)
-        return dntr;
+    dntr->d_state = 0;
+    list_init(&dntr->d_hash_list);
+    list_init(&dntr->d_lru);
 
     return dntr;
 }
 
+/* free a dentry that isn't linked anywhere, used for "." and ".." */
+static void __dentry_free(dentry_t *dntr)
+{
+    if (dntr)
+        (void)mm_cache_free_entry(dentry_cache, dntr);
+}
+
+// free a dentry that has been unlinked from its parent and the cache
+static void __dentry_destroy(dentry_t *dntr)
+{
+    if (dntr->d_inode)
+        dntr->d_inode->i_count--;
+
+    list_remove(&dntr->d_list);
+
+    if (dntr->d_children) {
+        __dentry_free(hm_get(dntr->d_children, "."));
+        __dentry_free(hm_get(dntr->d_children, ".."));
+        hm_dealloc_hashmap(dntr->d_children);
+    }
+
+    (void)mm_cache_free_entry(dentry_cache, dntr);
+}
+
+/* take `dntr` out of the cache unless someone besides the caller's `pins` references
+ * uses it, called with `__dcache_lock` held
+ *
+ * A lockless walk can take a reference with dentry_walk_get() until the dentry is
+ * unhashed so the count is checked in the same critical section. The parent is
+ * kept until __dcache_free() has unlinked the dentry from it
+ *
+ * return false if the dentry is in use */
+static bool __dcache_claim(dentry_t *dntr, int pins)
+{
+    if (dntr->d_count > 1 + pins)
+        return false;
+
+    if (dntr->d_parent)
+        dntr->d_parent->d_count++;
+
+    (void)__dcache_unhash(dntr);
+    __dcache_lru_del(dntr);
+
+    return true;
+}
+
+/* unlink a dentry claimed with __dcache_claim() from its parent and free it */
+static void __dcache_free(dentry_t *dntr)
+{
+    dentry_t *parent = dntr->d_parent;
+
+    // negative dentries only exist in the dentry cache
+    if (parent && !(dntr->d_state & DCACHE_NEGATIVE))
+        (void)hm_remove(parent->d_children, dntr->d_name);
+
+    __dentry_destroy(dntr);
+
+    if (parent) {
+        spin_lock(&__dcache_lock);
+        __dcache_put_parent(parent);
+        spin_unlock(&__dcache_lock);
+    }
+}
+
+/* the name is being created, forget that it didn't exist
+ *
+ * return -EBUSY if the negative dentry of the name is in use */
+static int __dcache_evict_negative(dentry_t *parent, const dname_t *name)
+{
+    uint32_t hash = __dcache_hash(parent, name->hash);
+    dentry_t *dntr;
+
+    spin_lock(&__dcache_lock);
+
+    if (!(dntr = __dcache_find(parent, name, hash)) || !(dntr->d_state & DCACHE_NEGATIVE)) {
+        spin_unlock(&__dcache_lock);
+        return 0;
+    }
+
+    if (!__dcache_claim(dntr, 0)) {
+        spin_unlock(&__dcache_lock);
+        return -EBUSY;
+    }
+
+    spin_unlock(&__dcache_lock);
+
+    __dcache_free(dntr);
+    STAT_INC(evictions);
+
+    return 0;
+}
+
 // alloc and initialize empty dentry
 static dentry_t *__dentry_alloc_empty(dentry_t *parent, char *name, bool cache)
 {
@@ -59,6 +341,11 @@ static dentry_t *__dentry_alloc_empty(dentry_t *parent, char *name, bool cache)
         return NULL;
     }
 
+    dname_t dname = __dname(name);
+
+    if (cache)
+        (void)__dcache_evict_negative(parent, &dname);
+
     if (!(dntr = __dentry_alloc(name, cache))) {
         errno = ENOMEM;
         return NULL;
@@ -79,9 +366,12 @@ static dentry_t *__dentry_alloc_empty(dentry_t *parent, char *name, bool cache)
         return NULL;
     }
 
-    parent->d_count++;
     list_append(&parent->d_list, &dntr->d_list);
 
+    // "." and ".." are part of the directory, they're not cached and don't reference it
+    if (cache)
+        (void)dentry_cache_insert(dntr);
+
     return dntr;
 }
 
@@ -215,48 +505,490 @@ dentry_t *dentry_alloc_orphan_ino(char *name, inode_t *ino, uint32_t flags)
 
 int dentry_dealloc(dentry_t *dntr)
 {
-    int ret = 0;
+    return dentry_dealloc_pinned(dntr, 0);
+}
+
+int dentry_dealloc_pinned(dentry_t *dntr, int pins)
+{
+    bool child;
 
     if (!dntr)
         return -EINVAL;
 
-    if (dntr->d_count > 1)
+    // negative dentries only exist in the dentry cache
+    child = dntr->d_parent && !(dntr->d_state & DCACHE_NEGATIVE);
+
+    if (child && hm_get(dntr->d_parent->d_children, dntr->d_name) != dntr)
+        return -ENOENT;
+
+    spin_lock(&__dcache_lock);
+
+    if (!__dcache_claim(dntr, pins)) {
+        spin_unlock(&__dcache_lock);
+        return -EBUSY;
+    }
+
+    spin_unlock(&__dcache_lock);
+
+    __dcache_free(dntr);
+    return 0;
+}
+
+int dentry_move(dentry_t *dntr, dentry_t *parent, char *name)
+{
+    dentry_t *old_parent;
+    char old_name[DENTRY_NAME_MAXLEN];
+    size_t len;
+    bool hashed;
+    int ret;
+
+    if (!dntr || !(old_parent = dntr->d_parent) || !parent || !parent->d_children || !name)
+        return -EINVAL;
+
+    if ((len = kstrlen(name) + 1) > DENTRY_NAME_MAXLEN)
+        return -E2BIG;
+
+    if (hm_get(parent->d_children, name))
+        return -EEXIST;
+
+    dname_t dname = __dname(name);
+
+    if (__dcache_evict_negative(parent, &dname) < 0)
         return -EBUSY;
 
-    if (dntr->d_parent) {
-        if ((ret = hm_remove(dntr->d_parent->d_children, dntr->d_name)) < 0)
-            return ret;
+    if ((ret = hm_remove(old_parent->d_children, dntr->d_name)) < 0)
+        return ret;
+
+    /* a lockless walk that found the dentry by its old name is redone */
+    spin_lock(&__dcache_lock);
+    hashed = __dcache_unhash(dntr);
+    spin_unlock(&__dcache_lock);
+
+    kstrncpy(old_name, dntr->d_name, DENTRY_NAME_MAXLEN);
+    kstrncpy(dntr->d_name, name, len);
+    dntr->d_parent = parent;
+
+    if ((ret = hm_insert(parent->d_children, dntr->d_name, dntr)) < 0) {
+        kstrncpy(dntr->d_name, old_name, DENTRY_NAME_MAXLEN);
+        dntr->d_parent = old_parent;
+
+        if (hm_insert(old_parent->d_children, dntr->d_name, dntr) < 0)
+            kprint("dentry - lost %s while moving it\n", dntr->d_name);
+    } else {
+        list_remove(&dntr->d_list);
+        list_append(&parent->d_list, &dntr->d_list);
     }
 
-    if (dntr->d_inode)
-        dntr->d_inode->i_count--;
+    if (dntr->d_children && dntr->d_parent != old_parent) {
+        dentry_t *dotdot = hm_get(dntr->d_children, "..");
 
-    list_remove(&dntr->d_list);
-    hm_dealloc_hashmap(dntr->d_children);
-    (void)mm_cache_free_entry(dentry_cache, dntr);
+        dotdot->d_parent = dntr->d_parent;
+        dotdot->d_inode  = dntr->d_parent->d_inode;
+    }
+
+    if (hashed)
+        (void)dentry_cache_insert(dntr);
 
     return ret;
 }
 
-// TODO: global dentry cache
+int dentry_replace(dentry_t *dntr, dentry_t *target, int pins)
+{
+    dentry_t *parent;
+    bool hashed;
+    int ret;
+
+    if (!dntr || !target || dntr == target || !(parent = target->d_parent))
+        return -EINVAL;
+
+    if (hm_get(parent->d_children, target->d_name) != target)
+        return -ENOENT;
+
+    spin_lock(&__dcache_lock);
+
+    // once unhashed, a walk can't find the target and take a reference to it
+    if (target->d_count > 1 + pins) {
+        spin_unlock(&__dcache_lock);
+        return -EBUSY;
+    }
+
+    hashed = __dcache_unhash(target);
+    spin_unlock(&__dcache_lock);
+
+    // can't fail, the name was found above
+    (void)hm_remove(parent->d_children, target->d_name);
+
+    // the target is only freed once the move can't fail anymore
+    if ((ret = dentry_move(dntr, parent, target->d_name)) < 0) {
+        if (hm_insert(parent->d_children, target->d_name, target) < 0)
+            kprint("dentry - lost %s while replacing it\n", target->d_name);
+        else if (hashed)
+            (void)dentry_cache_insert(target);
+
+        return ret;
+    }
+
+    __dentry_destroy(target);
+    return 0;
+}
+
+void dentry_get(dentry_t *dntr)
+{
+    spin_lock(&__dcache_lock);
+    dntr->d_count++;
+    spin_unlock(&__dcache_lock);
+}
 
-dentry_t *dentry_cache_lookup(char *name)
+void dentry_put(dentry_t *dntr)
 {
-    (void)name;
+    if (!dntr)
+        return;
 
-    return NULL;
+    spin_lock(&__dcache_lock);
+
+    kassert(dntr->d_count > 1);
+
+    if (--dntr->d_count == 1)
+        __dcache_lru_add(dntr);
+
+    spin_unlock(&__dcache_lock);
+
+    __dcache_trim();
+}
+
+/* create a negative dentry for `name` which `parent`'s filesystem doesn't have */
+static void __dentry_alloc_negative(dentry_t *parent, char *name)
+{
+    dentry_t *dntr;
+
+    if (kstrlen(name) + 1 > DENTRY_NAME_MAXLEN || !(dntr = __dentry_alloc(name, true)))
+        return;
+
+    dntr->d_parent  = parent;
+    dntr->d_private = NULL;
+    dntr->d_inode   = NULL;
+    dntr->d_flags   = 0;
+    dntr->d_count   = 1;
+    dntr->d_state   = DCACHE_NEGATIVE | DCACHE_RECLAIM;
+
+    kstrncpy(dntr->d_name, name, kstrlen(name) + 1);
+    list_init(&dntr->d_list);
+
+    if (!dentry_cache_insert(dntr))
+        (void)mm_cache_free_entry(dentry_cache, dntr);
+}
+
+dentry_t *dentry_lookup(dentry_t *parent, char *name)
+{
+    if (!parent || !name) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    dname_t dname = __dname(name);
+
+    return dentry_lookup_name(parent, &dname);
+}
+
+dentry_t *dentry_lookup_name(dentry_t *parent, const dname_t *dname)
+{
+    dentry_t *dntr = NULL;
+    inode_t *ino   = NULL;
+    char name[DENTRY_NAME_MAXLEN];
+
+    if (!parent || !dname) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((dntr = dentry_cache_lookup_name(parent, dname))) {
+        if (dntr->d_state & DCACHE_NEGATIVE) {
+            errno = ENOENT;
+            return NULL;
+        }
+
+        return dntr;
+    }
+
+    // the rest of the lookup needs a string
+    if (dname->len >= DENTRY_NAME_MAXLEN) {
+        errno = E2BIG;
+        return NULL;
+    }
+
+    kmemcpy(name, dname->name, dname->len);
+    name[dname->len] = '\0';
+
+    // "." and ".." and dentries created with DNTR_NO_CACHE are only known by the parent
+    if (parent->d_children && (dntr = hm_get(parent->d_children, name)))
+        return dntr;
+
+    errno = 0;
+
+    if (!(ino = inode_lookup(parent, name))) {
+        if (errno == ENOENT)
+            __dentry_alloc_negative(parent, name);
+        return NULL;
+    }
+
+    if (!(dntr = dentry_alloc_ino(parent, name, ino, ino->i_flags)))
+        return NULL;
+
+    // the filesystem can instantiate this dentry again so it can be evicted
+    spin_lock(&__dcache_lock);
+
+    dntr->d_state |= DCACHE_RECLAIM;
+
+    if (dntr->d_count == 1)
+        __dcache_lru_add(dntr);
+
+    spin_unlock(&__dcache_lock);
+
+    __dcache_trim();
+
+    return dntr;
+}
+
+dentry_t *dentry_cache_lookup(dentry_t *parent, char *name)
+{
+    dname_t dname = __dname(name);
+
+    return dentry_cache_lookup_name(parent, &dname);
+}
+
+dentry_t *dentry_cache_lookup_name(dentry_t *parent, const dname_t *name)
+{
+    dentry_t *dntr = __dcache_get(parent, name);
+
+    if (!dntr)
+        STAT_INC(misses);
+    else if (dntr->d_state & DCACHE_NEGATIVE)
+        STAT_INC(negative_hits);
+    else
+        STAT_INC(hits);
+
+    return dntr;
 }
 
 dentry_t *dentry_cache_insert(dentry_t *dntr)
 {
-    (void)dntr;
+    if (!dntr || !dntr->d_parent) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    dname_t name = __dname(dntr->d_name);
+
+    dntr->d_hash = __dcache_hash(dntr->d_parent, name.hash);
+
+    spin_lock(&__dcache_lock);
+
+    if ((dntr->d_state & DCACHE_HASHED) || __dcache_find(dntr->d_parent, &name, dntr->d_hash)) {
+        spin_unlock(&__dcache_lock);
+        errno = EEXIST;
+        return NULL;
+    }
+
+    __dcache_hash_add(__dcache_bucket(dntr->d_hash), dntr);
+
+    dntr->d_state |= DCACHE_HASHED;
+    dntr->d_parent->d_count++;
+    __dcache_lru_del(dntr->d_parent);
+
+    if (dntr->d_count == 1)
+        __dcache_lru_add(dntr);
+
+    spin_unlock(&__dcache_lock);
+
+    return dntr;
+}
+
+uint32_t dentry_walk_begin(void)
+{
+    return read_seqcount_begin(&__dcache_seq);
+}
+
+bool dentry_walk_retry(uint32_t start)
+{
+    return read_seqcount_retry(&__dcache_seq, start);
+}
+
+dentry_t *dentry_lookup_lockless(dentry_t *parent, const dname_t *name, uint32_t *seq)
+{
+    uint32_t hash       = __dcache_hash(parent, name->hash);
+    list_head_t *bucket = __dcache_bucket(hash);
+    list_head_t *iter   = __atomic_load_n(&bucket->next, __ATOMIC_ACQUIRE);
+
+    if (name->len >= DENTRY_NAME_MAXLEN)
+        goto again;
+
+    for (size_t i = 0; iter != bucket; ++i) {
+        // the chain was relinked under the lookup, see __dcache_hash_add()
+        if (!iter || i == DCACHE_LOCKLESS_CHAIN || __dcache_is_bucket(iter))
+            goto again;
+
+        dentry_t *dntr = container_of(iter, dentry_t, d_hash_list);
 
+        if (READ_ONCE(dntr->d_hash) == hash && READ_ONCE(dntr->d_parent) == parent &&
+            dntr->d_name[name->len] == '\0' && !kmemcmp(dntr->d_name, (void *)name->name, name->len)) {
+            uint32_t state;
+
+            if ((*seq = raw_read_seqcount(&dntr->d_seq)) & 1)
+                goto again;
+
+            // a dentry that is unhashed and reused after this check is caught
+            // by the global sequence count in dentry_walk_get()
+            if (!((state = READ_ONCE(dntr->d_state)) & DCACHE_HASHED))
+                goto again;
+
+            // don't write to the dentry unless the LRU scan has cleared the bit
+            if (!(state & DCACHE_REFERENCED))
+                __atomic_fetch_or(&dntr->d_state, DCACHE_REFERENCED, __ATOMIC_RELAXED);
+
+            if (state & DCACHE_NEGATIVE) {
+                STAT_INC(negative_hits);
+                errno = ENOENT;
+                return NULL;
+            }
+
+            STAT_INC(hits);
+            return dntr;
+        }
+
+        iter = __atomic_load_n(&iter->next, __ATOMIC_ACQUIRE);
+    }
+
+again:
+    errno = EAGAIN;
     return NULL;
 }
 
+int dentry_walk_get(dentry_t *dntr, uint32_t start, uint32_t seq)
+{
+    int ret = 0;
+
+    spin_lock(&__dcache_lock);
+
+    // nothing left the cache since the walk began so `dntr` hasn't been freed
+    if (read_seqcount_retry(&__dcache_seq, start) || read_seqcount_retry(&dntr->d_seq, seq))
+        ret = -EAGAIN;
+    else
+        dntr->d_count++;
+
+    spin_unlock(&__dcache_lock);
+
+    return ret;
+}
+
 int dentry_cache_evict(dentry_t *dntr)
 {
-    (void)dntr;
+    int ret;
 
-    return 0;
+    if ((ret = dentry_dealloc(dntr)) == 0)
+        STAT_INC(evictions);
+
+    return ret;
+}
+
+size_t dentry_cache_shrink(size_t nr)
+{
+    size_t freed = 0;
+
+    while (freed < nr) {
+        spin_lock(&__dcache_lock);
+
+        if (__dcache_lru.prev == &__dcache_lru) {
+            spin_unlock(&__dcache_lock);
+            break;
+        }
+
+        dentry_t *dntr = container_of(__dcache_lru.prev, dentry_t, d_lru);
+
+        __dcache_lru_del(dntr);
+
+        // taken into use since it was added to the list, it's added back when released
+        if (dntr->d_count > 1) {
+            spin_unlock(&__dcache_lock);
+            continue;
+        }
+
+        // second chance for dentries that have been looked up
+        if (dntr->d_state & DCACHE_REFERENCED) {
+            dntr->d_state &= ~DCACHE_REFERENCED;
+            __dcache_lru_add(dntr);
+            spin_unlock(&__dcache_lock);
+            continue;
+        }
+
+        // can't fail, the count was checked above, nobody can find the dentry afterwards
+        (void)__dcache_claim(dntr, 0);
+        spin_unlock(&__dcache_lock);
+
+        __dcache_free(dntr);
+        STAT_INC(evictions);
+        freed++;
+    }
+
+    return freed;
+}
+
+size_t dentry_cache_prune(dentry_t *parent)
+{
+    size_t freed = 0;
+
+    for (size_t i = 0; i < DCACHE_BUCKETS; ++i) {
+        for (;;) {
+            dentry_t *victim = NULL;
+
+            spin_lock(&__dcache_lock);
+
+            FOREACH(__dcache[i], iter) {
+                dentry_t *dntr = container_of(iter, dentry_t, d_hash_list);
+
+                if (dntr->d_parent == parent && (dntr->d_state & DCACHE_NEGATIVE) &&
+                    __dcache_claim(dntr, 0))
+                {
+                    victim = dntr;
+                    break;
+                }
+            }
+
+            spin_unlock(&__dcache_lock);
+
+            if (!victim)
+                break;
+
+            __dcache_free(victim);
+            STAT_INC(evictions);
+            freed++;
+        }
+    }
+
+    return freed;
+}
+
+void dentry_cache_stats(dcache_stats_t *stats)
+{
+    stats->hits          = __atomic_load_n(&__dcache_stats.hits,          __ATOMIC_RELAXED);
+    stats->negative_hits = __atomic_load_n(&__dcache_stats.negative_hits, __ATOMIC_RELAXED);
+    stats->misses        = __atomic_load_n(&__dcache_stats.misses,        __ATOMIC_RELAXED);
+    stats->evictions     = __atomic_load_n(&__dcache_stats.evictions,     __ATOMIC_RELAXED);
+    stats->unused        = READ_ONCE(__dcache_unused);
+}
+
+void dentry_cache_dump_stats(void)
+{
+    dcache_stats_t stats;
+
+    dentry_cache_stats(&stats);
+
+    uint64_t total = stats.hits + stats.negative_hits + stats.misses;
+
+    if (!total)
+        total = 1;
+
+    kprint("dentry - lookups %u: hit %u%%, negative hit %u%%, miss %u%%\n",
+           stats.hits + stats.negative_hits + stats.misses,
+           stats.hits * 100 / total, stats.negative_hits * 100 / total, stats.misses * 100 / total);
+    kprint("dentry - %u evictions, %u unused dentries\n", stats.evictions, stats.unused);
 }
@@ -39,10 +39,8 @@ static int devfs_rmdir(dentry_t *dir, dentry_t *dntr)
     if (!dir || !dntr)
         return -EINVAL;
 
-    if (dntr->d_count > 1)
-        return -EBUSY;
-
-    return dentry_dealloc(dntr);
+    // the VFS's reference goes with the dentry
+    return dentry_dealloc_pinned(dntr, 1);
 }
 
 static int devfs_mknod(dentry_t *dir, dentry_t *dntr, int mode, dev_t rdev)
@@ -163,22 +161,24 @@ int devfs_register_cdev(cdev_t *dev, char *name)
 {
     int ret         = 0;
     char *path      = kstrcat_s("/dev/", name);
-    path_t *retpath = vfs_path_lookup(path, LOOKUP_PARENT | LOOKUP_CREATE);
     dentry_t *dntr  = NULL;
     inode_t *ino    = NULL;
+    path_t retpath;
+
+    (void)vfs_path_walk(path, LOOKUP_PARENT | LOOKUP_CREATE, &retpath);
 
-    if (retpath->p_status & LOOKUP_STAT_EEXISTS) {
+    if (retpath.p_status & LOOKUP_STAT_EEXISTS) {
         kdebug("devfs - %s already exists!", path);
         ret = -EEXIST;
         goto end;
     }
 
-    if (!(ino = devfs_inode_alloc(retpath->p_dentry->d_inode->i_sb))) {
+    if (!(ino = devfs_inode_alloc(retpath.p_dentry->d_inode->i_sb))) {
         ret = -errno;
         goto end;
     }
 
-    if (!(dntr = dentry_alloc_ino(retpath->p_dentry, name, ino, T_IFCHR))) {
+    if (!(dntr = dentry_alloc_ino(retpath.p_dentry, name, ino, T_IFCHR))) {
         (void)devfs_inode_destroy(ino);
         ret = -errno;
         goto end;
@@ -191,7 +191,7 @@ int devfs_register_cdev(cdev_t *dev, char *name)
     list_append(&chr_devs, &dev->c_list);
 
 end:
-    vfs_path_release(retpath);
+    vfs_path_put(&retpath);
     return ret;
 }
 
@@ -1,5 +1,7 @@
+#include <fs/dentry.h>
 #include <fs/file.h>
 #include <fs/fs.h>
+#include <fs/pagecache.h>
 #include <kernel/kpanic.h>
 #include <mm/slab.h>
 #include <errno.h>
@@ -46,7 +48,7 @@ int file_generic_dealloc(file_t *file)
         return -EBUSY;
 
     if (file->f_dentry)
-        file->f_dentry->d_count--;
+        dentry_put(file->f_dentry);
 
     mm_cache_free_entry(file_ops_cache, file->f_ops);
     mm_cache_free_entry(file_cache,     file);
@@ -119,6 +121,10 @@ ssize_t file_read(file_t *file, off_t offset, size_t size, void *buffer)
     if (!file || !buffer)
         return -EINVAL;
 
+    // cached pages are copied without calling the file system
+    if (file->f_ops->readpage)
+        return pagecache_read(file, offset, size, buffer);
+
     if (!file->f_ops->read)
         return -ENOSYS;
 
@@ -135,3 +141,14 @@ ssize_t file_write(file_t *file, off_t offset, size_t size, void *buffer)
 
     return file->f_ops->write(file, offset, size, buffer);
 }
+
+int file_mmap(file_t *file, mm_as_t *as, uint64_t addr, size_t len, int prot, int flags, off_t off)
+{
+    if (!file || !as)
+        return -EINVAL;
+
+    if (!file->f_ops->mmap)
+        return -ENOSYS;
+
+    return file->f_ops->mmap(file, as, addr, len, prot, flags, off);
+}
@@ -3,12 +3,16 @@
 #include <fs/dentry.h>
 #include <fs/devfs.h>
 #include <fs/fs.h>
+#include <fs/pagecache.h>
 #include <fs/pipe.h>
 #include <fs/initramfs.h>
+#include <fs/tmpfs.h>
 #include <lib/hashmap.h>
 #include <lib/list.h>
+#include <kernel/compiler.h>
 #include <kernel/kassert.h>
 #include <kernel/kprint.h>
+#include <kernel/lock.h>
 #include <kernel/kpanic.h>
 #include <kernel/util.h>
 #include <mm/heap.h>
@@ -16,14 +20,22 @@
 #include <errno.h>
 #include <stdbool.h>
 
-#define NUM_FS_TYPES 2
-#define NUM_FS 1
+#define NUM_FS_TYPES 3
+#define NUM_FS 2
+
+#define MOUNT_HASH_BITS    6
+#define MOUNT_HASH_BUCKETS (1 << MOUNT_HASH_BITS)
 
 static mm_cache_t *path_cache;
 static mm_cache_t *fs_ctx_cache;
 static mm_cache_t *file_ctx_cache;
 
+// `mountpoints_lock` protects both the list and the hash of mountpoints,
+// lockless path walks read the hash and validate what they read with `mount_seq`
 static list_head_t mountpoints;
+static list_head_t mount_hash[MOUNT_HASH_BUCKETS];
+static rwlock_t    mountpoints_lock;
+static seqcount_t  mount_seq;
 static list_head_t superblocks;
 
 static mount_t *root_fs;
@@ -43,6 +55,11 @@ static fs_type_t fs_arr[NUM_FS_TYPES] = {
         .fs_name = "initramfs",
         .get_sb  = initramfs_get_sb,
         .kill_sb = initramfs_kill_sb
+    },
+    {
+        .fs_name = "tmpfs",
+        .get_sb  = tmpfs_get_sb,
+        .kill_sb = tmpfs_kill_sb
     }
 };
 
@@ -56,6 +73,11 @@ static struct {
         .target = "dev",
         .mount  = NULL
     },
+    {
+        .type   = "tmpfs",
+        .target = "tmp",
+        .mount  = NULL
+    },
 };
 
 static mount_t *alloc_empty_mount(void)
@@ -72,10 +94,73 @@ static mount_t *alloc_empty_mount(void)
     mnt->mnt_mount   = NULL;
 
     list_init(&mnt->mnt_list);
+    list_init(&mnt->mnt_hash);
 
     return mnt;
 }
 
+static inline list_head_t *mount_bucket(dentry_t *mountpoint)
+{
+    return &mount_hash[((uint64_t)mountpoint * 0x9e3779b97f4a7c15ULL) >> (64 - MOUNT_HASH_BITS)];
+}
+
+// add "mnt" to the list and hash of mountpoints, called with `mountpoints_lock` held
+static void mount_add(mount_t *mnt)
+{
+    list_append(&mountpoints, &mnt->mnt_list);
+
+    if (mnt->mnt_mount) {
+        write_seqcount_begin(&mount_seq);
+        write_seqcount_begin(&mnt->mnt_mount->d_seq);
+
+        list_append(mount_bucket(mnt->mnt_mount), &mnt->mnt_hash);
+        mnt->mnt_mount->d_flags |= DNTR_MOUNTPOINT;
+
+        write_seqcount_end(&mnt->mnt_mount->d_seq);
+        write_seqcount_end(&mount_seq);
+    }
+}
+
+// return the file system mounted on "mountpoint" or NULL,
+// called with `mountpoints_lock` held
+static mount_t *mount_find(dentry_t *mountpoint)
+{
+    list_head_t *bucket = mount_bucket(mountpoint);
+
+    FOREACH((*bucket), m) {
+        mount_t *mnt = container_of(m, mount_t, mnt_hash);
+
+        if (mnt->mnt_mount == mountpoint)
+            return mnt;
+    }
+
+    return NULL;
+}
+
+// move "mnt" on top of "mountpoint", called with `mountpoints_lock` held
+static void mount_move(mount_t *mnt, dentry_t *mountpoint)
+{
+    dentry_t *old = mnt->mnt_mount;
+
+    write_seqcount_begin(&mount_seq);
+    write_seqcount_begin(&old->d_seq);
+    write_seqcount_begin(&mountpoint->d_seq);
+
+    list_remove(&mnt->mnt_hash);
+    list_init(&mnt->mnt_hash);
+
+    if (!mount_find(old))
+        old->d_flags &= ~DNTR_MOUNTPOINT;
+
+    list_append(mount_bucket(mountpoint), &mnt->mnt_hash);
+    mountpoint->d_flags |= DNTR_MOUNTPOINT;
+    mnt->mnt_mount = mountpoint;
+
+    write_seqcount_end(&mountpoint->d_seq);
+    write_seqcount_end(&old->d_seq);
+    write_seqcount_end(&mount_seq);
+}
+
 static int vfs_mount_pseudo(char *target, char *type, dentry_t *mountpoint)
 {
     mount_t *mnt  = NULL;
@@ -94,15 +179,21 @@ static int vfs_mount_pseudo(char *target, char *type, dentry_t *mountpoint)
         return -ENOMEM;
     }
 
-    mnt->mnt_sb      = fs->get_sb(fs, NULL, 0, NULL);
+    if (!(mnt->mnt_sb = fs->get_sb(fs, NULL, 0, NULL))) {
+        kfree(mnt);
+        return -errno;
+    }
+
     mnt->mnt_type    = type;
     mnt->mnt_devname = kstrdup(type);
     mnt->mnt_mount   = mountpoint;
     mnt->mnt_root    = mnt->mnt_sb->s_root;
 
-    mountpoint->d_count++;
+    dentry_get(mountpoint);
 
-    list_append(&mountpoints, &mnt->mnt_list);
+    write_lock(&mountpoints_lock);
+    mount_add(mnt);
+    write_unlock(&mountpoints_lock);
 
     return 0;
 }
@@ -114,9 +205,16 @@ void vfs_init(void)
 
     list_init(&mountpoints);
     list_init(&superblocks);
+    rwlock_init(&mountpoints_lock);
+
+    for (int i = 0; i < MOUNT_HASH_BUCKETS; ++i)
+        list_init(&mount_hash[i]);
+
+    seqcount_init(&mount_seq);
 
     dentry_init();
     inode_init();
+    pagecache_init();
     file_init();
     pipe_init();
     binfmt_init();
@@ -127,12 +225,14 @@ void vfs_init(void)
             kprint("vfs - failed to register %s\n", fs_arr[i].fs_name);
     }
 
-    // create empty root
+    // create empty root, "/" isn't a mountpoint of any file system so it's not hashed
     root_fs            = alloc_empty_mount();
     root_fs->mnt_mount = dentry_alloc_orphan("/", T_IFDIR);
     root_fs->mnt_type  = "rootfs";
 
+    write_lock(&mountpoints_lock);
     list_append(&mountpoints, &root_fs->mnt_list);
+    write_unlock(&mountpoints_lock);
 
     // mount the pseudo filesystems, we must use vfs_mount_pseudo()
     // to mount these special file systems which skips most of the error
@@ -187,6 +287,35 @@ int vfs_install_rootfs(char *type, void *data)
 
     list_append(&superblocks, &root_fs->mnt_sb->s_list);
 
+    // the pseudo filesystems were mounted on the empty root,
+    // move them on top of the same directories of the new root
+    for (int i = 0; i < NUM_FS; ++i) {
+        dentry_t *old = file_systems[i].mount,
+                 *new = NULL;
+        mount_t *mnt  = NULL;
+
+        if (!old)
+            continue;
+
+        if (!(new = dentry_lookup(root_fs->mnt_root, file_systems[i].target)) &&
+            !(new = dentry_alloc(root_fs->mnt_root, file_systems[i].target, T_IFDIR))) {
+            kprint("vfs - failed to create /%s on rootfs\n", file_systems[i].target);
+            continue;
+        }
+
+        write_lock(&mountpoints_lock);
+
+        if ((mnt = mount_find(old))) {
+            mount_move(mnt, new);
+            dentry_get(new);
+            dentry_put(old);
+        }
+
+        write_unlock(&mountpoints_lock);
+
+        file_systems[i].mount = new;
+    }
+
     return 0;
 }
 
@@ -206,13 +335,19 @@ int vfs_unregister_fs(char *type)
     if (!type || !hm_get(fs_types, type))
         return -EINVAL;
 
+    read_lock(&mountpoints_lock);
+
     FOREACH(mountpoints, m) {
         mount_t *mnt = container_of(m, mount_t, mnt_list);
 
-        if (!kstrcmp_s(type, mnt->mnt_type))
+        if (!kstrcmp_s(type, mnt->mnt_type)) {
+            read_unlock(&mountpoints_lock);
             return -EBUSY;
+        }
     }
 
+    read_unlock(&mountpoints_lock);
+
     return hm_remove(fs_types, type);
 }
 
@@ -222,7 +357,7 @@ int vfs_mount(char *source, char *target,
     (void)flags;
 
     fs_type_t *fs   = NULL;
-    path_t    *path = NULL;
+    path_t     path;
     mount_t   *mnt  = NULL;
     dentry_t  *src  = NULL,
               *dst  = NULL;
@@ -244,15 +379,20 @@ int vfs_mount(char *source, char *target,
 
         // go through the mounted filesystems and check if filesystem
         // of "type" has already been mounted -> return error
+        read_lock(&mountpoints_lock);
+
         FOREACH(mountpoints, m) {
             mnt = container_of(m, mount_t, mnt_list);
 
             if (!kstrcmp_s(mnt->mnt_type, type)) {
+                read_unlock(&mountpoints_lock);
                 kprint("vfs - %s has already been mounted to %s\n", type, target);
                 return -EEXIST;
             }
         }
 
+        read_unlock(&mountpoints_lock);
+
         goto check_dest;
     }
 
@@ -263,31 +403,33 @@ int vfs_mount(char *source, char *target,
             return -EINVAL;
         }
     } else {
-        if (!(path = vfs_path_lookup(source, 0))->p_dentry) {
+        if (vfs_path_walk(source, 0, &path) < 0) {
             kprint("vfs - '%s' does not exist!\n", source);
             return -ENOENT;
         }
+
+        vfs_path_put(&path);
     }
 
 check_dest:
     // now check that "target" exist and it doesn't have a filesystem installed on it
-    if (!(path = vfs_path_lookup(target, 0))->p_dentry) {
+    if (vfs_path_walk(target, LOOKUP_MOUNTPOINT, &path) < 0) {
         kprint("vfs - mountpoint %s does not exist!\n", target);
         return -ENOENT;
     }
 
-    // TODO: there must a better way to do this
-    FOREACH(mountpoints, m) {
-        mnt = container_of(m, mount_t, mnt_list);
+    // the mount keeps the walk's reference
+    dst = path.p_dentry;
 
-        if (!kstrcmp_s(mnt->mnt_type, type)) {
-            kprint("vfs - %s has already been mounted to %s\n", type, target);
-            return -EEXIST;
-        }
+    if (dst->d_flags & DNTR_MOUNTPOINT) {
+        kprint("vfs - %s already has a file system mounted on it\n", target);
+        vfs_path_put(&path);
+        return -EBUSY;
     }
 
     if (!(mnt = alloc_empty_mount())) {
         kprint("vfs - failed to allocate mountpoint for %s\n", type);
+        vfs_path_put(&path);
         return -ENOMEM;
     }
 
@@ -295,199 +437,196 @@ check_dest:
     mnt->mnt_type    = type;
     mnt->mnt_devname = source;
     mnt->mnt_mount   = dst;
+    mnt->mnt_root = mnt->mnt_sb ? mnt->mnt_sb->s_root : NULL;
 
-    dst->d_count++;
-    mnt->mnt_root = NULL; // TODO: how to get this from the filesystem
-
-    list_append(&mountpoints, &mnt->mnt_list);
+    write_lock(&mountpoints_lock);
+    mount_add(mnt);
+    write_unlock(&mountpoints_lock);
 
     return 0;
 }
 
-static char *vfs_extract_child(char **path)
+/* scan the next component of `*path` in place and hash it, slashes between the
+ * components are skipped so "/etc//hello/" is the same as "/etc/hello"
+ *
+ * return false if there are no components left */
+static bool __path_next(const char **path, dname_t *name)
 {
-    char *start = *path,
-         *ptr   = *path;
-    size_t len  = kstrlen(*path);
-    size_t i    = 0;
+    const char *ptr = *path;
+    uint32_t hash   = DNAME_HASH_INIT;
 
-    for (i = 0; i < len && ptr[i] != '/' && ptr[i] != '\0'; ++i)
-        (*path)++;
+    while (*ptr == '/')
+        ptr++;
 
-    // there are more dentries left, add null byte to mark next start
-    if (i != len) {
-        (*path)++;
-        ptr[i] = '\0';
-    } else {
-        // we're at the end set path to NULL so vfs_walk_path() knows to end the path lookup
-        *path = NULL;
-    }
+    if (*ptr == '\0')
+        return false;
 
-    if (!len)
-        return NULL;
+    name->name = ptr;
 
-    return start;
-}
+    for (; *ptr != '/' && *ptr != '\0'; ++ptr)
+        hash = dname_hash_step(hash, *ptr);
 
-static dentry_t *vfs_walk_path(dentry_t *parent, char *path, int flags)
-{
-    if (!parent || !path) {
-        errno = EINVAL;
-        return NULL;
-    }
+    name->len  = ptr - name->name;
+    name->hash = hash;
+    *path      = ptr;
 
-    dentry_t *dntr = NULL;
-    inode_t *ino   = NULL;
-    char *next     = vfs_extract_child(&path);
-
-    // we're at the end of path
-    if (!path) {
-        if (flags & LOOKUP_PARENT)
-            return parent;
+    return true;
+}
 
-        // return dentry if found from parent's hashmap
-        if ((dntr = hm_get(parent->d_children, next)))
-            return dntr;
+/* lockless version of mount_find(), mounts are never freed so the chain can be read
+ * while it's being modified and `mount_seq` tells if what was read is valid
+ *
+ * return false if the lookup raced with an update */
+static bool __path_find_mount(dentry_t *mountpoint, uint32_t mseq, mount_t **mnt)
+{
+    list_head_t *bucket = mount_bucket(mountpoint);
+    list_head_t *iter   = READ_ONCE(bucket->next);
 
-        if (!(ino = inode_lookup(parent, next)))
-            return NULL;
+    *mnt = NULL;
 
-        if (!(dntr = dentry_alloc_ino(parent, next, ino, ino->i_flags)))
-            return NULL;
+    for (int i = 0; iter != bucket && i < MOUNT_HASH_BUCKETS; ++i) {
+        mount_t *m = container_of(iter, mount_t, mnt_hash);
 
-        return dntr;
-    }
+        if (READ_ONCE(m->mnt_mount) == mountpoint) {
+            *mnt = m;
+            break;
+        }
 
-    if (!parent->d_children) {
-        kprint("vfs - parent ('%s') doesn't have a valid children hashmap!\n", parent->d_name);
-        errno = EINVAL;
-        return NULL;
+        iter = READ_ONCE(iter->next);
     }
 
-    // check if parent has this dentry already cached, continue immediately if so
-    if ((dntr = hm_get(parent->d_children, next)))
-        return vfs_walk_path(dntr, path, flags);
-
-    // not found from the parent hashmap, do filesystem-specific search
-    if (!(ino = inode_lookup(parent, next)))
-        return NULL;
-
-    if (!(dntr = dentry_alloc_ino(parent, next, ino, ino->i_flags)))
-        return NULL;
-
-    return vfs_walk_path(dntr, path, flags);
+    return !read_seqcount_retry(&mount_seq, mseq);
 }
 
-static dentry_t *vfs_find_bootstrap(char **path)
+/* follow the mounts on top of `*dntr` to the root of the topmost file system,
+ * the mount hash is consulted only for dentries marked as mountpoints
+ *
+ * return false if a lockless walk has to be redone with locks */
+static bool __path_cross(dentry_t **dntr, uint32_t *seq, bool lockless, uint32_t mseq)
 {
-    char *orig     = NULL,
-         *tmp      = NULL,
-         *mount    = NULL;
-    dentry_t *dntr = NULL;
+    mount_t *mnt;
+
+    while (*dntr && ((*dntr)->d_flags & DNTR_MOUNTPOINT)) {
+        if (lockless) {
+            if (!__path_find_mount(*dntr, mseq, &mnt) || read_seqcount_retry(&(*dntr)->d_seq, *seq))
+                return false;
+        } else {
+            read_lock(&mountpoints_lock);
+            mnt = mount_find(*dntr);
+            read_unlock(&mountpoints_lock);
+        }
 
-    // skip '/'
-    kassert(**path == '/');
-    (*path)++;
+        if (!mnt || !mnt->mnt_root)
+            break;
 
-    // if the path is at the end already, it means that
-    // user wanted the dentry of root
-    if (**path == '\0') {
-        *path = NULL;
-        return root_fs->mnt_root;
+        *dntr = mnt->mnt_root;
+        *seq  = raw_read_seqcount(&(*dntr)->d_seq);
     }
 
-    orig  = tmp = kstrdup(*path);
-    mount = vfs_extract_child(&tmp);
+    return true;
+}
 
-    FOREACH(mountpoints, m) {
-        mount_t *mnt = container_of(m, mount_t, mnt_list);
+/* Walk `path` either with locks or, if `lockless` is true, without taking locks or
+ * references until the result is found (see dentry_lookup_lockless())
+ *
+ * A lockless walk returns -EAGAIN if anything it read can't be validated or if it
+ * needs something that isn't in the dentry cache, the caller then walks with locks */
+static int __path_walk(const char *path, int flags, path_t *out, bool lockless)
+{
+    dentry_t *start  = NULL,
+             *parent = NULL,
+             *dntr   = NULL;
+    uint32_t dseq = 0, mseq = 0,
+             seq  = 0, pseq = 0;
+    dname_t name, next;
+    bool more;
+
+    out->p_dentry = NULL;
+    out->p_flags  = flags;
+    out->p_status = LOOKUP_STAT_ENOENT;
+
+    if (!path || *path == '\0') {
+        out->p_status = LOOKUP_STAT_EINVAL;
+        return -EINVAL;
+    }
 
-        if (kstrcmp_s(mnt->mnt_mount->d_name, mount) == 0) {
-            dntr     = mnt->mnt_root;
-            (*path) += kstrlen(mount);
+    if (*path != '/')
+        kpanic("relative paths not supported");
 
-            if (**path == '\0')
-                *path = NULL;
-            else
-                (*path)++;
+    // the pseudo filesystems are mounted on the empty root until rootfs is installed
+    if (!(start = root_fs->mnt_root) && !(start = root_fs->mnt_mount))
+        kpanic("rootfs missing");
 
-            goto end;
-        }
+    if (lockless) {
+        dseq = dentry_walk_begin();
+        mseq = read_seqcount_begin(&mount_seq);
+        seq  = raw_read_seqcount(&start->d_seq);
     }
 
-end:
-    kfree(orig);
-    return dntr;
-}
+    // path is "/"
+    if (!__path_next(&path, &name)) {
+        out->p_dentry = start;
 
-path_t *vfs_path_lookup(char *path, int flags)
-{
-    path_t *retpath   = kmalloc(sizeof(path_t));
-    retpath->p_status = LOOKUP_STAT_ENOENT;
-    retpath->p_flags  = flags;
+        if (flags & LOOKUP_CREATE)
+            out->p_status = LOOKUP_STAT_EEXISTS;
 
-    if (!path || !kstrlen(path)) {
-        retpath->p_status = LOOKUP_STAT_EINVAL;
-        retpath->p_dentry = NULL;
-        return retpath;
-    }
+        if (flags & LOOKUP_OPEN)
+            out->p_status = LOOKUP_STAT_SUCCESS;
 
-    dentry_t *start = NULL,
-             *dntr  = NULL;
-    char *_path_ptr = NULL,
-         *_path     = NULL;
+        goto end;
+    }
 
-    _path_ptr = _path = kstrdup(path);
+    for (dntr = start; dntr; name = next) {
+        more   = __path_next(&path, &next);
+        parent = dntr;
+        pseq   = seq;
 
-    if (_path[0] == '/') {
-        start = vfs_find_bootstrap(&_path);
+        // `dntr` is the parent of the last component
+        if (!more && (flags & LOOKUP_PARENT))
+            break;
 
-        if (_path == NULL) {
-            if (flags & LOOKUP_PARENT)
-                retpath->p_dentry = root_fs->mnt_root;
-            else
-                retpath->p_dentry = start;
+        if (more && !dntr->d_children) {
+            if (lockless)
+                return -EAGAIN;
 
-            if ((flags & LOOKUP_CREATE) && (start != NULL))
-                retpath->p_status = LOOKUP_STAT_EEXISTS;
+            kprint("vfs - parent ('%s') doesn't have a valid children hashmap!\n", dntr->d_name);
+            errno = EINVAL;
+            dntr  = NULL;
+            break;
+        }
 
-            if ((flags & LOOKUP_OPEN) && (start != NULL))
-                retpath->p_status = LOOKUP_STAT_SUCCESS;
+        if (lockless) {
+            dntr = dentry_lookup_lockless(parent, &name, &seq);
 
-            goto end;
+            if ((!dntr && errno == EAGAIN) || read_seqcount_retry(&parent->d_seq, pseq))
+                return -EAGAIN;
+        } else {
+            dntr = dentry_lookup_name(parent, &name);
         }
 
-        // we got here so path is not NULL meaning there's more elements to process in the path
-        // check if the bootstrap dentry is NULL.
-        // if it is means that the first element after first '/' wasn't a mountpoint
-        // and we must default to root_fs
-        if (!start && !(start = root_fs->mnt_root)) {
-            kpanic("rootfs missing");
-        }
-    } else {
-        kpanic("relative paths not supported");
-    }
+        if (!dntr)
+            break;
 
-    if (!start) {
-        kprint("vfs - bootstrap dentry is NULL for %s!\n", _path_ptr);
-        retpath->p_status = LOOKUP_STAT_EINVAL;
-        errno = EINVAL;
-        goto end;
+        if ((more || !(flags & LOOKUP_MOUNTPOINT)) && !__path_cross(&dntr, &seq, lockless, mseq))
+            return -EAGAIN;
+
+        if (!more)
+            break;
     }
 
-    if (!(retpath->p_dentry = vfs_walk_path(start, _path, flags))) {
+    if (!(out->p_dentry = dntr)) {
 
         // intention was to open file but it doesn't exist -> path lookup "failed"
         if (flags & LOOKUP_OPEN)
-            retpath->p_status = LOOKUP_STAT_ENOENT;
+            out->p_status = LOOKUP_STAT_ENOENT;
 
         if (flags & LOOKUP_CREATE) {
-            retpath->p_status = LOOKUP_STAT_SUCCESS;
+            out->p_status = LOOKUP_STAT_SUCCESS;
 
-            if (flags & LOOKUP_PARENT)
-                retpath->p_dentry = start;
-            else
-                retpath->p_dentry = NULL;
+            if (flags & LOOKUP_PARENT) {
+                out->p_dentry = parent;
+                seq           = pseq;
+            }
         }
 
         goto end;
@@ -495,32 +634,323 @@ path_t *vfs_path_lookup(char *path, int flags)
 
     // intention was to create file but it already exists -> path lookup "failed"
     if (flags & LOOKUP_CREATE && !(flags & LOOKUP_PARENT))
-        retpath->p_status = LOOKUP_STAT_EEXISTS;
+        out->p_status = LOOKUP_STAT_EEXISTS;
 
     // intention was to open file and it exists -> success
     if (flags & LOOKUP_OPEN)
-        retpath->p_status = LOOKUP_STAT_SUCCESS;
-
-    retpath->p_dentry->d_count++;
+        out->p_status = LOOKUP_STAT_SUCCESS;
 
 end:
-    kfree(_path_ptr);
+    if (!out->p_dentry) {
+        // a negative result is only as good as the walk that led to it
+        if (lockless && dentry_walk_retry(dseq))
+            return -EAGAIN;
+
+        return -ENOENT;
+    }
+
+    // the reference is dropped by vfs_path_put()
+    if (lockless)
+        return dentry_walk_get(out->p_dentry, dseq, seq);
+
+    dentry_get(out->p_dentry);
+    return 0;
+}
+
+int vfs_path_walk(const char *path, int flags, path_t *out)
+{
+    int ret;
+
+    if ((ret = __path_walk(path, flags, out, true)) != -EAGAIN)
+        return ret;
+
+    return __path_walk(path, flags, out, false);
+}
+
+void vfs_path_put(path_t *path)
+{
+    if (path && path->p_dentry) {
+        dentry_put(path->p_dentry);
+        path->p_dentry = NULL;
+    }
+}
+
+path_t *vfs_path_lookup(char *path, int flags)
+{
+    path_t *retpath = kmalloc(sizeof(path_t));
+
+    if (retpath)
+        (void)vfs_path_walk(path, flags, retpath);
+
     return retpath;
 }
 
 int vfs_path_release(path_t *path)
 {
-    if (!path || !path->p_dentry)
+    int ret = 0;
+
+    if (!path)
         return -EINVAL;
 
-    if (--path->p_dentry->d_count == 1)
-        dentry_dealloc(path->p_dentry);
+    if (!path->p_dentry)
+        ret = -EINVAL;
 
+    vfs_path_put(path);
     kfree(path);
 
+    return ret;
+}
+
+// copy the last component of `path` to `name`
+static int __path_last(const char *path, char *name)
+{
+    const char *end = path + kstrlen(path),
+               *start;
+
+    while (end > path && end[-1] == '/')
+        end--;
+
+    for (start = end; start > path && start[-1] != '/'; --start)
+        ;
+
+    if (start == end)
+        return -EINVAL;
+
+    if (end - start >= DENTRY_NAME_MAXLEN)
+        return -E2BIG;
+
+    kmemcpy(name, start, end - start);
+    name[end - start] = '\0';
+
+    // "." and ".." are part of every directory
+    if (!kstrcmp(name, ".") || !kstrcmp(name, ".."))
+        return -EINVAL;
+
     return 0;
 }
 
+// walk to the directory that contains the last component of `path` and copy the
+// component to `name`, the reference to the directory is dropped by vfs_path_put()
+static int __path_parent(const char *path, path_t *parent, char *name)
+{
+    int ret;
+
+    if (!path)
+        return -EINVAL;
+
+    if ((ret = __path_last(path, name)) < 0)
+        return ret;
+
+    if ((ret = vfs_path_walk(path, LOOKUP_PARENT, parent)) < 0)
+        return ret;
+
+    if (!parent->p_dentry->d_inode || !(parent->p_dentry->d_flags & T_IFDIR)) {
+        vfs_path_put(parent);
+        return -ENOTDIR;
+    }
+
+    return 0;
+}
+
+// create a regular file or a directory at `path`
+static int __vfs_create(const char *path, int mode, uint32_t type)
+{
+    char name[DENTRY_NAME_MAXLEN];
+    dentry_t *dir  = NULL,
+             *dntr = NULL;
+    inode_ops_t *ops;
+    path_t parent;
+    int ret;
+
+    if ((ret = __path_parent(path, &parent, name)) < 0)
+        return ret;
+
+    dir = parent.p_dentry;
+    ops = dir->d_inode->i_iops;
+
+    if (!((type & T_IFDIR) ? (void *)ops->mkdir : (void *)ops->create)) {
+        ret = -ENOSYS;
+        goto end;
+    }
+
+    if (dentry_lookup(dir, name)) {
+        ret = -EEXIST;
+        goto end;
+    }
+
+    // the file system gives the new dentry an inode
+    if (!(dntr = dentry_alloc(dir, name, type))) {
+        ret = -errno;
+        goto end;
+    }
+
+    if (type & T_IFDIR)
+        ret = ops->mkdir(dir, dntr, mode);
+    else
+        ret = ops->create(dir, dntr, mode, NULL);
+
+    if (ret < 0)
+        (void)dentry_dealloc(dntr);
+
+end:
+    vfs_path_put(&parent);
+    return ret;
+}
+
+// remove the file or the directory at `path`
+static int __vfs_remove(const char *path, uint32_t type)
+{
+    dentry_t *dntr = NULL;
+    inode_ops_t *ops;
+    path_t target;
+    int ret;
+
+    if ((ret = vfs_path_walk(path, LOOKUP_OPEN | LOOKUP_MOUNTPOINT, &target)) < 0)
+        return ret;
+
+    dntr = target.p_dentry;
+    ops  = dntr->d_parent ? dntr->d_parent->d_inode->i_iops : NULL;
+
+    // the root of a file system or a mountpoint
+    if (!ops || !dntr->d_inode || (dntr->d_flags & DNTR_MOUNTPOINT))
+        ret = -EBUSY;
+    else if ((type & T_IFDIR) && !(dntr->d_inode->i_flags & T_IFDIR))
+        ret = -ENOTDIR;
+    else if (!(type & T_IFDIR) && (dntr->d_inode->i_flags & T_IFDIR))
+        ret = -EISDIR;
+    else if (type & T_IFDIR)
+        ret = ops->rmdir ? ops->rmdir(dntr->d_parent, dntr) : -ENOSYS;
+    else
+        ret = ops->unlink ? ops->unlink(dntr->d_parent, dntr) : -ENOSYS;
+
+    // the file system freed the dentry together with the walk's reference
+    if (ret < 0)
+        vfs_path_put(&target);
+
+    return ret;
+}
+
+int vfs_create(const char *path, int mode)
+{
+    return __vfs_create(path, mode, T_IFREG);
+}
+
+int vfs_mkdir(const char *path, int mode)
+{
+    return __vfs_create(path, mode, T_IFDIR);
+}
+
+int vfs_unlink(const char *path)
+{
+    return __vfs_remove(path, T_IFREG);
+}
+
+int vfs_rmdir(const char *path)
+{
+    return __vfs_remove(path, T_IFDIR);
+}
+
+int vfs_rename(const char *oldpath, const char *newpath)
+{
+    char name[DENTRY_NAME_MAXLEN];
+    dentry_t *old    = NULL,
+             *dir    = NULL,
+             *target = NULL,
+             *orphan = NULL;
+    inode_ops_t *ops;
+    path_t path, parent;
+    int ret;
+
+    if ((ret = vfs_path_walk(oldpath, LOOKUP_OPEN | LOOKUP_MOUNTPOINT, &path)) < 0)
+        return ret;
+
+    // the walk's reference keeps `old` until it has been moved
+    old = path.p_dentry;
+
+    if (!old->d_parent || !old->d_inode || (old->d_flags & DNTR_MOUNTPOINT)) {
+        vfs_path_put(&path);
+        return -EBUSY;
+    }
+
+    if ((ret = __path_parent(newpath, &parent, name)) < 0) {
+        vfs_path_put(&path);
+        return ret;
+    }
+
+    dir = parent.p_dentry;
+    ops = old->d_parent->d_inode->i_iops;
+
+    // both names must be in the same file system
+    if (dir->d_inode->i_sb != old->d_inode->i_sb) {
+        ret = -EXDEV;
+        goto end;
+    }
+
+    if (!ops->rename) {
+        ret = -ENOSYS;
+        goto end;
+    }
+
+    // a target that doesn't exist is passed as an unlinked dentry that carries the name
+    if ((target = dentry_lookup(dir, name))) {
+        dentry_get(target);
+    } else if (!(target = orphan = dentry_alloc_orphan(name, 0))) {
+        ret = -errno;
+        goto end;
+    }
+
+    if (target == old) {
+        ret = 0;
+    } else if (target->d_flags & DNTR_MOUNTPOINT) {
+        ret = -EBUSY;
+    } else {
+        ret = ops->rename(old->d_parent, old, dir, target);
+
+        // a replaced target was freed together with the reference
+        if (ret == 0 && !orphan)
+            target = NULL;
+    }
+
+end:
+    if (orphan)
+        (void)dentry_dealloc(orphan);
+    else if (target)
+        dentry_put(target);
+
+    vfs_path_put(&parent);
+    vfs_path_put(&path);
+    return ret;
+}
+
+int vfs_truncate(const char *path, off_t length)
+{
+    inode_t *ino = NULL;
+    path_t target;
+    int ret;
+
+    if (length < 0 || length > INT32_MAX)
+        return -EINVAL;
+
+    if ((ret = vfs_path_walk(path, LOOKUP_OPEN, &target)) < 0)
+        return ret;
+
+    ino = target.p_dentry->d_inode;
+
+    if (!ino) {
+        ret = -EINVAL;
+    } else if (ino->i_flags & T_IFDIR) {
+        ret = -EISDIR;
+    } else if (!ino->i_iops->truncate) {
+        ret = -ENOSYS;
+    } else {
+        ino->i_size = length;
+        ret = ino->i_iops->truncate(ino);
+    }
+
+    vfs_path_put(&target);
+    return ret;
+}
+
 fs_ctx_t *vfs_alloc_fs_ctx(dentry_t *pwd)
 {
     fs_ctx_t *ctx = mm_cache_alloc_entry(fs_ctx_cache);
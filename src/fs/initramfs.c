@@ -1,95 +1,97 @@
+#include <arch/amd64/cpu.h>
+#include <arch/amd64/mmu.h>
+#include <fs/dentry.h>
 #include <fs/fs.h>
-#include <fs/multiboot2.h>
 #include <fs/super.h>
 #include <kernel/kpanic.h>
 #include <kernel/util.h>
+#include <lib/lz4.h>
 #include <mm/heap.h>
 #include <mm/mmu.h>
+#include <mm/page.h>
 #include <mm/types.h>
+#include <mm/vma.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <stddef.h>
 
-// TODO:
-extern uint8_t _ramfs_start, _ramfs_end;
-
-// the design of this initamfs is extremely simple
+// The image is the first multiboot2 boot module (see the iso target of the top-level
+// Makefile), its pages are reserved by the page allocator until they're freed here
 //
-// 1) current maximum depth of directories is two. That is,
-//    only root and one additional directory is possible.
+// Image format (version 2)
 //
-// 2) root directory cannot contain any files, only directories
+// The image starts with a header followed by the inode table. Inode `n` is entry
+// `n` of the table (inode 0 is unused, the root directory is inode 1) and it tells
+// where the file data or the directory table of the inode is in the image.
 //
-// 3) directory can contain up to 5 files (root directory can contain
-//    5 directories and these directories can contain up to 5 files)
-
-#define HEADER_MAGIC  0x13371338
-#define FILE_MAGIC    0xdeadbeef
-#define DIR_MAGIC     0xcafebabe
+// A directory table is a header followed by the entries of the directory sorted
+// by the hash of their name (see dname_hash()) and the NUL-terminated names.
+// A name is looked up with a binary search over the hashes and the few entries
+// with the same hash are then compared by name.
+//
+// File data starts at a page boundary of the image so a file that's mapped can
+// use the pages of the image as is. All offsets are relative to the start of the image.
+//
+//   +--------+-------------+------------------+-----+-------------+-----
+//   | header | inode table | directory tables | pad | file data   | pad ...
+//   +--------+-------------+------------------+-----+-------------+-----
+//
+// The structures are shared with toolchain/util/mkinitrd.c and verify_initrd.c
+//
+// An image compressed with `mkinitrd -c` is an LZ4 frame of the image. It's decompressed
+// into pages of the page allocator when it's mounted and the module is freed, so the
+// compressed image costs memory only until the root is mounted
 
-#define NAME_MAXLEN   64
-#define MAX_FILES      5
-#define MAX_DIRS       5
+#define INITRD_MAGIC     0x13371339
+#define INITRD_DIR_MAGIC 0xcafebabf
+#define INITRD_VERSION   2
+#define INITRD_ROOT_INO  1
 
-typedef struct disk_header {
-    // how much is the total size of initrd
-    uint32_t size;
+enum {
+    INITRD_IFREG = 1,
+    INITRD_IFDIR = 2,
+};
 
-    // directory magic number (for verification)
+typedef struct initrd_header {
     uint32_t magic;
-
-    // how many directories initrd has
-    uint32_t num_dir;
-
-    // directory offsets (relative to disk's address)
-    uint32_t dir_offsets[MAX_DIRS];
-} disk_header_t;
-
-typedef struct dir_header {
-    char name[NAME_MAXLEN];
-
-    // how many bytes directory takes in total:
-    //  `sizeof(dir_header_t) + num_files * sizeof(file_header_t) + file sizes`
-    uint32_t size;
-
-    // how many files the directory has (1 <= num_files <= 5)
-    uint32_t num_files;
-
-    uint32_t inode;
+    uint32_t version;
+    uint64_t size;        // size of the image in bytes
+    uint64_t inodes;      // offset of the inode table
+    uint32_t num_inodes;  // number of entries in the inode table, including inode 0
+    uint32_t align;       // alignment of file data
+} initrd_header_t;
+
+typedef struct initrd_inode {
+    uint64_t offset;      // offset of the file data or the directory table
+    uint64_t size;        // size of the file or the directory table in bytes
+    uint32_t mode;        // INITRD_IFREG or INITRD_IFDIR
+    uint32_t reserved;
+} initrd_inode_t;
+
+typedef struct initrd_dir {
     uint32_t magic;
+    uint32_t num_entries;
+} initrd_dir_t;
 
-    uint32_t file_offsets[MAX_FILES];
-} dir_header_t;
-
-typedef struct file_header {
-    char name[NAME_MAXLEN];
-
-    // file size in bytes (header size excluded)
-    uint32_t size;
-
-    uint32_t inode;
-    uint32_t magic;
-} file_header_t;
+typedef struct initrd_dirent {
+    uint32_t hash;        // dname_hash() of the name
+    uint32_t ino;
+    uint32_t name;        // offset of the name relative to the directory table
+    uint32_t name_len;    // length of the name without the NUL
+} initrd_dirent_t;
 
 typedef struct fs_private {
-    disk_header_t *d_header;
-    void *phys_start;
+    uint8_t *base;                 // start of the image
+    const initrd_header_t *header;
+    const initrd_inode_t *inodes;
 } fs_private_t;
 
-typedef struct inode_private_t {
-    void *pstart;
-    void *vstart;
-    int num_mapped;
+typedef struct inode_private {
+    const initrd_inode_t *rec;
+    uint8_t *data;                 // file data or the directory table
 } i_private_t;
 
-typedef struct file_private {
-    bool mapped;
-    int num_mapped;
-    void *pstart; // points to physical memory
-    void *vstart; // points to allocated virtual memory (this must be released)
-} f_private_t;
-
-#define GET_FILE_PRIVATE(f) ((f_private_t *)(f->f_private))
+#define GET_SB_PRIVATE(sb)  ((fs_private_t *)(sb->s_private))
 #define GET_INO_PRIVATE(i)  ((i_private_t *)(i->i_private))
 
 static inode_t *initramfs_inode_lookup(dentry_t *parent, char *name);
@@ -105,15 +107,8 @@ static ssize_t initramfs_file_read(file_t *file, off_t offset, size_t count, voi
     if (!file || !buf)
         return -EINVAL;
 
-    /* allocate address space for file and map the bytes there */
-    if (!GET_FILE_PRIVATE(file)->mapped) {
-        GET_FILE_PRIVATE(file)->mapped     = true;
-        GET_FILE_PRIVATE(file)->num_mapped = -1;
-        GET_FILE_PRIVATE(file)->vstart     = GET_FILE_PRIVATE(file)->pstart;
-    }
-
     int ret    = initramfs_file_seek(file, offset);
-    char *addr = ((char *)GET_FILE_PRIVATE(file)->vstart) + sizeof(file_header_t);
+    char *addr = (char *)GET_INO_PRIVATE(file->f_dentry->d_inode)->data;
 
     if (ret < 0)
         return ret;
@@ -125,6 +120,86 @@ static ssize_t initramfs_file_read(file_t *file, off_t offset, size_t count, voi
     return count;
 }
 
+static int initramfs_file_readpage(file_t *file, uint64_t index, void *page)
+{
+    inode_t *ino = file->f_dentry->d_inode;
+    char *addr   = (char *)GET_INO_PRIVATE(ino)->data;
+    uint64_t off = index << PAGE_SHIFT;
+    size_t len;
+
+    if (off >= (uint64_t)ino->i_size)
+        return -EINVAL;
+
+    len = MIN(PAGE_SIZE, ino->i_size - off);
+
+    kmemcpy(page, addr + off, len);
+    kmemset((char *)page + len, 0, PAGE_SIZE - len);
+
+    return 0;
+}
+
+// the file's data is in memory already and it's page-aligned in the image so a page
+// is mapped as is (execute-in-place). The partial last page, whose tail must read as
+// zeros, is copied for the mapping, like every page if the image isn't page-aligned
+static uint64_t initramfs_vma_frame(mm_vma_t *vma, uint64_t pgoff, bool *shared)
+{
+    inode_t *ino = ((dentry_t *)vma->private)->d_inode;
+    char *addr   = (char *)GET_INO_PRIVATE(ino)->data;
+    uint64_t off = pgoff << PAGE_SHIFT;
+    uint64_t paddr;
+    size_t len;
+
+    if (off >= (uint64_t)ino->i_size)
+        return INVALID_ADDRESS;
+
+    len = MIN(PAGE_SIZE, ino->i_size - off);
+
+    if (PAGE_ALIGNED((unsigned long)addr) && len == PAGE_SIZE) {
+        *shared = true;
+        return amd64_v_to_p(addr + off);
+    }
+
+    if ((paddr = mm_block_try_alloc(MM_ZONE_NORMAL, 0, 0)) == INVALID_ADDRESS)
+        return INVALID_ADDRESS;
+
+    kmemcpy(amd64_p_to_v(paddr), addr + off, len);
+    kmemset((char *)amd64_p_to_v(paddr) + len, 0, PAGE_SIZE - len);
+
+    *shared = false;
+    return paddr;
+}
+
+// a mapping holds a reference to the dentry so the inode stays around
+static void initramfs_vma_open(mm_vma_t *vma)
+{
+    dentry_get(vma->private);
+}
+
+static void initramfs_vma_close(mm_vma_t *vma)
+{
+    dentry_put(vma->private);
+}
+
+static const mm_vma_ops_t initramfs_vma_ops = {
+    .frame = initramfs_vma_frame,
+    .open  = initramfs_vma_open,
+    .close = initramfs_vma_close,
+};
+
+static int initramfs_file_mmap(file_t *file, mm_as_t *as, uint64_t addr, size_t len,
+                               int prot, int flags, off_t off)
+{
+    if (!file || off < 0 || !PAGE_ALIGNED(off))
+        return -EINVAL;
+
+    // initramfs is a read-only filesystem
+    if ((prot & MM_PROT_WRITE) && !(flags & MM_VMA_PRIVATE))
+        return -ENOTSUP;
+
+    return mm_map_file(as, addr, len, prot, flags, &initramfs_vma_ops,
+                       file->f_dentry, (uint64_t)off >> PAGE_SHIFT);
+}
+
 static file_t *initramfs_file_open(dentry_t *dntr, int mode)
 {
     if (!dntr || !dntr->d_inode) {
@@ -153,16 +228,8 @@ static file_t *initramfs_file_open(dentry_t *dntr, int mode)
     file->f_mode    = mode;
     file->f_dentry  = dntr;
     file->f_ops     = dntr->d_inode->i_fops;
-    dntr->d_count++;
-
-    if (!(file->f_private = kzalloc(sizeof(f_private_t)))) {
-        (void)file_generic_dealloc(file);
-        return NULL;
-    }
-
-    GET_FILE_PRIVATE(file)->mapped = false;
-    GET_FILE_PRIVATE(file)->vstart = NULL;
-    GET_FILE_PRIVATE(file)->pstart = GET_INO_PRIVATE(dntr->d_inode)->pstart;
+    file->f_private = NULL;
+    dentry_get(dntr);
 
     return file;
 }
@@ -172,9 +239,6 @@ static int initramfs_file_close(file_t *file)
     if (!file)
         return -EINVAL;
 
-    // TODO: free file memory
-
-    kfree(file->f_private);
     return file_generic_dealloc(file);
 }
 
@@ -183,6 +247,91 @@ static int initramfs_file_seek(file_t *file, off_t offset)
     return file_generic_seek(file, offset);
 }
 
+// return the entry of `name` in directory table `dir` or NULL if there's no such entry
+static const initrd_dirent_t *__dir_find(const initrd_dir_t *dir, const char *name, size_t len)
+{
+    const initrd_dirent_t *ents = (const initrd_dirent_t *)(dir + 1);
+    uint32_t hash = dname_hash(name, len);
+    size_t lo = 0, hi = dir->num_entries;
+
+    // first entry with the hash
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (ents[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < dir->num_entries && ents[lo].hash == hash; ++lo) {
+        if (ents[lo].name_len == len && !kmemcmp((char *)name, (char *)dir + ents[lo].name, len))
+            return &ents[lo];
+    }
+
+    return NULL;
+}
+
+// return the record of inode `i_ino` or NULL if the image is corrupted
+static const initrd_inode_t *__inode_rec(fs_private_t *fsp, uint32_t i_ino)
+{
+    const initrd_inode_t *rec;
+
+    if (i_ino == 0 || i_ino >= fsp->header->num_inodes)
+        return NULL;
+
+    rec = &fsp->inodes[i_ino];
+
+    if (rec->offset > fsp->header->size || rec->size > fsp->header->size - rec->offset)
+        return NULL;
+
+    if (rec->mode == INITRD_IFREG)
+        return rec->size <= INT32_MAX ? rec : NULL;
+
+    if (rec->mode != INITRD_IFDIR || rec->size < sizeof(initrd_dir_t))
+        return NULL;
+
+    const initrd_dir_t *dir = (const initrd_dir_t *)(fsp->base + rec->offset);
+
+    if (dir->magic != INITRD_DIR_MAGIC ||
+        dir->num_entries > (rec->size - sizeof(initrd_dir_t)) / sizeof(initrd_dirent_t))
+        return NULL;
+
+    return rec;
+}
+
+// allocate an inode for inode `i_ino` of the image
+static inode_t *__inode_get(superblock_t *sb, uint32_t i_ino)
+{
+    fs_private_t *fsp = GET_SB_PRIVATE(sb);
+    const initrd_inode_t *rec;
+    inode_t *inode;
+
+    if (!(rec = __inode_rec(fsp, i_ino))) {
+        kprint("initramfs - inode %u is corrupted\n", i_ino);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!(inode = initramfs_inode_alloc(sb)))
+        return NULL;
+
+    if (!(inode->i_private = kzalloc(sizeof(i_private_t)))) {
+        (void)initramfs_inode_destroy(inode);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    inode->i_ino   = i_ino;
+    inode->i_size  = rec->size;
+    inode->i_flags = (rec->mode == INITRD_IFDIR) ? T_IFDIR : T_IFREG;
+
+    GET_INO_PRIVATE(inode)->rec  = rec;
+    GET_INO_PRIVATE(inode)->data = fsp->base + rec->offset;
+
+    return inode;
+}
+
 static inode_t *initramfs_inode_lookup(dentry_t *parent, char *name)
 {
     if (!parent || !name) {
@@ -195,80 +344,15 @@ static inode_t *initramfs_inode_lookup(dentry_t *parent, char *name)
         return NULL;
     }
 
-    uint32_t i_ino    = 0;
-    uint32_t i_size   = 0;
-    uint32_t i_flags  = 0;
-    uint32_t i_offset = 0;
-    inode_t *inode    = NULL;
-
-    i_private_t *ip  = ((i_private_t *)parent->d_inode->i_private);
-    dir_header_t *dh = (dir_header_t *)ip->vstart;
-
-    for (size_t i = 0; i < dh->num_files; ++i) {
-        i_offset            = dh->file_offsets[i];
-        dir_header_t *dir   = (dir_header_t  *)((char *)dh + i_offset);
-        file_header_t *file = (file_header_t *)((char *)dh + i_offset);
-
-        if (dir->magic == DIR_MAGIC) {
-            if (!kstrcmp_s(dir->name, name)) {
-                i_ino   = dir->inode;
-                i_size  = dir->size;
-                i_flags = T_IFDIR;
-                goto found;
-            }
-        }
-
-        if (file->magic == FILE_MAGIC) {
-            if (!kstrcmp_s(file->name, name)) {
-                i_ino   = file->inode;
-                i_size  = file->size;
-                i_flags = T_IFREG;
-                goto found;
-            }
-        }
-    }
-
-    errno = ENOENT;
-    return NULL;
+    const initrd_dir_t *dir = (const initrd_dir_t *)GET_INO_PRIVATE(parent->d_inode)->data;
+    const initrd_dirent_t *ent;
 
-found:
-    if (!(inode = initramfs_inode_alloc(parent->d_inode->i_sb)))
+    if (!(ent = __dir_find(dir, name, kstrlen(name)))) {
+        errno = ENOENT;
         return NULL;
-
-    inode->i_ino     = i_ino;
-    inode->i_size    = i_size;
-    inode->i_flags   = i_flags;
-
-    // if the item found was directory, check whether its children fit into
-    // the memory area allocated by the parent.
-    //
-    // If they do, make `i_private->vstart` point to `parent->...->i_private->vstart + offset`.
-    // If, however, the children occupies more memory than currently has been mapped,
-    // we must map the whole directory to memory and make `i_private->vstart`
-    // point to this new area
-    //
-    // if the item was file, no need allocate any memory/address space yet
-    inode->i_private      = kzalloc(sizeof(i_private_t));
-    uint32_t parent_start = (unsigned long)ip->pstart;
-    uint32_t parent_size  = parent->d_inode->i_size;
-    uint32_t boundary     = ROUND_DOWN(parent_start, PAGE_SIZE);
-    uint32_t off_start    = parent_start + i_offset - boundary;
-
-    // if the offset from page boundary of the initrd + directory size is more than `PAGE_SIZE`,
-    // it means that this directory overlaps two pages and we must allocate space for two pages
-    if ((i_flags & T_IFDIR) && (off_start + i_size) > PAGE_SIZE) {
-        GET_INO_PRIVATE(inode)->pstart = (void *)((uint8_t *)ip->pstart + i_offset);
-        GET_INO_PRIVATE(inode)->vstart = (void *)((uint8_t *)ip->pstart + i_offset);
-    } else {
-        if (i_flags & T_IFDIR)
-            GET_INO_PRIVATE(inode)->vstart = (char *)ip->vstart + i_offset;
-        else
-            GET_INO_PRIVATE(inode)->vstart = NULL;
-
-        GET_INO_PRIVATE(inode)->pstart = (char *)ip->pstart + i_offset;
     }
 
-    return inode;
+    return __inode_get(parent->d_inode->i_sb, ent->ino);
 }
 
 static inode_t *initramfs_inode_alloc(superblock_t *sb)
@@ -283,11 +367,13 @@ static inode_t *initramfs_inode_alloc(superblock_t *sb)
     ino->i_size = 0;
     ino->i_sb   = sb;
 
-    ino->i_iops->lookup = initramfs_inode_lookup;
-    ino->i_fops->read   = initramfs_file_read;
-    ino->i_fops->open   = initramfs_file_open;
-    ino->i_fops->close  = initramfs_file_close;
-    ino->i_fops->seek   = initramfs_file_seek;
+    ino->i_iops->lookup   = initramfs_inode_lookup;
+    ino->i_fops->read     = initramfs_file_read;
+    ino->i_fops->readpage = initramfs_file_readpage;
+    ino->i_fops->mmap     = initramfs_file_mmap;
+    ino->i_fops->open     = initramfs_file_open;
+    ino->i_fops->close    = initramfs_file_close;
+    ino->i_fops->seek     = initramfs_file_seek;
 
     ino->i_iops->create   = NULL; ino->i_iops->link     = NULL; ino->i_iops->unlink      = NULL;
     ino->i_iops->symlink  = NULL; ino->i_iops->mkdir    = NULL; ino->i_iops->rmdir       = NULL;
@@ -302,42 +388,150 @@ static inode_t *initramfs_inode_alloc(superblock_t *sb)
 
 static int initramfs_inode_destroy(inode_t *ino)
 {
-    // TODO: free `i_private`
+    kfree(ino->i_private);
     return inode_generic_dealloc(ino);
 }
 
+// check the header of image `base` of `len` bytes
+static int __image_check(uint8_t *base, size_t len)
+{
+    const initrd_header_t *hdr = (const initrd_header_t *)base;
+
+    if (len < sizeof(initrd_header_t) || hdr->magic != INITRD_MAGIC) {
+        kprint("initramfs - initramfs does not exist: 0x%x\n", len ? hdr->magic : 0);
+        return -ENXIO;
+    }
+
+    if (hdr->version != INITRD_VERSION) {
+        kprint("initramfs - unsupported image version %u\n", hdr->version);
+        return -ENOTSUP;
+    }
+
+    if (hdr->size > len || hdr->inodes > hdr->size || hdr->num_inodes <= INITRD_ROOT_INO ||
+        hdr->num_inodes > (hdr->size - hdr->inodes) / sizeof(initrd_inode_t)) {
+        kprint("initramfs - image header is corrupted\n");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+// decompress the LZ4 frame at `*image` into a block of pages and point `*image` to it
+static int __image_decompress(uint8_t **image, size_t *len)
+{
+    ssize_t size = lz4_frame_content_size(*image, *len);
+    uint64_t start = get_tsc();
+    uint32_t order = 0;
+    uint64_t paddr;
+    size_t npages;
+
+    if (size < 0) {
+        kprint("initramfs - invalid compressed image: %d\n", size);
+        return size;
+    }
+
+    npages = ROUND_UP((size_t)size, PAGE_SIZE) / PAGE_SIZE;
+
+    while ((1UL << order) < npages && order < BUDDY_MAX_ORDER)
+        order++;
+
+    if (order == BUDDY_MAX_ORDER || (paddr = mm_block_try_alloc(MM_ZONE_NORMAL, order, 0)) == INVALID_ADDRESS) {
+        kprint("initramfs - no memory for a %u KB image\n", size / 1024);
+        return -ENOMEM;
+    }
+
+    ssize_t ret = lz4_frame_decompress(*image, *len, amd64_p_to_v(paddr), size);
+
+    if (ret != size) {
+        kprint("initramfs - failed to decompress the image: %d\n", ret);
+        (void)mm_block_free(paddr, order);
+        return ret < 0 ? ret : -EINVAL;
+    }
+
+    // the block is rounded up to a power of two pages, the rest of it isn't needed
+    mm_free_range(paddr + npages * PAGE_SIZE, ((1UL << order) - npages) * PAGE_SIZE);
+
+    kprint("initramfs - decompressed %u KB to %u KB in %u kcycles\n",
+           *len / 1024, size / 1024, (get_tsc() - start) / 1000);
+
+    *image = (uint8_t *)amd64_p_to_v(paddr);
+    *len   = size;
+
+    return 0;
+}
+
+// the boot module was recorded by the page allocator, the multiboot2 information
+// given in `args` may have been overwritten by now
 static int initramfs_init(superblock_t *sb, void *args)
 {
+    uint8_t *ramfs_start;
+    size_t  ramfs_len;
+    uint64_t module_start;
+    size_t  module_len;
+    fs_private_t *fsp;
+    inode_t *root;
+    bool compressed;
+    int ret;
+
     (void)args;
 
-    uint8_t *ramfs_start = &_ramfs_start;
-    size_t  ramfs_len    = (uint64_t)&_ramfs_end - (uint64_t)&_ramfs_start;
-    disk_header_t *dh    = (disk_header_t *)ramfs_start;
+    if (mm_boot_module(&module_start, &module_len) < 0) {
+        kprint("initramfs - no boot module\n");
+        return -ENOENT;
+    }
 
-    if (!ramfs_len || dh->magic != HEADER_MAGIC) {
-        kprint("initramfs - initramfs does not exist: 0x%x\n", dh->magic);
-        return -ENXIO;
+    ramfs_start = (uint8_t *)amd64_p_to_v(module_start);
+    ramfs_len   = module_len;
+
+    // an uncompressed image is used in place and the module stays reserved
+    if ((compressed = lz4_frame_detect(ramfs_start, ramfs_len))) {
+        if ((ret = __image_decompress(&ramfs_start, &ramfs_len)) < 0)
+            return ret;
     }
 
-    sb->s_root          = dentry_alloc_orphan("/", T_IFDIR);
-    sb->s_root->d_inode = initramfs_inode_alloc(sb);
+    if ((ret = __image_check(ramfs_start, ramfs_len)) < 0)
+        goto error_image;
 
-    sb->s_private = kzalloc(sizeof(fs_private_t));
-    ((fs_private_t *)sb->s_private)->d_header   = NULL;
-    ((fs_private_t *)sb->s_private)->phys_start = (uint8_t *)(unsigned long)ramfs_start;
+    if (!(fsp = sb->s_private = kzalloc(sizeof(fs_private_t)))) {
+        ret = -ENOMEM;
+        goto error_image;
+    }
 
-    sb->s_root->d_inode->i_ino   = 1;
-    sb->s_root->d_inode->i_flags = T_IFDIR;
+    fsp->base   = ramfs_start;
+    fsp->header = (const initrd_header_t *)ramfs_start;
+    fsp->inodes = (const initrd_inode_t *)(ramfs_start + fsp->header->inodes);
 
-    sb->s_root->d_inode->i_private = kzalloc(sizeof(i_private_t));
+    if (!(root = __inode_get(sb, INITRD_ROOT_INO)) || !(root->i_flags & T_IFDIR)) {
+        kprint("initramfs - root directory is corrupted\n");
 
-    // physical and virtual start address of '/' (memory is identity mapped)
-    ((i_private_t *)sb->s_root->d_inode->i_private)->pstart =
-    ((i_private_t *)sb->s_root->d_inode->i_private)->vstart =
-        ((char *)(unsigned long)ramfs_start) + sizeof(disk_header_t);
+        if (root)
+            (void)initramfs_inode_destroy(root);
+
+        ret = -EINVAL;
+        goto error_image;
+    }
 
-    kprint("initramfs - initramfs initialized!\n");
+    // the module is given back only once the decompressed image has been found good,
+    // its pages were reserved whole so they're given back the same way
+    if (compressed) {
+        mm_free_range(
+            ROUND_DOWN(module_start, PAGE_SIZE),
+            ROUND_UP(module_start + module_len, PAGE_SIZE) - ROUND_DOWN(module_start, PAGE_SIZE)
+        );
+    }
+
+    sb->s_root          = dentry_alloc_orphan("/", T_IFDIR);
+    sb->s_root->d_inode = root;
+
+    kprint("initramfs - initramfs initialized, %u inodes\n", fsp->header->num_inodes - 1);
     return 0;
+
+error_image:
+    // __image_decompress() trimmed the block of the decompressed image to its pages
+    if (compressed)
+        mm_free_range(amd64_v_to_p(ramfs_start), ROUND_UP(ramfs_len, PAGE_SIZE));
+
+    return ret;
 }
 
 superblock_t *initramfs_get_sb(fs_type_t *type, char *dev, int flags, void *data)
@@ -345,6 +539,7 @@ superblock_t *initramfs_get_sb(fs_type_t *type, char *dev, int flags, void *data
     (void)dev, (void)flags;
 
     superblock_t *sb = NULL;
+    int ret;
 
     if (!(sb = kzalloc(sizeof(superblock_t)))) {
         errno = ENOMEM;
@@ -363,7 +558,7 @@ superblock_t *initramfs_get_sb(fs_type_t *type, char *dev, int flags, void *data
     sb->s_private   = NULL;
     sb->s_root      = NULL;
     sb->s_type      = type;
-    sb->s_magic     = HEADER_MAGIC;
+    sb->s_magic     = INITRD_MAGIC;
 
     sb->s_ops->destroy_inode = initramfs_inode_destroy;
     sb->s_ops->alloc_inode   = initramfs_inode_alloc;
@@ -381,7 +576,13 @@ superblock_t *initramfs_get_sb(fs_type_t *type, char *dev, int flags, void *data
     list_init(&sb->s_ino_dirty);
     list_init(&sb->s_instances);
 
-    initramfs_init(sb, data);
+    if ((ret = initramfs_init(sb, data)) < 0) {
+        kfree(sb->s_private);
+        kfree(sb->s_ops);
+        kfree(sb);
+        errno = -ret;
+        return NULL;
+    }
 
     return sb;
 }
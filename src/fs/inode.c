@@ -1,6 +1,7 @@
 #include <fs/dentry.h>
 #include <fs/file.h>
 #include <fs/inode.h>
+#include <fs/pagecache.h>
 #include <kernel/kpanic.h>
 #include <mm/slab.h>
 #include <errno.h>
@@ -62,6 +63,8 @@ int inode_generic_dealloc(inode_t *ino)
     if (ino->i_count > 1)
         return -EBUSY;
 
+    pagecache_truncate(&ino->i_mapping);
+
     (void)mm_cache_free_entry(inode_ops_cache, ino->i_iops);
     (void)mm_cache_free_entry(file_ops_cache,  ino->i_fops);
     (void)mm_cache_free_entry(inode_cache,     ino);
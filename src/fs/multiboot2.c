@@ -6,22 +6,31 @@
 #include <mm/mmu.h>
 #include <sys/types.h>
 
+/* the tags start after the 8-byte header (total size and a reserved field) of the information */
+static inline struct multiboot_tag *__first_tag(uint64_t *address)
+{
+    return (struct multiboot_tag *)((multiboot_uint8_t *)address + 8);
+}
+
+static inline struct multiboot_tag *__next_tag(struct multiboot_tag *tag)
+{
+    return (struct multiboot_tag *)((multiboot_uint8_t *)tag + ((tag->size + 7) & ~7));
+}
+
 size_t multiboot2_map_memory(uint64_t *address, void (*callback)(uint32_t, uint64_t, size_t))
 {
     struct multiboot_tag *tag;
     multiboot_memory_map_t *mmap;
 
-    for (tag = (struct multiboot_tag *)(address + 8);
-         tag->type != MULTIBOOT_TAG_TYPE_END;
-         tag = (struct multiboot_tag *)((multiboot_uint8_t *)tag + ((tag->size + 7) & ~7)))
+    for (tag = __first_tag(address); tag->type != MULTIBOOT_TAG_TYPE_END; tag = __next_tag(tag))
     {
         switch (tag->type) {
             case MULTIBOOT_TAG_TYPE_MMAP: {
                 mmap = ((multiboot_tag_mmap_t *)tag)->entries;
 
                 do {
-                    uint64_t addr = (mmap->addr >> 32) | (mmap->addr & 0xffffffff);
-                    uint64_t len  = (mmap->len  >> 32) | (mmap->len  & 0xffffffff);
+                    uint64_t addr = mmap->addr;
+                    uint64_t len  = mmap->len;
 
                     switch (mmap->type) {
                         case MULTIBOOT_MEMORY_AVAILABLE:
@@ -43,6 +52,27 @@ size_t multiboot2_map_memory(uint64_t *address, void (*callback)(uint32_t, uint6
     return 0;
 }
 
+size_t multiboot2_map_modules(uint64_t *address, void (*callback)(uint64_t, size_t, const char *))
+{
+    struct multiboot_tag *tag;
+    struct multiboot_tag_module *mod;
+    size_t nmodules = 0;
+
+    for (tag = __first_tag(address); tag->type != MULTIBOOT_TAG_TYPE_END; tag = __next_tag(tag)) {
+        if (tag->type != MULTIBOOT_TAG_TYPE_MODULE)
+            continue;
+
+        mod = (struct multiboot_tag_module *)tag;
+
+        if (mod->mod_end > mod->mod_start) {
+            callback(mod->mod_start, mod->mod_end - mod->mod_start, mod->cmdline);
+            nmodules++;
+        }
+    }
+
+    return nmodules;
+}
+
 size_t multiboot2_parse_elf(uint64_t *address)
 {
     struct multiboot_tag *tag;
@@ -54,9 +84,7 @@ size_t multiboot2_parse_elf(uint64_t *address)
     int symbol_size = 0;
     int string_size = 0;
 
-    for (tag = (struct multiboot_tag *)(address + 8);
-         tag->type != MULTIBOOT_TAG_TYPE_END;
-         tag = (struct multiboot_tag *)((multiboot_uint8_t *)tag + ((tag->size + 7) & ~7)))
+    for (tag = __first_tag(address); tag->type != MULTIBOOT_TAG_TYPE_END; tag = __next_tag(tag))
     {
         switch (tag->type) {
             case MULTIBOOT_TAG_TYPE_ELF_SECTIONS:
@@ -0,0 +1,391 @@
+#include <arch/amd64/mmu.h>
+#include <fs/dentry.h>
+#include <fs/file.h>
+#include <fs/inode.h>
+#include <fs/pagecache.h>
+#include <kernel/common.h>
+#include <kernel/compiler.h>
+#include <kernel/kpanic.h>
+#include <kernel/kprint.h>
+#include <kernel/util.h>
+#include <mm/page.h>
+#include <mm/slab.h>
+#include <mm/types.h>
+#include <errno.h>
+#include <stdbool.h>
+
+/* a page read into the cache may be evicted before the reader gets to copy it */
+#define PAGECACHE_READ_TRIES 3
+
+static mm_cache_t *cpage_cache = NULL;
+
+/* `__pc_lru_lock` protects the LRU list. It's taken after the lock of an address space
+ * so the shrinker, which goes the other way, only tries to take the latter */
+static list_head_t   __pc_lru;  /* most recently cached first */
+static spinlock_t    __pc_lru_lock;
+static mm_shrinker_t __pc_shrinker;
+
+static struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t ra_pages;
+    uint64_t ra_hits;
+    uint64_t evictions;
+    uint64_t pages;
+} __pc_stats;
+
+#define STAT_ADD(stat, n) __atomic_fetch_add(&__pc_stats.stat, (n), __ATOMIC_RELAXED)
+
+static inline void *__page_data(cpage_t *page)
+{
+    return amd64_p_to_v(page->phys);
+}
+
+/* number of pages the file spans */
+static inline uint64_t __nr_pages(inode_t *ino)
+{
+    return ((uint64_t)ino->i_size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+}
+
+static inline address_space_t *__mapping(file_t *file)
+{
+    return &file->f_dentry->d_inode->i_mapping;
+}
+
+static void __page_free(cpage_t *page)
+{
+    (void)mm_block_free(page->phys, 0);
+    (void)mm_cache_free_entry(cpage_cache, page);
+}
+
+static size_t __pc_scan(size_t nr)
+{
+    return pagecache_shrink(nr);
+}
+
+void pagecache_init(void)
+{
+    if (!(cpage_cache = mm_cache_create(sizeof(cpage_t))))
+        kpanic("failed to initialize slab cache for cached pages!");
+
+    list_init(&__pc_lru);
+    spin_init(&__pc_lru_lock);
+
+    __pc_shrinker.scan = __pc_scan;
+    mm_register_shrinker(&__pc_shrinker);
+}
+
+/* set `flags` of a cached page, return false if the page isn't cached */
+static bool __page_set_flags(address_space_t *mapping, uint64_t index, uint32_t flags)
+{
+    cpage_t *page;
+
+    spin_lock(&mapping->lock);
+
+    if ((page = radix_lookup(&mapping->pages, index)))
+        page->flags |= flags;
+
+    spin_unlock(&mapping->lock);
+
+    return page != NULL;
+}
+
+/* read page `index` of `file` into the cache
+ *
+ * return 0 on success
+ * return -EEXIST if the page is cached already
+ * return -errno on error */
+static int __page_fill(file_t *file, uint64_t index, uint32_t flags)
+{
+    address_space_t *mapping = __mapping(file);
+    cpage_t *page;
+    int ret;
+
+    spin_lock(&mapping->lock);
+    page = radix_lookup(&mapping->pages, index);
+    spin_unlock(&mapping->lock);
+
+    if (page)
+        return -EEXIST;
+
+    if (!(page = mm_cache_alloc_entry(cpage_cache)))
+        return -ENOMEM;
+
+    if ((page->phys = mm_block_try_alloc(MM_ZONE_NORMAL, 0, 0)) == INVALID_ADDRESS) {
+        (void)mm_cache_free_entry(cpage_cache, page);
+        return -ENOMEM;
+    }
+
+    page->index   = index;
+    page->flags   = flags;
+    page->mapping = mapping;
+    list_init(&page->lru);
+
+    if ((ret = file->f_ops->readpage(file, index, __page_data(page))) < 0) {
+        __page_free(page);
+        return ret;
+    }
+
+    spin_lock(&mapping->lock);
+
+    // -EEXIST if another reader cached the page first
+    if ((ret = radix_insert(&mapping->pages, index, page)) < 0) {
+        spin_unlock(&mapping->lock);
+        __page_free(page);
+        return ret;
+    }
+
+    mapping->nrpages++;
+
+    spin_lock(&__pc_lru_lock);
+    list_append(&__pc_lru, &page->lru);
+    spin_unlock(&__pc_lru_lock);
+
+    spin_unlock(&mapping->lock);
+
+    STAT_ADD(pages, 1);
+    return 0;
+}
+
+/* read `nr` pages from `start` ahead, reading page `mark` later starts the next window
+ *
+ * readahead stops at the first error, the pages are then read when they're needed */
+static void __readahead(file_t *file, uint64_t start, uint32_t nr, uint64_t mark)
+{
+    uint64_t end = MIN(start + nr, __nr_pages(file->f_dentry->d_inode));
+    int ret;
+
+    for (uint64_t index = start; index < end; ++index) {
+        uint32_t flags = (index == mark) ? CPAGE_READAHEAD : 0;
+
+        if ((ret = __page_fill(file, index, flags | CPAGE_UNUSED_RA)) == 0)
+            STAT_ADD(ra_pages, 1);
+        else if (ret != -EEXIST)
+            break;
+        else if (flags)
+            (void)__page_set_flags(__mapping(file), index, flags);
+    }
+}
+
+static inline uint32_t __ra_next_size(uint32_t size)
+{
+    return size ? MIN(size * 2, PAGECACHE_RA_MAX) : PAGECACHE_RA_INIT;
+}
+
+/* page `index` wasn't cached, read it and the window after it if the file is read sequentially */
+static int __ra_sync(file_t *file, uint64_t index)
+{
+    ra_state_t *ra = &file->f_ra;
+    int ret;
+
+    if ((ret = __page_fill(file, index, 0)) < 0 && ret != -EEXIST)
+        return ret;
+
+    // a random read doesn't read ahead and starts over
+    if (!(index == ra->prev + 1 || (index == 0 && !ra->size))) {
+        ra->size = 0;
+        return 0;
+    }
+
+    ra->start      = index;
+    ra->size       = __ra_next_size(ra->size);
+    ra->async_size = ra->size / 2;
+
+    __readahead(file, index + 1, ra->size - 1, ra->start + ra->size - ra->async_size);
+    return 0;
+}
+
+/* the reader reached the marked page `index`, read the next window before it's needed */
+static void __ra_async(file_t *file, uint64_t index)
+{
+    ra_state_t *ra = &file->f_ra;
+
+    // the mark may have been left by another file
+    if (index >= ra->start && index < ra->start + ra->size)
+        ra->start += ra->size;
+    else
+        ra->start = index + 1;
+
+    ra->size       = __ra_next_size(ra->size);
+    ra->async_size = ra->size;
+
+    __readahead(file, ra->start, ra->size, ra->start);
+}
+
+/* copy `len` bytes at `off` of page `index` to `buf` */
+static int __page_read(file_t *file, uint64_t index, size_t off, size_t len, void *buf)
+{
+    address_space_t *mapping = __mapping(file);
+    uint32_t flags = 0;
+    cpage_t *page;
+    int tries, ret;
+
+    for (tries = 0; tries < PAGECACHE_READ_TRIES; ++tries) {
+        spin_lock(&mapping->lock);
+
+        if ((page = radix_lookup(&mapping->pages, index))) {
+            flags        = page->flags;
+            page->flags |= CPAGE_REFERENCED;
+            page->flags &= ~(CPAGE_READAHEAD | CPAGE_UNUSED_RA);
+
+            kmemcpy(buf, (uint8_t *)__page_data(page) + off, len);
+        }
+
+        spin_unlock(&mapping->lock);
+
+        if (page)
+            break;
+
+        if ((ret = __ra_sync(file, index)) < 0)
+            return ret;
+    }
+
+    if (!page)
+        return -ENOMEM;
+
+    STAT_ADD(hits,   tries == 0);
+    STAT_ADD(misses, tries != 0);
+
+    if (flags & CPAGE_UNUSED_RA)
+        STAT_ADD(ra_hits, 1);
+
+    if (flags & CPAGE_READAHEAD)
+        __ra_async(file, index);
+
+    file->f_ra.prev = index;
+    return 0;
+}
+
+ssize_t pagecache_read(file_t *file, off_t offset, size_t size, void *buffer)
+{
+    if (!file || !buffer || !file->f_dentry || !file->f_dentry->d_inode)
+        return -EINVAL;
+
+    if (!file->f_ops->readpage)
+        return -ENOSYS;
+
+    inode_t *ino = file->f_dentry->d_inode;
+    size_t done  = 0;
+    off_t pos;
+    int ret;
+
+    // `offset` is relative to the file position like in the `read()` of the file systems
+    if ((ret = file->f_ops->seek ? file->f_ops->seek(file, offset) : file_generic_seek(file, offset)) < 0)
+        return ret;
+
+    if (size > (size_t)(ino->i_size - file->f_pos))
+        return -E2BIG;
+
+    for (pos = file->f_pos; done < size; ) {
+        size_t off = pos & (PAGE_SIZE - 1);
+        size_t len = MIN(PAGE_SIZE - off, size - done);
+
+        if ((ret = __page_read(file, pos >> PAGE_SHIFT, off, len, (uint8_t *)buffer + done)) < 0)
+            return ret;
+
+        done += len;
+        pos  += len;
+    }
+
+    return size;
+}
+
+static void __truncate_page(void *item, void *arg)
+{
+    (void)arg;
+
+    cpage_t *page = item;
+
+    spin_lock(&__pc_lru_lock);
+    list_remove(&page->lru);
+    spin_unlock(&__pc_lru_lock);
+
+    __page_free(page);
+    STAT_ADD(pages, -1);
+}
+
+void pagecache_truncate(address_space_t *mapping)
+{
+    if (!mapping)
+        return;
+
+    spin_lock(&mapping->lock);
+
+    radix_destroy(&mapping->pages, __truncate_page, NULL);
+    mapping->nrpages = 0;
+
+    spin_unlock(&mapping->lock);
+}
+
+size_t pagecache_shrink(size_t nr)
+{
+    // every page gets a second chance, the rest may be locked by the caller
+    size_t limit = 2 * __atomic_load_n(&__pc_stats.pages, __ATOMIC_RELAXED);
+    size_t freed = 0;
+
+    for (size_t scanned = 0; freed < nr && scanned < limit; ++scanned) {
+        spin_lock(&__pc_lru_lock);
+
+        if (__pc_lru.prev == &__pc_lru) {
+            spin_unlock(&__pc_lru_lock);
+            break;
+        }
+
+        cpage_t *page            = container_of(__pc_lru.prev, cpage_t, lru);
+        address_space_t *mapping = page->mapping;
+
+        list_remove(&page->lru);
+
+        if (!spin_trylock(&mapping->lock)) {
+            list_append(&__pc_lru, &page->lru);
+            spin_unlock(&__pc_lru_lock);
+            continue;
+        }
+
+        if (page->flags & CPAGE_REFERENCED) {
+            page->flags &= ~CPAGE_REFERENCED;
+            list_append(&__pc_lru, &page->lru);
+            spin_unlock(&mapping->lock);
+            spin_unlock(&__pc_lru_lock);
+            continue;
+        }
+
+        (void)radix_delete(&mapping->pages, page->index);
+        mapping->nrpages--;
+
+        spin_unlock(&mapping->lock);
+        spin_unlock(&__pc_lru_lock);
+
+        __page_free(page);
+        STAT_ADD(evictions, 1);
+        STAT_ADD(pages, -1);
+        freed++;
+    }
+
+    return freed;
+}
+
+void pagecache_stats(pagecache_stats_t *stats)
+{
+    stats->hits      = __atomic_load_n(&__pc_stats.hits,      __ATOMIC_RELAXED);
+    stats->misses    = __atomic_load_n(&__pc_stats.misses,    __ATOMIC_RELAXED);
+    stats->ra_pages  = __atomic_load_n(&__pc_stats.ra_pages,  __ATOMIC_RELAXED);
+    stats->ra_hits   = __atomic_load_n(&__pc_stats.ra_hits,   __ATOMIC_RELAXED);
+    stats->evictions = __atomic_load_n(&__pc_stats.evictions, __ATOMIC_RELAXED);
+    stats->pages     = __atomic_load_n(&__pc_stats.pages,     __ATOMIC_RELAXED);
+}
+
+void pagecache_dump_stats(void)
+{
+    pagecache_stats_t stats;
+
+    pagecache_stats(&stats);
+
+    uint64_t total = stats.hits + stats.misses;
+    uint64_t ra    = stats.ra_pages ? stats.ra_pages : 1;
+
+    kprint("pagecache - page reads %u: hit %u%%, miss %u%%\n", total,
+           stats.hits * 100 / (total ? total : 1), stats.misses * 100 / (total ? total : 1));
+    kprint("pagecache - readahead %u pages, %u%% of them used\n", stats.ra_pages, stats.ra_hits * 100 / ra);
+    kprint("pagecache - %u pages cached, %u evictions\n", stats.pages, stats.evictions);
+}
@@ -6,6 +6,7 @@
 #include <kernel/compiler.h>
 #include <kernel/kprint.h>
 #include <kernel/util.h>
+#include <lib/ring.h>
 #include <mm/heap.h>
 #include <mm/slab.h>
 #include <errno.h>
@@ -13,9 +14,7 @@
 struct pipe {
     file_t *file;    // underlying file object of the pipe
 
-    void *mem;       // buffer holding the pipe data
-    size_t size;     // size of the pipe in bytes
-    size_t ptr;      // read/write ptr of the pipe
+    ring_t *ring;    // byte ring holding the pipe data
 
     size_t nreaders; // number of readers on this pipe
     size_t nwriters; // number of writers on this pipe
@@ -31,22 +30,8 @@ static ssize_t __read(file_t *file, off_t offset, size_t size, void *buffer)
         return -EINVAL;
 
     pipe_t *pipe = file->f_private;
-    size_t nread = 0;
 
-	if (!READ_ONCE(pipe->ptr))
-        return 0;
-
-    nread = (size < pipe->ptr) ? size : pipe->ptr;
-    kmemcpy(buffer, pipe->mem, nread);
-
-    if (size >= pipe->ptr) {
-        pipe->ptr = 0;
-    } else {
-        kmemmove(pipe->mem, (uint8_t *)pipe->mem + size, pipe->ptr - nread);
-        pipe->ptr = size + pipe->ptr - nread;
-    }
-
-    return nread;
+    return ring_dequeue(pipe->ring, buffer, MIN(size, ring_capacity(pipe->ring)));
 }
 
 static ssize_t __write(file_t *file, off_t offset, size_t size, void *buffer)
@@ -58,11 +43,14 @@ static ssize_t __write(file_t *file, off_t offset, size_t size, void *buffer)
 
     pipe_t *pipe = file->f_private;
 
-    if (pipe->size - pipe->ptr < size)
+    // a write larger than the whole pipe never fits, checked before the size
+    // is narrowed to the ring's record count
+    if (size > ring_capacity(pipe->ring))
         return -ENOSPC;
 
-    kmemcpy((uint8_t *)pipe->mem + pipe->ptr, buffer, size);
-    pipe->ptr += size;
+    // all or nothing
+    if (!ring_enqueue_bulk(pipe->ring, buffer, size))
+        return -ENOSPC;
 
     return size;
 }
@@ -126,7 +114,7 @@ pipe_t *pipe_create(size_t size)
         return NULL;
 
     if (!(pipe->file = file_generic_alloc()))
-        return NULL;
+        goto error_pipe;
 
     pipe->file->f_ops->open  = __open;
     pipe->file->f_ops->close = __close;
@@ -137,11 +125,23 @@ pipe_t *pipe_create(size_t size)
     pipe->file->f_private           = pipe;
     pipe->file->f_dentry->d_private = pipe;
 
-    pipe->mem  = kmalloc(size);
-    pipe->size = size;
-    pipe->ptr  = 0;
+    /* writers may be in interrupt context, the ring needs no lock for that */
+    size_t count = 1;
+
+    while (count < size)
+        count <<= 1;
+
+    if (!(pipe->ring = ring_alloc(count, 1, RING_MPSC)))
+        goto error_file;
 
     return pipe;
+
+error_file:
+    (void)file_generic_dealloc(pipe->file);
+
+error_pipe:
+    (void)mm_cache_free_entry(p_cache, pipe);
+    return NULL;
 }
 
 int pipe_open(pipe_t *pipe, int mode)
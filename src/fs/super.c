@@ -87,14 +87,35 @@ superblock_t *super_get_sb_nodev(
     int (*fill_super)(superblock_t *)
 )
 {
-    (void)dev, (void)flags, (void)data, (void)fill_super;
+    (void)dev, (void)data;
 
-    if (!type) {
+    superblock_t *sb = NULL;
+    int ret          = 0;
+
+    if (!type || !fill_super) {
         errno = EINVAL;
         return NULL;
     }
 
-    return NULL;
+    // every mount gets a superblock of its own
+    if (!(sb = alloc_generic_sb())) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    sb->s_type = type;
+
+    if ((ret = fill_super(sb)) < 0) {
+        super_free_sb(sb);
+        errno = -ret;
+        return NULL;
+    }
+
+    sb->s_flags = flags;
+    sb->s_bdev  = NULL;
+    sb->s_dev   = MAKE_DEV(0, devfs_alloc_minor(0));
+
+    return sb;
 }
 
 superblock_t *super_get_sb_bdev(
@@ -114,3 +135,12 @@ superblock_t *super_get_sb_bdev(
 
     return NULL;
 }
+
+void super_free_sb(superblock_t *sb)
+{
+    if (!sb)
+        return;
+
+    (void)mm_cache_free_entry(sb_ops_cache, sb->s_ops);
+    (void)mm_cache_free_entry(sb_cache, sb);
+}
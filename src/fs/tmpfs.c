@@ -0,0 +1,572 @@
+#include <arch/amd64/mmu.h>
+#include <fs/dentry.h>
+#include <fs/fs.h>
+#include <fs/super.h>
+#include <fs/tmpfs.h>
+#include <kernel/common.h>
+#include <kernel/lock.h>
+#include <kernel/util.h>
+#include <lib/hashmap.h>
+#include <lib/radix.h>
+#include <mm/heap.h>
+#include <mm/page.h>
+#include <mm/types.h>
+#include <errno.h>
+#include <stdbool.h>
+
+// tmpfs keeps everything in memory
+//
+// Directories are the dentry tree itself: every file is a dentry linked to its parent
+// and there's nothing below the tree to look names up from. The data of a regular file
+// is stored in pages of the page allocator indexed by a radix tree of the inode. A page
+// is allocated when it's first written so a hole reads as zeros without taking memory.
+// The pages belong to the file until it's truncated or removed, they're not cached
+// pages and the shrinkers never see them.
+//
+// The bytes of a page past the end of the file are always zero, a new page is zeroed
+// and truncate clears the tail of the last page, so a file that grows reads zeros
+
+#define TMPFS_MAGIC 0x01021994
+
+typedef struct tmpfs_inode {
+    spinlock_t   lock;    // protects the pages and the size of the inode
+    radix_tree_t pages;   // page index -> page (virtual address)
+    size_t       nrpages;
+} tmpfs_inode_t;
+
+#define GET_INO_PRIVATE(ino) ((tmpfs_inode_t *)(ino)->i_private)
+
+static file_t *tmpfs_file_open(dentry_t *dntr, int mode);
+static int tmpfs_file_close(file_t *file);
+static int tmpfs_file_seek(file_t *file, off_t offset);
+static ssize_t tmpfs_file_read(file_t *file, off_t offset, size_t count, void *buf);
+static ssize_t tmpfs_file_write(file_t *file, off_t offset, size_t count, void *buf);
+
+static inode_t *tmpfs_inode_lookup(dentry_t *parent, char *name);
+static int tmpfs_create(dentry_t *dir, dentry_t *dntr, int mode, path_t *path);
+static int tmpfs_unlink(dentry_t *dir, dentry_t *dntr);
+static int tmpfs_mkdir(dentry_t *dir, dentry_t *dntr, int mode);
+static int tmpfs_rmdir(dentry_t *dir, dentry_t *dntr);
+static int tmpfs_rename(dentry_t *old_dir, dentry_t *old_dntr, dentry_t *new_dir, dentry_t *new_dntr);
+static int tmpfs_truncate(inode_t *ino);
+
+static void *__page_alloc(void)
+{
+    uint64_t paddr;
+    void *page;
+
+    if ((paddr = mm_block_try_alloc(MM_ZONE_NORMAL, 0, 0)) == INVALID_ADDRESS)
+        return NULL;
+
+    page = amd64_p_to_v(paddr);
+    kmemset(page, 0, PAGE_SIZE);
+
+    return page;
+}
+
+static void __page_free(void *page, void *arg)
+{
+    (void)arg;
+    (void)mm_block_free(amd64_v_to_p(page), 0);
+}
+
+static inode_t *__inode_alloc(superblock_t *sb, uint32_t flags)
+{
+    tmpfs_inode_t *priv = NULL;
+    inode_t *ino        = NULL;
+
+    if (!(priv = kzalloc(sizeof(tmpfs_inode_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (!(ino = inode_generic_alloc(flags))) {
+        kfree(priv);
+        return NULL;
+    }
+
+    spin_init(&priv->lock);
+    radix_init(&priv->pages);
+
+    ino->i_uid     = 0;
+    ino->i_gid     = 0;
+    ino->i_size    = 0;
+    ino->i_sb      = sb;
+    ino->i_private = priv;
+
+    kmemset(ino->i_iops, 0, sizeof(inode_ops_t));
+    kmemset(ino->i_fops, 0, sizeof(file_ops_t));
+
+    if (flags & T_IFDIR) {
+        ino->i_iops->lookup = tmpfs_inode_lookup;
+        ino->i_iops->create = tmpfs_create;
+        ino->i_iops->unlink = tmpfs_unlink;
+        ino->i_iops->mkdir  = tmpfs_mkdir;
+        ino->i_iops->rmdir  = tmpfs_rmdir;
+        ino->i_iops->rename = tmpfs_rename;
+    } else {
+        ino->i_iops->truncate = tmpfs_truncate;
+
+        ino->i_fops->open  = tmpfs_file_open;
+        ino->i_fops->close = tmpfs_file_close;
+        ino->i_fops->seek  = tmpfs_file_seek;
+        ino->i_fops->read  = tmpfs_file_read;
+        ino->i_fops->write = tmpfs_file_write;
+    }
+
+    list_append(&sb->s_ino, &ino->i_list);
+
+    return ino;
+}
+
+// free the inode and its pages, the last dentry of the inode is gone
+static int __inode_destroy(inode_t *ino)
+{
+    tmpfs_inode_t *priv = GET_INO_PRIVATE(ino);
+
+    radix_destroy(&priv->pages, __page_free, NULL);
+    kfree(priv);
+
+    list_remove(&ino->i_list);
+
+    return inode_generic_dealloc(ino);
+}
+
+// set the size of the file to `size` and free the pages past it
+static void __truncate(inode_t *ino, int size)
+{
+    tmpfs_inode_t *priv = GET_INO_PRIVATE(ino);
+    uint64_t index      = ((uint64_t)size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    size_t tail         = size & (PAGE_SIZE - 1);
+    void *page;
+
+    spin_lock(&priv->lock);
+
+    ino->i_size = size;
+
+    if (tail && (page = radix_lookup(&priv->pages, size >> PAGE_SHIFT)))
+        kmemset((char *)page + tail, 0, PAGE_SIZE - tail);
+
+    while ((page = radix_next(&priv->pages, index, &index))) {
+        (void)radix_delete(&priv->pages, index);
+        __page_free(page, NULL);
+        priv->nrpages--;
+    }
+
+    spin_unlock(&priv->lock);
+}
+
+// copy `len` bytes of page `index` at `off` to `dst`, a hole is read as zeros
+static void __page_read(inode_t *ino, uint64_t index, size_t off, size_t len, char *dst)
+{
+    tmpfs_inode_t *priv = GET_INO_PRIVATE(ino);
+    void *page;
+
+    spin_lock(&priv->lock);
+
+    if ((page = radix_lookup(&priv->pages, index)))
+        kmemcpy(dst, (char *)page + off, len);
+    else
+        kmemset(dst, 0, len);
+
+    spin_unlock(&priv->lock);
+}
+
+// copy `len` bytes from `src` to page `index` at `off`, the page is allocated if
+// it's a hole and the file is extended if the write ends past it
+static int __page_write(inode_t *ino, uint64_t index, size_t off, size_t len, const char *src)
+{
+    tmpfs_inode_t *priv = GET_INO_PRIVATE(ino);
+    int end             = (index << PAGE_SHIFT) + off + len;
+    void *page, *new    = NULL;
+    int ret;
+
+    spin_lock(&priv->lock);
+
+    if (!(page = radix_lookup(&priv->pages, index))) {
+        spin_unlock(&priv->lock);
+
+        if (!(new = __page_alloc()))
+            return -ENOSPC;
+
+        spin_lock(&priv->lock);
+
+        // another writer may have filled the hole in the meantime
+        if (!(page = radix_lookup(&priv->pages, index))) {
+            if ((ret = radix_insert(&priv->pages, index, new)) < 0) {
+                spin_unlock(&priv->lock);
+                __page_free(new, NULL);
+                return ret;
+            }
+
+            page = new;
+            new  = NULL;
+            priv->nrpages++;
+        }
+    }
+
+    kmemcpy((char *)page + off, src, len);
+
+    if (end > ino->i_size)
+        ino->i_size = end;
+
+    spin_unlock(&priv->lock);
+
+    if (new)
+        __page_free(new, NULL);
+
+    return 0;
+}
+
+static ssize_t tmpfs_file_read(file_t *file, off_t offset, size_t count, void *buf)
+{
+    inode_t *ino;
+    size_t done, len;
+    int ret;
+
+    if (!file || !buf)
+        return -EINVAL;
+
+    ino = file->f_dentry->d_inode;
+
+    if ((ret = tmpfs_file_seek(file, offset)) < 0)
+        return ret;
+
+    if ((off_t)count > ino->i_size - file->f_pos)
+        return -E2BIG;
+
+    for (done = 0; done < count; done += len) {
+        off_t pos  = file->f_pos + done;
+        size_t off = pos & (PAGE_SIZE - 1);
+
+        len = MIN(PAGE_SIZE - off, count - done);
+        __page_read(ino, pos >> PAGE_SHIFT, off, len, (char *)buf + done);
+    }
+
+    return count;
+}
+
+static ssize_t tmpfs_file_write(file_t *file, off_t offset, size_t count, void *buf)
+{
+    inode_t *ino;
+    size_t done, len;
+    int ret = 0;
+
+    if (!file || !buf)
+        return -EINVAL;
+
+    if (!(file->f_mode & (O_WRONLY | O_RDWR)))
+        return -EINVAL;
+
+    ino = file->f_dentry->d_inode;
+
+    if (file->f_mode & O_APPEND)
+        offset = ino->i_size - file->f_pos;
+
+    if ((ret = tmpfs_file_seek(file, offset)) < 0)
+        return ret;
+
+    // the size of an inode is an int
+    if ((off_t)count > INT32_MAX - file->f_pos)
+        return -E2BIG;
+
+    for (done = 0; done < count; done += len) {
+        off_t pos  = file->f_pos + done;
+        size_t off = pos & (PAGE_SIZE - 1);
+
+        len = MIN(PAGE_SIZE - off, count - done);
+
+        if ((ret = __page_write(ino, pos >> PAGE_SHIFT, off, len, (char *)buf + done)) < 0)
+            break;
+    }
+
+    return done ? (ssize_t)done : ret;
+}
+
+// unlike file_generic_seek(), the position may be past the end of the file,
+// a write there leaves a hole behind it
+static int tmpfs_file_seek(file_t *file, off_t offset)
+{
+    if (!file)
+        return -EINVAL;
+
+    if (file->f_pos < -offset || offset > INT32_MAX - file->f_pos)
+        return -ESPIPE;
+
+    file->f_pos += offset;
+    return 0;
+}
+
+static file_t *tmpfs_file_open(dentry_t *dntr, int mode)
+{
+    file_t *file = NULL;
+
+    if (!dntr || !dntr->d_inode) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!(dntr->d_inode->i_flags & T_IFREG)) {
+        errno = EISDIR;
+        return NULL;
+    }
+
+    if (!(file = file_generic_alloc()))
+        return NULL;
+
+    file->f_pos     = 0;
+    file->f_count   = 1;
+    file->f_mode    = mode;
+    file->f_dentry  = dntr;
+    file->f_private = NULL;
+    *file->f_ops    = *dntr->d_inode->i_fops;
+    dentry_get(dntr);
+
+    if ((mode & O_TRUNC) && (mode & (O_WRONLY | O_RDWR)))
+        __truncate(dntr->d_inode, 0);
+
+    return file;
+}
+
+static int tmpfs_file_close(file_t *file)
+{
+    if (!file)
+        return -EINVAL;
+
+    return file_generic_dealloc(file);
+}
+
+static int tmpfs_truncate(inode_t *ino)
+{
+    if (!ino || !(ino->i_flags & T_IFREG))
+        return -EINVAL;
+
+    __truncate(ino, ino->i_size);
+    return 0;
+}
+
+// every file is in the dentry tree, a name that isn't there doesn't exist
+static inode_t *tmpfs_inode_lookup(dentry_t *parent, char *name)
+{
+    (void)parent, (void)name;
+
+    errno = ENOENT;
+    return NULL;
+}
+
+// give the new dentry `dntr` of `dir` an inode of type `type`
+static int __instantiate(dentry_t *dir, dentry_t *dntr, uint32_t type)
+{
+    inode_t *ino = NULL;
+
+    if (!dir || !dir->d_inode || !dntr || dntr->d_inode || dntr->d_parent != dir)
+        return -EINVAL;
+
+    if (!(dntr->d_flags & type))
+        return -EINVAL;
+
+    if (!(ino = __inode_alloc(dir->d_inode->i_sb, type)))
+        return -errno;
+
+    // the reference the inode was allocated with belongs to the dentry
+    dntr->d_inode = ino;
+    return 0;
+}
+
+// remove `dntr` from the tree and free its inode, the VFS's reference goes with it
+static int __release(dentry_t *dntr)
+{
+    inode_t *ino = dntr->d_inode;
+    int ret;
+
+    if (dntr->d_flags & DNTR_MOUNTPOINT)
+        return -EBUSY;
+
+    if ((ret = dentry_dealloc_pinned(dntr, 1)) < 0)
+        return ret;
+
+    if (ino && ino->i_count <= 0)
+        return __inode_destroy(ino);
+
+    return 0;
+}
+
+// negative dentries of the names looked up from `dntr` hold references to it,
+// they go away with the directory
+static int __release_dir(dentry_t *dntr)
+{
+    if (hm_get_size(dntr->d_children) > 2)
+        return -ENOTEMPTY;
+
+    (void)dentry_cache_prune(dntr);
+
+    return __release(dntr);
+}
+
+static int tmpfs_create(dentry_t *dir, dentry_t *dntr, int mode, path_t *path)
+{
+    (void)mode, (void)path;
+
+    return __instantiate(dir, dntr, T_IFREG);
+}
+
+static int tmpfs_mkdir(dentry_t *dir, dentry_t *dntr, int mode)
+{
+    (void)mode;
+
+    return __instantiate(dir, dntr, T_IFDIR);
+}
+
+static int tmpfs_unlink(dentry_t *dir, dentry_t *dntr)
+{
+    if (!dir || !dntr || !dntr->d_inode || dntr->d_parent != dir)
+        return -EINVAL;
+
+    if (dntr->d_inode->i_flags & T_IFDIR)
+        return -EISDIR;
+
+    return __release(dntr);
+}
+
+static int tmpfs_rmdir(dentry_t *dir, dentry_t *dntr)
+{
+    if (!dir || !dntr || !dntr->d_inode || dntr->d_parent != dir)
+        return -EINVAL;
+
+    if (!(dntr->d_inode->i_flags & T_IFDIR))
+        return -ENOTDIR;
+
+    return __release_dir(dntr);
+}
+
+static int tmpfs_rename(dentry_t *old_dir, dentry_t *old_dntr, dentry_t *new_dir, dentry_t *new_dntr)
+{
+    char name[DENTRY_NAME_MAXLEN];
+    inode_t *old, *new;
+    int ret;
+
+    if (!old_dir || !old_dntr || !new_dir || !new_dntr || !(old = old_dntr->d_inode))
+        return -EINVAL;
+
+    if (old_dntr->d_parent != old_dir || !new_dir->d_children)
+        return -EINVAL;
+
+    if (old_dntr == new_dntr)
+        return 0;
+
+    if (old_dntr->d_flags & DNTR_MOUNTPOINT)
+        return -EBUSY;
+
+    // a directory can't be moved below itself
+    for (dentry_t *iter = new_dir; iter; iter = iter->d_parent) {
+        if (iter == old_dntr)
+            return -EINVAL;
+    }
+
+    // without a target `new_dntr` only carries the name
+    if (!(new = new_dntr->d_inode)) {
+        kstrncpy(name, new_dntr->d_name, DENTRY_NAME_MAXLEN);
+        return dentry_move(old_dntr, new_dir, name);
+    }
+
+    // an existing target is replaced by the file that's moved, everything that
+    // can fail is checked before it's touched
+    if (new_dntr->d_parent != new_dir)
+        return -EINVAL;
+
+    if ((old->i_flags & T_IFDIR) && !(new->i_flags & T_IFDIR))
+        return -ENOTDIR;
+
+    if (!(old->i_flags & T_IFDIR) && (new->i_flags & T_IFDIR))
+        return -EISDIR;
+
+    if (new_dntr->d_flags & DNTR_MOUNTPOINT)
+        return -EBUSY;
+
+    if (new->i_flags & T_IFDIR) {
+        if (hm_get_size(new_dntr->d_children) > 2)
+            return -ENOTEMPTY;
+
+        (void)dentry_cache_prune(new_dntr);
+    }
+
+    // the target is only freed once the moved file has taken its place
+    if ((ret = dentry_replace(old_dntr, new_dntr, 1)) < 0)
+        return ret;
+
+    if (new->i_count <= 0)
+        return __inode_destroy(new);
+
+    return 0;
+}
+
+static int tmpfs_fill_super(superblock_t *sb)
+{
+    inode_t *ino = NULL;
+
+    if (!sb)
+        return -EINVAL;
+
+    sb->s_blocksize = PAGE_SIZE;
+    sb->s_count     = 1;
+    sb->s_dirty     = 0;
+    sb->s_magic     = TMPFS_MAGIC;
+    sb->s_private   = NULL;
+
+    list_init(&sb->s_ino);
+    list_init(&sb->s_ino_dirty);
+    list_init(&sb->s_instances);
+
+    if (!(sb->s_root = dentry_alloc_orphan("tmpfs", T_IFDIR)))
+        return -errno;
+
+    if (!(ino = __inode_alloc(sb, T_IFDIR))) {
+        (void)dentry_dealloc(sb->s_root);
+        return -errno;
+    }
+
+    sb->s_root->d_inode = ino;
+
+    sb->s_ops->destroy_inode = __inode_destroy;
+    sb->s_ops->alloc_inode   = NULL;
+    sb->s_ops->read_inode    = NULL;
+    sb->s_ops->delete_inode  = NULL;
+    sb->s_ops->write_super   = NULL;
+    sb->s_ops->dirty_inode   = NULL;
+    sb->s_ops->write_inode   = NULL;
+    sb->s_ops->put_inode     = NULL;
+    sb->s_ops->put_super     = NULL;
+    sb->s_ops->sync_fs       = NULL;
+
+    return 0;
+}
+
+superblock_t *tmpfs_get_sb(fs_type_t *type, char *dev, int flags, void *data)
+{
+    return super_get_sb_nodev(type, dev, flags, data, tmpfs_fill_super);
+}
+
+// only an empty file system can be released, its files are freed by unlink and rmdir
+int tmpfs_kill_sb(superblock_t *sb)
+{
+    inode_t *ino = NULL;
+    int ret;
+
+    if (!sb)
+        return -EINVAL;
+
+    if (sb->s_count > 1 || hm_get_size(sb->s_root->d_children) > 2)
+        return -EBUSY;
+
+    (void)dentry_cache_prune(sb->s_root);
+
+    ino = sb->s_root->d_inode;
+
+    if ((ret = dentry_dealloc(sb->s_root)) < 0)
+        return ret;
+
+    (void)__inode_destroy(ino);
+    super_free_sb(sb);
+
+    return 0;
+}
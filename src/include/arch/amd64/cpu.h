@@ -9,6 +9,20 @@ typedef struct task task_t;
 #define FS_BASE   0xC0000100
 #define GS_BASE   0xC0000101
 #define KGS_BASE  0xC0000102
+#define IA32_PAT  0x00000277
+
+#define RFLAGS_IF (1 << 9)
+
+/* CPUID leaf 0x1, EDX */
+#define CPUID_EDX_PGE  (1 << 13)
+#define CPUID_EDX_PAT  (1 << 16)
+
+/* CPUID leaf 0x7, subleaf 0 */
+#define CPUID_7_EBX_ERMS  (1 << 9)
+#define CPUID_7_EDX_FSRM  (1 << 4)
+
+/* CPUID leaf 0x80000001, EDX */
+#define CPUID_EXT_EDX_1GB  (1 << 26)
 
 typedef struct cpu_state {
     uint64_t rax, rcx, rdx, rbx, rbp, rsi, rdi;
@@ -27,6 +41,44 @@ static inline void enable_irq(void)
     asm volatile ("sti" ::: "memory");
 }
 
+/* Host tests (see test/host) build with CONFIG_HOSTED: they run in user mode
+ * where `cli` and `sti` fault, so interrupts are only reported as disabled */
+#ifdef CONFIG_HOSTED
+static inline uint64_t disable_irq_save(void)
+{
+    return 0;
+}
+
+static inline void restore_irq(uint64_t flags)
+{
+    (void)flags;
+}
+#else
+/* disable interrupts and return the previous RFLAGS */
+static inline uint64_t disable_irq_save(void)
+{
+    uint64_t flags;
+    asm volatile ("pushfq\n\tpopq %0\n\tcli" : "=r"(flags) :: "memory");
+
+    return flags;
+}
+
+/* enable interrupts if they were enabled in `flags` */
+static inline void restore_irq(uint64_t flags)
+{
+    if (flags & RFLAGS_IF)
+        enable_irq();
+}
+#endif
+
+static inline uint64_t get_tsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+
+    return ((uint64_t)hi) << 32 | lo;
+}
+
 static inline uint64_t get_sp(void)
 {
     uint64_t sp;
@@ -52,6 +104,20 @@ static inline void set_msr(uint32_t msr, uint64_t reg)
     );
 }
 
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+                         uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+    asm volatile ("cpuid"
+        : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+        : "a" (leaf), "c" (subleaf)
+    );
+}
+
+static inline void cpu_wbinvd(void)
+{
+    asm volatile ("wbinvd" ::: "memory");
+}
+
 static inline void cpu_relax(void)
 {
     asm volatile ("pause");
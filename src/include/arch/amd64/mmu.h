@@ -1,6 +1,8 @@
 #ifndef __AMD64_MMU_TYPES_H__
 #define __AMD64_MMU_TYPES_H__
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <kernel/kassert.h>
 
@@ -9,6 +11,32 @@
 #define KVSTART   0xffffffff80100000
 #define KPML4I    511
 
+/* start of the kernel half of the address space */
+#define KSPACE_START 0xffff800000000000
+
+/* end of the user half of the address space (exclusive) */
+#define USPACE_END   0x0000800000000000
+
+/* all physical memory reported by the memory map is mapped
+ * at `KDMSTART` (see `mm_native_init_direct_map()`)
+ *
+ * The direct map occupies exactly one PML4 entry which limits it to 512 GB
+ *
+ * Host tests (see test/host) build with their own `KDMSTART` that points
+ * to a user space mapping which acts as physical memory */
+#ifndef KDMSTART
+#define KDMSTART  0xffff880000000000
+#endif
+#define KDMSIZE   0x0000008000000000
+
+/* window for dynamic kernel mappings (MMIO, see `ioremap()`)
+ *
+ * like the direct map, this is one PML4 entry that is shared by all address spaces */
+#define KIOSTART  0xffffc80000000000
+#define KIOSIZE   0x0000008000000000
+
+#define CR4_PGE   (1 << 7)
+
 enum MM_PAGE_FLAGS {
     MM_NO_FLAGS   = 0,
     MM_PRESENT    = 1,
@@ -20,9 +48,42 @@ enum MM_PAGE_FLAGS {
     MM_ACCESSED   = 1 << 5,
     MM_SIZE_4MB   = 1 << 6,
     MM_2MB        = 1 << 7,
-    MM_COW        = 1 << 9
+    MM_1GB        = 1 << 7, /* same bit, set in a PDPT entry */
+    MM_GLOBAL     = 1 << 8,
+    MM_COW        = 1 << 9,
+    MM_BORROWED   = 1 << 10 /* the frame belongs to a mapped object, it's not freed on unmap */
+};
+
+/* Page attribute table
+ *
+ * IA32_PAT is reprogrammed at boot so that the PWT/PCD bits of a leaf entry
+ * select the following memory types:
+ *
+ *   PAT PCD PWT  index  type
+ *    0   0   0     0    write-back
+ *    0   0   1     1    write-combining (write-through by default)
+ *    0   1   0     2    uncached-minus
+ *    0   1   1     3    uncached
+ *
+ * Entries 4-7 keep their default values and are not used.
+ *
+ * Use one of the cache modes below instead of the raw PWT/PCD flags */
+#define MM_PAT_LAYOUT 0x0007040600070106
+
+enum MM_CACHE_MODES {
+    MM_WB       = 0,
+    MM_WC       = MM_WR_THROUGH,
+    MM_UC_MINUS = MM_D_CACHE,
+    MM_UC       = MM_WR_THROUGH | MM_D_CACHE,
 };
 
+/* physical address stored in a page table entry */
+#define MM_ENTRY_ADDR(e) ((e) & 0x000ffffffffff000)
+
+/* flags that are propagated to the PML4, PDPT and PD entries,
+ * everything else (global, cache control, etc.) only makes sense for leaves */
+#define MM_TABLE_FLAGS (MM_PRESENT | MM_READWRITE | MM_USER)
+
 static inline uint64_t amd64_get_cr3(void)
 {
     uint64_t address;
@@ -39,37 +100,166 @@ static inline void amd64_set_cr3(uint64_t address)
                   "mov %%rax, %%cr3" :: "r" (address));
 }
 
+static inline uint64_t amd64_get_cr4(void)
+{
+    uint64_t cr4;
+
+    asm volatile ("mov %%cr4, %0" : "=r" (cr4));
+
+    return cr4;
+}
+
+static inline void amd64_set_cr4(uint64_t cr4)
+{
+    asm volatile ("mov %0, %%cr4" :: "r" (cr4) : "memory");
+}
+
+/* flush all non-global TLB entries
+ *
+ * kernel mappings are global so they survive this flush */
 static inline void amd64_flush_tlb(void)
 {
     asm volatile ("mov %cr3, %rax \n"
                   "mov %rax, %cr3");
 }
 
-/* convert a physical address to a virtual address */
+/* flush all TLB entries, including the global ones
+ *
+ * toggling CR4.PGE is the only way to drop global entries without
+ * knowing their addresses so this should only be used when kernel mappings
+ * have been changed in a way that `amd64_invlpg()` can't handle */
+static inline void amd64_flush_tlb_all(void)
+{
+    uint64_t cr4 = amd64_get_cr4();
+
+    if (cr4 & CR4_PGE) {
+        amd64_set_cr4(cr4 & ~CR4_PGE);
+        amd64_set_cr4(cr4);
+    } else {
+        amd64_flush_tlb();
+    }
+}
+
+/* flush the TLB entry of `vaddr` (global or not) */
+static inline void amd64_invlpg(uint64_t vaddr)
+{
+    asm volatile ("invlpg (%0)" :: "r" (vaddr) : "memory");
+}
+
+/* convert a physical address to a virtual address
+ *
+ * the returned address points to the direct map so this is valid
+ * for every frame of the memory map once `mm_native_init_direct_map()` has been called */
 static inline uint64_t *amd64_p_to_v(uint64_t paddr)
 {
-    return (uint64_t *)(paddr + (KVSTART - KPSTART));
+    return (uint64_t *)(paddr + KDMSTART);
 }
 
+/* convert a virtual address of the direct map or the kernel image to a physical address */
 static inline uint64_t amd64_v_to_p(void *vaddr)
 {
-    kassert((uint64_t)vaddr > (KVSTART - KPSTART));
+    if ((uint64_t)vaddr > (KVSTART - KPSTART))
+        return ((uint64_t)vaddr - (KVSTART - KPSTART));
+
+    kassert((uint64_t)vaddr >= KDMSTART && (uint64_t)vaddr < KDMSTART + KDMSIZE);
 
-    return ((uint64_t)vaddr - (KVSTART - KPSTART));
+    return ((uint64_t)vaddr - KDMSTART);
 }
 
 // initialize the archictecture-specific page directories
+//
+// kernel mappings are marked global and CR4.PGE is enabled if the CPU
+// supports it so that CR3 switches don't throw away the kernel TLB entries
 int mm_native_init(void);
 
+// map all physical memory reported by the memory map to `KDMSTART`
+//
+// 1 GB pages are used where the CPU supports them and the range allows it,
+// 2 MB pages otherwise. The page directories are allocated from boot memory
+// so this must be called after `mm_bootmem_init()` and before anyone uses `amd64_p_to_v()`
+//
+// `arg` - pointer to multiboot2 information
+int mm_native_init_direct_map(void *arg);
+
+// return true if the direct map covers all of `len` bytes of physical memory at `paddr`
+//
+// only RAM and the ACPI ranges are direct mapped, see `mm_native_init_direct_map()`
+bool amd64_is_direct_mapped(uint64_t paddr, size_t len);
+
+// program the page attribute table of the calling CPU (see `MM_PAT_LAYOUT`)
+void mm_native_init_pat(void);
+
+// switch an application processor to the kernel page directory
+// and enable the same paging features that BSP uses
+void mm_native_init_ap(void);
+
 // map a physical address `paddr` point to virtual address 'vaddr'
-void amd64_map_page(uint64_t paddr, uint64_t vaddr, int flags);
+int amd64_map_page(uint64_t paddr, uint64_t vaddr, int flags);
+
+// unmap virtual address `vaddr` of the current address space
+//
+// page tables that become empty are freed, return the physical address
+// that `vaddr` was mapped to or INVALID_ADDRESS if it wasn't mapped
+uint64_t amd64_unmap_page(uint64_t vaddr);
+
+// unmap virtual address `vaddr` of address space `pml4`, see `amd64_unmap_page()`
+uint64_t amd64_unmap_page_from_dir(uint64_t *pml4, uint64_t vaddr);
+
+// return the leaf entry that maps `vaddr` in address space `pml4` or 0 if it's not mapped
+//
+// if `size` is not NULL, it's set to the size of the region that the entry maps,
+// or if `vaddr` is not mapped, to the size of the region that is known to be unmapped
+uint64_t amd64_lookup_page(uint64_t *pml4, uint64_t vaddr, size_t *size);
+
+// map 2 MB page `paddr` to virtual address `vaddr` of address space `pml4`
+//
+// return 0 on success
+// return -ENOMEM if a page table couldn't be allocated, nothing is mapped then
+int amd64_map_large_page_to_dir(uint64_t *pml4, uint64_t paddr, uint64_t vaddr, int flags);
+
+// replace the 2 MB mapping of `vaddr` with 512 4 KB mappings of the same memory
+void amd64_split_large_page(uint64_t *pml4, uint64_t vaddr);
+
+// replace the 4 KB mappings of the 2 MB window `vaddr` with one mapping of 2 MB page `paddr`
+//
+// the page table is reused so this can't fail, `put` is called with every frame
+// that was mapped in the window once it's no longer mapped
+void amd64_merge_large_page(uint64_t *pml4, uint64_t paddr, uint64_t vaddr, int flags,
+                            void (*put)(uint64_t paddr));
+
+// return the number of page-table pages used by the user half of address space `pml4`
+// (including the PML4 itself, the shared kernel-half tables are not counted)
+size_t amd64_dir_table_pages(uint64_t *pml4);
+
+// map `len` bytes of physical memory at `paddr` to `vaddr` in the kernel half
+//
+// the mapping is visible in all address spaces and it uses the largest pages
+// (1 GB, 2 MB or 4 KB) that the alignment of `paddr`, `vaddr` and `len` allows
+void amd64_map_kernel_range(uint64_t paddr, uint64_t vaddr, size_t len, int flags);
+
+// unmap the range mapped by `amd64_map_kernel_range()`
+void amd64_unmap_kernel_range(uint64_t vaddr, size_t len);
 
 // build page directory
+//
+// return NULL if the PML4 couldn't be allocated
 void *amd64_build_dir(void);
 
 // map a physical address `paddr` point to virtual address 'vaddr'
 // where `dir` points to a virtualized PML4 address
-void amd64_map_page_to_dir(uint64_t *pml4, uint64_t paddr, uint64_t vaddr, int flags);
+//
+// mappings in the kernel half of the address space are always global
+//
+// `flags` may contain one of the cache modes (`MM_WB`, `MM_WC`, `MM_UC_MINUS`, `MM_UC`)
+//
+// return 0 on success
+// return -ENOMEM if a page table couldn't be allocated, nothing is mapped then
+int amd64_map_page_to_dir(uint64_t *pml4, uint64_t paddr, uint64_t vaddr, int flags);
+
+// release page directory built with `amd64_build_dir()`
+//
+// the user half of the directory must be empty
+void amd64_destroy_dir(uint64_t *pml4);
 
 // duplicate page directory
 //
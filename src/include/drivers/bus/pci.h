@@ -27,6 +27,15 @@ enum PCI_OFFSETS {
     PCI_OFF_INT_PIN  = 0x3d
 };
 
+enum PCI_BAR_BITS {
+    PCI_BAR_IO       = 1 << 0,     /* I/O space BAR */
+    PCI_BAR_64BIT    = 1 << 2,     /* 64-bit memory BAR */
+    PCI_BAR_PREFETCH = 1 << 3,     /* prefetchable memory */
+};
+
+/* base address of a memory BAR, doesn't fit an enum constant */
+#define PCI_BAR_MEM_MASK 0xfffffff0U
+
 typedef struct pci_dev {
     uint16_t bus;
     uint16_t dev;
@@ -90,4 +99,15 @@ pci_irq_route_t *pci_alloc_route(void);
 pci_link_t *pci_alloc_link(void);
 uint8_t pci_find_irq_route(uint8_t bus, uint8_t dev, uint8_t pin);
 
+// return the physical base address of memory BAR `bar` (0 - 5) of `dev`
+//
+// a 64-bit BAR takes the high dword of its address from the BAR that follows it
+uint64_t pci_bar_address(pci_dev_t *dev, int bar);
+
+// return the cache mode that should be used to map memory BAR `bar` (0 - 5) of `dev`
+//
+// prefetchable BARs (framebuffers and the like) are mapped write-combining,
+// everything else is register space and must be uncached
+int pci_bar_cache_mode(pci_dev_t *dev, int bar);
+
 #endif /* __PCI_H__ */
@@ -17,6 +17,9 @@ int errno;
 #define ENXIO   12      /* No such device or address */
 #define EAGAIN  13      /* Try again */
 #define EFAULT  14      /* Bad address */
+#define ENOTEMPTY 15    /* Directory not empty */
+#define EISDIR  16      /* Is a directory */
+#define EXDEV   17      /* Cross-device link */
 #define EINPROGRESS 115 /* Operation now in progress */
 
 #define EMAX    13 /* Used by the kstrerror() */
@@ -3,6 +3,7 @@
 
 #include <fs/file.h>
 #include <lib/list.h>
+#include <mm/vma.h>
 #include <stdbool.h>
 
 typedef bool (*binfmt_loader_t)(file_t *, int, char **);
@@ -11,4 +12,17 @@ void binfmt_init(void);
 void binfmt_add_loader(binfmt_loader_t loader);
 bool binfmt_load(file_t *file, int argc, char **argv);
 
+/* map a loadable segment for a loader: `filesz` bytes of `file` at `off` to `vaddr`
+ * of `as` followed by zeros up to `memsz` bytes, `vaddr` and `off` must have the same
+ * offset within a page
+ *
+ * the file's pages are mapped privately if the file system can map them,
+ * so code executes in place and only the written pages are copied,
+ * otherwise the segment is read into anonymous memory
+ *
+ * return 0 on success
+ * return -errno on error */
+int binfmt_map_segment(file_t *file, mm_as_t *as, uint64_t vaddr, size_t filesz,
+                       size_t memsz, off_t off, int prot);
+
 #endif /* __BIMFMT_H__ */
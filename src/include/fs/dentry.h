@@ -2,6 +2,7 @@
 #define __DENTRY_H__
 
 #include <fs/inode.h>
+#include <kernel/lock.h>
 #include <lib/list.h>
 #include <lib/hashmap.h>
 #include <stdint.h>
@@ -13,11 +14,44 @@ typedef struct dentry     dentry_t;
 typedef struct dentry_ops dentry_ops_t;
 
 enum DENTRY_FLAGS {
-    DNTR_NO_CACHE = 1 << 7,
+    DNTR_NO_CACHE   = 1 << 7,
+    DNTR_MOUNTPOINT = 1 << 8, /* a file system is mounted on the dentry */
 };
 
+/* Dentry cache
+ *
+ * Every cached dentry is linked into a global hash table keyed by (parent, name) and
+ * holds a reference to its parent. A dentry whose only reference is the cache's own
+ * (`d_count == 1`) is unused. Unused dentries that were instantiated by a lookup are
+ * kept on an LRU list and the coldest of them are evicted when there are more than
+ * `DCACHE_MAX_UNUSED` of them or when the page allocator runs out of memory. The
+ * dcache's shrinker counts the slab pages that evicting dentries released.
+ *
+ * A lookup of a name that doesn't exist leaves a negative dentry (`d_inode == NULL`)
+ * in the cache so repeated misses don't reach the filesystem. */
+enum DCACHE_STATE {
+    DCACHE_HASHED     = 1 << 0, /* in the hash table, holds a reference to the parent */
+    DCACHE_LRU        = 1 << 1, /* on the LRU list */
+    DCACHE_REFERENCED = 1 << 2, /* looked up since the last LRU scan */
+    DCACHE_RECLAIM    = 1 << 3, /* can be evicted and looked up again later */
+    DCACHE_NEGATIVE   = 1 << 4, /* the name doesn't exist */
+};
+
+#define DCACHE_MAX_UNUSED 4096
+
+typedef struct dcache_stats {
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t unused;
+} dcache_stats_t;
+
 struct dentry {
     uint32_t  d_flags;
+    uint32_t  d_state;
+    uint32_t  d_hash;
+    seqcount_t d_seq;  /* changes when a lockless walk must not trust what it read */
 
     dentry_t *d_parent;
     inode_t  *d_inode;
@@ -25,11 +59,41 @@ struct dentry {
 
     int d_count;
     list_head_t d_list;
+    list_head_t d_hash_list;
+    list_head_t d_lru;
     void *d_private;
 
     char d_name[DENTRY_NAME_MAXLEN];
 };
 
+/* A name that isn't NUL-terminated, e.g. a component in the middle of a path
+ *
+ * `hash` doesn't depend on the parent so a path walk computes it while it scans
+ * the component, see dname_hash() */
+typedef struct dname {
+    const char *name;
+    size_t      len;
+    uint32_t    hash;
+} dname_t;
+
+#define DNAME_HASH_INIT 5381
+
+/* http://www.cse.yorku.ca/~oz/hash.html */
+static inline uint32_t dname_hash_step(uint32_t hash, char c)
+{
+    return ((hash << 5) + hash) + (uint8_t)c;
+}
+
+static inline uint32_t dname_hash(const char *name, size_t len)
+{
+    uint32_t hash = DNAME_HASH_INIT;
+
+    while (len--)
+        hash = dname_hash_step(hash, *name++);
+
+    return hash;
+}
+
 int dentry_init(void);
 
 dentry_t *dentry_alloc(dentry_t *parent, char *name, uint32_t flags);
@@ -38,10 +102,105 @@ dentry_t *dentry_alloc_ino(dentry_t *parent, char *name, inode_t *ino, uint32_t
 dentry_t *dentry_alloc_orphan_ino(char *name, inode_t *ino, uint32_t flags);
 int       dentry_dealloc(dentry_t *dntr);
 
+/* free `dntr` like dentry_dealloc() while the caller holds `pins` references to it,
+ * the references go away with the dentry
+ *
+ * return 0 on success
+ * return -ENOENT if `dntr` isn't linked to its parent
+ * return -EBUSY if anyone else holds a reference to `dntr` */
+int dentry_dealloc_pinned(dentry_t *dntr, int pins);
+
+/* move `dntr` under `parent` and rename it to `name`, a directory keeps its children
+ *
+ * return 0 on success
+ * return -EEXIST if `parent` already has `name`
+ * return -E2BIG if `name` is too long
+ * return -EBUSY if a negative dentry of `name` is in use
+ * return -ENOMEM if `dntr` couldn't be linked to `parent`, it's left where it was */
+int dentry_move(dentry_t *dntr, dentry_t *parent, char *name);
+
+/* move `dntr` in place of `target` and free `target`, the inode of `target` loses
+ * the dentry's reference but isn't freed
+ *
+ * the caller holds `pins` references to `target`, they go away with it on success
+ *
+ * return 0 on success
+ * return -ENOENT if `target` isn't linked to its parent
+ * return -EBUSY if anyone else holds a reference to `target`
+ * return the error of dentry_move() if the move fails, both dentries are left where they were */
+int dentry_replace(dentry_t *dntr, dentry_t *target, int pins);
+
+/* take a reference to `dntr`, which the caller must already keep from being freed */
+void dentry_get(dentry_t *dntr);
+
+/* drop a reference to `dntr`, an unused dentry stays in the cache until it's evicted */
+void dentry_put(dentry_t *dntr);
+
+/* look up `name` from the dentry cache and, if it's not cached, from the filesystem
+ *
+ * return pointer to dentry on success
+ * return NULL and set errno on error (ENOENT if the name doesn't exist) */
 dentry_t *dentry_lookup(dentry_t *parent, char *name);
 
-dentry_t *dentry_cache_lookup(char *name);
+/* same as dentry_lookup() but `name` doesn't have to be NUL-terminated
+ *
+ * a cached name is found without allocating memory */
+dentry_t *dentry_lookup_name(dentry_t *parent, const dname_t *name);
+
+/* return the cached dentry of `name` (which may be negative) or NULL if it's not cached */
+dentry_t *dentry_cache_lookup(dentry_t *parent, char *name);
+dentry_t *dentry_cache_lookup_name(dentry_t *parent, const dname_t *name);
+
+/* add `dntr` to the cache
+ *
+ * return `dntr` on success
+ * return NULL and set errno on error */
 dentry_t *dentry_cache_insert(dentry_t *dntr);
-int       dentry_cache_evict(dentry_t *dntr);
+
+/* remove an unused dentry from the cache and free it
+ *
+ * return 0 on success
+ * return -EBUSY if the dentry is in use */
+int dentry_cache_evict(dentry_t *dntr);
+
+/* evict at most `nr` unused dentries, coldest first
+ *
+ * return the number of dentries evicted */
+size_t dentry_cache_shrink(size_t nr);
+
+/* evict the unused negative dentries of the names below `parent`
+ *
+ * every cached child holds a reference to its parent so a directory can't be removed
+ * while the negative dentries of the names that were looked up from it are cached.
+ * The whole hash table is scanned.
+ *
+ * return the number of dentries evicted */
+size_t dentry_cache_prune(dentry_t *parent);
+
+/* Lockless lookups
+ *
+ * A lockless path walk reads the dentry cache without taking locks or references. It
+ * begins with dentry_walk_begin(), looks up each component with dentry_lookup_lockless()
+ * and checks with the parent's `d_seq` that the parent didn't change while its child was
+ * looked up. Dentries live in a slab cache which never returns its pages so a dentry that
+ * is freed under the walk is still readable, and every dentry that leaves the cache bumps
+ * a global sequence count that dentry_walk_get() checks before it takes a reference to
+ * the result. A walk that can't be validated is redone with dentry_lookup_name().
+ *
+ * dentry_lookup_lockless() returns the cached dentry of `name` and the sequence count to
+ * validate it with, or NULL and sets errno: ENOENT if `name` is negative, EAGAIN if it
+ * isn't cached or the lookup raced with an update. */
+uint32_t  dentry_walk_begin(void);
+bool      dentry_walk_retry(uint32_t start);
+dentry_t *dentry_lookup_lockless(dentry_t *parent, const dname_t *name, uint32_t *seq);
+
+/* take a reference to `dntr` found by a lockless walk that began at `start`
+ *
+ * return 0 on success
+ * return -EAGAIN if the walk can't be validated */
+int dentry_walk_get(dentry_t *dntr, uint32_t start, uint32_t seq);
+
+void dentry_cache_stats(dcache_stats_t *stats);
+void dentry_cache_dump_stats(void);
 
 #endif /* __DENTRY_H__ */
@@ -1,6 +1,7 @@
 #ifndef __FILE_H__
 #define __FILE_H__
 
+#include <fs/pagecache.h>
 #include <kernel/common.h>
 #include <sys/types.h>
 
@@ -9,6 +10,7 @@ typedef struct dentry dentry_t;
 typedef struct fs_context fs_ctx_t;
 typedef struct file_ops file_ops_t;
 typedef struct file_context file_ctx_t;
+typedef struct mm_as mm_as_t;
 
 struct file_ops {
     ssize_t  (*read)(file_t  *, off_t, size_t, void *);
@@ -16,6 +18,15 @@ struct file_ops {
     file_t  *(*open)(dentry_t *, int);
     int      (*close)(file_t *);
     int      (*seek)(file_t *, off_t);
+
+    // fill the page at page offset `index` of the file, the part past
+    // the end of the file must be zeroed. If the file system implements
+    // this, file_read() reads the file through the page cache
+    int      (*readpage)(file_t *, uint64_t index, void *page);
+
+    // map `len` bytes of the file at offset `off` to `addr` of `as`,
+    // `prot` and `flags` are the MM_PROT_* and MM_VMA_PRIVATE of mm/vma.h
+    int      (*mmap)(file_t *, mm_as_t *as, uint64_t addr, size_t len, int prot, int flags, off_t off);
 };
 
 struct file {
@@ -27,6 +38,7 @@ struct file {
     int f_mode;
 
     struct file_ops *f_ops;
+    ra_state_t f_ra;  // readahead state, see fs/pagecache.h
 };
 
 struct fs_context {
@@ -60,4 +72,6 @@ void    file_close(file_t *file);
 ssize_t file_read(file_t  *file, off_t offset, size_t size, void *buffer);
 ssize_t file_write(file_t *file, off_t offset, size_t size, void *buffer);
 
+int file_mmap(file_t *file, mm_as_t *as, uint64_t addr, size_t len, int prot, int flags, off_t off);
+
 #endif /* __FILE_H__ */
@@ -26,9 +26,10 @@ enum FILE_ACCESS_MODES {
 };
 
 enum LOOKUP_FLAGS {
-    LOOKUP_PARENT = 1 << 0,
-    LOOKUP_CREATE = 1 << 1,
-    LOOKUP_OPEN   = 1 << 2,
+    LOOKUP_PARENT     = 1 << 0,
+    LOOKUP_CREATE     = 1 << 1,
+    LOOKUP_OPEN       = 1 << 2,
+    LOOKUP_MOUNTPOINT = 1 << 3, // return a mountpoint at the end of the path, not the mounted root
 };
 
 enum LOOKUP_STATUS_FLAGS {
@@ -55,6 +56,7 @@ typedef struct mount {
     char *mnt_type;       // type of the mounted filesystem
 
     list_head_t mnt_list; // list of mountpoints
+    list_head_t mnt_hash; // mount hash chain, keyed by "mnt_mount"
 } mount_t;
 
 typedef struct path {
@@ -103,6 +105,61 @@ int vfs_install_rootfs(char *type, void *data);
 // If something was indeed found, path->p_dentry points to the object in question */
 path_t *vfs_path_lookup(char *path, int flags);
 
+// walk "path" and fill "out" like vfs_path_lookup() does without allocating memory
+//
+// the walk is iterative and the components are hashed in place so a path that is
+// in the dentry cache is resolved without a single allocation
+//
+// return 0 if the path resolved to a dentry, the reference taken to it is
+// dropped by `vfs_path_put()`
+// return -EINVAL if the path is invalid and -ENOENT if it didn't resolve to anything,
+// "out->p_status" tells what that means for the intended operation
+int vfs_path_walk(const char *path, int flags, path_t *out);
+
+// drop the reference "path" has to its dentry
+void vfs_path_put(path_t *path);
+
+// create an empty regular file at "path"
+//
+// the directory of "path" must exist, the last component is created by its file system
+//
+// return 0 on success
+// return -EEXIST if "path" exists
+// return -ENOENT or -ENOTDIR if the directory of "path" doesn't exist
+// return -ENOSYS if the file system can't create files
+int vfs_create(const char *path, int mode);
+
+// create an empty directory at "path", return values are those of `vfs_create()`
+int vfs_mkdir(const char *path, int mode);
+
+// remove the regular file at "path"
+//
+// return 0 on success
+// return -EISDIR if "path" is a directory
+// return -EBUSY if the file is open or a file system is mounted on it
+int vfs_unlink(const char *path);
+
+// remove the empty directory at "path"
+//
+// return 0 on success
+// return -ENOTDIR if "path" is not a directory
+// return -ENOTEMPTY if the directory has entries
+// return -EBUSY if the directory is in use or a file system is mounted on it
+int vfs_rmdir(const char *path);
+
+// move "oldpath" to "newpath", an existing "newpath" is replaced
+//
+// a directory can only replace an empty directory and a file only a file
+//
+// return 0 on success
+// return -EXDEV if the paths are in different file systems
+// return -EINVAL if a directory would be moved below itself
+int vfs_rename(const char *oldpath, const char *newpath);
+
+// set the size of the regular file at "path" to "length",
+// the file is cut or extended with a hole
+int vfs_truncate(const char *path, off_t length);
+
 // allocate file system context
 //
 // toot dentry is set automatically, "pwd" may be NULL
@@ -1,6 +1,7 @@
 #ifndef __INODE_H__
 #define __INODE_H__
 
+#include <fs/pagecache.h>
 #include <lib/list.h>
 #include <sys/types.h>
 #include <stdint.h>
@@ -14,6 +15,18 @@ typedef struct file_ops   file_ops_t;
 typedef struct inode_ops  inode_ops_t;
 typedef struct superblock superblock_t;
 
+/* The VFS (see fs/fs.h) calls the ops of the parent directory
+ *
+ * create() and mkdir() get a dentry that the VFS has already linked to `parent` and
+ * give it an inode. unlink() and rmdir() unlink and free the dentry and release its
+ * inode, they fail with -EBUSY if the dentry is in use. rename() moves `old_dentry`
+ * to `new_dir`, `new_dentry` is either the dentry of `new_dir` that is replaced or an
+ * unlinked dentry that only carries the new name. truncate() is called after the VFS
+ * has set the new `i_size` of the inode.
+ *
+ * The VFS holds a reference to the dentry passed to unlink() and rmdir() and to an
+ * existing `new_dentry`. A dentry that is freed takes that reference with it (see
+ * dentry_dealloc_pinned()), otherwise the VFS drops it afterwards. */
 struct inode_ops {
     int (*create)(dentry_t *parent, dentry_t *dntr, int mode, path_t *path);
     inode_t *(*lookup)(dentry_t *parent, char *name);
@@ -52,6 +65,8 @@ struct inode {
 
     list_head_t i_list;
     list_head_t i_dirty;
+
+    address_space_t i_mapping; // cached pages of the file
 };
 
 int inode_init(void);
@@ -95,6 +95,13 @@ size_t multiboot2_map_memory(
     void (*callback)(unsigned, unsigned long, size_t)
 );
 
+/* call `callback` with the physical address, the length and the command line
+ * of every boot module, return the number of modules */
+size_t multiboot2_map_modules(
+    unsigned long *address,
+    void (*callback)(unsigned long, size_t, const char *)
+);
+
 size_t multiboot2_parse_elf(unsigned long *address);
 
 typedef unsigned char           multiboot_uint8_t;
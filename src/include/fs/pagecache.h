@@ -0,0 +1,88 @@
+#ifndef __PAGECACHE_H__
+#define __PAGECACHE_H__
+
+#include <kernel/lock.h>
+#include <lib/list.h>
+#include <lib/radix.h>
+#include <sys/types.h>
+#include <stdint.h>
+
+typedef struct file  file_t;
+typedef struct inode inode_t;
+
+/* Page cache
+ *
+ * Every inode has an address space: a radix tree of the file's cached pages indexed by
+ * the page's offset in the file. file_read() of a file whose file system implements
+ * `readpage()` copies the data from the cache and only asks the file system for pages
+ * that aren't cached.
+ *
+ * A miss also reads ahead if the file is being read sequentially. The readahead window
+ * of the file starts at `PAGECACHE_RA_INIT` pages and doubles up to `PAGECACHE_RA_MAX`
+ * every time the reader reaches the marked page of the previous window, a random read
+ * only reads the page it needs. Cached pages stay until the inode is freed or the page
+ * allocator runs out of memory. */
+
+#define PAGECACHE_RA_INIT 4
+#define PAGECACHE_RA_MAX  32
+
+enum CPAGE_FLAGS {
+    CPAGE_REFERENCED = 1 << 0, /* read since the last shrinker scan */
+    CPAGE_READAHEAD  = 1 << 1, /* reading this page starts the next readahead window */
+    CPAGE_UNUSED_RA  = 1 << 2, /* read ahead but not read by anyone yet */
+};
+
+typedef struct address_space address_space_t;
+
+typedef struct cpage {
+    uint64_t phys;   /* physical address of the data */
+    uint64_t index;  /* offset in the file in pages */
+    uint32_t flags;
+    address_space_t *mapping;
+    list_head_t lru;
+} cpage_t;
+
+/* a zeroed address space is empty */
+struct address_space {
+    radix_tree_t pages;
+    spinlock_t   lock;
+    size_t       nrpages;
+};
+
+/* readahead state of an open file, a zeroed state is a file that hasn't been read */
+typedef struct ra_state {
+    uint64_t start;       /* first page of the current window */
+    uint32_t size;        /* number of pages in the current window */
+    uint32_t async_size;  /* the next window is read when this many pages are left */
+    uint64_t prev;        /* page read last */
+} ra_state_t;
+
+typedef struct pagecache_stats {
+    uint64_t hits;        /* pages found in the cache */
+    uint64_t misses;      /* pages that had to be read */
+    uint64_t ra_pages;    /* pages read ahead */
+    uint64_t ra_hits;     /* pages read ahead that were later read */
+    uint64_t evictions;
+    uint64_t pages;       /* pages in the cache */
+} pagecache_stats_t;
+
+void pagecache_init(void);
+
+/* read `size` bytes at `offset` from the file position like the `read()` of the
+ * file system would, the file's `f_ops` must implement `readpage()`
+ *
+ * return `size` on success
+ * return -E2BIG if the read goes past the end of the file
+ * return -errno on error */
+ssize_t pagecache_read(file_t *file, off_t offset, size_t size, void *buffer);
+
+/* free all cached pages of `mapping` */
+void pagecache_truncate(address_space_t *mapping);
+
+/* evict at most `nr` pages that haven't been read recently, return the number evicted */
+size_t pagecache_shrink(size_t nr);
+
+void pagecache_stats(pagecache_stats_t *stats);
+void pagecache_dump_stats(void);
+
+#endif /* __PAGECACHE_H__ */
@@ -30,8 +30,8 @@ ssize_t pipe_read(pipe_t *pipe, void *buffer, size_t size);
 //
 // return the number of bytes written written on success (`size`)
 // return `-EINVAL` if one the parameters is invalid
-// return `-ENOMEM` if "size" is larger than pipe's capacity
-// return `-ENOSPC` if there is not enough space in the pipe for `size` bytes
+// return `-ENOSPC` if there is not enough space in the pipe for `size` bytes,
+//                  also when `size` is larger than the pipe's capacity
 ssize_t pipe_write(pipe_t *pipe, void *buffer, size_t size);
 
 #endif /* __PIPE_H__ */
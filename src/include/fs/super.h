@@ -88,4 +88,7 @@ superblock_t *super_get_sb_bdev(
     int (*fill_super)(superblock_t *)
 );
 
+// release a superblock returned by one of the functions above
+void super_free_sb(superblock_t *sb);
+
 #endif /* __SUPER_H__ */
@@ -0,0 +1,9 @@
+#ifndef __TMPFS_H__
+#define __TMPFS_H__
+
+#include <fs/fs.h>
+
+superblock_t *tmpfs_get_sb(fs_type_t *type, char *dev, int flags, void *data);
+int tmpfs_kill_sb(superblock_t *sb);
+
+#endif /* __TMPFS_H__ */
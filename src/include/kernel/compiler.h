@@ -6,6 +6,9 @@
 #define __noreturn __attribute__((noreturn))
 #define __percpu   __attribute__((section(".percpu")))
 
+#define CACHE_LINE_SIZE      64
+#define __cacheline_aligned __attribute__((aligned(CACHE_LINE_SIZE)))
+
 #define READ_ONCE(var) (*((volatile typeof(var) *)&(var)))
 
 #endif /* end of include guard: __COMPILER_H__ */
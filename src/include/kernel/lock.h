@@ -0,0 +1,176 @@
+#ifndef __LOCK_H__
+#define __LOCK_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Spinning locks
+ *
+ * spinlock_t - test-and-test-and-set lock, cheapest when uncontended
+ * ticket_t   - FIFO ticket lock, waiters get the lock in the order they arrived
+ * mcs_lock_t - MCS queue lock, every waiter spins on its own node so a contended
+ *              lock doesn't bounce one cache line between all waiting CPUs
+ * rwlock_t   - reader-writer spinlock, a waiting writer blocks new readers
+ *
+ * A zeroed lock is unlocked. The `_irqsave` variants disable interrupts and return
+ * the previous RFLAGS which must be given to the matching `_irqrestore` call, they
+ * must be used for every lock that is also taken by an interrupt handler.
+ *
+ * Building with CONFIG_LOCK_STAT records statistics per lock class. The class of a lock
+ * is the place where it was initialized with one of the `*_init()` macros so e.g. all
+ * slab caches share one class. `lock_stat_dump()` prints the statistics, kpanic() prints
+ * them too. */
+
+typedef struct lock_class {
+    const char *name;
+    uint64_t acquired;      /* number of acquisitions */
+    uint64_t contended;     /* acquisitions that had to wait */
+    uint64_t spin_cycles;   /* TSC cycles spent waiting */
+    uint64_t max_hold;      /* longest hold time in TSC cycles */
+    struct lock_class *next;
+    uint32_t registered;
+} lock_class_t;
+
+#ifdef CONFIG_LOCK_STAT
+#define __LOCK_STAT_FIELDS \
+    lock_class_t *class;   \
+    uint64_t held_since;
+
+#define __LOCK_CLASS(lock) ({                              \
+    static lock_class_t __class = { .name = #lock };       \
+    &__class;                                              \
+})
+#else
+#define __LOCK_STAT_FIELDS
+#define __LOCK_CLASS(lock) NULL
+#endif
+
+typedef struct spinlock {
+    volatile uint32_t locked;
+    __LOCK_STAT_FIELDS
+} spinlock_t;
+
+typedef struct ticket {
+    volatile uint16_t next;
+    volatile uint16_t owner;
+    __LOCK_STAT_FIELDS
+} ticket_t;
+
+/* queue node of an MCS lock, lives on the stack of the CPU acquiring the lock */
+typedef struct mcs_node {
+    struct mcs_node *volatile next;
+    volatile uint32_t locked;
+} mcs_node_t;
+
+typedef struct mcs_lock {
+    mcs_node_t *volatile tail;
+    __LOCK_STAT_FIELDS
+} mcs_lock_t;
+
+typedef struct rwlock {
+    volatile uint32_t state;
+    __LOCK_STAT_FIELDS
+} rwlock_t;
+
+#define spin_init(lock)   __spin_init((lock), __LOCK_CLASS(lock))
+#define ticket_init(lock) __ticket_init((lock), __LOCK_CLASS(lock))
+#define mcs_init(lock)    __mcs_init((lock), __LOCK_CLASS(lock))
+#define rwlock_init(lock) __rwlock_init((lock), __LOCK_CLASS(lock))
+
+void __spin_init(spinlock_t *lock, lock_class_t *class);
+void __ticket_init(ticket_t *lock, lock_class_t *class);
+void __mcs_init(mcs_lock_t *lock, lock_class_t *class);
+void __rwlock_init(rwlock_t *lock, lock_class_t *class);
+
+void spin_lock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+
+/* return true if the lock was acquired */
+bool spin_trylock(spinlock_t *lock);
+
+uint64_t spin_lock_irqsave(spinlock_t *lock);
+void     spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags);
+
+void ticket_lock(ticket_t *lock);
+void ticket_unlock(ticket_t *lock);
+
+uint64_t ticket_lock_irqsave(ticket_t *lock);
+void     ticket_unlock_irqrestore(ticket_t *lock, uint64_t flags);
+
+/* `node` must stay valid until the lock is released with the same node */
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
+
+uint64_t mcs_lock_irqsave(mcs_lock_t *lock, mcs_node_t *node);
+void     mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node, uint64_t flags);
+
+void read_lock(rwlock_t *lock);
+void read_unlock(rwlock_t *lock);
+void write_lock(rwlock_t *lock);
+void write_unlock(rwlock_t *lock);
+
+/* Sequence counts
+ *
+ * A seqcount lets readers access data without writing to shared memory. The writer,
+ * serialized by a lock of its own, makes the count odd for the duration of an update
+ * and a reader retries (or falls back to taking the writer's lock) if the count was odd
+ * or has changed since it started:
+ *
+ *   do {
+ *       seq = read_seqcount_begin(&sc);
+ *       ...
+ *   } while (read_seqcount_retry(&sc, seq));
+ *
+ * A zeroed seqcount is valid. */
+typedef struct seqcount {
+    volatile uint32_t seq;
+} seqcount_t;
+
+static inline void seqcount_init(seqcount_t *sc)
+{
+    sc->seq = 0;
+}
+
+/* return the current count, wait until no update is in progress */
+static inline uint32_t read_seqcount_begin(const seqcount_t *sc)
+{
+    uint32_t seq;
+
+    while ((seq = __atomic_load_n(&sc->seq, __ATOMIC_ACQUIRE)) & 1)
+        __builtin_ia32_pause();
+
+    return seq;
+}
+
+/* return the current count without waiting, it's odd if an update is in progress */
+static inline uint32_t raw_read_seqcount(const seqcount_t *sc)
+{
+    return __atomic_load_n(&sc->seq, __ATOMIC_ACQUIRE);
+}
+
+/* return true if the data read since `read_seqcount_begin()` may be inconsistent */
+static inline bool read_seqcount_retry(const seqcount_t *sc, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (seq & 1) || __atomic_load_n(&sc->seq, __ATOMIC_RELAXED) != seq;
+}
+
+static inline void write_seqcount_begin(seqcount_t *sc)
+{
+    __atomic_store_n(&sc->seq, sc->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_seqcount_end(seqcount_t *sc)
+{
+    __atomic_store_n(&sc->seq, sc->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* print the statistics of every lock class that has been used */
+void lock_stat_dump(void);
+
+/* clear the statistics of all lock classes */
+void lock_stat_reset(void);
+
+#endif /* __LOCK_H__ */
@@ -2,31 +2,117 @@
 #define __PERCPU_H__
 
 #include <arch/amd64/cpu.h>
+#include <kernel/compiler.h>
+#include <kernel/lock.h>
+#include <stddef.h>
+
+/* Per-CPU variables
+ *
+ * Static per-CPU variables are declared with `__percpu` and linked into the .percpu
+ * section. percpu_setup() gives every CPU its own copy of the section followed by
+ * `PERCPU_DYN_SIZE` bytes for percpu_alloc(). GS base of a CPU holds the distance
+ * between its copy and the section so `%gs:var` is the calling CPU's instance of `var`
+ * and a single instruction reads or updates it.
+ *
+ * Before percpu_setup() GS base is zero and the BSP uses the section itself.
+ * The copies are made from the section so variables written before percpu_setup()
+ * start with the same value on every CPU. */
+
+#define PERCPU_DYN_SIZE (16 * 1024)
 
 extern uint8_t _percpu_start, _percpu_end;
 
-#pragma GCC push_options
-#pragma GCC optimize ("O0")
+/* distance of the per-CPU area of each CPU from the .percpu section */
+extern uint64_t __percpu_offsets[MAX_CPU];
+
+extern __percpu uint64_t __percpu_offset;
+extern __percpu uint32_t __percpu_cpu_id;
+
+/* read, write and add to the calling CPU's instance of an integer or a pointer variable
+ *
+ * each is one instruction so the update can't be torn by an interrupt on the same CPU */
+#define thiscpu_read(var) ({                                       \
+    typeof(var) __ret;                                             \
+    asm volatile ("mov %%gs:%1, %0" : "=r"(__ret) : "m"(var));     \
+    __ret;                                                         \
+})
 
-#define __percpu_size           ((uint64_t)((uint64_t)&_percpu_end - (uint64_t)&_percpu_start))
-#define __this_cpu_ptr(var)     ((typeof(var) *)(((uint8_t *)(&(var))) + get_msr(GS_BASE)))
-#define __any_cpu_ptr(var, cpu) ((typeof(var) *)(((uint8_t *)(&(var))) + cpu * __percpu_size))
+#define thiscpu_write(var, val) \
+    asm volatile ("mov %1, %%gs:%0" : "=m"(var) : "r"((typeof(var))(val)))
 
-#define get_thiscpu_var(var) *(__this_cpu_ptr(var))
-#define get_thiscpu_ptr(var)  (__this_cpu_ptr(var))
-#define get_thiscpu_id()      (get_msr(GS_BASE) / __percpu_size)
+#define thiscpu_add(var, val) \
+    asm volatile ("add %1, %%gs:%0" : "+m"(var) : "r"((typeof(var))(val)))
+
+#define thiscpu_inc(var) thiscpu_add(var, 1)
+#define thiscpu_dec(var) thiscpu_add(var, -1)
+
+/* convert a per-CPU pointer (address of a `__percpu` variable or a pointer returned
+ * by percpu_alloc()) to the address of the calling CPU's or `cpu`'s instance */
+#define thiscpu_ptr(ptr)     ((typeof(ptr))((uint8_t *)(ptr) + thiscpu_read(__percpu_offset)))
+#define percpu_ptr(ptr, cpu) ((typeof(ptr))((uint8_t *)(ptr) + __percpu_offsets[(cpu)]))
+
+#define get_thiscpu_var(var) (*thiscpu_ptr(&(var)))
+#define get_thiscpu_ptr(var)  (thiscpu_ptr(&(var)))
+#define get_thiscpu_id()      (thiscpu_read(__percpu_cpu_id))
 
 #define put_thiscpu_var(var) ((void)(var))
 #define put_thiscpu_ptr(var) ((void)(var))
 
-#define get_percpu_var(var, cpu) *(__any_cpu_ptr(var, cpu))
-#define get_percpu_ptr(var, cpu)  (__any_cpu_ptr(var, cpu))
+#define get_percpu_var(var, cpu) (*percpu_ptr(&(var), cpu))
+#define get_percpu_ptr(var, cpu)  (percpu_ptr(&(var), cpu))
 
 #define put_percpu_var(var, cpu) ((void)(&(var)))
 #define put_percpu_ptr(var, cpu) ((void)(var))
 
-#define percpu_init(cpu)         (set_msr(GS_BASE, (cpu) * __percpu_size))
+/* allocate the per-CPU areas of `ncpus` CPUs
+ *
+ * return 0 on success
+ * return -ENOMEM if out of memory */
+int percpu_setup(size_t ncpus);
+
+/* make `cpu`'s per-CPU area the area of the calling CPU */
+void percpu_init(uint32_t cpu);
+
+/* return the number of CPUs that have a per-CPU area */
+size_t percpu_cpu_count(void);
+
+/* allocate `size` bytes of zeroed memory for each CPU
+ *
+ * the returned pointer must be converted with thiscpu_ptr() or percpu_ptr()
+ * before it's dereferenced
+ *
+ * return per-CPU pointer on success
+ * return NULL and set errno on error */
+void *percpu_alloc(size_t size, size_t align);
+
+/* release memory allocated with percpu_alloc() */
+void percpu_free(void *ptr);
+
+/* Per-CPU counter
+ *
+ * Updates go to a local delta of the calling CPU and the delta is folded into the
+ * shared count only when it exceeds `batch` so hot paths never write a shared
+ * cache line. percpu_counter_read() returns the shared count which is off by at most
+ * `batch * CPUs`, percpu_counter_sum() adds up the deltas of all CPUs. */
+typedef struct percpu_counter {
+    spinlock_t lock;
+    int64_t count;
+    int32_t batch;
+    int32_t *deltas;  /* per-CPU pointer */
+} percpu_counter_t;
+
+#define PERCPU_COUNTER_BATCH 32
+
+/* return 0 on success
+ * return -ENOMEM if out of memory */
+int percpu_counter_init(percpu_counter_t *pc, int64_t value);
+void percpu_counter_destroy(percpu_counter_t *pc);
+
+void    percpu_counter_add(percpu_counter_t *pc, int64_t amount);
+int64_t percpu_counter_read(percpu_counter_t *pc);
+int64_t percpu_counter_sum(percpu_counter_t *pc);
 
-#pragma GCC pop_options
+#define percpu_counter_inc(pc) percpu_counter_add((pc), 1)
+#define percpu_counter_dec(pc) percpu_counter_add((pc), -1)
 
 #endif /* __PERCPU_H__ */
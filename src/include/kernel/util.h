@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 
+/* select the fastest kmemcpy() and kmemset() variant the CPU supports */
+void kutil_init(void);
+
 void *kmemcpy(void *restrict dstptr, const void *restrict srcptr, size_t size);
 void *kmemset(void *buf, int c, size_t size);
 void *kmemmove(void *dstptr, const void *srcptr, size_t size);
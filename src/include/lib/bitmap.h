@@ -4,13 +4,20 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/* bitmap is stored in 64-bit words, bit `n` is bit `n % 64` of word `n / 64`
+ *
+ * all operations work a word at a time: ranges are updated using masks for
+ * the partial words at both ends and searches skip over uninteresting words
+ * and use count-trailing-zeros to locate the bit inside a word */
 typedef struct bitmap {
     size_t len;
-    uint32_t *bits;
+    uint64_t *bits;
 } bitmap_t;
 
-#define TO_BM_LEN(n)    ((n) / 32)
-#define BM_GET_SIZE(bm) (sizeof(*bm) + sizeof(uint32_t) * (bm->len / 32))
+#define BM_BITS_PER_WORD 64
+#define BM_WORDS(nbits)  (((nbits) + BM_BITS_PER_WORD - 1) / BM_BITS_PER_WORD)
+#define TO_BM_LEN(n)     BM_WORDS(n)
+#define BM_GET_SIZE(bm)  (sizeof(*bm) + sizeof(uint64_t) * BM_WORDS(bm->len))
 
 // allocate new bitmap with `nmemb` elements
 bitmap_t *bm_alloc_bitmap(size_t nmemb);
@@ -21,13 +28,13 @@ void bm_dealloc_bitmap(bitmap_t *bm);
 // set bit
 int bm_set_bit(bitmap_t *bm, uint32_t n);
 
-// set a range of bits
+// set a range of bits `[n, k]`
 int bm_set_range(bitmap_t *bm, uint32_t n, uint32_t k);
 
 // unset bit
 int bm_unset_bit(bitmap_t *bm, uint32_t n);
 
-// unset a range of bits
+// unset a range of bits `[n, k]`
 int bm_unset_range(bitmap_t *bm, uint32_t n, uint32_t k);
 
 // check if a bit is set
@@ -39,10 +46,19 @@ int bm_find_first_set(bitmap_t *bm, uint32_t n, uint32_t k);
 // find first unset bit from range `[n, k]`
 int bm_find_first_unset(bitmap_t *bm, uint32_t n, uint32_t k);
 
+// find first set bit at or after `n`, return -ENOENT if there is none
+int bm_find_next_set(bitmap_t *bm, uint32_t n);
+
+// find first unset bit at or after `n`, return -ENOENT if there is none
+int bm_find_next_unset(bitmap_t *bm, uint32_t n);
+
 // find first range with all bits set to 1 that is at least `len` bits long
 int bm_find_first_set_range(bitmap_t *bm, uint32_t n, uint32_t k, size_t len);
 
 // find first range with all bits set to 0 that is at least `len` bits long
 int bm_find_first_unset_range(bitmap_t *bm, uint32_t n, uint32_t k, size_t len);
 
+// return the number of set bits
+size_t bm_weight(bitmap_t *bm);
+
 #endif /* __BITMAP_H__ */
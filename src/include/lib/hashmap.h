@@ -9,18 +9,40 @@ typedef enum {
     HM_KEY_TYPE_STR = 1,
 } hm_key_type_t;
 
+/* The map stores only pointers to the keys: a key must stay valid and
+ * unchanged for as long as its element is in the map.
+ *
+ * Keys are compared by value (`strcmp()` or the 32-bit number they point to)
+ * so colliding hashes never return the wrong element. */
 typedef struct hashmap hashmap_t;
 
+/* allocate a hashmap with room for at least `size` elements
+ *
+ * the map grows and shrinks as needed but never below `size`
+ *
+ * return pointer to the hashmap on success
+ * return NULL and set errno on error */
 hashmap_t *hm_alloc_hashmap(size_t size, hm_key_type_t type);
 void       hm_dealloc_hashmap(hashmap_t *hm);
 
+/* return 0 on success
+ * return -EINVAL if `ukey` is invalid
+ * return -EEXIST if `ukey` is already in the map
+ * return -ENOMEM if the map needs to grow and there's no memory */
 int hm_insert(hashmap_t *hm, void *ukey, void *elem);
+
+/* return 0 on success
+ * return -EINVAL if `ukey` is invalid
+ * return -ENOENT if `ukey` is not in the map */
 int hm_remove(hashmap_t *hm, void *ukey);
 
 void   *hm_get(hashmap_t *hm, void *ukey);
 size_t  hm_get_size(hashmap_t *hm);
 size_t  hm_get_capacity(hashmap_t *hm);
 
+/* replace the hash function, the map must be empty
+ *
+ * a key for which `hm_hash_func` returns UINT32_MAX is invalid */
 void hm_add_hash_func(hashmap_t *hm, uint32_t (*hm_hash_func)(void *));
 
 #endif /* __HASHMAP_H__ */
@@ -0,0 +1,57 @@
+#ifndef __ITREE_H__
+#define __ITREE_H__
+
+#include <lib/rbtree.h>
+#include <stdint.h>
+
+/* Intrusive interval tree
+ *
+ * A red-black tree of closed intervals `[start, last]` ordered by `start`. Every node
+ * also stores the largest `last` of its subtree so an overlap query skips all subtrees
+ * that end before the queried interval and finds each overlapping interval in O(log n).
+ * Intervals may overlap each other and several intervals may have the same start.
+ *
+ * Iterating all intervals that overlap `[start, last]`:
+ *
+ *   for (itree_node_t *n = itree_first_overlap(&tree, start, last); n;
+ *        n = itree_next_overlap(n, start, last))
+ *       ...
+ *
+ * `start` and `last` must not be changed while the node is in the tree. */
+
+typedef struct itree_node {
+    rb_node_t node;
+    uint64_t start;
+    uint64_t last;
+    uint64_t max_last;  /* largest `last` of the subtree */
+} itree_node_t;
+
+typedef struct itree {
+    rb_tree_t tree;
+} itree_t;
+
+void itree_init(itree_t *tree);
+
+/* insert `node` whose `start` and `last` have been set by the caller */
+void itree_insert(itree_t *tree, itree_node_t *node);
+void itree_remove(itree_t *tree, itree_node_t *node);
+
+/* in-order traversal by `start`, return NULL if there are no more nodes */
+itree_node_t *itree_first(itree_t *tree);
+itree_node_t *itree_next(itree_node_t *node);
+
+/* return the first interval that starts at or after `start`, NULL if there is none */
+itree_node_t *itree_lower_bound(itree_t *tree, uint64_t start);
+
+/* return the first (lowest start) interval overlapping `[start, last]` or the next
+ * one after `node`, NULL if there are no more overlapping intervals */
+itree_node_t *itree_first_overlap(itree_t *tree, uint64_t start, uint64_t last);
+itree_node_t *itree_next_overlap(itree_node_t *node, uint64_t start, uint64_t last);
+
+/* return the first interval containing `point`, NULL if there is none */
+static inline itree_node_t *itree_stab(itree_t *tree, uint64_t point)
+{
+    return itree_first_overlap(tree, point, point);
+}
+
+#endif /* __ITREE_H__ */
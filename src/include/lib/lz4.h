@@ -0,0 +1,46 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* LZ4 frame decompression
+ *
+ * Decodes the LZ4 frame format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md)
+ * into one contiguous buffer. Blocks are decoded one after another straight into the
+ * destination so linked blocks need no separate window and nothing is allocated.
+ *
+ * The header checksum is always verified, block and content checksums when the frame has
+ * them. Dictionaries are not supported. Skippable frames before the LZ4 frame are skipped. */
+
+#define LZ4_FRAME_MAGIC 0x184d2204
+
+/* return true if `src` starts with an LZ4 frame or a skippable frame */
+bool lz4_frame_detect(const void *src, size_t len);
+
+/* return the decompressed size stored in the frame header
+ * return -EINVAL if `src` is not a valid frame
+ * return -ENOTSUP if the frame header doesn't have the content size */
+ssize_t lz4_frame_content_size(const void *src, size_t len);
+
+/* decompress the frame at `src` to `dst`
+ *
+ * return the number of bytes written to `dst` on success
+ * return -E2BIG if the data doesn't fit in `dst_len` bytes
+ * return -EINVAL if the frame is corrupted
+ * return -ENOTSUP if the frame uses a feature that is not supported */
+ssize_t lz4_frame_decompress(const void *src, size_t len, void *dst, size_t dst_len);
+
+/* decompress one LZ4 block
+ *
+ * matches may reach `prefix` bytes before `dst`, the output of the previous blocks
+ *
+ * return the number of bytes written on success and -errno like lz4_frame_decompress() on error */
+ssize_t lz4_block_decompress(const void *src, size_t len, void *dst, size_t dst_len, size_t prefix);
+
+/* 32-bit xxHash of `len` bytes at `src`, the checksum of the frame format */
+uint32_t lz4_xxh32(const void *src, size_t len, uint32_t seed);
+
+#endif /* __LZ4_H__ */
@@ -0,0 +1,49 @@
+#ifndef __RADIX_H__
+#define __RADIX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Radix tree of pointers indexed by an unsigned integer
+ *
+ * Every node has `RADIX_SLOTS` slots and consumes `RADIX_SHIFT` bits of the index so
+ * a lookup touches at most one node per level. The tree is only as tall as its largest
+ * index requires: it grows a new root when a larger index is inserted and nodes that
+ * become empty are freed. A zeroed tree is empty, NULL items can't be stored. */
+
+#define RADIX_SHIFT 6
+#define RADIX_SLOTS (1 << RADIX_SHIFT)
+#define RADIX_MASK  (RADIX_SLOTS - 1)
+
+typedef struct radix_node {
+    void *slots[RADIX_SLOTS];
+    uint32_t count;  /* number of non-NULL slots */
+} radix_node_t;
+
+typedef struct radix_tree {
+    radix_node_t *root;
+    uint32_t height;  /* 0 if the tree is empty */
+} radix_tree_t;
+
+void radix_init(radix_tree_t *tree);
+
+/* return the item stored at `index` or NULL */
+void *radix_lookup(radix_tree_t *tree, uint64_t index);
+
+/* return 0 on success
+ * return -EEXIST if `index` is already in use
+ * return -ENOMEM if a node couldn't be allocated
+ * return -EINVAL if `item` is NULL */
+int radix_insert(radix_tree_t *tree, uint64_t index, void *item);
+
+/* remove and return the item stored at `index`, NULL if there is none */
+void *radix_delete(radix_tree_t *tree, uint64_t index);
+
+/* return the first item stored at `index` or after it and store its index to `found`,
+ * NULL if there is none */
+void *radix_next(radix_tree_t *tree, uint64_t index, uint64_t *found);
+
+/* free all nodes, `fn` (if not NULL) is called for every item in index order */
+void radix_destroy(radix_tree_t *tree, void (*fn)(void *item, void *arg), void *arg);
+
+#endif /* __RADIX_H__ */
@@ -0,0 +1,82 @@
+#ifndef __RBTREE_H__
+#define __RBTREE_H__
+
+#include <lib/list.h>
+#include <stddef.h>
+
+/* Intrusive red-black tree
+ *
+ * The tree doesn't know anything about keys: the caller embeds `rb_node_t` into its
+ * own structure, finds the insertion point itself and then calls `rb_insert()` to link
+ * and rebalance the node. Use `container_of()` to get from a node to the structure.
+ *
+ * Searching for a node with key `key`:
+ *
+ *   rb_node_t *n = tree.root;
+ *
+ *   while (n) {
+ *       my_t *e = container_of(n, my_t, node);
+ *
+ *       if (key < e->key)      n = n->left;
+ *       else if (key > e->key) n = n->right;
+ *       else                   return e;
+ *   }
+ *
+ * Augmented trees
+ *
+ * If the tree is initialized with an augment callback, the callback is called for a node
+ * whenever the set of nodes in its subtree changes (insertion, removal and rotations).
+ * The callback must recompute the node's augmented value using only the node itself
+ * and its (already up-to-date) children. If the caller changes the data that the
+ * augmented value is computed from, it must call `rb_propagate()` for that node. */
+
+enum {
+    RB_RED   = 0,
+    RB_BLACK = 1,
+};
+
+typedef struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    int color;
+} rb_node_t;
+
+typedef void (*rb_augment_t)(rb_node_t *node);
+
+/* compare `key` to the key of `node`, return <0, 0 or >0 like kstrcmp() */
+typedef int (*rb_cmp_t)(const void *key, const rb_node_t *node);
+
+typedef struct rb_tree {
+    rb_node_t *root;
+    rb_augment_t augment;
+} rb_tree_t;
+
+/* initialize empty tree, `augment` may be NULL */
+void rb_init(rb_tree_t *tree, rb_augment_t augment);
+
+/* link `node` to `*link` as a child of `parent` and rebalance the tree
+ *
+ * `parent` and `link` are found by the caller by descending the tree:
+ * `link` is either `&parent->left`, `&parent->right` or `&tree->root` (if `parent` is NULL) */
+void rb_insert(rb_tree_t *tree, rb_node_t *node, rb_node_t *parent, rb_node_t **link);
+
+/* unlink `node` from the tree and rebalance the tree */
+void rb_remove(rb_tree_t *tree, rb_node_t *node);
+
+/* recompute the augmented values of `node` and all of its ancestors */
+void rb_propagate(rb_tree_t *tree, rb_node_t *node);
+
+/* in-order traversal, return NULL if there are no more nodes */
+rb_node_t *rb_first(rb_tree_t *tree);
+rb_node_t *rb_last(rb_tree_t *tree);
+rb_node_t *rb_next(rb_node_t *node);
+rb_node_t *rb_prev(rb_node_t *node);
+
+/* return the node whose key equals `key`, NULL if there is none */
+rb_node_t *rb_find(rb_tree_t *tree, const void *key, rb_cmp_t cmp);
+
+/* return the first node whose key is not less than `key`, NULL if there is none */
+rb_node_t *rb_lower_bound(rb_tree_t *tree, const void *key, rb_cmp_t cmp);
+
+#endif /* __RBTREE_H__ */
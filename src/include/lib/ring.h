@@ -0,0 +1,126 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <kernel/compiler.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Lock-free ring buffer of fixed-size records
+ *
+ * A byte ring is a ring with 1-byte records. The number of records is a power of two,
+ * positions are free-running 32-bit counters and `pos & mask` is the slot so a full ring
+ * doesn't waste a slot and wrapping costs nothing.
+ *
+ * There is always exactly one consumer. With RING_SPSC there is also one producer,
+ * with RING_MPSC any number of producers reserve space with a compare-and-swap and
+ * publish their records in reservation order. A producer publishes with a release store
+ * after copying the records and the consumer reads the position with an acquire load
+ * (and vice versa for freeing the slots) so no locks are needed.
+ *
+ * The producer and consumer positions live on separate cache lines and each side keeps
+ * a cached copy of the other side's position that is refreshed only when the ring looks
+ * full/empty, so the common case touches no cache line written by the other side.
+ *
+ * IRQ context: a producer or consumer may run in an interrupt handler. For an MPSC ring
+ * whose producers include an interrupt handler, the other producers on the same CPU must
+ * have interrupts disabled between reserve and commit, otherwise the handler spins forever
+ * waiting for the interrupted producer to publish.
+ *
+ * Zero-copy: ring_reserve() returns a pointer to contiguous free slots which the producer
+ * fills and publishes with ring_commit(). ring_peek()/ring_release() do the same for the
+ * consumer. Fewer records than asked may be returned at the point where the ring wraps. */
+
+enum {
+    RING_SPSC = 0,
+    RING_MPSC = 1,
+};
+
+typedef struct ring {
+    /* read-only after ring_init() */
+    uint8_t *data;
+    uint32_t mask;
+    uint32_t esize;
+    uint32_t flags;
+
+    struct {
+        volatile uint32_t head;  /* end of reserved records */
+        volatile uint32_t tail;  /* end of published records */
+        uint32_t cons_cache;     /* last seen `cons.head`, SPSC only */
+    } prod __cacheline_aligned;
+
+    struct {
+        volatile uint32_t head;  /* next record to consume */
+        uint32_t prod_cache;     /* last seen `prod.tail` */
+    } cons __cacheline_aligned;
+} ring_t;
+
+/* initialize `ring` to use `mem` which holds `count` records of `esize` bytes
+ *
+ * return 0 on success
+ * return -EINVAL if `count` is not a power of two */
+int ring_init(ring_t *ring, void *mem, uint32_t count, uint32_t esize, int flags);
+
+/* allocate a ring and its storage
+ *
+ * return pointer to ring on success
+ * return NULL and set errno on error */
+ring_t *ring_alloc(uint32_t count, uint32_t esize, int flags);
+
+/* free a ring allocated with ring_alloc() */
+void ring_free(ring_t *ring);
+
+/* enqueue/dequeue as many of the `n` records as fit/are available
+ *
+ * return the number of records copied */
+uint32_t ring_enqueue(ring_t *ring, const void *recs, uint32_t n);
+uint32_t ring_dequeue(ring_t *ring, void *recs, uint32_t n);
+
+/* enqueue/dequeue all `n` records or nothing
+ *
+ * return `n` on success
+ * return 0 if there isn't enough space/records */
+uint32_t ring_enqueue_bulk(ring_t *ring, const void *recs, uint32_t n);
+uint32_t ring_dequeue_bulk(ring_t *ring, void *recs, uint32_t n);
+
+/* reserve at most `n` contiguous free records and store their address to `ptr`
+ *
+ * every successful reservation must be published with ring_commit()
+ *
+ * return the number of records reserved, 0 if the ring is full */
+uint32_t ring_reserve(ring_t *ring, uint32_t n, void **ptr);
+
+/* publish `n` records reserved by ring_reserve() at `ptr` */
+void ring_commit(ring_t *ring, void *ptr, uint32_t n);
+
+/* get the address of at most `n` contiguous published records to `ptr`
+ *
+ * return the number of records available, 0 if the ring is empty */
+uint32_t ring_peek(ring_t *ring, uint32_t n, void **ptr);
+
+/* free the first `n` records returned by ring_peek() */
+void ring_release(ring_t *ring, uint32_t n);
+
+static inline uint32_t ring_capacity(ring_t *ring)
+{
+    return ring->mask + 1;
+}
+
+/* the values are a snapshot and may be stale by the time they're used */
+static inline uint32_t ring_count(ring_t *ring)
+{
+    return __atomic_load_n(&ring->prod.tail, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&ring->cons.head, __ATOMIC_ACQUIRE);
+}
+
+static inline uint32_t ring_free_count(ring_t *ring)
+{
+    return ring_capacity(ring) - ring_count(ring);
+}
+
+static inline bool ring_empty(ring_t *ring)
+{
+    return ring_count(ring) == 0;
+}
+
+#endif /* __RING_H__ */
@@ -1,6 +1,7 @@
 #ifndef __PAGE_H__
 #define __PAGE_H__
 
+#include <mm/types.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -10,6 +11,12 @@ void mm_zones_init(void *arg);
 /* allocate block of physical memory */
 uint64_t mm_block_alloc(uint32_t memzone, uint32_t order, int flags);
 
+/* allocate block of physical memory
+ *
+ * unlike `mm_block_alloc()`, return INVALID_ADDRESS and set errno on error
+ * so this can be used for opportunistic allocations */
+uint64_t mm_block_try_alloc(uint32_t memzone, uint32_t order, int flags);
+
 /* allocate one page of physical memory */
 uint64_t mm_page_alloc(uint32_t memzone, int flags);
 
@@ -19,10 +26,43 @@ int mm_block_free(uint64_t address, uint32_t order);
 /* free a page of physical memory */
 int mm_page_free(uint64_t address);
 
+/* free the pages of `len` bytes at `address`, allocated or reserved at boot, in as few
+ * blocks as possible. The range is rounded inwards to page boundaries */
+void mm_free_range(uint64_t address, size_t len);
+
+/* store the physical address and the length of the first boot module to `start`
+ * and `len`, the module is recorded by mm_zones_init() while the multiboot2
+ * information is still intact
+ *
+ * return 0 on success
+ * return -ENOENT if there are no boot modules */
+int mm_boot_module(uint64_t *start, size_t *len);
+
+/* return the page array entry of physical address `address`
+ * or NULL if the page array doesn't cover it */
+page_t *mm_get_page(uint64_t address);
+
 /* claim a page of physical memory at `addres` for page frame allocator */
 void mm_claim_page(uint64_t address);
 
 /* claim a range of physical memory for page frame allocator */
 void mm_claim_range(uint64_t address, size_t len);
 
+/* Shrinkers release memory held by caches when an allocation fails
+ *
+ * `scan()` returns at most `nr` pages to the page allocator and returns the number
+ * returned. Freeing slab objects counts once their page has been returned, see
+ * mm_cache_pages(). Heap pages are kept so freeing heap objects doesn't count.
+ * It's called without any allocator lock held but it may be called from
+ * inside an allocation so it must not wait for a lock held while allocating. */
+typedef struct mm_shrinker {
+    size_t (*scan)(size_t nr);
+    struct mm_shrinker *next;
+} mm_shrinker_t;
+
+void mm_register_shrinker(mm_shrinker_t *shrinker);
+
+/* ask every shrinker to free at most `nr` pages, return the total freed */
+size_t mm_shrink(size_t nr);
+
 #endif /* __PAGE_H__ */
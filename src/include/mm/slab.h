@@ -26,6 +26,14 @@ void *mm_cache_alloc_entry(mm_cache_t *cache);
  * `entry` - non-null pointer to the entry */
 int mm_cache_free_entry(mm_cache_t *cache, void *entry);
 
+/* return the number of pages a slab cache holds
+ *
+ * A page is returned to the page allocator when all of its entries have been freed
+ * so shrinkers can tell how many pages freeing entries released
+ *
+ * `cache` - non-null pointer to a slab cache */
+size_t mm_cache_pages(mm_cache_t *cache);
+
 /* initialize the slab allocator using boot memory allocator */
 int mm_slab_preinit(void);
 
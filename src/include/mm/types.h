@@ -31,10 +31,15 @@ enum MM_PAGE_TYPES {
 };
 
 typedef struct page {
-    list_head_t list;
+    union {
+        list_head_t list;
+        void *slab; /* the slab page descriptor if a slab cache owns the page */
+    };
     uint8_t type:2;  /* page type */
     uint8_t order:5; /* block order [0, BUDDY_MAX_ORDER[ */
     uint8_t first:1; /* first block of range? */
+    uint16_t pt_count; /* present entries if the page is a page table */
+    uint16_t cow_shares; /* other address spaces that map the frame copy-on-write */
 } page_t;
 
 #endif /* __MMU_TYPES_H__ */
@@ -0,0 +1,147 @@
+#ifndef __VMA_H__
+#define __VMA_H__
+
+#include <lib/rbtree.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum MM_PROT {
+    MM_PROT_NONE  = 0,
+    MM_PROT_READ  = 1 << 0,
+    MM_PROT_WRITE = 1 << 1,
+};
+
+enum MM_VMA_FLAGS {
+    MM_VMA_ANON    = 1 << 0,
+    MM_VMA_FILE    = 1 << 1, /* backed by the frames of an object, see mm_map_file() */
+    MM_VMA_PRIVATE = 1 << 2, /* writes go to private copies of the object's frames */
+};
+
+typedef struct mm_vma mm_vma_t;
+
+/* backing object of a file VMA */
+typedef struct mm_vma_ops {
+    /* return the frame of page `pgoff` of the object or INVALID_ADDRESS
+     *
+     * `shared` is set if the frame belongs to the object: it's only mapped and
+     * never freed by the VMA. Otherwise the frame was allocated for this mapping
+     * and it's freed when it's unmapped */
+    uint64_t (*frame)(mm_vma_t *vma, uint64_t pgoff, bool *shared);
+
+    /* called for every new VMA of the object (including the ones created by
+     * splitting a VMA) and for every VMA that is removed, both are optional */
+    void (*open)(mm_vma_t *vma);
+    void (*close)(mm_vma_t *vma);
+} mm_vma_ops_t;
+
+/* virtual memory area, range [start, end[ of an address space
+ * with the same protection and backing */
+struct mm_vma {
+    rb_node_t node;
+    uint64_t start;
+    uint64_t end;
+    int prot;
+    int flags;
+
+    /* `MM_VMA_FILE` only */
+    const mm_vma_ops_t *ops;
+    void *private;
+    uint64_t pgoff;     /* page offset of `start` in the object */
+};
+
+/* user address space
+ *
+ * VMAs are kept in a red-black tree ordered by start address.
+ * Page tables are populated lazily by the page fault handler */
+typedef struct mm_as {
+    uint64_t *pml4;     /* virtual address of the page directory */
+    rb_tree_t vmas;
+    mm_vma_t *last;     /* result of the last lookup */
+    size_t nvmas;
+} mm_as_t;
+
+/* create an empty address space
+ *
+ * return pointer to the address space on success
+ * return NULL and set errno on error */
+mm_as_t *mm_as_create(void);
+
+/* unmap all memory of address space `as` and release it
+ *
+ * `as` must not be the active address space of any CPU */
+void mm_as_destroy(mm_as_t *as);
+
+/* make `as` the active address space of the calling CPU */
+void mm_as_switch(mm_as_t *as);
+
+/* return the active address space of the calling CPU or NULL */
+mm_as_t *mm_as_current(void);
+
+/* map `len` bytes of anonymous memory at `addr`
+ *
+ * nothing is allocated here: each page is allocated and zeroed
+ * when it's touched for the first time
+ *
+ * `addr` and `len` must be page aligned and the range must be free
+ * `prot` - combination of `MM_PROT` flags
+ *
+ * return 0 on success
+ * return -EINVAL if the range is invalid
+ * return -EEXIST if the range overlaps an existing mapping
+ * return -ENOMEM if out of memory */
+int mm_map_anon(mm_as_t *as, uint64_t addr, size_t len, int prot);
+
+/* map `len` bytes of an object at `addr`, page `pgoff` of the object is mapped at `addr`
+ *
+ * nothing is mapped here: each page is mapped when it's touched for the first time,
+ * the frames come from `ops->frame()`. Frames of the object are mapped read-only in
+ * a `MM_VMA_PRIVATE` mapping and copied on the first write
+ *
+ * `flags` - 0 for a shared mapping or `MM_VMA_PRIVATE`
+ *
+ * return values are the same as mm_map_anon()'s */
+int mm_map_file(mm_as_t *as, uint64_t addr, size_t len, int prot, int flags,
+                const mm_vma_ops_t *ops, void *private, uint64_t pgoff);
+
+/* unmap range [addr, addr + len[ and free its pages
+ *
+ * VMAs that are only partially covered by the range are trimmed or split */
+int mm_unmap(mm_as_t *as, uint64_t addr, size_t len);
+
+/* return the VMA that contains `addr` or NULL */
+mm_vma_t *mm_find_vma(mm_as_t *as, uint64_t addr);
+
+/* handle a page fault at `addr` of address space `as`
+ *
+ * `write` - the faulting access was a write
+ * `present` - the faulting page was present (protection fault)
+ *
+ * return 0 if the fault was resolved
+ * return -EFAULT if the access is not allowed
+ * return -ENOMEM if there's no memory for the page or the tables that map it */
+int mm_handle_fault(mm_as_t *as, uint64_t addr, int write, int present);
+
+/* fault in the page of `addr` like an access by the user would and return the
+ * physical address of `addr`, INVALID_ADDRESS if the access is not allowed */
+uint64_t mm_get_user_page(mm_as_t *as, uint64_t addr, int write);
+
+/* set the number of pages populated around a faulting page (0 disables fault-around)
+ *
+ * the pages come from the same aligned window as the faulting page and
+ * they're only populated if they belong to the same VMA */
+void mm_set_fault_around(size_t npages);
+
+/* enable or disable transparent huge pages (enabled by default)
+ *
+ * when enabled, the first fault in a 2 MB aligned window that lies completely
+ * inside an anonymous VMA maps the whole window with one 2 MB page if the
+ * window is still empty and a 2 MB block is available */
+void mm_set_thp(int enabled);
+
+/* promote every fully populated 2 MB window of `as` to a huge page
+ *
+ * return the number of windows that were collapsed */
+size_t mm_collapse(mm_as_t *as);
+
+#endif /* __VMA_H__ */
@@ -0,0 +1,36 @@
+#ifndef __VREGION_H__
+#define __VREGION_H__
+
+#include <mm/types.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* initialize the kernel virtual region allocator
+ *
+ * must be called after the slab allocator has been initialized */
+int mm_vregion_init(void);
+
+/* allocate `len` bytes of kernel virtual address space from the I/O window
+ *
+ * the returned address is congruent to `offset` modulo `align` (a power of two)
+ * which allows the caller to use large pages for the mapping
+ *
+ * return INVALID_ADDRESS and set errno on error */
+uint64_t mm_vregion_alloc(size_t len, size_t align, uint64_t offset);
+
+/* release region allocated with `mm_vregion_alloc()` */
+int mm_vregion_free(uint64_t addr);
+
+/* map `len` bytes of device memory at `paddr` to the kernel half
+ *
+ * the mapping is shared by all address spaces and it uses the largest pages possible
+ * `cache_mode` is one of `MM_CACHE_MODES` (usually `MM_UC` or `MM_WC`)
+ *
+ * return pointer to the first byte of `paddr` on success
+ * return NULL and set errno on error */
+void *ioremap(uint64_t paddr, size_t len, int cache_mode);
+
+/* unmap memory mapped with `ioremap()` */
+void iounmap(void *addr);
+
+#endif /* __VREGION_H__ */
@@ -1,11 +1,13 @@
 #include <drivers/bus/pci.h>
 #include <kernel/acpi/acpica/acpi.h>
 #include <kernel/irq.h>
-// #include <sync/spinlock.h>
 #include <kernel/io.h>
 #include <kernel/kprint.h>
+#include <kernel/lock.h>
+#include <arch/amd64/mmu.h>
 #include <mm/heap.h>
 #include <mm/mmu.h>
+#include <mm/vregion.h>
 
 extern unsigned long acpi_get_rspd(void);
 
@@ -34,19 +36,22 @@ void AcpiOsFree(void *ptr)
 
 void *AcpiOsMapMemory(ACPI_PHYSICAL_ADDRESS addr, ACPI_SIZE length)
 {
-    (void)length;
-
-    /* kdebug("0x%x", addr); */
-    /* if ((addr & 0xff) == 0xca) { */
-    /*     /1* for (;;); *1/ */
-    /* } */
+    /* ACPI tables live in ACPI reclaimable or NVS ranges, or below 1 MB, which are
+     * covered by the direct map. Operation regions may be in device memory that
+     * isn't, those are mapped uncached */
+    if (amd64_is_direct_mapped(addr, length))
+        return (void *)amd64_p_to_v(addr);
 
-    return (void *)addr;
+    return ioremap(addr, length, MM_UC);
 }
 
 void AcpiOsUnmapMemory(void *addr, ACPI_SIZE length)
 {
-    (void)addr, (void)length;
+    (void)length;
+
+    /* direct map addresses stay mapped, only ioremap() mappings are in the I/O window */
+    if ((uint64_t)addr >= KIOSTART && (uint64_t)addr < KIOSTART + KIOSIZE)
+        iounmap(addr);
 }
 
 ACPI_STATUS AcpiOsWriteMemory(ACPI_PHYSICAL_ADDRESS Address, uint64_t Value, uint32_t width)
@@ -147,25 +152,36 @@ ACPI_STATUS AcpiOsSignalSemaphore(ACPI_SEMAPHORE handle, uint32_t units)
     return AE_OK;
 }
 
+/* ACPICA takes its spinlocks also from the SCI handler so interrupts are disabled */
 ACPI_STATUS AcpiOsCreateLock(ACPI_SPINLOCK *out_handle)
 {
-    *out_handle = (void *)0x1337;
+    spinlock_t *lock;
+
+    if (!out_handle)
+        return AE_BAD_PARAMETER;
+
+    if (!(lock = kmalloc(sizeof(spinlock_t))))
+        return AE_NO_MEMORY;
+
+    spin_init(lock);
+    *out_handle = lock;
+
     return AE_OK;
 }
 
 void AcpiOsDeleteLock(ACPI_HANDLE handle)
 {
-    kdebug("NOT IMPLEMENTED");
+    kfree(handle);
 }
 
 ACPI_CPU_FLAGS AcpiOsAcquireLock(ACPI_SPINLOCK handle)
 {
-    kdebug("NOT IMPLEMENTED");
+    return spin_lock_irqsave(handle);
 }
 
 void AcpiOsReleaseLock(ACPI_SPINLOCK handle, ACPI_CPU_FLAGS flags)
 {
-    kdebug("NOT IMPLEMENTED");
+    spin_unlock_irqrestore(handle, flags);
 }
 
 UINT64 AcpiOsGetTimer()
@@ -1,7 +1,9 @@
 #include <arch/amd64/cpu.h>
+#include <kernel/compiler.h>
 #include <kernel/irq.h>
 #include <kernel/kpanic.h>
 #include <kernel/kassert.h>
+#include <kernel/lock.h>
 #include <kernel/util.h>
 
 #define MAX_INT      256
@@ -20,6 +22,11 @@ static struct irq_handler {
     } handlers[MAX_HANDLERS];
 } handlers[MAX_INT];
 
+/* serializes handler installation, interrupt_handler() reads the table without it:
+ * a new handler is published by incrementing `installed` after the handler is stored
+ * and an uninstalled handler is only cleared, never removed */
+static spinlock_t handlers_lock;
+
 const char *interrupts[] = {
     "division by zero",            "debug exception",          "non-maskable interrupt",
     "breakpoint",                  "into detected overflow",   "out of bounds",
@@ -33,6 +40,7 @@ const char *interrupts[] = {
 void irq_init(void)
 {
     kmemset(handlers, 0, sizeof(handlers));
+    spin_init(&handlers_lock);
 
     handlers[VECNUM_PAGE_FAULT].installed           = 1;
     handlers[VECNUM_PAGE_FAULT].handlers[0].handler = amd64_page_fault_handler;
@@ -45,14 +53,21 @@ void irq_init(void)
 
 void interrupt_handler(cpu_state_t *cpu_state)
 {
-    if (cpu_state->isr_num > MAX_INT)
+    if (cpu_state->isr_num >= MAX_INT)
         kpanic("isr number is too high");
 
-    if (handlers[cpu_state->isr_num].installed) {
+    int installed = __atomic_load_n(&handlers[cpu_state->isr_num].installed, __ATOMIC_ACQUIRE);
+
+    if (installed) {
         uint32_t ret;
 
-        for (int i = 0; i < handlers[cpu_state->isr_num].installed; ++i) {
-            ret = handlers[cpu_state->isr_num].handlers[i].handler(
+        for (int i = 0; i < installed; ++i) {
+            uint32_t (*handler)(void *) = READ_ONCE(handlers[cpu_state->isr_num].handlers[i].handler);
+
+            if (!handler)
+                continue;
+
+            ret = handler(
                     handlers[cpu_state->isr_num].handlers[i].ctx ?
                         handlers[cpu_state->isr_num].handlers[i].ctx :
                         cpu_state
@@ -82,13 +97,19 @@ void interrupt_handler(cpu_state_t *cpu_state)
 void irq_install_handler(int num, uint32_t (*handler)(void *), void *ctx)
 {
     kassert((num >= 0 && num < MAX_INT) && (handler != NULL));
-    kassert(handlers[num].installed < MAX_HANDLERS);
 
     kprint("irq - installing irq handler, num %d, handler 0x%x, ctx 0x%x\n", num, handler, ctx);
 
-    handlers[num].handlers[handlers[num].installed].handler = handler;
-    handlers[num].handlers[handlers[num].installed].ctx     = ctx;
-    handlers[num].installed++;
+    uint64_t flags = spin_lock_irqsave(&handlers_lock);
+    int slot       = handlers[num].installed;
+
+    kassert(slot < MAX_HANDLERS);
+
+    handlers[num].handlers[slot].handler = handler;
+    handlers[num].handlers[slot].ctx     = ctx;
+    __atomic_store_n(&handlers[num].installed, slot + 1, __ATOMIC_RELEASE);
+
+    spin_unlock_irqrestore(&handlers_lock, flags);
 }
 
 void irq_uninstall_handler(int num, uint32_t (*handler)(void *))
@@ -97,8 +118,12 @@ void irq_uninstall_handler(int num, uint32_t (*handler)(void *))
 
     kprint("irq - uninstalling irq handler, num %d, handler 0x%x\n", num, handler);
 
+    uint64_t flags = spin_lock_irqsave(&handlers_lock);
+
     for (int i = 0; i < handlers[num].installed; ++i) {
         if (handlers[num].handlers[i].handler == handler)
-            handlers[num].handlers[i].handler = NULL;
+            __atomic_store_n(&handlers[num].handlers[i].handler, NULL, __ATOMIC_RELAXED);
     }
+
+    spin_unlock_irqrestore(&handlers_lock, flags);
 }
@@ -21,11 +21,12 @@
 
 // defined by the linker
 extern uint8_t _trampoline_start, _trampoline_end;
-extern uint8_t _percpu_start, _percpu_end;
-extern uint8_t _kernel_physical_end;
 
 void init_bsp(void *arg)
 {
+    // pick the memory copy routines for this CPU
+    kutil_init();
+
     // initialize the interrupt subsystem
     irq_init();
 
@@ -62,17 +63,8 @@ void init_bsp(void *arg)
     kmemcpy((uint8_t *)0x55000, &_trampoline_start, trmp_size);
 
     // initialize percpu areas for BSP and APs
-    uint64_t kernel_end   = (uint64_t)&_kernel_physical_end;
-    uint64_t percpu_start = ROUND_UP(kernel_end, PAGE_SIZE);
-    size_t percpu_size    = (uint64_t)&_percpu_end - (uint64_t)&_percpu_start;
-
-    for (size_t i = 0; i < lapic_get_cpu_count(); ++i) {
-        kmemcpy(
-            (uint8_t *)&percpu_start + i * percpu_size,
-            (uint8_t *)&_percpu_start,
-            percpu_size
-        );
-    }
+    if (percpu_setup(lapic_get_cpu_count()) < 0)
+        kpanic("failed to allocate percpu areas");
 
     // initialize percpu state and GS base for BSP
     percpu_init(0);
@@ -89,6 +81,8 @@ void init_bsp(void *arg)
 
 void init_ap(void *arg)
 {
+    mm_native_init_ap();
+
     gdt_init();
     idt_init();
 
@@ -1,11 +1,20 @@
 #include <kernel/compiler.h>
 #include <arch/amd64/cpu.h>
 #include <kernel/kpanic.h>
+#include <kernel/kprint.h>
+#include <kernel/lock.h>
 
 void __noreturn kpanic(const char *error)
 {
     disable_irq();
 
+    kprint("\nkernel panic: %s\n", error);
+
+#ifdef CONFIG_LOCK_STAT
+    /* a hang behind a panic is often a lock, show where the time went */
+    lock_stat_dump();
+#endif
+
     while (1) { }
     __builtin_unreachable();
 }
@@ -1,14 +1,24 @@
 #include <fs/elf.h>
 #include <kernel/kassert.h>
 #include <kernel/util.h>
+#include <lib/itree.h>
+#include <mm/heap.h>
 
 #define CALL_STACK_MAX_DEPTH 8
 
+typedef struct ksym {
+    itree_node_t node;
+    const char *name;
+} ksym_t;
+
 static uint8_t *__sym;
 static uint8_t *__str;
 static size_t __sym_size;
 static size_t __str_size;
 
+static itree_t __funcs;
+static ksym_t *__ksyms;
+
 /* Printing a stack trace for kernel asserts
  *
  * Assert in itself is a very useful tool for checking the logic of the program
@@ -23,7 +33,11 @@ static size_t __str_size;
  *
  * As the base pointer unwound, its current value is checked against the ELF
  * symbol table and if a corresponding function name is found, its name is printed.
- * Otherwise only the address is printed. */
+ * Otherwise only the address is printed.
+ *
+ * The function symbols are put into an interval tree when they're registered so
+ * each frame is resolved in O(log n). If the tree can't be allocated, the symbol
+ * table is searched linearly. */
 
 int ktrace_register_sym(uint8_t *sym, size_t sym_size, uint8_t *str, size_t str_size)
 {
@@ -32,31 +46,67 @@ int ktrace_register_sym(uint8_t *sym, size_t sym_size, uint8_t *str, size_t str_
     __sym_size = sym_size;
     __str_size = str_size;
 
+    itree_init(&__funcs);
+
+    size_t nfuncs = 0;
+
+    for (size_t i = 0; i < sym_size; i += sizeof(Elf64_Sym)) {
+        Elf64_Sym *iter = (Elf64_Sym *)(sym + i);
+
+        if (ELF64_ST_TYPE(iter->st_info) == STT_FUNC)
+            nfuncs++;
+    }
+
+    if (!nfuncs || !(__ksyms = kmalloc(nfuncs * sizeof(ksym_t))))
+        return 0;
+
+    for (size_t i = 0, k = 0; i < sym_size; i += sizeof(Elf64_Sym)) {
+        Elf64_Sym *iter = (Elf64_Sym *)(sym + i);
+
+        if (ELF64_ST_TYPE(iter->st_info) != STT_FUNC)
+            continue;
+
+        __ksyms[k].node.start = iter->st_value;
+        __ksyms[k].node.last  = iter->st_value + iter->st_size;
+        __ksyms[k].name       = (const char *)&str[iter->st_name];
+
+        itree_insert(&__funcs, &__ksyms[k++].node);
+    }
+
     return 0;
 }
 
-static int __trace(uint64_t rbp)
+static const char *__find_func(uint64_t addr)
 {
-    Elf64_Sym *iter = (Elf64_Sym *)__sym;
+    if (__ksyms) {
+        itree_node_t *node = itree_stab(&__funcs, addr);
+
+        return node ? container_of(node, ksym_t, node)->name : NULL;
+    }
+
+    for (size_t i = 0; i < __sym_size; i += sizeof(Elf64_Sym)) {
+        Elf64_Sym *iter = (Elf64_Sym *)(__sym + i);
 
-    for (size_t i = 0; i < __sym_size; ) {
-        iter = (Elf64_Sym *)((uint8_t *) __sym + i);
+        if (ELF64_ST_TYPE(iter->st_info) == STT_FUNC &&
+            iter->st_value <= addr && addr <= iter->st_value + iter->st_size)
+            return (const char *)&__str[iter->st_name];
+    }
 
-        if (iter->st_value <= rbp && rbp <= iter->st_value + iter->st_size) {
-            if (ELF64_ST_TYPE(iter->st_info) == STT_FUNC) {
-                kprint("--> 0x%x %s\n", rbp, &__str[iter->st_name]);
+    return NULL;
+}
 
-                if (!kstrcmp((const char *)&__str[iter->st_name], "kmain"))
-                    return 1;
-                return 0;
-            } else
-                kprint("--> 0x%x\n", rbp);
-        }
+static int __trace(uint64_t rbp)
+{
+    const char *name = __find_func(rbp);
 
-        i += sizeof(Elf64_Sym);
+    if (!name) {
+        kprint("--> 0x%x\n", rbp);
+        return 0;
     }
 
-    return 0;
+    kprint("--> 0x%x %s\n", rbp, name);
+
+    return !kstrcmp(name, "kmain");
 }
 
 void ktrace(void)
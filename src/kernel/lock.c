@@ -0,0 +1,312 @@
+#include <arch/amd64/cpu.h>
+#include <kernel/kprint.h>
+#include <kernel/lock.h>
+
+#define RW_WRITER  (1U << 31)
+#define RW_WAITING (1U << 30) /* a writer is waiting, new readers must wait */
+#define RW_READERS (RW_WAITING - 1)
+
+#ifdef CONFIG_LOCK_STAT
+static lock_class_t *__classes;
+
+static void __register(lock_class_t *class)
+{
+    if (!class || __atomic_exchange_n(&class->registered, 1, __ATOMIC_ACQ_REL))
+        return;
+
+    class->next = __atomic_load_n(&__classes, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(&__classes, &class->next, class, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+}
+
+static void __stat_acquired(lock_class_t *class, uint64_t *held_since, uint64_t start, bool contended)
+{
+    uint64_t now = get_tsc();
+
+    if (held_since)
+        *held_since = now;
+
+    if (!class)
+        return;
+
+    __atomic_fetch_add(&class->acquired, 1, __ATOMIC_RELAXED);
+
+    if (contended) {
+        __atomic_fetch_add(&class->contended,   1,           __ATOMIC_RELAXED);
+        __atomic_fetch_add(&class->spin_cycles, now - start, __ATOMIC_RELAXED);
+    }
+}
+
+static void __stat_released(lock_class_t *class, uint64_t held_since)
+{
+    if (!class)
+        return;
+
+    uint64_t hold = get_tsc() - held_since;
+    uint64_t max  = __atomic_load_n(&class->max_hold, __ATOMIC_RELAXED);
+
+    while (hold > max && !__atomic_compare_exchange_n(&class->max_hold, &max, hold, true,
+                                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+#define STAT_INIT(lock, cls)       do { (lock)->class = (cls); __register(cls); } while (0)
+#define STAT_BEGIN()               uint64_t __start = get_tsc()
+#define STAT_ACQUIRED(lock, cont)  __stat_acquired((lock)->class, &(lock)->held_since, __start, (cont))
+#define STAT_SHARED(lock, cont)    __stat_acquired((lock)->class, NULL, __start, (cont))
+#define STAT_RELEASED(lock)        __stat_released((lock)->class, (lock)->held_since)
+#else
+#define STAT_INIT(lock, cls)       ((void)(cls))
+#define STAT_BEGIN()
+#define STAT_ACQUIRED(lock, cont)  ((void)(cont))
+#define STAT_SHARED(lock, cont)    ((void)(cont))
+#define STAT_RELEASED(lock)
+#endif
+
+void __spin_init(spinlock_t *lock, lock_class_t *class)
+{
+    lock->locked = 0;
+    STAT_INIT(lock, class);
+}
+
+void __ticket_init(ticket_t *lock, lock_class_t *class)
+{
+    lock->next  = 0;
+    lock->owner = 0;
+    STAT_INIT(lock, class);
+}
+
+void __mcs_init(mcs_lock_t *lock, lock_class_t *class)
+{
+    lock->tail = NULL;
+    STAT_INIT(lock, class);
+}
+
+void __rwlock_init(rwlock_t *lock, lock_class_t *class)
+{
+    lock->state = 0;
+    STAT_INIT(lock, class);
+}
+
+void spin_lock(spinlock_t *lock)
+{
+    bool contended = false;
+    STAT_BEGIN();
+
+    /* spin on a plain read so waiters don't keep stealing the cache line from the owner */
+    while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+        contended = true;
+
+        while (lock->locked)
+            cpu_relax();
+    }
+
+    STAT_ACQUIRED(lock, contended);
+}
+
+bool spin_trylock(spinlock_t *lock)
+{
+    STAT_BEGIN();
+
+    if (lock->locked || __atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE))
+        return false;
+
+    STAT_ACQUIRED(lock, false);
+    return true;
+}
+
+void spin_unlock(spinlock_t *lock)
+{
+    STAT_RELEASED(lock);
+    __atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+uint64_t spin_lock_irqsave(spinlock_t *lock)
+{
+    uint64_t flags = disable_irq_save();
+
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags)
+{
+    spin_unlock(lock);
+    restore_irq(flags);
+}
+
+void ticket_lock(ticket_t *lock)
+{
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    bool contended  = false;
+    STAT_BEGIN();
+
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        contended = true;
+        cpu_relax();
+    }
+
+    STAT_ACQUIRED(lock, contended);
+}
+
+void ticket_unlock(ticket_t *lock)
+{
+    STAT_RELEASED(lock);
+
+    /* only the owner writes `owner` so a plain increment is enough */
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t ticket_lock_irqsave(ticket_t *lock)
+{
+    uint64_t flags = disable_irq_save();
+
+    ticket_lock(lock);
+    return flags;
+}
+
+void ticket_unlock_irqrestore(ticket_t *lock, uint64_t flags)
+{
+    ticket_unlock(lock);
+    restore_irq(flags);
+}
+
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node)
+{
+    mcs_node_t *prev;
+    STAT_BEGIN();
+
+    node->next   = NULL;
+    node->locked = 1;
+
+    if (!(prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL))) {
+        STAT_ACQUIRED(lock, false);
+        return;
+    }
+
+    /* queue behind the previous tail and wait until it hands the lock over */
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+
+    while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+        cpu_relax();
+
+    STAT_ACQUIRED(lock, true);
+}
+
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node)
+{
+    mcs_node_t *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+
+    STAT_RELEASED(lock);
+
+    if (!next) {
+        mcs_node_t *expected = node;
+
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+
+        /* a new waiter has swapped the tail but hasn't linked itself yet */
+        while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)))
+            cpu_relax();
+    }
+
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+uint64_t mcs_lock_irqsave(mcs_lock_t *lock, mcs_node_t *node)
+{
+    uint64_t flags = disable_irq_save();
+
+    mcs_lock(lock, node);
+    return flags;
+}
+
+void mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node, uint64_t flags)
+{
+    mcs_unlock(lock, node);
+    restore_irq(flags);
+}
+
+void read_lock(rwlock_t *lock)
+{
+    bool contended = false;
+    STAT_BEGIN();
+
+    for (;;) {
+        uint32_t state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+
+        if (!(state & (RW_WRITER | RW_WAITING)) &&
+            __atomic_compare_exchange_n(&lock->state, &state, state + 1, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+
+        contended = true;
+        cpu_relax();
+    }
+
+    STAT_SHARED(lock, contended);
+}
+
+void read_unlock(rwlock_t *lock)
+{
+    __atomic_fetch_sub(&lock->state, 1, __ATOMIC_RELEASE);
+}
+
+void write_lock(rwlock_t *lock)
+{
+    bool contended = false;
+    STAT_BEGIN();
+
+    for (;;) {
+        uint32_t state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+
+        /* taking the lock clears `RW_WAITING`, other waiting writers set it again */
+        if (!(state & (RW_WRITER | RW_READERS)) &&
+            __atomic_compare_exchange_n(&lock->state, &state, RW_WRITER, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+
+        if (!(state & RW_WAITING))
+            __atomic_fetch_or(&lock->state, RW_WAITING, __ATOMIC_RELAXED);
+
+        contended = true;
+        cpu_relax();
+    }
+
+    STAT_ACQUIRED(lock, contended);
+}
+
+void write_unlock(rwlock_t *lock)
+{
+    STAT_RELEASED(lock);
+    __atomic_fetch_and(&lock->state, ~RW_WRITER, __ATOMIC_RELEASE);
+}
+
+void lock_stat_dump(void)
+{
+#ifdef CONFIG_LOCK_STAT
+    kprint("lock - class: acquired, contended, spin cycles, max hold cycles\n");
+
+    for (lock_class_t *c = __atomic_load_n(&__classes, __ATOMIC_ACQUIRE); c; c = c->next) {
+        kprint("lock - %s: %u, %u, %u, %u\n", c->name,
+               c->acquired, c->contended, c->spin_cycles, c->max_hold);
+    }
+#else
+    kprint("lock - lock statistics are not enabled, build with CONFIG_LOCK_STAT\n");
+#endif
+}
+
+void lock_stat_reset(void)
+{
+#ifdef CONFIG_LOCK_STAT
+    for (lock_class_t *c = __atomic_load_n(&__classes, __ATOMIC_ACQUIRE); c; c = c->next) {
+        __atomic_store_n(&c->acquired,    0, __ATOMIC_RELAXED);
+        __atomic_store_n(&c->contended,   0, __ATOMIC_RELAXED);
+        __atomic_store_n(&c->spin_cycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&c->max_hold,    0, __ATOMIC_RELAXED);
+    }
+#endif
+}
@@ -0,0 +1,225 @@
+#include <kernel/common.h>
+#include <kernel/kassert.h>
+#include <kernel/percpu.h>
+#include <kernel/util.h>
+#include <lib/bitmap.h>
+#include <mm/mmu.h>
+#include <mm/page.h>
+#include <errno.h>
+
+/* the dynamic area is handed out in units of 8 bytes */
+#define DYN_UNIT  8
+#define DYN_UNITS (PERCPU_DYN_SIZE / DYN_UNIT)
+
+uint64_t __percpu_offsets[MAX_CPU];
+
+__percpu uint64_t __percpu_offset;
+__percpu uint32_t __percpu_cpu_id;
+
+static size_t     __ncpus = 1;
+static bitmap_t   *__dyn_used;  /* allocated units */
+static bitmap_t   *__dyn_last;  /* last unit of every allocation */
+static spinlock_t __dyn_lock;
+
+static inline size_t __static_size(void)
+{
+    return ROUND_UP((uint64_t)&_percpu_end - (uint64_t)&_percpu_start, 64);
+}
+
+/* per-CPU pointers to the dynamic area start after the static variables */
+static inline uint64_t __dyn_base(void)
+{
+    return (uint64_t)&_percpu_start + __static_size();
+}
+
+int percpu_setup(size_t ncpus)
+{
+    kassert(ncpus > 0 && ncpus <= MAX_CPU);
+
+    size_t static_size = (uint64_t)&_percpu_end - (uint64_t)&_percpu_start;
+    size_t area_size   = __static_size() + PERCPU_DYN_SIZE;
+    uint32_t order     = 0;
+
+    while (((size_t)PAGE_SIZE << order) < area_size)
+        order++;
+
+    if (!(__dyn_used = bm_alloc_bitmap(DYN_UNITS)) || !(__dyn_last = bm_alloc_bitmap(DYN_UNITS)))
+        return -ENOMEM;
+
+    for (size_t cpu = 0; cpu < ncpus; ++cpu) {
+        uint64_t mem = mm_block_try_alloc(MM_ZONE_NORMAL, order, 0);
+
+        if (mem == INVALID_ADDRESS) {
+            while (cpu--)
+                (void)mm_block_free(amd64_v_to_p(percpu_ptr(&_percpu_start, cpu)), order);
+            return -ENOMEM;
+        }
+
+        uint8_t *area = (uint8_t *)amd64_p_to_v(mem);
+
+        kmemcpy(area, &_percpu_start, static_size);
+        kmemset(area + static_size, 0, ((size_t)PAGE_SIZE << order) - static_size);
+
+        __percpu_offsets[cpu] = (uint64_t)area - (uint64_t)&_percpu_start;
+
+        get_percpu_var(__percpu_offset, cpu) = __percpu_offsets[cpu];
+        get_percpu_var(__percpu_cpu_id, cpu) = cpu;
+    }
+
+    spin_init(&__dyn_lock);
+    __ncpus = ncpus;
+
+    return 0;
+}
+
+void percpu_init(uint32_t cpu)
+{
+    kassert(cpu < __ncpus);
+
+    /* GS base is written once, all accesses after this are `%gs`-relative */
+    set_msr(GS_BASE, __percpu_offsets[cpu]);
+}
+
+size_t percpu_cpu_count(void)
+{
+    return __ncpus;
+}
+
+void *percpu_alloc(size_t size, size_t align)
+{
+    if (!__dyn_used) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (size == 0 || size > PERCPU_DYN_SIZE || (align & (align - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t units = (size + DYN_UNIT - 1) / DYN_UNIT;
+    size_t step  = (align > DYN_UNIT) ? align / DYN_UNIT : 1;
+    uint64_t flags = spin_lock_irqsave(&__dyn_lock);
+    int start = 0;
+
+    for (;;) {
+        if ((size_t)start >= DYN_UNITS ||
+            (start = bm_find_first_unset_range(__dyn_used, start, DYN_UNITS - 1, units)) < 0) {
+            spin_unlock_irqrestore(&__dyn_lock, flags);
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        if ((size_t)start % step == 0)
+            break;
+
+        start = ROUND_UP((size_t)start, step);
+    }
+
+    bm_set_range(__dyn_used, start, start + units - 1);
+    bm_set_bit(__dyn_last, start + units - 1);
+
+    spin_unlock_irqrestore(&__dyn_lock, flags);
+
+    void *ptr = (void *)(__dyn_base() + start * DYN_UNIT);
+
+    for (size_t cpu = 0; cpu < __ncpus; ++cpu)
+        kmemset(percpu_ptr(ptr, cpu), 0, units * DYN_UNIT);
+
+    return ptr;
+}
+
+void percpu_free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    uint32_t unit = ((uint64_t)ptr - __dyn_base()) / DYN_UNIT;
+
+    kassert((uint64_t)ptr >= __dyn_base() && unit < DYN_UNITS);
+
+    uint64_t flags = spin_lock_irqsave(&__dyn_lock);
+    int last       = bm_find_next_set(__dyn_last, unit);
+
+    kassert(last >= 0);
+
+    bm_unset_bit(__dyn_last, last);
+    bm_unset_range(__dyn_used, unit, last);
+
+    spin_unlock_irqrestore(&__dyn_lock, flags);
+}
+
+/* add `amount` to the calling CPU's instance of `*ptr` and return the new value */
+static inline int32_t __delta_add(int32_t *ptr, int32_t amount)
+{
+    int32_t old = amount;
+
+    asm volatile ("xaddl %0, %%gs:(%1)" : "+r"(old) : "r"(ptr) : "memory");
+    return old + amount;
+}
+
+/* reset the calling CPU's instance of `*ptr` to zero and return the old value */
+static inline int32_t __delta_take(int32_t *ptr)
+{
+    int32_t old = 0;
+
+    asm volatile ("xchgl %0, %%gs:(%1)" : "+r"(old) : "r"(ptr) : "memory");
+    return old;
+}
+
+int percpu_counter_init(percpu_counter_t *pc, int64_t value)
+{
+    if (!(pc->deltas = percpu_alloc(sizeof(int32_t), sizeof(int32_t))))
+        return -ENOMEM;
+
+    spin_init(&pc->lock);
+    pc->count = value;
+    pc->batch = PERCPU_COUNTER_BATCH;
+
+    return 0;
+}
+
+void percpu_counter_destroy(percpu_counter_t *pc)
+{
+    percpu_free(pc->deltas);
+    pc->deltas = NULL;
+}
+
+void percpu_counter_add(percpu_counter_t *pc, int64_t amount)
+{
+    if (amount >= pc->batch || amount <= -pc->batch) {
+        uint64_t flags = spin_lock_irqsave(&pc->lock);
+
+        pc->count += amount;
+        spin_unlock_irqrestore(&pc->lock, flags);
+        return;
+    }
+
+    int32_t delta = __delta_add(pc->deltas, amount);
+
+    if (delta >= pc->batch || delta <= -pc->batch) {
+        uint64_t flags = spin_lock_irqsave(&pc->lock);
+
+        /* an interrupt may have folded the delta after the add above */
+        pc->count += __delta_take(pc->deltas);
+        spin_unlock_irqrestore(&pc->lock, flags);
+    }
+}
+
+int64_t percpu_counter_read(percpu_counter_t *pc)
+{
+    return READ_ONCE(pc->count);
+}
+
+int64_t percpu_counter_sum(percpu_counter_t *pc)
+{
+    uint64_t flags = spin_lock_irqsave(&pc->lock);
+    int64_t sum    = pc->count;
+
+    for (size_t cpu = 0; cpu < __ncpus; ++cpu)
+        sum += READ_ONCE(*percpu_ptr(pc->deltas, cpu));
+
+    spin_unlock_irqrestore(&pc->lock, flags);
+
+    return sum;
+}
@@ -1,34 +1,132 @@
+#include <arch/amd64/cpu.h>
 #include <kernel/util.h>
 #include <mm/heap.h>
 #include <stdint.h>
 
-size_t kstrlen(const char *str)
+/* `rep movsb`/`rep stosb` are the fastest way to copy and set memory of any size
+ * with FSRM (fast short rep mov) and of a few hundred bytes or more with ERMS.
+ * Elsewhere, and until kutil_init() has run, `rep movsq`/`rep stosq` are used */
+#define ERMS_THRESHOLD 256
+
+/* smallest size copied or set with `rep movsb`/`rep stosb` */
+static size_t __rep_bytes_min = SIZE_MAX;
+
+/* strings and buffers are read a word at a time, possibly unaligned */
+typedef uint64_t __attribute__((may_alias, aligned(1))) word_t;
+
+#define WORD_ONES  0x0101010101010101ULL
+#define WORD_HIGHS 0x8080808080808080ULL
+
+/* non-zero if any byte of `w` is zero */
+#define HAS_ZERO(w) (((w) - WORD_ONES) & ~(w) & WORD_HIGHS)
+
+void kutil_init(void)
 {
-    size_t len = 0;
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+
+    if (eax < 7)
+        return;
 
-    while (str[len] != '\0')
-        len++;
+    cpuid(7, 0, &eax, &ebx, &ecx, &edx);
 
-    return len;
+    if (edx & CPUID_7_EDX_FSRM)
+        __rep_bytes_min = 0;
+    else if (ebx & CPUID_7_EBX_ERMS)
+        __rep_bytes_min = ERMS_THRESHOLD;
 }
 
-void *kmemcpy(void *restrict dstptr, const void *restrict srcptr, size_t size)
+/* below this size `rep` startup costs more than a loop of moves */
+#define REP_THRESHOLD 64
+
+/* forward copy a word at a time, also safe for overlapping buffers if `dst` < `src` */
+static inline void __copy_words(uint8_t *dst, const uint8_t *src, size_t size)
 {
-    unsigned char *dst = dstptr;
-    const unsigned char *src = srcptr;
+    for (; size >= sizeof(word_t); size -= sizeof(word_t)) {
+        *(word_t *)dst = *(const word_t *)src;
+        dst += sizeof(word_t);
+        src += sizeof(word_t);
+    }
 
-    for (size_t i = 0; i < size; ++i)
-        dst[i] = src[i];
+    while (size--)
+        *dst++ = *src++;
+}
+
+/* forward copy, also safe for overlapping buffers if `dst` < `src` */
+static inline void __copy(void *dst, const void *src, size_t size)
+{
+    if (size >= __rep_bytes_min) {
+        asm volatile ("rep movsb" : "+D"(dst), "+S"(src), "+c"(size) :: "memory");
+        return;
+    }
+
+    if (size < REP_THRESHOLD) {
+        __copy_words(dst, src, size);
+        return;
+    }
+
+    size_t words = size / sizeof(word_t);
+    size_t tail  = size % sizeof(word_t);
+
+    asm volatile ("rep movsq" : "+D"(dst), "+S"(src), "+c"(words) :: "memory");
+    asm volatile ("rep movsb" : "+D"(dst), "+S"(src), "+c"(tail)  :: "memory");
+}
+
+size_t kstrlen(const char *str)
+{
+    const char *ptr = str;
+
+    /* aligned word reads never cross into the next page */
+    for (; (uintptr_t)ptr % sizeof(word_t); ++ptr) {
+        if (*ptr == '\0')
+            return ptr - str;
+    }
+
+    const word_t *word = (const word_t *)ptr;
+
+    while (!HAS_ZERO(*word))
+        word++;
+
+    for (ptr = (const char *)word; *ptr != '\0'; ++ptr)
+        ;
 
+    return ptr - str;
+}
+
+void *kmemcpy(void *restrict dstptr, const void *restrict srcptr, size_t size)
+{
+    __copy(dstptr, srcptr, size);
     return dstptr;
 }
 
 void *kmemset(void *buf, int c, size_t size)
 {
-    unsigned char *ptr = buf;
+    void *ptr = buf;
+    uint64_t pattern = (uint8_t)c * WORD_ONES;
 
-    while (size--)
-        *ptr++ = c;
+    if (size >= __rep_bytes_min) {
+        asm volatile ("rep stosb" : "+D"(ptr), "+c"(size) : "a"(pattern) : "memory");
+        return buf;
+    }
+
+    if (size < REP_THRESHOLD) {
+        uint8_t *dst = buf;
+
+        for (; size >= sizeof(word_t); size -= sizeof(word_t), dst += sizeof(word_t))
+            *(word_t *)dst = pattern;
+
+        while (size--)
+            *dst++ = pattern;
+
+        return buf;
+    }
+
+    size_t words = size / sizeof(word_t);
+    size_t tail  = size % sizeof(word_t);
+
+    asm volatile ("rep stosq" : "+D"(ptr), "+c"(words) : "a"(pattern) : "memory");
+    asm volatile ("rep stosb" : "+D"(ptr), "+c"(tail)  : "a"(pattern) : "memory");
 
     return buf;
 }
@@ -38,6 +136,18 @@ int kmemcmp(void *s1, void *s2, size_t n)
     uint8_t *s1_ptr = s1;
     uint8_t *s2_ptr = s2;
 
+    for (; n >= sizeof(word_t); n -= sizeof(word_t)) {
+        uint64_t w1 = *(word_t *)s1_ptr;
+        uint64_t w2 = *(word_t *)s2_ptr;
+
+        /* the lowest differing byte decides, byte swap to compare it first */
+        if (w1 != w2)
+            return __builtin_bswap64(w1) < __builtin_bswap64(w2) ? -1 : 1;
+
+        s1_ptr += sizeof(word_t);
+        s2_ptr += sizeof(word_t);
+    }
+
     for (size_t i = 0; i < n; ++i) {
         if (s1_ptr[i] < s2_ptr[i])
             return -1;
@@ -51,6 +161,24 @@ int kmemcmp(void *s1, void *s2, size_t n)
 
 int kstrcmp(const char *s1, const char *s2)
 {
+    /* words can only be compared if both strings become aligned at the same time */
+    if (((uintptr_t)s1 ^ (uintptr_t)s2) % sizeof(word_t) == 0) {
+        while ((uintptr_t)s1 % sizeof(word_t) && *s1 && *s1 == *s2)
+            s1++, s2++;
+
+        if ((uintptr_t)s1 % sizeof(word_t) == 0) {
+            const word_t *w1 = (const word_t *)s1;
+            const word_t *w2 = (const word_t *)s2;
+
+            while (*w1 == *w2 && !HAS_ZERO(*w1))
+                w1++, w2++;
+
+            s1 = (const char *)w1;
+            s2 = (const char *)w2;
+        }
+    }
+
+    /* find the differing or terminating byte */
     while (*s1 && (*s1 == *s2))
         s1++, s2++;
 
@@ -141,12 +269,31 @@ void *kmemmove(void *dstptr, const void *srcptr, size_t size)
     uint8_t *dst = dstptr;
     const uint8_t *src = srcptr;
 
-    if (dst < src)
-        for (size_t i = 0; i < size; ++i)
-            dst[i] = src[i];
-    else
-        for (size_t i = size; i; --i)
-            dst[i-1] = src[i-1];
+    /* a forward copy is safe unless the destination starts inside the source but
+     * string moves are slow if the destination is less than a cache line behind */
+    if (dst >= src + size || dst + REP_THRESHOLD <= src) {
+        __copy(dst, src, size);
+        return dstptr;
+    }
+
+    if (dst <= src) {
+        __copy_words(dst, src, size);
+        return dstptr;
+    }
+
+    /* copy backwards with plain moves, `std; rep movs` is slow and
+     * interrupt handlers don't clear the direction flag */
+    dst += size;
+    src += size;
+
+    for (; size >= sizeof(word_t); size -= sizeof(word_t)) {
+        dst -= sizeof(word_t);
+        src -= sizeof(word_t);
+        *(word_t *)dst = *(const word_t *)src;
+    }
+
+    while (size--)
+        *--dst = *--src;
 
     return dstptr;
 }
@@ -4,21 +4,104 @@
 #include <mm/heap.h>
 #include <errno.h>
 
+#define WORD(n) ((n) / BM_BITS_PER_WORD)
+#define BIT(n)  ((n) % BM_BITS_PER_WORD)
+
+/* mask of bits `[s, e]` of a word */
+static inline uint64_t __mask(uint32_t s, uint32_t e)
+{
+    return (~0ULL << s) & (~0ULL >> (BM_BITS_PER_WORD - 1 - e));
+}
+
+static inline void __update_word(uint64_t *word, uint64_t mask, int set)
+{
+    if (set)
+        *word |= mask;
+    else
+        *word &= ~mask;
+}
+
+static void __update_range(bitmap_t *bm, uint32_t n, uint32_t k, int set)
+{
+    size_t first = WORD(n);
+    size_t last  = WORD(k);
+
+    if (first == last) {
+        __update_word(&bm->bits[first], __mask(BIT(n), BIT(k)), set);
+        return;
+    }
+
+    __update_word(&bm->bits[first], __mask(BIT(n), BM_BITS_PER_WORD - 1), set);
+
+    for (size_t i = first + 1; i < last; ++i)
+        bm->bits[i] = set ? ~0ULL : 0;
+
+    __update_word(&bm->bits[last], __mask(0, BIT(k)), set);
+}
+
+/* find the first bit in `[n, k]` whose value is `bit`
+ *
+ * the words are inverted when searching for zeros so that
+ * both searches come down to finding the lowest set bit */
+static int __find(bitmap_t *bm, uint32_t n, uint32_t k, int bit)
+{
+    uint64_t invert = bit ? 0 : ~0ULL;
+    size_t last     = WORD(k);
+    size_t i        = WORD(n);
+    uint64_t word   = (bm->bits[i] ^ invert) & (~0ULL << BIT(n));
+
+    for (;;) {
+        if (word) {
+            uint32_t pos = i * BM_BITS_PER_WORD + __builtin_ctzll(word);
+            return (pos <= k) ? (int)pos : -ENOENT;
+        }
+
+        if (++i > last)
+            return -ENOENT;
+
+        word = bm->bits[i] ^ invert;
+    }
+}
+
+/* find the first run of `len` bits in `[n, k]` whose value is `bit`
+ *
+ * find where the next candidate run starts, then find the first bit that breaks it
+ * and continue the search after that bit, both steps skip whole words */
+static int __find_range(bitmap_t *bm, uint32_t n, uint32_t k, size_t len, int bit)
+{
+    if (len == 0)
+        return -EINVAL;
+
+    while (n <= k) {
+        int start = __find(bm, n, k, bit);
+
+        if (start < 0 || (uint64_t)start + len - 1 > k)
+            return -ENOENT;
+
+        int stop = __find(bm, start, start + len - 1, !bit);
+
+        if (stop == -ENOENT)
+            return start;
+
+        n = stop + 1;
+    }
+
+    return -ENOENT;
+}
+
 bitmap_t *bm_alloc_bitmap(size_t nmemb)
 {
     kassert(nmemb != 0);
 
     bitmap_t *bm;
-    size_t num_bits;
 
     if (!(bm = kzalloc(sizeof(bitmap_t))))
         return NULL;
 
-    // round it up to nearest multiple of 32
-	num_bits = (nmemb % 32) ? ((nmemb / 32) + 1) : (nmemb / 32);
-    bm->len = num_bits * 32;
+    // round it up to nearest multiple of 64
+    bm->len = BM_WORDS(nmemb) * BM_BITS_PER_WORD;
 
-    if (!(bm->bits = kzalloc(num_bits * sizeof(uint32_t)))) {
+    if (!(bm->bits = kzalloc(BM_WORDS(nmemb) * sizeof(uint64_t)))) {
         kfree(bm);
         return NULL;
     }
@@ -37,10 +120,10 @@ int bm_set_bit(bitmap_t *bm, uint32_t n)
     if (!bm)
         return -EINVAL;
 
-    if (n / 32 > bm->len)
+    if (n >= bm->len)
         return -E2BIG;
 
-    bm->bits[n / 32] |= 1 << (n % 32);
+    bm->bits[WORD(n)] |= 1ULL << BIT(n);
     return 0;
 }
 
@@ -49,10 +132,8 @@ int bm_set_range(bitmap_t *bm, uint32_t n, uint32_t k)
     if (n >= bm->len || k >= bm->len)
         return -E2BIG;
 
-    while (n <= k) {
-        bm->bits[n / 32] |= 1 << (n % 32);
-        n++;
-    }
+    if (n <= k)
+        __update_range(bm, n, k, 1);
 
     return 0;
 }
@@ -62,7 +143,7 @@ int bm_unset_bit(bitmap_t *bm, uint32_t n)
     if (n >= bm->len)
         return -E2BIG;
 
-    bm->bits[n / 32] &= ~(1 << (n % 32));
+    bm->bits[WORD(n)] &= ~(1ULL << BIT(n));
     return 0;
 }
 
@@ -71,10 +152,8 @@ int bm_unset_range(bitmap_t *bm, uint32_t n, uint32_t k)
     if (n >= bm->len || k >= bm->len)
         return -E2BIG;
 
-    while (n <= k) {
-        bm->bits[n / 32] &= ~(1 << (n % 32));
-        n++;
-    }
+    if (n <= k)
+        __update_range(bm, n, k, 0);
 
     return 0;
 }
@@ -84,66 +163,67 @@ int bm_test_bit(bitmap_t *bm, uint32_t n)
     if (n >= bm->len)
         return -E2BIG;
 
-    return (bm->bits[n / 32] & (1 << (n % 32))) >> (n % 32);
+    return (bm->bits[WORD(n)] >> BIT(n)) & 1;
 }
 
-static int bm_find_first(bitmap_t *bm, uint32_t n, uint32_t k, uint8_t bit_status)
+int bm_find_first_unset(bitmap_t *bm, uint32_t n, uint32_t k)
 {
     if (n >= bm->len || k >= bm->len)
         return -E2BIG;
 
-    while (n <= k) {
-        if (((bm->bits[n / 32] & (1 << (n % 32))) >> (n % 32)) == bit_status)
-            return n;
-        n++;
-    }
-
-    return -ENOENT;
-}
-
-int bm_find_first_unset(bitmap_t *bm, uint32_t n, uint32_t k)
-{
-    return bm_find_first(bm, n, k, 0);
+    return (n <= k) ? __find(bm, n, k, 0) : -ENOENT;
 }
 
 int bm_find_first_set(bitmap_t *bm, uint32_t n, uint32_t k)
-{
-    return bm_find_first(bm, n, k, 1);
-}
-
-static int bm_find_first_range(bitmap_t *bm, uint32_t n, uint32_t k, size_t len, uint8_t bit_status)
 {
     if (n >= bm->len || k >= bm->len)
         return -E2BIG;
 
-    int start = -ENOENT;
-    size_t cur_len = 0;
-
-    while (n <= k) {
-        if (((bm->bits[n / 32] & (1 << (n % 32))) >> (n % 32)) == bit_status) {
+    return (n <= k) ? __find(bm, n, k, 1) : -ENOENT;
+}
 
-            if (start == -ENOENT)
-                start = n;
+int bm_find_next_set(bitmap_t *bm, uint32_t n)
+{
+    if (n >= bm->len)
+        return -ENOENT;
 
-            if (++cur_len == len)
-                return start;
+    return __find(bm, n, bm->len - 1, 1);
+}
 
-        } else {
-            start   = -ENOENT;
-            cur_len = 0;
-        }
-        n++;
-    }
+int bm_find_next_unset(bitmap_t *bm, uint32_t n)
+{
+    if (n >= bm->len)
+        return -ENOENT;
 
-    return -ENOENT;
+    return __find(bm, n, bm->len - 1, 0);
 }
 
 int bm_find_first_set_range(bitmap_t *bm, uint32_t n, uint32_t k, size_t len)
 {
-    return bm_find_first_range(bm, n, k, len, 1);
+    if (n >= bm->len || k >= bm->len)
+        return -E2BIG;
+
+    return __find_range(bm, n, k, len, 1);
 }
 
 int bm_find_first_unset_range(bitmap_t *bm, uint32_t n, uint32_t k, size_t len)
 {
-    return bm_find_first_range(bm, n, k, len, 0);
+    if (n >= bm->len || k >= bm->len)
+        return -E2BIG;
+
+    return __find_range(bm, n, k, len, 0);
+}
+
+size_t bm_weight(bitmap_t *bm)
+{
+    size_t weight = 0;
+    size_t words  = WORD(bm->len);
+
+    for (size_t i = 0; i < words; ++i)
+        weight += __builtin_popcountll(bm->bits[i]);
+
+    if (BIT(bm->len))
+        weight += __builtin_popcountll(bm->bits[words] & __mask(0, BIT(bm->len) - 1));
+
+    return weight;
 }
@@ -6,21 +6,46 @@
 #include <errno.h>
 #include <stdbool.h>
 
-#define BUCKET_MAX_LEN 12
-#define KEY_SIZE       12
-
-typedef struct hm_item {
+/* Robin Hood hashmap
+ *
+ * Open addressing with linear probing over flat arrays: `hashes` holds the full 32-bit
+ * hash of every slot (0 marks an empty slot) and `entries` the key and value pointers
+ * so probing touches only the hash array until a hash matches. On insert, an element
+ * that is further from its home slot than the resident element takes the slot and the
+ * resident continues probing, which keeps probe sequences short and lets lookups stop
+ * as soon as they meet an element that is closer to its home than the probe is.
+ * Removal shifts the following elements back by one slot so no tombstones are needed.
+ *
+ * Growing and shrinking is incremental: a new table is allocated and every insert
+ * and remove moves at most `HM_REHASH_STEP` slots from the old table to the new one.
+ * Lookups check both tables while the move is in progress. */
+
+#define HM_MIN_CAP     8
+#define HM_REHASH_STEP 16
+
+#define HM_GROW(cap)   ((cap) - (cap) / 8)  /* grow when load factor exceeds 7/8 */
+#define HM_SHRINK(cap) ((cap) / 8)          /* shrink when it falls below 1/8 */
+
+typedef struct hm_entry {
+    void *key;
     void *data;
-    uint32_t key;
-    bool occupied;
-} hm_item_t;
+} hm_entry_t;
 
-struct hashmap {
-    size_t len;
+typedef struct hm_table {
     size_t cap;
+    size_t len;
+    uint32_t *hashes;
+    hm_entry_t *entries;
+} hm_table_t;
+
+struct hashmap {
+    hm_table_t cur;     /* table receiving new elements */
+    hm_table_t old;     /* table being emptied, valid if `old.cap != 0` */
+    size_t migrate;     /* next slot of the old table to move */
+    size_t min_cap;
 
-    hm_item_t **elem;
     uint32_t (*hm_hash)(void *);
+    bool (*hm_equal)(void *, void *);
 };
 
 /*  https://stackoverflow.com/questions/664014/what-integer-
@@ -55,93 +80,261 @@ static uint32_t hm_hash_str(void *key)
     return hash;
 }
 
-/* "size" should be large enough so that rehashing
- * needn't to be performed as it's very expensive */
-hashmap_t *hm_alloc_hashmap(size_t size, hm_key_type_t type)
+static bool hm_equal_num(void *k1, void *k2)
 {
-    hashmap_t *hm;
+    return *(uint32_t *)k1 == *(uint32_t *)k2;
+}
 
-    if (!(hm = kmalloc(sizeof(hashmap_t))))
-        return NULL;
+static bool hm_equal_str(void *k1, void *k2)
+{
+    return kstrcmp(k1, k2) == 0;
+}
 
-    if (!(hm->elem = kzalloc(size * sizeof(hm_item_t *))))
-        return NULL;
+/* hash `ukey`, return 0 if the key is invalid
+ *
+ * the home slot is taken from the low bits of the hash which are poorly
+ * distributed for e.g. djb2 of similar names so the hash is mixed first.
+ * Zero is reserved for empty slots so valid keys never hash to it */
+static inline uint32_t __hash(hashmap_t *hm, void *ukey)
+{
+    if (!ukey)
+        return 0;
 
-    hm->len  = 0;
-    hm->cap  = size;
+    uint32_t hash = hm->hm_hash(ukey);
 
-	switch (type) {
-        case HM_KEY_TYPE_NUM:
-            hm->hm_hash = hm_hash_num;
-            return hm;
-        case HM_KEY_TYPE_STR:
-            hm->hm_hash = hm_hash_str;
-            return hm;
-        default:
-            errno = EINVAL;
-            return NULL;
+    if (hash == UINT32_MAX)
+        return 0;
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+
+    return hash ? hash : 1;
+}
+
+/* distance of slot `i` from the home slot of its element */
+static inline size_t __dist(hm_table_t *t, size_t i)
+{
+    return (i - t->hashes[i]) & (t->cap - 1);
+}
+
+static int __table_alloc(hm_table_t *t, size_t cap)
+{
+    void *mem;
+
+    if (!(mem = kzalloc(cap * (sizeof(uint32_t) + sizeof(hm_entry_t)))))
+        return -ENOMEM;
+
+    /* `cap` is a power of two so the entries stay aligned */
+    t->cap     = cap;
+    t->len     = 0;
+    t->entries = mem;
+    t->hashes  = (uint32_t *)(t->entries + cap);
+
+    return 0;
+}
+
+static void __table_free(hm_table_t *t)
+{
+    kfree(t->entries);
+    t->cap = t->len = 0;
+    t->entries = NULL;
+    t->hashes  = NULL;
+}
+
+/* return the slot of `ukey` or -ENOENT */
+static int __table_find(hashmap_t *hm, hm_table_t *t, uint32_t hash, void *ukey)
+{
+    if (t->len == 0)
+        return -ENOENT;
+
+    size_t mask = t->cap - 1;
+    size_t i    = hash & mask;
+
+    for (size_t d = 0; ; ++d, i = (i + 1) & mask) {
+        if (!t->hashes[i] || __dist(t, i) < d)
+            return -ENOENT;
+
+        if (t->hashes[i] == hash && hm->hm_equal(t->entries[i].key, ukey))
+            return i;
     }
+}
 
-    return hm;
+/* insert an element that's known not to be in the table */
+static void __table_insert(hm_table_t *t, uint32_t hash, hm_entry_t entry)
+{
+    size_t mask = t->cap - 1;
+    size_t i    = hash & mask;
+
+    for (size_t d = 0; ; ++d, i = (i + 1) & mask) {
+        if (!t->hashes[i]) {
+            t->hashes[i]  = hash;
+            t->entries[i] = entry;
+            t->len++;
+            return;
+        }
+
+        /* the resident is closer to its home, take its slot and move it forward */
+        size_t rd = __dist(t, i);
+
+        if (rd < d) {
+            uint32_t tmp_hash    = t->hashes[i];
+            hm_entry_t tmp_entry = t->entries[i];
+
+            t->hashes[i]  = hash;
+            t->entries[i] = entry;
+            hash  = tmp_hash;
+            entry = tmp_entry;
+            d     = rd;
+        }
+    }
 }
 
-void hm_dealloc_hashmap(hashmap_t *hm)
+/* empty slot `i` and shift the elements after it back by one slot */
+static void __table_remove(hm_table_t *t, size_t i)
 {
-    if (!hm)
+    size_t mask = t->cap - 1;
+    size_t next = (i + 1) & mask;
+
+    while (t->hashes[next] && __dist(t, next) > 0) {
+        t->hashes[i]  = t->hashes[next];
+        t->entries[i] = t->entries[next];
+        i    = next;
+        next = (next + 1) & mask;
+    }
+
+    t->hashes[i] = 0;
+    t->len--;
+}
+
+/* move at most `nslots` slots of the old table to the current table
+ *
+ * the old table is a valid Robin Hood table at all times because the
+ * elements are moved out of it using the regular removal */
+static void __rehash_step(hashmap_t *hm, size_t nslots)
+{
+    hm_table_t *old = &hm->old;
+
+    if (!old->cap)
         return;
 
-    if (!hm->elem)
-        goto free_hm;
+    while (nslots-- && old->len) {
+        size_t i = hm->migrate;
 
-    for (size_t i = 0; i < hm->len; ++i)
-        kfree(hm->elem[i]);
+        if (!old->hashes[i]) {
+            hm->migrate++;
+            continue;
+        }
 
-    kfree(hm->elem);
+        __table_insert(&hm->cur, old->hashes[i], old->entries[i]);
+        __table_remove(old, i);
+    }
 
-free_hm:
-    kfree(hm);
+    if (!old->len) {
+        __table_free(old);
+        hm->migrate = 0;
+    }
 }
 
-static int hm_find_free_bucket(hashmap_t *hm, uint32_t key)
+/* start moving the elements to a table of `cap` slots
+ *
+ * if the previous resize is still in progress, it's finished first */
+static int __resize(hashmap_t *hm, size_t cap)
 {
-    int index = key % hm->cap;
+    hm_table_t table;
 
-    for (size_t i = 0; i < BUCKET_MAX_LEN; ++i) {
-        if (!hm->elem[index]) {
-            hm->elem[index] = kmalloc(sizeof(hm_item_t));
-            return index;
-        }
+    __rehash_step(hm, SIZE_MAX);
+
+    if (__table_alloc(&table, cap) < 0)
+        return -ENOMEM;
+
+    hm->old     = hm->cur;
+    hm->cur     = table;
+    hm->migrate = 0;
+
+    return 0;
+}
+
+static size_t __round_pow2(size_t n)
+{
+    size_t cap = HM_MIN_CAP;
+
+    while (cap < n)
+        cap <<= 1;
+
+    return cap;
+}
+
+hashmap_t *hm_alloc_hashmap(size_t size, hm_key_type_t type)
+{
+    hashmap_t *hm;
+
+    if (type != HM_KEY_TYPE_NUM && type != HM_KEY_TYPE_STR) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!(hm = kzalloc(sizeof(hashmap_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    hm->min_cap = __round_pow2(size);
 
-        if (!hm->elem[index]->occupied)
-            return index;
+    if (__table_alloc(&hm->cur, hm->min_cap) < 0) {
+        kfree(hm);
+        errno = ENOMEM;
+        return NULL;
+    }
 
-        index = (index + 1) % hm->cap;
+    switch (type) {
+        case HM_KEY_TYPE_NUM:
+            hm->hm_hash  = hm_hash_num;
+            hm->hm_equal = hm_equal_num;
+            break;
+
+        case HM_KEY_TYPE_STR:
+            hm->hm_hash  = hm_hash_str;
+            hm->hm_equal = hm_equal_str;
+            break;
     }
 
-    return -ENOSPC;
+    return hm;
+}
+
+void hm_dealloc_hashmap(hashmap_t *hm)
+{
+    if (!hm)
+        return;
+
+    if (hm->old.cap)
+        __table_free(&hm->old);
+
+    __table_free(&hm->cur);
+    kfree(hm);
 }
 
 int hm_insert(hashmap_t *hm, void *ukey, void *elem)
 {
-    kassert(hm != NULL && hm->elem != 0);
-    kassert(hm->len < hm->cap); // TODO: fix
+    kassert(hm != NULL);
 
-    uint32_t key;
-    int index;
+    uint32_t hash = __hash(hm, ukey);
 
-    if ((key = hm->hm_hash(ukey)) == UINT32_MAX)
+    if (!hash)
         return -EINVAL;
 
-    index = hm_find_free_bucket(hm, key);
+    if (__table_find(hm, &hm->cur, hash, ukey) >= 0 ||
+        __table_find(hm, &hm->old, hash, ukey) >= 0)
+        return -EEXIST;
+
+    __rehash_step(hm, HM_REHASH_STEP);
 
-    if (index < 0) {
-        return -ENOSPC;
+    if (hm->cur.len + 1 > HM_GROW(hm->cur.cap)) {
+        if (__resize(hm, hm->cur.cap * 2) < 0)
+            return -ENOMEM;
     }
 
-    hm->elem[index]->data     = elem;
-    hm->elem[index]->key      = key;
-    hm->elem[index]->occupied = true;
-    hm->len++;
+    __table_insert(&hm->cur, hash, (hm_entry_t){ .key = ukey, .data = elem });
 
     return 0;
 }
@@ -150,64 +343,61 @@ int hm_remove(hashmap_t *hm, void *ukey)
 {
     kassert(hm != NULL);
 
-    uint32_t key;
-    int index;
+    uint32_t hash = __hash(hm, ukey);
 
-    if ((key = hm->hm_hash(ukey)) == UINT32_MAX)
+    if (!hash)
         return -EINVAL;
+    int i;
 
-    index = key % hm->cap;
+    if ((i = __table_find(hm, &hm->cur, hash, ukey)) >= 0)
+        __table_remove(&hm->cur, i);
+    else if ((i = __table_find(hm, &hm->old, hash, ukey)) >= 0)
+        __table_remove(&hm->old, i);
+    else
+        return -ENOENT;
 
-    for (size_t i = 0; i < BUCKET_MAX_LEN; ++i) {
-        if (hm->elem[index]->key == key) {
-            hm->elem[index]->occupied = false;
-            return 0;
-        }
+    __rehash_step(hm, HM_REHASH_STEP);
 
-        index = (index + 1) % hm->cap;
-    }
+    /* failing to shrink is not an error, the current table stays in use */
+    if (!hm->old.cap && hm->cur.cap > hm->min_cap && hm->cur.len < HM_SHRINK(hm->cur.cap))
+        (void)__resize(hm, hm->cur.cap / 2);
 
-    return -ENOENT;
+    return 0;
 }
 
 void *hm_get(hashmap_t *hm, void *ukey)
 {
-    kassert(hm != NULL && hm->elem != 0);
+    kassert(hm != NULL);
 
-    uint32_t key;
-    int index;
+    uint32_t hash = __hash(hm, ukey);
 
-    if ((key = hm->hm_hash(ukey)) == UINT32_MAX)
+    if (!hash)
         return NULL;
+    int i;
 
-    index = key % hm->cap;
+    if ((i = __table_find(hm, &hm->cur, hash, ukey)) >= 0)
+        return hm->cur.entries[i].data;
 
-    for (size_t i = 0; i < BUCKET_MAX_LEN; ++i) {
-        if (!hm->elem[index])
-            return NULL;
-        if (!hm->elem[index]->occupied)
-            return NULL;
-        if (hm->elem[index]->key == key)
-            return hm->elem[index]->data;
-
-        index = (index + 1) % hm->cap;
-    }
+    if ((i = __table_find(hm, &hm->old, hash, ukey)) >= 0)
+        return hm->old.entries[i].data;
 
     return NULL;
 }
 
 size_t hm_get_size(hashmap_t *hm)
 {
-    return hm ? hm->len : 0;
+    return hm ? hm->cur.len + hm->old.len : 0;
 }
 
 size_t hm_get_capacity(hashmap_t *hm)
 {
-    return hm ? hm->cap : 0;
+    return hm ? hm->cur.cap : 0;
 }
 
 void hm_add_hash_func(hashmap_t *hm, uint32_t (*hm_hash_func)(void *))
 {
     kassert(hm != NULL && hm_hash_func != NULL);
+    kassert(hm_get_size(hm) == 0);
+
     hm->hm_hash = hm_hash_func;
 }
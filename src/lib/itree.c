@@ -0,0 +1,124 @@
+#include <kernel/common.h>
+#include <lib/itree.h>
+
+#define IT(n) container_of((n), itree_node_t, node)
+
+static void __augment(rb_node_t *node)
+{
+    itree_node_t *it = IT(node);
+
+    it->max_last = it->last;
+
+    if (node->left && IT(node->left)->max_last > it->max_last)
+        it->max_last = IT(node->left)->max_last;
+
+    if (node->right && IT(node->right)->max_last > it->max_last)
+        it->max_last = IT(node->right)->max_last;
+}
+
+/* leftmost interval of the subtree at `n` that overlaps `[start, last]`
+ *
+ * a subtree is entered only if its `max_last` reaches `start` so the overlap is either
+ * in the left subtree, the node itself or the right subtree, and once a node starts
+ * after `last` so does every node after it */
+static itree_node_t *__subtree_first(rb_node_t *n, uint64_t start, uint64_t last)
+{
+    if (!n || IT(n)->max_last < start)
+        return NULL;
+
+    for (;;) {
+        if (n->left && IT(n->left)->max_last >= start) {
+            n = n->left;
+            continue;
+        }
+
+        if (IT(n)->start > last)
+            return NULL;
+
+        if (IT(n)->last >= start)
+            return IT(n);
+
+        n = n->right;
+    }
+}
+
+void itree_init(itree_t *tree)
+{
+    rb_init(&tree->tree, __augment);
+}
+
+void itree_insert(itree_t *tree, itree_node_t *node)
+{
+    rb_node_t **link = &tree->tree.root, *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        link   = (node->start < IT(parent)->start) ? &parent->left : &parent->right;
+    }
+
+    rb_insert(&tree->tree, &node->node, parent, link);
+}
+
+void itree_remove(itree_t *tree, itree_node_t *node)
+{
+    rb_remove(&tree->tree, &node->node);
+}
+
+itree_node_t *itree_first(itree_t *tree)
+{
+    rb_node_t *n = rb_first(&tree->tree);
+
+    return n ? IT(n) : NULL;
+}
+
+itree_node_t *itree_next(itree_node_t *node)
+{
+    rb_node_t *n = rb_next(&node->node);
+
+    return n ? IT(n) : NULL;
+}
+
+itree_node_t *itree_lower_bound(itree_t *tree, uint64_t start)
+{
+    rb_node_t *n      = tree->tree.root;
+    itree_node_t *ret = NULL;
+
+    while (n) {
+        if (IT(n)->start >= start) {
+            ret = IT(n);
+            n   = n->left;
+        } else {
+            n = n->right;
+        }
+    }
+
+    return ret;
+}
+
+itree_node_t *itree_first_overlap(itree_t *tree, uint64_t start, uint64_t last)
+{
+    return __subtree_first(tree->tree.root, start, last);
+}
+
+itree_node_t *itree_next_overlap(itree_node_t *node, uint64_t start, uint64_t last)
+{
+    rb_node_t *n = &node->node, *prev;
+
+    for (;;) {
+        /* nodes in the right subtree come next */
+        if (n->right && IT(n->right)->max_last >= start)
+            return __subtree_first(n->right, start, last);
+
+        /* then the first ancestor that has `n` in its left subtree */
+        do {
+            prev = n;
+            n    = n->parent;
+        } while (n && n->right == prev);
+
+        if (!n || IT(n)->start > last)
+            return NULL;
+
+        if (IT(n)->last >= start)
+            return IT(n);
+    }
+}
@@ -0,0 +1,297 @@
+#include <kernel/common.h>
+#include <kernel/util.h>
+#include <lib/lz4.h>
+#include <errno.h>
+
+#define LZ4_SKIP_MAGIC   0x184d2a50  /* 0x184d2a50 - 0x184d2a5f */
+#define LZ4_SKIP_MASK    0xfffffff0
+#define LZ4_MIN_MATCH    4
+
+/* frame descriptor */
+#define FLG_VERSION(f)   (((f) >> 6) & 0x3)
+#define FLG_BLOCK_CSUM   (1 << 4)
+#define FLG_CONTENT_SIZE (1 << 3)
+#define FLG_CONTENT_CSUM (1 << 2)
+#define FLG_RESERVED     (1 << 1)
+#define FLG_DICT_ID      (1 << 0)
+#define BD_BLOCK_MAX(b)  (((b) >> 4) & 0x7)
+#define BD_RESERVED      0x8f
+
+#define BLOCK_UNCOMPRESSED (1U << 31)
+
+#define XXH_PRIME1 2654435761U
+#define XXH_PRIME2 2246822519U
+#define XXH_PRIME3 3266489917U
+#define XXH_PRIME4  668265263U
+#define XXH_PRIME5  374761393U
+
+static inline uint32_t __read32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t __read64(const uint8_t *p)
+{
+    return __read32(p) | ((uint64_t)__read32(p + 4) << 32);
+}
+
+static inline uint32_t __rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t __xxh32_round(uint32_t acc, uint32_t input)
+{
+    return __rotl32(acc + input * XXH_PRIME2, 13) * XXH_PRIME1;
+}
+
+uint32_t lz4_xxh32(const void *src, size_t len, uint32_t seed)
+{
+    const uint8_t *p   = src;
+    const uint8_t *end = p + len;
+    uint32_t h;
+
+    if (len >= 16) {
+        uint32_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        uint32_t v2 = seed + XXH_PRIME2;
+        uint32_t v3 = seed;
+        uint32_t v4 = seed - XXH_PRIME1;
+
+        for (; p + 16 <= end; p += 16) {
+            v1 = __xxh32_round(v1, __read32(p));
+            v2 = __xxh32_round(v2, __read32(p + 4));
+            v3 = __xxh32_round(v3, __read32(p + 8));
+            v4 = __xxh32_round(v4, __read32(p + 12));
+        }
+
+        h = __rotl32(v1, 1) + __rotl32(v2, 7) + __rotl32(v3, 12) + __rotl32(v4, 18);
+    } else {
+        h = seed + XXH_PRIME5;
+    }
+
+    h += (uint32_t)len;
+
+    for (; p + 4 <= end; p += 4)
+        h = __rotl32(h + __read32(p) * XXH_PRIME3, 17) * XXH_PRIME4;
+
+    for (; p < end; ++p)
+        h = __rotl32(h + *p * XXH_PRIME5, 11) * XXH_PRIME1;
+
+    h ^= h >> 15;
+    h *= XXH_PRIME2;
+    h ^= h >> 13;
+    h *= XXH_PRIME3;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/* read a length continued in the following bytes, each 255 means that another byte follows */
+static inline int __read_length(const uint8_t **ip, const uint8_t *iend, size_t *length)
+{
+    uint8_t b;
+
+    do {
+        if (*ip >= iend)
+            return -EINVAL;
+
+        b        = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+
+    return 0;
+}
+
+ssize_t lz4_block_decompress(const void *src, size_t len, void *dst, size_t dst_len, size_t prefix)
+{
+    const uint8_t *ip   = src;
+    const uint8_t *iend = ip + len;
+    uint8_t *op         = dst;
+    uint8_t *oend       = op + dst_len;
+    uint8_t *base       = op - prefix;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t length = token >> 4;
+
+        if (length == 15 && __read_length(&ip, iend, &length) < 0)
+            return -EINVAL;
+
+        if (length > (size_t)(iend - ip))
+            return -EINVAL;
+
+        if (length > (size_t)(oend - op))
+            return -E2BIG;
+
+        kmemcpy(op, ip, length);
+        op += length;
+        ip += length;
+
+        /* the last sequence has only literals */
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -EINVAL;
+
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > (size_t)(op - base))
+            return -EINVAL;
+
+        length = token & 0xf;
+
+        if (length == 15 && __read_length(&ip, iend, &length) < 0)
+            return -EINVAL;
+
+        length += LZ4_MIN_MATCH;
+
+        if (length > (size_t)(oend - op))
+            return -E2BIG;
+
+        const uint8_t *match = op - offset;
+
+        /* a match that overlaps its own output repeats the last `offset` bytes */
+        if (offset >= length) {
+            kmemcpy(op, match, length);
+            op += length;
+        } else {
+            while (length--)
+                *op++ = *match++;
+        }
+    }
+
+    return op - (uint8_t *)dst;
+}
+
+/* skip the skippable frames at the start of `src`, return the start of the LZ4 frame */
+static const uint8_t *__skip_frames(const uint8_t *ip, const uint8_t *iend)
+{
+    while (iend - ip >= 8 && (__read32(ip) & LZ4_SKIP_MASK) == LZ4_SKIP_MAGIC) {
+        uint32_t size = __read32(ip + 4);
+
+        if (size > (size_t)(iend - ip - 8))
+            return NULL;
+
+        ip += 8 + size;
+    }
+
+    return ip;
+}
+
+/* parse the frame header at `*ip` and advance `*ip` to the first block
+ *
+ * return the frame descriptor flags on success and -errno on error */
+static int __read_header(const uint8_t **ip, const uint8_t *iend, uint64_t *content_size)
+{
+    const uint8_t *p = *ip;
+
+    if (!(p = __skip_frames(p, iend)) || iend - p < 7 || __read32(p) != LZ4_FRAME_MAGIC)
+        return -EINVAL;
+
+    uint8_t flg     = p[4];
+    uint8_t bd      = p[5];
+    size_t desc_len = 2 + ((flg & FLG_CONTENT_SIZE) ? 8 : 0) + ((flg & FLG_DICT_ID) ? 4 : 0);
+
+    if (FLG_VERSION(flg) != 1 || (flg & FLG_RESERVED) || (bd & BD_RESERVED) || BD_BLOCK_MAX(bd) < 4)
+        return -EINVAL;
+
+    if ((size_t)(iend - p) < 4 + desc_len + 1)
+        return -EINVAL;
+
+    if (((lz4_xxh32(p + 4, desc_len, 0) >> 8) & 0xff) != p[4 + desc_len])
+        return -EINVAL;
+
+    if (flg & FLG_DICT_ID)
+        return -ENOTSUP;
+
+    *content_size = (flg & FLG_CONTENT_SIZE) ? __read64(p + 6) : 0;
+    *ip           = p + 4 + desc_len + 1;
+
+    return flg;
+}
+
+bool lz4_frame_detect(const void *src, size_t len)
+{
+    return len >= 4 && (__read32(src) == LZ4_FRAME_MAGIC ||
+                        (__read32(src) & LZ4_SKIP_MASK) == LZ4_SKIP_MAGIC);
+}
+
+ssize_t lz4_frame_content_size(const void *src, size_t len)
+{
+    const uint8_t *ip = src;
+    uint64_t size;
+    int flg;
+
+    if ((flg = __read_header(&ip, ip + len, &size)) < 0)
+        return flg;
+
+    if (!(flg & FLG_CONTENT_SIZE))
+        return -ENOTSUP;
+
+    if (size > INT64_MAX)
+        return -EINVAL;
+
+    return size;
+}
+
+ssize_t lz4_frame_decompress(const void *src, size_t len, void *dst, size_t dst_len)
+{
+    const uint8_t *ip   = src;
+    const uint8_t *iend = ip + len;
+    uint8_t *op         = dst;
+    uint64_t content_size;
+    ssize_t ret;
+    int flg;
+
+    if ((flg = __read_header(&ip, iend, &content_size)) < 0)
+        return flg;
+
+    for (;;) {
+        if (iend - ip < 4)
+            return -EINVAL;
+
+        uint32_t block = __read32(ip);
+        uint32_t size  = block & ~BLOCK_UNCOMPRESSED;
+
+        ip += 4;
+
+        if (block == 0)
+            break;
+
+        if (size > (size_t)(iend - ip) || ((flg & FLG_BLOCK_CSUM) && size + 4 > (size_t)(iend - ip)))
+            return -EINVAL;
+
+        if ((flg & FLG_BLOCK_CSUM) && lz4_xxh32(ip, size, 0) != __read32(ip + size))
+            return -EINVAL;
+
+        if (block & BLOCK_UNCOMPRESSED) {
+            if (size > dst_len - (op - (uint8_t *)dst))
+                return -E2BIG;
+
+            kmemcpy(op, ip, size);
+            ret = size;
+        } else {
+            /* linked blocks may reach back into the output of the previous blocks,
+             * a valid independent block never does so it can have the same prefix */
+            ret = lz4_block_decompress(ip, size, op, dst_len - (op - (uint8_t *)dst), op - (uint8_t *)dst);
+
+            if (ret < 0)
+                return ret;
+        }
+
+        op += ret;
+        ip += size + ((flg & FLG_BLOCK_CSUM) ? 4 : 0);
+    }
+
+    if ((flg & FLG_CONTENT_SIZE) && content_size != (uint64_t)(op - (uint8_t *)dst))
+        return -EINVAL;
+
+    if (flg & FLG_CONTENT_CSUM) {
+        if (iend - ip < 4 || lz4_xxh32(dst, op - (uint8_t *)dst, 0) != __read32(ip))
+            return -EINVAL;
+    }
+
+    return op - (uint8_t *)dst;
+}
@@ -0,0 +1,193 @@
+#include <lib/radix.h>
+#include <mm/heap.h>
+#include <errno.h>
+#include <stdbool.h>
+
+/* the tree can hold indices up to this height, 11 levels of 6 bits cover 64 bits */
+#define RADIX_MAX_HEIGHT ((64 + RADIX_SHIFT - 1) / RADIX_SHIFT)
+
+static inline uint32_t __slot(uint64_t index, uint32_t level)
+{
+    return (index >> (level * RADIX_SHIFT)) & RADIX_MASK;
+}
+
+/* largest index a tree of `height` can hold */
+static inline uint64_t __max_index(uint32_t height)
+{
+    if (height >= RADIX_MAX_HEIGHT)
+        return UINT64_MAX;
+
+    return (1ULL << (height * RADIX_SHIFT)) - 1;
+}
+
+static void __destroy(radix_node_t *node, uint32_t level, void (*fn)(void *, void *), void *arg)
+{
+    for (uint32_t i = 0; i < RADIX_SLOTS; ++i) {
+        if (!node->slots[i])
+            continue;
+
+        if (level)
+            __destroy(node->slots[i], level - 1, fn, arg);
+        else if (fn)
+            fn(node->slots[i], arg);
+    }
+
+    kfree(node);
+}
+
+/* first item at or after `index` below `node`, `base` is the first index the node covers */
+static void *__next(radix_node_t *node, uint32_t level, uint64_t base, uint64_t index, uint64_t *found)
+{
+    for (uint32_t i = __slot(index, level); i < RADIX_SLOTS; ++i) {
+        uint64_t start = base | ((uint64_t)i << (level * RADIX_SHIFT));
+        void *item;
+
+        if (!node->slots[i])
+            continue;
+
+        if (!level) {
+            *found = start;
+            return node->slots[i];
+        }
+
+        // only the subtree of `index` is searched from the middle, the ones after it from the start
+        if ((item = __next(node->slots[i], level - 1, start, index > start ? index : start, found)))
+            return item;
+    }
+
+    return NULL;
+}
+
+void radix_init(radix_tree_t *tree)
+{
+    tree->root   = NULL;
+    tree->height = 0;
+}
+
+void *radix_lookup(radix_tree_t *tree, uint64_t index)
+{
+    radix_node_t *node = tree->root;
+
+    if (!node || index > __max_index(tree->height))
+        return NULL;
+
+    for (uint32_t level = tree->height - 1; level > 0; --level) {
+        if (!(node = node->slots[__slot(index, level)]))
+            return NULL;
+    }
+
+    return node->slots[__slot(index, 0)];
+}
+
+int radix_insert(radix_tree_t *tree, uint64_t index, void *item)
+{
+    radix_node_t *node, *child;
+
+    if (!item)
+        return -EINVAL;
+
+    // add levels on top until `index` fits, the old root becomes the first child
+    while (!tree->root || index > __max_index(tree->height)) {
+        if (!(node = kzalloc(sizeof(radix_node_t))))
+            return -ENOMEM;
+
+        if (tree->root) {
+            node->slots[0] = tree->root;
+            node->count    = 1;
+        }
+
+        tree->root = node;
+        tree->height++;
+    }
+
+    node = tree->root;
+
+    for (uint32_t level = tree->height - 1; level > 0; --level) {
+        uint32_t slot = __slot(index, level);
+
+        if (!(child = node->slots[slot])) {
+            if (!(child = kzalloc(sizeof(radix_node_t))))
+                return -ENOMEM;
+
+            node->slots[slot] = child;
+            node->count++;
+        }
+
+        node = child;
+    }
+
+    if (node->slots[__slot(index, 0)])
+        return -EEXIST;
+
+    node->slots[__slot(index, 0)] = item;
+    node->count++;
+
+    return 0;
+}
+
+void *radix_delete(radix_tree_t *tree, uint64_t index)
+{
+    radix_node_t *path[RADIX_MAX_HEIGHT];
+    radix_node_t *node = tree->root;
+    void *item;
+
+    if (!node || index > __max_index(tree->height))
+        return NULL;
+
+    for (uint32_t level = tree->height - 1; level > 0; --level) {
+        path[level] = node;
+
+        if (!(node = node->slots[__slot(index, level)]))
+            return NULL;
+    }
+
+    path[0] = node;
+
+    if (!(item = node->slots[__slot(index, 0)]))
+        return NULL;
+
+    // free the nodes that became empty, bottom up
+    for (uint32_t level = 0; level < tree->height; ++level) {
+        path[level]->slots[__slot(index, level)] = NULL;
+
+        if (--path[level]->count)
+            break;
+
+        kfree(path[level]);
+
+        if (level == tree->height - 1) {
+            tree->root   = NULL;
+            tree->height = 0;
+            return item;
+        }
+
+        // the parent's slot is cleared by the next iteration
+    }
+
+    // drop the roots that only have the first slot in use
+    while (tree->height > 1 && tree->root->count == 1 && tree->root->slots[0]) {
+        node = tree->root;
+
+        tree->root = node->slots[0];
+        tree->height--;
+        kfree(node);
+    }
+
+    return item;
+}
+
+void *radix_next(radix_tree_t *tree, uint64_t index, uint64_t *found)
+{
+    if (!tree->root || index > __max_index(tree->height))
+        return NULL;
+
+    return __next(tree->root, tree->height - 1, 0, index, found);
+}
+
+void radix_destroy(radix_tree_t *tree, void (*fn)(void *item, void *arg), void *arg)
+{
+    if (tree->root)
+        __destroy(tree->root, tree->height - 1, fn, arg);
+
+    radix_init(tree);
+}
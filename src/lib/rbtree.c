@@ -0,0 +1,352 @@
+#include <lib/rbtree.h>
+
+#define IS_RED(n)   ((n) && (n)->color == RB_RED)
+#define IS_BLACK(n) (!(n) || (n)->color == RB_BLACK)
+
+static inline void __augment(rb_tree_t *tree, rb_node_t *node)
+{
+    if (tree->augment)
+        tree->augment(node);
+}
+
+/* make `new` take the place of `old` as the child of `parent` */
+static void __replace_child(rb_tree_t *tree, rb_node_t *parent, rb_node_t *old, rb_node_t *new)
+{
+    if (!parent)
+        tree->root = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
+}
+
+/* rotations only change the subtrees of `node` and its child,
+ * the augmented values of their ancestors stay the same */
+static void __rotate_left(rb_tree_t *tree, rb_node_t *node)
+{
+    rb_node_t *right = node->right;
+
+    node->right = right->left;
+    if (right->left)
+        right->left->parent = node;
+
+    right->parent = node->parent;
+    __replace_child(tree, node->parent, node, right);
+
+    right->left  = node;
+    node->parent = right;
+
+    __augment(tree, node);
+    __augment(tree, right);
+}
+
+static void __rotate_right(rb_tree_t *tree, rb_node_t *node)
+{
+    rb_node_t *left = node->left;
+
+    node->left = left->right;
+    if (left->right)
+        left->right->parent = node;
+
+    left->parent = node->parent;
+    __replace_child(tree, node->parent, node, left);
+
+    left->right  = node;
+    node->parent = left;
+
+    __augment(tree, node);
+    __augment(tree, left);
+}
+
+void rb_init(rb_tree_t *tree, rb_augment_t augment)
+{
+    tree->root    = NULL;
+    tree->augment = augment;
+}
+
+void rb_propagate(rb_tree_t *tree, rb_node_t *node)
+{
+    if (!tree->augment)
+        return;
+
+    for (; node; node = node->parent)
+        tree->augment(node);
+}
+
+void rb_insert(rb_tree_t *tree, rb_node_t *node, rb_node_t *parent, rb_node_t **link)
+{
+    node->parent = parent;
+    node->left   = NULL;
+    node->right  = NULL;
+    node->color  = RB_RED;
+    *link        = node;
+
+    rb_propagate(tree, node);
+
+    while (IS_RED(node->parent)) {
+        parent = node->parent;
+        rb_node_t *gparent = parent->parent;
+
+        if (parent == gparent->left) {
+            rb_node_t *uncle = gparent->right;
+
+            if (IS_RED(uncle)) {
+                parent->color  = RB_BLACK;
+                uncle->color   = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+
+            if (node == parent->right) {
+                __rotate_left(tree, parent);
+                node   = parent;
+                parent = node->parent;
+            }
+
+            parent->color  = RB_BLACK;
+            gparent->color = RB_RED;
+            __rotate_right(tree, gparent);
+        } else {
+            rb_node_t *uncle = gparent->left;
+
+            if (IS_RED(uncle)) {
+                parent->color  = RB_BLACK;
+                uncle->color   = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+
+            if (node == parent->left) {
+                __rotate_right(tree, parent);
+                node   = parent;
+                parent = node->parent;
+            }
+
+            parent->color  = RB_BLACK;
+            gparent->color = RB_RED;
+            __rotate_left(tree, gparent);
+        }
+    }
+
+    tree->root->color = RB_BLACK;
+}
+
+/* `node` (possibly NULL) is one black short, `parent` is its parent */
+static void __remove_fixup(rb_tree_t *tree, rb_node_t *node, rb_node_t *parent)
+{
+    rb_node_t *sibling;
+
+    while (node != tree->root && IS_BLACK(node)) {
+        if (node == parent->left) {
+            sibling = parent->right;
+
+            if (IS_RED(sibling)) {
+                sibling->color = RB_BLACK;
+                parent->color  = RB_RED;
+                __rotate_left(tree, parent);
+                sibling = parent->right;
+            }
+
+            if (IS_BLACK(sibling->left) && IS_BLACK(sibling->right)) {
+                sibling->color = RB_RED;
+                node   = parent;
+                parent = node->parent;
+                continue;
+            }
+
+            if (IS_BLACK(sibling->right)) {
+                sibling->left->color = RB_BLACK;
+                sibling->color       = RB_RED;
+                __rotate_right(tree, sibling);
+                sibling = parent->right;
+            }
+
+            sibling->color = parent->color;
+            parent->color  = RB_BLACK;
+            if (sibling->right)
+                sibling->right->color = RB_BLACK;
+            __rotate_left(tree, parent);
+        } else {
+            sibling = parent->left;
+
+            if (IS_RED(sibling)) {
+                sibling->color = RB_BLACK;
+                parent->color  = RB_RED;
+                __rotate_right(tree, parent);
+                sibling = parent->left;
+            }
+
+            if (IS_BLACK(sibling->left) && IS_BLACK(sibling->right)) {
+                sibling->color = RB_RED;
+                node   = parent;
+                parent = node->parent;
+                continue;
+            }
+
+            if (IS_BLACK(sibling->left)) {
+                sibling->right->color = RB_BLACK;
+                sibling->color        = RB_RED;
+                __rotate_left(tree, sibling);
+                sibling = parent->left;
+            }
+
+            sibling->color = parent->color;
+            parent->color  = RB_BLACK;
+            if (sibling->left)
+                sibling->left->color = RB_BLACK;
+            __rotate_right(tree, parent);
+        }
+
+        node = tree->root;
+        break;
+    }
+
+    if (node)
+        node->color = RB_BLACK;
+}
+
+void rb_remove(rb_tree_t *tree, rb_node_t *node)
+{
+    rb_node_t *child, *parent;
+    int color;
+
+    if (!node->left || !node->right) {
+        child  = node->left ? node->left : node->right;
+        parent = node->parent;
+        color  = node->color;
+
+        if (child)
+            child->parent = parent;
+        __replace_child(tree, parent, node, child);
+    } else {
+        /* replace `node` with its successor which has no left child */
+        rb_node_t *succ = node->right;
+
+        while (succ->left)
+            succ = succ->left;
+
+        child  = succ->right;
+        parent = succ->parent;
+        color  = succ->color;
+
+        if (parent == node) {
+            parent = succ;
+        } else {
+            if (child)
+                child->parent = parent;
+            parent->left = child;
+
+            succ->right         = node->right;
+            node->right->parent = succ;
+        }
+
+        succ->left         = node->left;
+        node->left->parent = succ;
+        succ->color        = node->color;
+        succ->parent       = node->parent;
+        __replace_child(tree, node->parent, node, succ);
+    }
+
+    /* `parent` is the deepest node whose subtree changed */
+    rb_propagate(tree, parent);
+
+    if (color == RB_BLACK)
+        __remove_fixup(tree, child, parent);
+}
+
+rb_node_t *rb_first(rb_tree_t *tree)
+{
+    rb_node_t *n = tree->root;
+
+    if (!n)
+        return NULL;
+
+    while (n->left)
+        n = n->left;
+
+    return n;
+}
+
+rb_node_t *rb_last(rb_tree_t *tree)
+{
+    rb_node_t *n = tree->root;
+
+    if (!n)
+        return NULL;
+
+    while (n->right)
+        n = n->right;
+
+    return n;
+}
+
+rb_node_t *rb_next(rb_node_t *node)
+{
+    if (node->right) {
+        node = node->right;
+
+        while (node->left)
+            node = node->left;
+
+        return node;
+    }
+
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+
+    return node->parent;
+}
+
+rb_node_t *rb_prev(rb_node_t *node)
+{
+    if (node->left) {
+        node = node->left;
+
+        while (node->right)
+            node = node->right;
+
+        return node;
+    }
+
+    while (node->parent && node == node->parent->left)
+        node = node->parent;
+
+    return node->parent;
+}
+
+rb_node_t *rb_find(rb_tree_t *tree, const void *key, rb_cmp_t cmp)
+{
+    rb_node_t *n = tree->root;
+
+    while (n) {
+        int ret = cmp(key, n);
+
+        if (ret < 0)
+            n = n->left;
+        else if (ret > 0)
+            n = n->right;
+        else
+            return n;
+    }
+
+    return NULL;
+}
+
+rb_node_t *rb_lower_bound(rb_tree_t *tree, const void *key, rb_cmp_t cmp)
+{
+    rb_node_t *n   = tree->root;
+    rb_node_t *ret = NULL;
+
+    while (n) {
+        if (cmp(key, n) <= 0) {
+            ret = n;
+            n   = n->left;
+        } else {
+            n = n->right;
+        }
+    }
+
+    return ret;
+}
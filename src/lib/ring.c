@@ -0,0 +1,260 @@
+#include <arch/amd64/cpu.h>
+#include <kernel/common.h>
+#include <kernel/kassert.h>
+#include <kernel/util.h>
+#include <lib/ring.h>
+#include <mm/mmu.h>
+#include <mm/page.h>
+#include <errno.h>
+
+#define __load_acquire(ptr)       __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define __store_release(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+static inline void *__slot(ring_t *ring, uint32_t pos)
+{
+    return ring->data + (size_t)(pos & ring->mask) * ring->esize;
+}
+
+/* clamp the number of records to what's available and, for zero-copy,
+ * to what's left before the end of the storage */
+static inline uint32_t __clamp(ring_t *ring, uint32_t pos, uint32_t n, uint32_t avail,
+                               bool exact, bool contig)
+{
+    if (contig)
+        avail = MIN(avail, ring_capacity(ring) - (pos & ring->mask));
+
+    if (n > avail)
+        return exact ? 0 : avail;
+
+    return n;
+}
+
+/* reserve space for up to `n` records, return the number reserved and the start position */
+static uint32_t __prod_begin(ring_t *ring, uint32_t n, bool exact, bool contig, uint32_t *start)
+{
+    uint32_t cap  = ring_capacity(ring);
+    uint32_t head = __atomic_load_n(&ring->prod.head, __ATOMIC_RELAXED);
+    uint32_t cnt;
+
+    if (ring->flags == RING_SPSC) {
+        if (cap - (head - ring->prod.cons_cache) < n)
+            ring->prod.cons_cache = __load_acquire(&ring->cons.head);
+
+        if ((cnt = __clamp(ring, head, n, cap - (head - ring->prod.cons_cache), exact, contig)))
+            __atomic_store_n(&ring->prod.head, head + cnt, __ATOMIC_RELAXED);
+
+        *start = head;
+        return cnt;
+    }
+
+    do {
+        uint32_t cons = __load_acquire(&ring->cons.head);
+
+        if (!(cnt = __clamp(ring, head, n, cap - (head - cons), exact, contig)))
+            return 0;
+    } while (!__atomic_compare_exchange_n(&ring->prod.head, &head, head + cnt, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    *start = head;
+    return cnt;
+}
+
+/* publish `n` records starting at `start` */
+static void __prod_end(ring_t *ring, uint32_t start, uint32_t n)
+{
+    /* producers that reserved earlier must publish first */
+    if (ring->flags == RING_MPSC) {
+        while (__atomic_load_n(&ring->prod.tail, __ATOMIC_RELAXED) != start)
+            cpu_relax();
+    }
+
+    __store_release(&ring->prod.tail, start + n);
+}
+
+static uint32_t __cons_begin(ring_t *ring, uint32_t n, bool exact, bool contig, uint32_t *start)
+{
+    uint32_t head = ring->cons.head;
+
+    if (ring->cons.prod_cache - head < n)
+        ring->cons.prod_cache = __load_acquire(&ring->prod.tail);
+
+    *start = head;
+    return __clamp(ring, head, n, ring->cons.prod_cache - head, exact, contig);
+}
+
+static void __cons_end(ring_t *ring, uint32_t start, uint32_t n)
+{
+    __store_release(&ring->cons.head, start + n);
+}
+
+/* copy `n` records between `recs` and the slots starting at `pos`,
+ * in two parts if the records wrap around the end of the storage */
+static void __copy_in(ring_t *ring, uint32_t pos, const void *recs, uint32_t n)
+{
+    uint32_t first = MIN(n, ring_capacity(ring) - (pos & ring->mask));
+
+    kmemcpy(__slot(ring, pos), recs, (size_t)first * ring->esize);
+
+    if (first < n)
+        kmemcpy(ring->data, (const uint8_t *)recs + (size_t)first * ring->esize,
+                (size_t)(n - first) * ring->esize);
+}
+
+static void __copy_out(ring_t *ring, uint32_t pos, void *recs, uint32_t n)
+{
+    uint32_t first = MIN(n, ring_capacity(ring) - (pos & ring->mask));
+
+    kmemcpy(recs, __slot(ring, pos), (size_t)first * ring->esize);
+
+    if (first < n)
+        kmemcpy((uint8_t *)recs + (size_t)first * ring->esize, ring->data,
+                (size_t)(n - first) * ring->esize);
+}
+
+static uint32_t __enqueue(ring_t *ring, const void *recs, uint32_t n, bool exact)
+{
+    uint32_t start, cnt;
+
+    if ((cnt = __prod_begin(ring, n, exact, false, &start))) {
+        __copy_in(ring, start, recs, cnt);
+        __prod_end(ring, start, cnt);
+    }
+
+    return cnt;
+}
+
+static uint32_t __dequeue(ring_t *ring, void *recs, uint32_t n, bool exact)
+{
+    uint32_t start, cnt;
+
+    if ((cnt = __cons_begin(ring, n, exact, false, &start))) {
+        __copy_out(ring, start, recs, cnt);
+        __cons_end(ring, start, cnt);
+    }
+
+    return cnt;
+}
+
+int ring_init(ring_t *ring, void *mem, uint32_t count, uint32_t esize, int flags)
+{
+    if (!ring || !mem || !count || (count & (count - 1)) || !esize)
+        return -EINVAL;
+
+    if (flags != RING_SPSC && flags != RING_MPSC)
+        return -EINVAL;
+
+    ring->data  = mem;
+    ring->mask  = count - 1;
+    ring->esize = esize;
+    ring->flags = flags;
+
+    ring->prod.head       = 0;
+    ring->prod.tail       = 0;
+    ring->prod.cons_cache = 0;
+    ring->cons.head       = 0;
+    ring->cons.prod_cache = 0;
+
+    return 0;
+}
+
+/* the ring and its storage share one block of pages so the
+ * cache line padding of `ring_t` is honored */
+static uint32_t __alloc_order(uint32_t count, uint32_t esize)
+{
+    size_t size    = sizeof(ring_t) + (size_t)count * esize;
+    uint32_t order = 0;
+
+    while (((size_t)PAGE_SIZE << order) < size)
+        order++;
+
+    return order;
+}
+
+ring_t *ring_alloc(uint32_t count, uint32_t esize, int flags)
+{
+    if (!count || (count & (count - 1)) || !esize) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uint64_t mem = mm_block_alloc(MM_ZONE_NORMAL, __alloc_order(count, esize), 0);
+
+    if (mem == INVALID_ADDRESS)
+        return NULL;
+
+    ring_t *ring = (ring_t *)amd64_p_to_v(mem);
+    int ret;
+
+    if ((ret = ring_init(ring, ring + 1, count, esize, flags)) < 0) {
+        (void)mm_block_free(mem, __alloc_order(count, esize));
+        errno = -ret;
+        return NULL;
+    }
+
+    return ring;
+}
+
+void ring_free(ring_t *ring)
+{
+    if (!ring)
+        return;
+
+    kassert(ring->data == (uint8_t *)(ring + 1));
+
+    (void)mm_block_free(amd64_v_to_p(ring), __alloc_order(ring_capacity(ring), ring->esize));
+}
+
+uint32_t ring_enqueue(ring_t *ring, const void *recs, uint32_t n)
+{
+    return __enqueue(ring, recs, n, false);
+}
+
+uint32_t ring_enqueue_bulk(ring_t *ring, const void *recs, uint32_t n)
+{
+    return __enqueue(ring, recs, n, true);
+}
+
+uint32_t ring_dequeue(ring_t *ring, void *recs, uint32_t n)
+{
+    return __dequeue(ring, recs, n, false);
+}
+
+uint32_t ring_dequeue_bulk(ring_t *ring, void *recs, uint32_t n)
+{
+    return __dequeue(ring, recs, n, true);
+}
+
+uint32_t ring_reserve(ring_t *ring, uint32_t n, void **ptr)
+{
+    uint32_t start, cnt;
+
+    if ((cnt = __prod_begin(ring, n, false, true, &start)))
+        *ptr = __slot(ring, start);
+
+    return cnt;
+}
+
+void ring_commit(ring_t *ring, void *ptr, uint32_t n)
+{
+    uint32_t slot = ((uint8_t *)ptr - ring->data) / ring->esize;
+    uint32_t tail = __load_acquire(&ring->prod.tail);
+
+    /* unpublished reservations never span more than the whole ring so the
+     * start position is the first position after `tail` that maps to `slot` */
+    __prod_end(ring, tail + ((slot - tail) & ring->mask), n);
+}
+
+uint32_t ring_peek(ring_t *ring, uint32_t n, void **ptr)
+{
+    uint32_t start, cnt;
+
+    if ((cnt = __cons_begin(ring, n, false, true, &start)))
+        *ptr = __slot(ring, start);
+
+    return cnt;
+}
+
+void ring_release(ring_t *ring, uint32_t n)
+{
+    __cons_end(ring, ring->cons.head, n);
+}
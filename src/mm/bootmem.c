@@ -10,6 +10,8 @@
 #define BOOTMEM_MAX_RANGES     5
 #define BOOTMEM_MAX_ENTRIES  256
 
+extern uint8_t _kernel_physical_end;
+
 /* Boot memory initialization procedure
  *
  * Before smough is usable for normal operation, its memory allocators need to be initialized
@@ -25,17 +27,17 @@
  * which can then be used for temporary memory allocation.
  *
  * The memory map given by Multiboot2 can be split into several ranges and for now, smough only
- * maps the first five ranges, each of which can contain up to 256 * 32 * 4096 bytes (32 MB) of
+ * maps the first five ranges, each of which can contain up to 256 * 64 * 4096 bytes (64 MB) of
  * memory which is plenty enough for booting.
  *
  * Because at this point in booting smough doesn't have access to heap, the bitmap cannot be allocated
- * "the correct way" but its memory is manually initialized to point to an array of uint32_ts */
+ * "the correct way" but its memory is manually initialized to point to an array of uint64_ts */
 
 struct {
     struct {
         unsigned long start;
         size_t len;
-        uint32_t mem[BOOTMEM_MAX_ENTRIES];
+        uint64_t mem[BOOTMEM_MAX_ENTRIES];
         bitmap_t bm;
     } ranges[BOOTMEM_MAX_RANGES];
 
@@ -51,19 +53,53 @@ static void bootmem_claim_range(unsigned type, unsigned long addr, size_t len)
     if (mem_info.ptr >= BOOTMEM_MAX_RANGES)
         return;
 
+    /* the kernel image is loaded into the beginning of an available range */
+    uint64_t kernel_end = (uint64_t)&_kernel_physical_end;
+
+    if (addr < kernel_end && addr + len > KPSTART) {
+        if (addr + len <= kernel_end)
+            return;
+
+        len  = addr + len - kernel_end;
+        addr = kernel_end;
+    }
+
 	/* discard ranges that contain less than a page of memory */
     size_t npages = ROUND_DOWN(len, PAGE_SIZE) / PAGE_SIZE;
     if (npages == 0)
         return;
 
+    /* only the beginning of a large range is usable for boot memory */
+    if (npages > BOOTMEM_MAX_ENTRIES * BM_BITS_PER_WORD)
+        npages = BOOTMEM_MAX_ENTRIES * BM_BITS_PER_WORD;
+
     kprint("bootmem: free range 0x%x - 0x%x (%u, %u)\n", addr, addr + len, len, npages);
 
     mem_info.ranges[mem_info.ptr].start = ROUND_UP(addr, PAGE_SIZE);
-    bm_unset_range(&mem_info.ranges[mem_info.ptr].bm, 0, npages);
+    bm_unset_range(&mem_info.ranges[mem_info.ptr].bm, 0, npages - 1);
 
     mem_info.ptr++;
 }
 
+/* boot modules are loaded into available memory, keep their pages out of boot memory */
+static void bootmem_reserve_module(unsigned long addr, size_t len, const char *cmdline)
+{
+    (void)cmdline;
+
+    for (size_t i = 0; i < mem_info.ptr; ++i) {
+        uint64_t start = mem_info.ranges[i].start;
+        uint64_t end   = start + mem_info.ranges[i].bm.len * PAGE_SIZE;
+
+        if (addr >= end || addr + len <= start)
+            continue;
+
+        uint64_t first = (MAX(addr, start) - start) / PAGE_SIZE;
+        uint64_t last  = (MIN(addr + len, end) - start - 1) / PAGE_SIZE;
+
+        bm_set_range(&mem_info.ranges[i].bm, first, last);
+    }
+}
+
 int mm_bootmem_init(void *arg)
 {
     kprint("bootmem: initialize boot memory maps");
@@ -71,13 +107,14 @@ int mm_bootmem_init(void *arg)
     for (int i = 0; i < BOOTMEM_MAX_RANGES; ++i) {
         mem_info.ranges[i].bm.bits = mem_info.ranges[i].mem;
         mem_info.ranges[i].start   = INVALID_ADDRESS;
-        mem_info.ranges[i].bm.len  = BOOTMEM_MAX_ENTRIES * 32;
+        mem_info.ranges[i].bm.len  = BOOTMEM_MAX_ENTRIES * BM_BITS_PER_WORD;
 
-        bm_set_range(&mem_info.ranges[i].bm, 0, BOOTMEM_MAX_ENTRIES * 32 - 1);
+        bm_set_range(&mem_info.ranges[i].bm, 0, BOOTMEM_MAX_ENTRIES * BM_BITS_PER_WORD - 1);
     }
 
     mem_info.ptr = 0;
     multiboot2_map_memory(arg, bootmem_claim_range);
+    multiboot2_map_modules(arg, bootmem_reserve_module);
 
     return 0;
 }
@@ -98,7 +135,7 @@ uint64_t mm_bootmem_alloc_block(size_t npages)
         if (npages == 1) {
             if (bm_set_bit(&mem_info.ranges[i].bm, start) != 0)
                 return INVALID_ADDRESS;
-        } else if (bm_set_range(&mem_info.ranges[i].bm, start, start + npages) != 0)
+        } else if (bm_set_range(&mem_info.ranges[i].bm, start, start + npages - 1) != 0)
             return INVALID_ADDRESS;
 
         return mem_info.ranges[i].start + PAGE_SIZE * start;
@@ -5,7 +5,6 @@
 #include <kernel/util.h>
 #include <mm/bootmem.h>
 #include <mm/page.h>
-#include <mm/slab.h>
 #include <mm/types.h>
 #include <sys/types.h>
 #include <errno.h>
@@ -28,22 +27,31 @@ typedef struct mm_arena {
 } __packed mm_arena_t;
 
 static mm_arena_t __mem;
-static mm_cache_t *__arena_cache;
 static int initialized;
 
-static void __alloc_arena(void)
+/* allocate new arena that can hold at least `size` bytes
+ *
+ * the arena header is stored at the start of its own memory: taking it from a slab
+ * cache would make growing the heap depend on the slab which grows through the heap */
+static void __alloc_arena(size_t size)
 {
-    /* allocate new arena */
-    mm_arena_t *arena = mm_cache_alloc_entry(__arena_cache);
-    uint64_t mem = mm_block_alloc(MM_ZONE_NORMAL, HEAP_ARENA_SIZE, 0);
+    uint32_t order = HEAP_ARENA_SIZE;
+
+    /* requests that don't fit into a normal arena get a larger one */
+    while (PAGE_SIZE * (1UL << order) - sizeof(mm_arena_t) - sizeof(mm_chunk_t) < size)
+        order++;
 
-    arena->base = (mm_chunk_t *)amd64_p_to_v(mem);
-    arena->size = PAGE_SIZE * (1 << HEAP_ARENA_SIZE);
+    uint64_t mem = mm_block_alloc(MM_ZONE_NORMAL, order, 0);
+    mm_arena_t *arena = (mm_arena_t *)amd64_p_to_v(mem);
+
+    arena->base = (mm_chunk_t *)(arena + 1);
+    arena->size = PAGE_SIZE * (1UL << order) - sizeof(mm_arena_t);
+    arena->next = NULL;
 
     arena->base->free = 1;
     arena->base->next = NULL;
     arena->base->prev = NULL;
-    arena->base->size = PAGE_SIZE * (1 << HEAP_ARENA_SIZE) - sizeof(mm_chunk_t);
+    arena->base->size = arena->size - sizeof(mm_chunk_t);
 
     /* add the new arena at the end of the heap */
     mm_arena_t *iter = &__mem;
@@ -140,7 +148,7 @@ void *kmalloc(size_t size)
     mm_chunk_t *block;
 
     if (!(block = __find_free(&__mem, size))) {
-        __alloc_arena();
+        __alloc_arena(size);
 
         if (!(block = __find_free(&__mem, size)))
             kpanic("out of memory");
@@ -202,8 +210,5 @@ int mm_heap_init(void)
     __mem.base->prev = NULL;
     __mem.base->size = PAGE_SIZE * (1 << HEAP_ARENA_SIZE) - sizeof(mm_chunk_t);
 
-	__arena_cache = mm_cache_create(sizeof(mm_arena_t));
-	kassert(__arena_cache != NULL);
-
     return 0;
 }
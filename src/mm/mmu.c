@@ -5,6 +5,7 @@
 #include <mm/mmu.h>
 #include <mm/page.h>
 #include <mm/slab.h>
+#include <mm/vregion.h>
 
 int mm_init(void *arg)
 {
@@ -15,6 +16,11 @@ int mm_init(void *arg)
     (void)mm_native_init();
 
     (void)mm_bootmem_init(arg);
+
+    /* the direct map is built using boot memory and it must
+     * exist before any allocator touches the memory it hands out */
+    (void)mm_native_init_direct_map(arg);
+
     (void)mm_heap_preinit();
     (void)mm_slab_preinit();
 
@@ -22,6 +28,7 @@ int mm_init(void *arg)
 
     (void)mm_heap_init();
     (void)mm_slab_init();
+    (void)mm_vregion_init();
 
     kprint("mmu: memory allocators initialized\n");
 
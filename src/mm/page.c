@@ -2,6 +2,7 @@
 #include <kernel/common.h>
 #include <kernel/kpanic.h>
 #include <kernel/kassert.h>
+#include <kernel/lock.h>
 #include <kernel/util.h>
 #include <lib/bitmap.h>
 #include <lib/list.h>
@@ -15,6 +16,15 @@
 
 #define ORDER_EMPTY(o) (o.list.next == NULL)
 
+#define PAGE_ARRAY_ORDER   12
+#define PAGE_ARRAY_ENTRIES (((1UL << PAGE_ARRAY_ORDER) * PAGE_SIZE) / sizeof(page_t))
+
+/* pages asked from the shrinkers per page of a failed allocation */
+#define SHRINK_BATCH 64
+
+/* ranges kept out of the zones at boot: the kernel image and the boot modules */
+#define MAX_RESERVED 8
+
 typedef int (*add_block_t)(void *, uint64_t, uint32_t);
 
 typedef struct mm_block {
@@ -25,10 +35,15 @@ typedef struct mm_block {
 
 /* first item of every block order list is "dummy" entry
  * which tells if this order has any blocks and if so,
- * points to the first block of the order */
+ * points to the first block of the order
+ *
+ * The block lists are protected by `lock`. Block descriptors come from a slab
+ * cache which may allocate pages itself so they're never allocated or freed
+ * while the lock is held */
 typedef struct mm_zone {
     const char *name;
     size_t page_count;
+    mcs_lock_t lock;
     mm_block_t blocks[BUDDY_MAX_ORDER];
 } mm_zone_t;
 
@@ -38,6 +53,24 @@ static mm_zone_t  zone_high;
 static mm_cache_t *mm_block_cache;
 static page_t     *page_array;
 
+static mm_shrinker_t *__shrinkers;
+static uint32_t      __shrinking;
+
+/* Memory that's in use before the page allocator is, the pages are handed to the
+ * zones only when their owner frees them with mm_free_range() */
+static struct {
+    uint64_t start;
+    uint64_t end;
+} __reserved[MAX_RESERVED];
+
+static size_t __nreserved;
+
+/* the first boot module, the multiboot2 information isn't kept after boot */
+static uint64_t __module_start;
+static size_t   __module_len;
+
+extern uint8_t _kernel_physical_end;
+
 static inline mm_zone_t *__get_zone(uint64_t start, uint64_t end)
 {
     if (end < MM_ZONE_DMA_END)
@@ -56,6 +89,7 @@ static int __zone_add_block(void *param, uint64_t start, uint32_t order)
 {
     mm_zone_t *zone   = (mm_zone_t *)param;
     mm_block_t *block = mm_cache_alloc_entry(mm_block_cache);
+    mcs_node_t node;
 
     if (block == NULL)
         return -errno;
@@ -65,9 +99,14 @@ static int __zone_add_block(void *param, uint64_t start, uint32_t order)
     block->end   = start + PAGE_SIZE * (1 << order) - 1;
 
     list_init_null(&block->list);
+
+    uint64_t flags = mcs_lock_irqsave(&zone->lock, &node);
+
     list_append(&zone->blocks[order].list, &block->list);
     zone->page_count += (1 << order);
 
+    mcs_unlock_irqrestore(&zone->lock, &node, flags);
+
     return 0;
 }
 
@@ -78,6 +117,10 @@ static int __page_array_add_block(void *param, uint64_t start, uint32_t order)
     uint32_t type = *(uint32_t *)param;
     uint32_t pfn  = start >> PAGE_SHIFT;
 
+    /* the page array doesn't cover all of physical memory, see mm_zones_init() */
+    if (pfn + (1 << order) > PAGE_ARRAY_ENTRIES)
+        return 0;
+
     page_array[pfn].type  = type;
     page_array[pfn].order = order;
     page_array[pfn].first = 1;
@@ -109,7 +152,7 @@ static void __claim_range(uint64_t start, uint64_t end, add_block_t callback, vo
         if (num_blocks > 0) {
             for (size_t b = 0; b < num_blocks; ++b) {
                 (void)callback(cb_param, start, order);
-                start = start + (b + 1) * BLOCK_SIZE;
+                start += BLOCK_SIZE;
             }
 
             range_len = rem_bytes;
@@ -131,8 +174,12 @@ static mm_block_t *__get_free_entry(mm_zone_t *zone, uint32_t order)
 }
 
 /* Split the block of order "split_order" into smaller blocks and keep splitting until
- * we've reached a half of a block that satisfies the request "req_order" */
-static uint64_t __split_block(mm_zone_t *zone, uint32_t req_order, uint32_t split_order)
+ * we've reached a half of a block that satisfies the request "req_order"
+ *
+ * The new blocks are described using the preallocated descriptors of `spare`,
+ * `split_order - req_order - 1` of them are needed */
+static uint64_t __split_block(mm_zone_t *zone, uint32_t req_order, uint32_t split_order,
+                              mm_block_t **spare)
 {
     kassert(split_order != 0 && req_order < BUDDY_MAX_ORDER);
 
@@ -147,7 +194,7 @@ static uint64_t __split_block(mm_zone_t *zone, uint32_t req_order, uint32_t spli
     list_append(&zone->blocks[--split_order].list, &b->list);
 
     while (req_order != split_order) {
-        mm_block_t *tmp = mm_cache_alloc_entry(mm_block_cache);
+        mm_block_t *tmp = *spare++;
 
         tmp->start  = split_start;
         split_size  = (1 << (split_order - 1)) * PAGE_SIZE;
@@ -192,27 +239,98 @@ static uint64_t __alloc_mem(uint32_t memzone, uint32_t order, int flags)
     else if (memzone & MM_ZONE_HIGH)
         zone = &zone_high;
 
-    for (uint32_t i = order; i < BUDDY_MAX_ORDER; ++i) {
-        if (ORDER_EMPTY(zone->blocks[i]))
-            continue;
+    mm_block_t *spare[BUDDY_MAX_ORDER];
+    mm_block_t *freed = NULL;
+    uint32_t nspare   = 0;
+    uint64_t start    = INVALID_ADDRESS;
+    mcs_node_t node;
+
+    for (;;) {
+        uint64_t irq = mcs_lock_irqsave(&zone->lock, &node);
+        uint32_t i   = order;
+
+        while (i < BUDDY_MAX_ORDER && ORDER_EMPTY(zone->blocks[i]))
+            ++i;
 
         /* There's a free block available in the order's list caller requested
          * Hanle this as a special case because it's cleaner */
-        if (i == order) {
-            mm_block_t *b = __get_free_entry(zone, i);
-            kassert(b != NULL);
+        if (i == BUDDY_MAX_ORDER) {
+            /* no block large enough */
+        } else if (i == order) {
+            freed = __get_free_entry(zone, i);
+            start = freed->start;
+        } else if (i - order - 1 <= nspare) {
+            nspare -= i - order - 1;
+            start   = __split_block(zone, order, i, spare + nspare);
+        }
+
+        mcs_unlock_irqrestore(&zone->lock, &node, irq);
 
-            uint64_t start = b->start;
-            (void)mm_cache_free_entry(mm_block_cache, b);
+        if (start != INVALID_ADDRESS || i == BUDDY_MAX_ORDER) {
+            if (start == INVALID_ADDRESS)
+                errno = ENOMEM;
+            break;
+        }
 
-            return start;
+        /* the split needs more block descriptors, allocate them and try again */
+        while (nspare < i - order - 1) {
+            if (!(spare[nspare] = mm_cache_alloc_entry(mm_block_cache)))
+                break;
+            nspare++;
         }
 
-        return __split_block(zone, order, i);
+        if (nspare < i - order - 1)
+            break;
+    }
+
+    if (freed)
+        (void)mm_cache_free_entry(mm_block_cache, freed);
+
+    while (nspare)
+        (void)mm_cache_free_entry(mm_block_cache, spare[--nspare]);
+
+    return start;
+}
+
+/* reserve the pages that `len` bytes at `address` touch */
+static void __reserve_range(uint64_t address, size_t len)
+{
+    if (__nreserved == MAX_RESERVED)
+        kpanic("too many reserved memory ranges");
+
+    __reserved[__nreserved].start = ROUND_DOWN(address, PAGE_SIZE);
+    __reserved[__nreserved].end   = ROUND_UP(address + len, PAGE_SIZE);
+    __nreserved++;
+}
+
+static void __reserve_module(uint64_t address, size_t len, const char *cmdline)
+{
+    kprint("page - reserve module \"%s\" 0x%x - 0x%x\n", cmdline, address, address + len);
+    __reserve_range(address, len);
+
+    if (__module_len == 0) {
+        __module_start = address;
+        __module_len   = len;
+    }
+}
+
+/* claim the parts of [start, end) that reserved ranges `i` and after it don't cover */
+static void __claim_unreserved(uint64_t start, uint64_t end, size_t i)
+{
+    for (; i < __nreserved; ++i) {
+        if (__reserved[i].start >= end || __reserved[i].end <= start)
+            continue;
+
+        if (start < __reserved[i].start)
+            __claim_unreserved(start, __reserved[i].start, i + 1);
+
+        if (__reserved[i].end < end)
+            __claim_unreserved(__reserved[i].end, end, i + 1);
+
+        return;
     }
 
-    errno = ENOMEM;
-    return INVALID_ADDRESS;
+    mm_claim_range(start, end - start);
 }
 
 /* claim only available/reclaimable memory for zones */
@@ -222,7 +340,7 @@ static void __claim_range_preinit(uint32_t type, uint64_t address, size_t len)
         type != MULTIBOOT_MEMORY_ACPI_RECLAIMABLE)
         return;
 
-    return mm_claim_range(address, len);
+    return __claim_unreserved(address, address + len, 0);
 }
 
 /* claim all memory but update only the page array */
@@ -261,6 +379,10 @@ void mm_zones_init(void *arg)
     zone_normal.page_count = 0;
     zone_high.page_count   = 0;
 
+    mcs_init(&zone_dma.lock);
+    mcs_init(&zone_normal.lock);
+    mcs_init(&zone_high.lock);
+
     for (size_t i = 0; i < BUDDY_MAX_ORDER; ++i) {
         zone_dma.blocks[i].start    = 0;
         zone_dma.blocks[i].end      = 0;
@@ -279,6 +401,15 @@ void mm_zones_init(void *arg)
     if (!(mm_block_cache = mm_cache_create(sizeof(mm_block_t))))
         kpanic("Failed to allocate mm_block_cache for PFA");
 
+    /* the kernel image and the boot modules are in use already, see mm_free_range() */
+    __nreserved  = 0;
+    __module_len = 0;
+
+    if ((uint64_t)&_kernel_physical_end > KPSTART)
+        __reserve_range(KPSTART, (uint64_t)&_kernel_physical_end - KPSTART);
+
+    (void)multiboot2_map_modules(arg, __reserve_module);
+
     /* Memory is claimed twice: on the first run we're only interested in free memory
      * because we're initializing the zones. When zones and the page array have been initialized
      * we reclaim all memory but this time we're only updating the page array */
@@ -293,21 +424,41 @@ void mm_zones_init(void *arg)
      *
      * Use the internal allocation function to allocate the block because currently
      * the page_array points to NULL */
-    uint64_t pa_mem = __alloc_mem(MM_ZONE_NORMAL, 12, 0);
+    uint64_t pa_mem = __alloc_mem(MM_ZONE_NORMAL, PAGE_ARRAY_ORDER, 0);
     kassert(pa_mem != INVALID_ADDRESS);
 
     page_array = (page_t *)amd64_p_to_v(pa_mem);
 
     /* initially mark all memory as invalid
      * (even the parts that multiboot2 memory doesn't contain) */
-    kmemset(page_array, MM_PT_INVALID, (1 << 12) * PAGE_SIZE);
+    kmemset(page_array, MM_PT_INVALID, (1 << PAGE_ARRAY_ORDER) * PAGE_SIZE);
 
     /* Mark areas of page array to free/occupied using multiboot2 memory map */
     multiboot2_map_memory(arg, __claim_range_postinit);
 
-    /* set the memory consumed by the page array as in use separately
-     * because multiboot2_map_memory() has marked it as free */
-    (void)__page_array_add_block(&(uint32_t){ MM_PT_IN_USE }, pa_mem, 12);
+    /* set the memory consumed by the page array and the reserved ranges as in use
+     * separately because multiboot2_map_memory() has marked them as free */
+    (void)__page_array_add_block(&(uint32_t){ MM_PT_IN_USE }, pa_mem, PAGE_ARRAY_ORDER);
+
+    for (size_t i = 0; i < __nreserved; ++i) {
+        __claim_range(
+            __reserved[i].start,
+            __reserved[i].end,
+            __page_array_add_block,
+            &(uint32_t){ MM_PT_IN_USE }
+        );
+    }
+}
+
+int mm_boot_module(uint64_t *start, size_t *len)
+{
+    if (__module_len == 0)
+        return -ENOENT;
+
+    *start = __module_start;
+    *len   = __module_len;
+
+    return 0;
 }
 
 void mm_claim_range(uint64_t address, size_t len)
@@ -347,6 +498,16 @@ void mm_claim_range(uint64_t address, size_t len)
     }
 }
 
+page_t *mm_get_page(uint64_t address)
+{
+    uint64_t pfn = address >> PAGE_SHIFT;
+
+    if (pfn >= PAGE_ARRAY_ENTRIES)
+        return NULL;
+
+    return &page_array[pfn];
+}
+
 void mm_claim_page(uint64_t address)
 {
     mm_claim_range(address, PAGE_SIZE);
@@ -359,10 +520,47 @@ uint64_t mm_page_alloc(uint32_t memzone, int flags)
 
 uint64_t mm_block_alloc(uint32_t memzone, uint32_t order, int flags)
 {
-    uint64_t address = __alloc_mem(memzone, order, flags);
+    uint64_t address = mm_block_try_alloc(memzone, order, flags);
     kassert(address != INVALID_ADDRESS);
 
-    (void)__page_array_add_block(&(uint32_t){ MM_PT_IN_USE }, address, order);
+    return address;
+}
+
+void mm_register_shrinker(mm_shrinker_t *shrinker)
+{
+    shrinker->next = __atomic_load_n(&__shrinkers, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(&__shrinkers, &shrinker->next, shrinker, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+}
+
+size_t mm_shrink(size_t nr)
+{
+    size_t freed = 0;
+
+    /* a shrinker freeing memory may allocate, don't recurse into the shrinkers */
+    if (__atomic_exchange_n(&__shrinking, 1, __ATOMIC_ACQUIRE))
+        return 0;
+
+    for (mm_shrinker_t *s = __atomic_load_n(&__shrinkers, __ATOMIC_ACQUIRE); s; s = s->next)
+        freed += s->scan(nr);
+
+    __atomic_store_n(&__shrinking, 0, __ATOMIC_RELEASE);
+    return freed;
+}
+
+uint64_t mm_block_try_alloc(uint32_t memzone, uint32_t order, int flags)
+{
+    uint64_t address = __alloc_mem(memzone, order, flags);
+
+    /* give the caches one chance to release memory */
+    if (address == INVALID_ADDRESS && mm_shrink(SHRINK_BATCH << order))
+        address = __alloc_mem(memzone, order, flags);
+
+    if (address != INVALID_ADDRESS)
+        (void)__page_array_add_block(&(uint32_t){ MM_PT_IN_USE }, address, order);
+
     return address;
 }
 
@@ -382,3 +580,21 @@ int mm_page_free(uint64_t address)
 {
     return mm_block_free(address, 0);
 }
+
+void mm_free_range(uint64_t address, size_t len)
+{
+    uint64_t start = ROUND_UP(address, PAGE_SIZE);
+    uint64_t end   = ROUND_DOWN(address + len, PAGE_SIZE);
+
+    /* a block aligned to its size doesn't cross a zone boundary */
+    while (start < end) {
+        uint32_t order = 0;
+        uint64_t size  = PAGE_SIZE;
+
+        while (order + 1 < BUDDY_MAX_ORDER && ALIGNED(start, 2 * size) && start + 2 * size <= end)
+            order++, size *= 2;
+
+        (void)mm_block_free(start, order);
+        start += size;
+    }
+}
@@ -1,6 +1,8 @@
 #include <kernel/common.h>
+#include <kernel/compiler.h>
 #include <kernel/kassert.h>
 #include <kernel/kprint.h>
+#include <kernel/lock.h>
 #include <kernel/util.h>
 #include <lib/list.h>
 #include <mm/bootmem.h>
@@ -8,45 +10,76 @@
 #include <mm/page.h>
 #include <mm/slab.h>
 #include <errno.h>
+#include <stdbool.h>
 
+/* a freed entry holds the pointer to the next freed entry of its page so
+ * freeing an entry doesn't allocate anything */
 struct cache_free_chunk {
-    void *mem;
-    list_head_t list;
+    struct cache_free_chunk *next;
 };
 
+/* A slab page. Freed entries go back to the page they were carved from and a page
+ * whose entries have all been freed is released: pages from the page allocator are
+ * returned to it and the boot pages go to the global free list */
 typedef struct cache_fixed_entry {
-    size_t num_free;
+    size_t num_free; /* entries never handed out, starting at `next_free` */
+    size_t num_used; /* entries handed out and not freed */
     void *next_free;
     void *mem;
+    bool reclaim;    /* `mem` is a page of the page allocator */
 
+    struct cache_free_chunk *free_chunks;
     list_head_t list;
 } cfe_t;
 
+/* `lock` protects the cache but it's never held while pages or heap memory
+ * are allocated or freed because the page allocator itself allocates from a cache
+ *
+ * New entries are carved from `free_list`. Pages that have freed entries are on
+ * `partial` and they're used first. A full page isn't on any list, it's found
+ * through the page array when one of its entries is freed */
 struct mm_cache {
+    spinlock_t lock;
     size_t item_size;
-    size_t capacity;
+    size_t npages;
 
     struct cache_fixed_entry *free_list;
-    struct cache_fixed_entry *used_list;
-    struct cache_free_chunk *free_chunks;
+    list_head_t partial;
 };
 
+#define SLAB_BOOT_BLOCKS 2
+
 static list_head_t __free_list;
+static spinlock_t  __free_list_lock;
+
+/* the page array doesn't exist yet when the boot pages are allocated */
+static cfe_t *__boot_cfes[SLAB_BOOT_BLOCKS];
 
 static cfe_t *__alloc_cfe(size_t item_size)
 {
     kassert(item_size != 0);
 
+    uint64_t flags = spin_lock_irqsave(&__free_list_lock);
+
     if (__free_list.next) {
         cfe_t *e = container_of(__free_list.next, struct cache_fixed_entry, list);
 
         list_remove(&e->list);
-        e->num_free = (PAGE_SIZE / item_size) - 1; // TODO:
+        spin_unlock_irqrestore(&__free_list_lock, flags);
+
+        e->next_free   = e->mem;
+        e->num_free    = PAGE_SIZE / item_size;
+        e->num_used    = 0;
+        e->free_chunks = NULL;
 
         return e;
     }
 
-    uint64_t mem = mm_block_alloc(MM_ZONE_NORMAL, 1, 0);
+    spin_unlock_irqrestore(&__free_list_lock, flags);
+
+    /* a single page: the page allocator's block descriptors come from a slab cache and
+     * a larger block may have to be split which takes more descriptors */
+    uint64_t mem = mm_block_alloc(MM_ZONE_NORMAL, 0, 0);
     kassert(mem != INVALID_ADDRESS);
 
     void *virtual = amd64_p_to_v(mem);
@@ -54,12 +87,55 @@ static cfe_t *__alloc_cfe(size_t item_size)
 
     entry->mem       = virtual;
     entry->next_free = virtual;
-    entry->num_free  = PAGE_SIZE;
+    entry->num_free  = PAGE_SIZE / item_size;
+    entry->reclaim   = true;
+
+    mm_get_page(mem)->slab = entry;
 
     list_init_null(&entry->list);
     return entry;
 }
 
+/* return an unused entry to the global free list */
+static void __release_cfe(cfe_t *cfe)
+{
+    uint64_t flags = spin_lock_irqsave(&__free_list_lock);
+
+    list_append(&__free_list, &cfe->list);
+    spin_unlock_irqrestore(&__free_list_lock, flags);
+}
+
+/* release a page that no longer has entries in use */
+static void __put_cfe(cfe_t *cfe)
+{
+    if (!cfe->reclaim) {
+        __release_cfe(cfe);
+        return;
+    }
+
+    uint64_t mem = amd64_v_to_p(cfe->mem);
+
+    mm_get_page(mem)->slab = NULL;
+    (void)mm_page_free(mem);
+    kfree(cfe);
+}
+
+/* find the slab page `entry` was carved from */
+static cfe_t *__find_cfe(void *entry)
+{
+    void *mem = (void *)ROUND_DOWN((uint64_t)entry, PAGE_SIZE);
+
+    for (size_t i = 0; i < SLAB_BOOT_BLOCKS; ++i) {
+        if (__boot_cfes[i] && __boot_cfes[i]->mem == mem)
+            return __boot_cfes[i];
+    }
+
+    page_t *page = mm_get_page(amd64_v_to_p(mem));
+    kassert(page != NULL && page->slab != NULL);
+
+    return page->slab;
+}
+
 mm_cache_t *mm_cache_create(size_t size)
 {
     kassert(size > 0 && size <= PAGE_SIZE);
@@ -69,11 +145,12 @@ mm_cache_t *mm_cache_create(size_t size)
     if (!(c = kzalloc(sizeof(mm_cache_t))))
         return NULL;
 
-    c->item_size = MULTIPLE_OF_2(size);
-    c->capacity  = PAGE_SIZE / c->item_size;
+    spin_init(&c->lock);
+    list_init(&c->partial);
 
+    c->item_size = MULTIPLE_OF_2(MAX(size, sizeof(struct cache_free_chunk)));
     c->free_list = __alloc_cfe(c->item_size);
-    c->used_list = NULL;
+    c->npages    = 1;
 
     return c;
 }
@@ -82,11 +159,17 @@ int mm_cache_destroy(mm_cache_t *cache)
 {
     kassert(cache != NULL);
 
-    if (cache->used_list) {
+    /* pages other than `free_list` are released when their last entry is freed */
+    if (cache->npages > (cache->free_list ? 1 : 0) ||
+        (cache->free_list && cache->free_list->num_used))
+    {
         kprint("slab: cache still in use, unable to destroy it!\n");
         return -EBUSY;
     }
 
+    if (cache->free_list)
+        __put_cfe(cache->free_list);
+
     kfree(cache);
     return 0;
 }
@@ -95,39 +178,51 @@ void *mm_cache_alloc_entry(mm_cache_t *cache)
 {
     kassert(cache != NULL);
 
-    /* if there are any free chunks left, try to use them first and return early */
-    if (cache->free_chunks) {
-        void *ret = cache->free_chunks->mem;
-
-        /* is there only one free chunk? */
-        if (!cache->free_chunks->list.next) {
-            cache->free_chunks = NULL;
-        } else {
-            list_head_t *next_chunk = cache->free_chunks->list.next;
-            list_remove(&cache->free_chunks->list);
-            cache->free_chunks = container_of(next_chunk, struct cache_free_chunk, list);
-        }
+    uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+    /* if there are any freed entries left, try to use them first */
+    if (cache->partial.next != &cache->partial) {
+        cfe_t *cfe = container_of(cache->partial.next, struct cache_fixed_entry, list);
+        void *ret  = cfe->free_chunks;
+
+        if (!(cfe->free_chunks = cfe->free_chunks->next))
+            list_remove(&cfe->list);
+
+        cfe->num_used++;
+        spin_unlock_irqrestore(&cache->lock, flags);
 
+        kmemset(ret, 0, cache->item_size);
         return ret;
     }
 
-    if (!cache->free_list) {
-        cache->free_list = __alloc_cfe(cache->item_size);
-        cache->capacity += PAGE_SIZE / cache->item_size;
+    while (!cache->free_list) {
+        spin_unlock_irqrestore(&cache->lock, flags);
+        cfe_t *cfe = __alloc_cfe(cache->item_size);
+        flags = spin_lock_irqsave(&cache->lock);
+
+        /* someone else may have refilled the cache while the lock was released */
+        if (cache->free_list) {
+            spin_unlock_irqrestore(&cache->lock, flags);
+            __release_cfe(cfe);
+            flags = spin_lock_irqsave(&cache->lock);
+            continue;
+        }
+
+        cache->free_list = cfe;
+        cache->npages++;
     }
     void *ret = cache->free_list->next_free;
 
-    /* if last element, set free_list to NULL and append cache_entry to used list
+    cache->free_list->num_used++;
+
+    /* if last element, forget the page until one of its entries is freed
      * else set next_free to point to next free element in cache->free_list->mem */
-    if (!--cache->free_list->num_free) {
-        if (!cache->used_list)
-            cache->used_list = cache->free_list;
-        else
-            list_append(&cache->used_list->list, &cache->free_list->list);
+    if (!--cache->free_list->num_free)
         cache->free_list = NULL;
-    } else {
+    else
         cache->free_list->next_free = (uint8_t *)cache->free_list->next_free + cache->item_size;
-    }
+
+    spin_unlock_irqrestore(&cache->lock, flags);
 
     kmemset(ret, 0, cache->item_size);
     return ret;
@@ -138,27 +233,49 @@ int mm_cache_free_entry(mm_cache_t *cache, void *entry)
     kassert(cache != NULL);
     kassert(entry != NULL);
 
-    struct cache_free_chunk *cfc = kmalloc(sizeof(struct cache_free_chunk));
+    struct cache_free_chunk *cfc = entry;
+    cfe_t *cfe = __find_cfe(entry);
+    cfe_t *empty = NULL;
+    uint64_t flags = spin_lock_irqsave(&cache->lock);
 
-    list_init_null(&cfc->list);
-    cfc->mem = entry;
+    if (!cfe->free_chunks)
+        list_append(&cache->partial, &cfe->list);
 
-    if (!cache->free_chunks)
-        cache->free_chunks = cfc;
-    else
-        list_append(&cache->free_chunks->list, &cfc->list);
+    cfc->next        = cfe->free_chunks;
+    cfe->free_chunks = cfc;
+
+    /* keep the page new entries are carved from so a cache that allocates and frees
+     * one entry at a time doesn't allocate and free a page every time */
+    if (!--cfe->num_used && cfe != cache->free_list) {
+        list_remove(&cfe->list);
+        cache->npages--;
+        empty = cfe;
+    }
+
+    spin_unlock_irqrestore(&cache->lock, flags);
+
+    if (empty)
+        __put_cfe(empty);
 
     return 0;
 }
 
+size_t mm_cache_pages(mm_cache_t *cache)
+{
+    kassert(cache != NULL);
+
+    return READ_ONCE(cache->npages);
+}
+
 int mm_slab_preinit(void)
 {
     kprint("slab: initializing slab with bootmem\n");
 
+    spin_init(&__free_list_lock);
     list_init_null(&__free_list);
 
     /* allocate 16 KB for booting */
-    for (int i = 0; i < 2; ++i) {
+    for (int i = 0; i < SLAB_BOOT_BLOCKS; ++i) {
         uint64_t mem = mm_bootmem_alloc_block(1);
         void *mem_v  = amd64_p_to_v(mem);
 
@@ -168,6 +285,8 @@ int mm_slab_preinit(void)
         entry->next_free = mem_v;
         entry->num_free  = PAGE_SIZE;
 
+        __boot_cfes[i] = entry;
+
         list_init_null(&entry->list);
         list_append(&__free_list, &entry->list);
     }
@@ -196,6 +315,8 @@ int mm_slab_init(void)
         entry->next_free = entry->mem;
         entry->num_free  = PAGE_SIZE; /* assume `elem_size` == 1 */
 
+        mm_get_page(mem)->slab = entry;
+
         list_init_null(&entry->list);
         list_append(&__free_list, &entry->list);
     }
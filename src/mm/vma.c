@@ -0,0 +1,583 @@
+#include <arch/amd64/mmu.h>
+#include <kernel/common.h>
+#include <kernel/compiler.h>
+#include <kernel/kassert.h>
+#include <kernel/percpu.h>
+#include <kernel/util.h>
+#include <mm/page.h>
+#include <mm/slab.h>
+#include <mm/vma.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#define VMA(n) container_of((n), mm_vma_t, node)
+
+#define FAULT_AROUND_PAGES 16
+
+#define HUGE_SIZE  (1UL << 21)
+#define HUGE_ORDER 9
+
+static mm_cache_t *__as_cache;
+static mm_cache_t *__vma_cache;
+static size_t      __fault_around = FAULT_AROUND_PAGES;
+static bool        __thp          = true;
+
+static __percpu mm_as_t *__current;
+
+static int __init_caches(void)
+{
+    if (!__as_cache && !(__as_cache = mm_cache_create(sizeof(mm_as_t))))
+        return -errno;
+
+    if (!__vma_cache && !(__vma_cache = mm_cache_create(sizeof(mm_vma_t))))
+        return -errno;
+
+    return 0;
+}
+
+static void __insert(mm_as_t *as, mm_vma_t *vma)
+{
+    rb_node_t **link = &as->vmas.root, *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        link   = (vma->start < VMA(parent)->start) ? &parent->left : &parent->right;
+    }
+
+    rb_insert(&as->vmas, &vma->node, parent, link);
+    as->nvmas++;
+}
+
+static void __remove(mm_as_t *as, mm_vma_t *vma)
+{
+    rb_remove(&as->vmas, &vma->node);
+    as->nvmas--;
+
+    if (as->last == vma)
+        as->last = NULL;
+
+    if ((vma->flags & MM_VMA_FILE) && vma->ops->close)
+        vma->ops->close(vma);
+
+    (void)mm_cache_free_entry(__vma_cache, vma);
+}
+
+static inline uint64_t __pgoff(mm_vma_t *vma, uint64_t vaddr)
+{
+    return vma->pgoff + (vaddr - vma->start) / PAGE_SIZE;
+}
+
+/* return the lowest VMA that ends above `addr` or NULL */
+static mm_vma_t *__lower_bound(mm_as_t *as, uint64_t addr)
+{
+    rb_node_t *n  = as->vmas.root;
+    mm_vma_t *ret = NULL;
+
+    while (n) {
+        if (VMA(n)->end > addr) {
+            ret = VMA(n);
+            n   = n->left;
+        } else {
+            n = n->right;
+        }
+    }
+
+    return ret;
+}
+
+/* drop a mapping of 4 KB frame `paddr`, a copy-on-write frame is freed
+ * only when no other address space maps it anymore */
+static void __put_frame(uint64_t paddr)
+{
+    page_t *page    = mm_get_page(paddr);
+    uint16_t shares = page ? __atomic_load_n(&page->cow_shares, __ATOMIC_RELAXED) : 0;
+
+    while (shares > 0) {
+        if (__atomic_compare_exchange_n(&page->cow_shares, &shares, shares - 1, true,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            return;
+    }
+
+    (void)mm_page_free(paddr);
+}
+
+static void __unmap_pages(mm_as_t *as, uint64_t start, uint64_t end)
+{
+    uint64_t vaddr = start;
+
+    while (vaddr < end) {
+        size_t size;
+        uint64_t entry = amd64_lookup_page(as->pml4, vaddr, &size);
+        uint64_t base  = ROUND_DOWN(vaddr, size);
+
+        /* `size` tells how much can be skipped if nothing is mapped
+         * which makes unmapping large sparse regions cheap */
+        if (!(entry & MM_PRESENT)) {
+            vaddr = base + size;
+            continue;
+        }
+
+        /* only part of a huge page is unmapped, keep the rest as 4 KB pages */
+        if (size > PAGE_SIZE && (base < start || base + size > end)) {
+            amd64_split_large_page(as->pml4, vaddr);
+            continue;
+        }
+
+        uint64_t paddr = amd64_unmap_page_from_dir(as->pml4, vaddr);
+
+        /* the frames of a mapped object belong to the object */
+        if (!(entry & MM_BORROWED)) {
+            if (size == HUGE_SIZE)
+                (void)mm_block_free(paddr, HUGE_ORDER);
+            else
+                __put_frame(paddr);
+        }
+
+        vaddr = base + size;
+    }
+}
+
+/* allocate a 2 MB aligned block of 512 pages or return INVALID_ADDRESS */
+static uint64_t __alloc_huge(void)
+{
+    uint64_t paddr = mm_block_try_alloc(MM_ZONE_NORMAL, HUGE_ORDER, MM_NO_FLAGS);
+
+    if (paddr == INVALID_ADDRESS)
+        return INVALID_ADDRESS;
+
+    /* buddy blocks are naturally aligned unless the zone itself is
+     * misaligned, in which case 4 KB pages must be used */
+    if (paddr % HUGE_SIZE) {
+        (void)mm_block_free(paddr, HUGE_ORDER);
+        return INVALID_ADDRESS;
+    }
+
+    return paddr;
+}
+
+static int __vma_flags(mm_vma_t *vma)
+{
+    return MM_PRESENT | MM_USER | ((vma->prot & MM_PROT_WRITE) ? MM_READWRITE : 0);
+}
+
+/* try to back the 2 MB window of `vaddr` with one huge page
+ *
+ * this is possible only if the whole window belongs to `vma` and nothing
+ * in the window has been mapped yet */
+static bool __populate_huge(mm_as_t *as, mm_vma_t *vma, uint64_t vaddr)
+{
+    uint64_t window = ROUND_DOWN(vaddr, HUGE_SIZE);
+    size_t size;
+
+    if (!__thp || window < vma->start || window + HUGE_SIZE > vma->end)
+        return false;
+
+    if ((amd64_lookup_page(as->pml4, window, &size) & MM_PRESENT) || size < HUGE_SIZE)
+        return false;
+
+    uint64_t paddr = __alloc_huge();
+
+    if (paddr == INVALID_ADDRESS)
+        return false;
+
+    kmemset(amd64_p_to_v(paddr), 0, HUGE_SIZE);
+
+    if (amd64_map_large_page_to_dir(as->pml4, paddr, window, __vma_flags(vma)) < 0) {
+        (void)mm_block_free(paddr, HUGE_ORDER);
+        return false;
+    }
+
+    return true;
+}
+
+/* allocate a zeroed frame for `vaddr` and map it according to the protection of `vma` */
+static int __populate(mm_as_t *as, mm_vma_t *vma, uint64_t vaddr)
+{
+    uint64_t paddr = mm_block_try_alloc(MM_ZONE_NORMAL, 0, MM_NO_FLAGS);
+
+    if (paddr == INVALID_ADDRESS)
+        return -ENOMEM;
+
+    kmemset(amd64_p_to_v(paddr), 0, PAGE_SIZE);
+
+    if (amd64_map_page_to_dir(as->pml4, paddr, vaddr, __vma_flags(vma)) < 0) {
+        (void)mm_page_free(paddr);
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+/* map a copy of frame `paddr` at `vaddr` that can be written to */
+static int __populate_copy(mm_as_t *as, mm_vma_t *vma, uint64_t vaddr, uint64_t paddr)
+{
+    uint64_t copy = mm_block_try_alloc(MM_ZONE_NORMAL, 0, MM_NO_FLAGS);
+
+    if (copy == INVALID_ADDRESS)
+        return -ENOMEM;
+
+    kmemcpy(amd64_p_to_v(copy), amd64_p_to_v(paddr), PAGE_SIZE);
+
+    if (amd64_map_page_to_dir(as->pml4, copy, vaddr, __vma_flags(vma)) < 0) {
+        (void)mm_page_free(copy);
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+/* map the object's frame of `vaddr`
+ *
+ * A frame that belongs to the object is mapped as is unless the mapping is private:
+ * then it's mapped read-only and copied when it's written to, right away if this is
+ * a write fault */
+static int __populate_file(mm_as_t *as, mm_vma_t *vma, uint64_t vaddr, int write)
+{
+    bool shared   = false;
+    uint64_t paddr = vma->ops->frame(vma, __pgoff(vma, vaddr), &shared);
+    int flags      = __vma_flags(vma);
+
+    if (paddr == INVALID_ADDRESS)
+        return -EFAULT;
+
+    if (shared) {
+        if ((vma->flags & MM_VMA_PRIVATE) && write)
+            return __populate_copy(as, vma, vaddr, paddr);
+
+        flags |= MM_BORROWED;
+
+        if ((vma->flags & MM_VMA_PRIVATE) && (flags & MM_READWRITE))
+            flags = (flags & ~MM_READWRITE) | MM_COW;
+    }
+
+    return amd64_map_page_to_dir(as->pml4, paddr, vaddr, flags);
+}
+
+/* a write to a copy-on-write page, give the mapping its own copy */
+static int __break_cow(mm_as_t *as, mm_vma_t *vma, uint64_t vaddr)
+{
+    size_t size;
+    uint64_t entry = amd64_lookup_page(as->pml4, vaddr, &size);
+    int ret;
+
+    /* amd64_duplicate_dir() splits huge pages, only 4 KB frames are shared */
+    if (!(entry & MM_COW) || size != PAGE_SIZE)
+        return -EFAULT;
+
+    /* the new entry replaces the old one and flushes it from the TLB */
+    if ((ret = __populate_copy(as, vma, vaddr, MM_ENTRY_ADDR(entry))) < 0)
+        return ret;
+
+    if (!(entry & MM_BORROWED))
+        __put_frame(MM_ENTRY_ADDR(entry));
+
+    return 0;
+}
+
+mm_as_t *mm_as_create(void)
+{
+    int ret;
+    mm_as_t *as;
+
+    if ((ret = __init_caches()) < 0) {
+        errno = -ret;
+        return NULL;
+    }
+
+    if (!(as = mm_cache_alloc_entry(__as_cache)))
+        return NULL;
+
+    if (!(as->pml4 = amd64_build_dir())) {
+        (void)mm_cache_free_entry(__as_cache, as);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    as->last  = NULL;
+    as->nvmas = 0;
+    rb_init(&as->vmas, NULL);
+
+    return as;
+}
+
+void mm_as_destroy(mm_as_t *as)
+{
+    kassert(as != NULL && as != mm_as_current());
+
+    rb_node_t *n;
+
+    while ((n = rb_first(&as->vmas)) != NULL) {
+        __unmap_pages(as, VMA(n)->start, VMA(n)->end);
+        __remove(as, VMA(n));
+    }
+
+    amd64_destroy_dir(as->pml4);
+    (void)mm_cache_free_entry(__as_cache, as);
+}
+
+void mm_as_switch(mm_as_t *as)
+{
+    kassert(as != NULL);
+
+    thiscpu_write(__current, as);
+    amd64_set_cr3(amd64_v_to_p(as->pml4));
+}
+
+mm_as_t *mm_as_current(void)
+{
+    return thiscpu_read(__current);
+}
+
+mm_vma_t *mm_find_vma(mm_as_t *as, uint64_t addr)
+{
+    /* faults tend to hit the same VMA many times in a row */
+    if (as->last && as->last->start <= addr && addr < as->last->end)
+        return as->last;
+
+    mm_vma_t *vma = __lower_bound(as, addr);
+
+    if (!vma || vma->start > addr)
+        return NULL;
+
+    return (as->last = vma);
+}
+
+int mm_map_anon(mm_as_t *as, uint64_t addr, size_t len, int prot)
+{
+    if (!as || !PAGE_ALIGNED(addr) || !PAGE_ALIGNED(len) || len == 0)
+        return -EINVAL;
+
+    if (addr < PAGE_SIZE || addr + len > USPACE_END || addr + len < addr)
+        return -EINVAL;
+
+    mm_vma_t *vma = __lower_bound(as, addr);
+
+    if (vma && vma->start < addr + len)
+        return -EEXIST;
+
+    if (!(vma = mm_cache_alloc_entry(__vma_cache)))
+        return -ENOMEM;
+
+    vma->start = addr;
+    vma->end   = addr + len;
+    vma->prot  = prot;
+    vma->flags = MM_VMA_ANON;
+
+    __insert(as, vma);
+
+    return 0;
+}
+
+int mm_map_file(mm_as_t *as, uint64_t addr, size_t len, int prot, int flags,
+                const mm_vma_ops_t *ops, void *private, uint64_t pgoff)
+{
+    if (!ops || !ops->frame || (flags & ~MM_VMA_PRIVATE))
+        return -EINVAL;
+
+    int ret = mm_map_anon(as, addr, len, prot);
+
+    if (ret < 0)
+        return ret;
+
+    mm_vma_t *vma = mm_find_vma(as, addr);
+
+    vma->flags   = MM_VMA_FILE | flags;
+    vma->ops     = ops;
+    vma->private = private;
+    vma->pgoff   = pgoff;
+
+    if (ops->open)
+        ops->open(vma);
+
+    return 0;
+}
+
+int mm_unmap(mm_as_t *as, uint64_t addr, size_t len)
+{
+    if (!as || !PAGE_ALIGNED(addr) || !PAGE_ALIGNED(len) || addr + len < addr)
+        return -EINVAL;
+
+    uint64_t end  = addr + len;
+    mm_vma_t *vma = __lower_bound(as, addr);
+
+    while (vma && vma->start < end) {
+        rb_node_t *next = rb_next(&vma->node);
+        uint64_t start  = MAX(vma->start, addr);
+        uint64_t stop   = MIN(vma->end, end);
+
+        if (start == vma->start && stop == vma->end) {
+            __unmap_pages(as, start, stop);
+            __remove(as, vma);
+        } else if (start == vma->start) {
+            /* the order of the VMAs doesn't change so the key can be modified in place */
+            __unmap_pages(as, start, stop);
+            vma->pgoff = __pgoff(vma, stop);
+            vma->start = stop;
+        } else if (stop == vma->end) {
+            __unmap_pages(as, start, stop);
+            vma->end = start;
+        } else {
+            /* split the VMA, allocate the new half before anything is unmapped */
+            mm_vma_t *tail = mm_cache_alloc_entry(__vma_cache);
+
+            if (!tail)
+                return -ENOMEM;
+
+            __unmap_pages(as, start, stop);
+
+            tail->start   = stop;
+            tail->end     = vma->end;
+            tail->prot    = vma->prot;
+            tail->flags   = vma->flags;
+            tail->ops     = vma->ops;
+            tail->private = vma->private;
+            tail->pgoff   = __pgoff(vma, stop);
+            vma->end      = start;
+
+            __insert(as, tail);
+
+            if ((tail->flags & MM_VMA_FILE) && tail->ops->open)
+                tail->ops->open(tail);
+            break;
+        }
+
+        vma = next ? VMA(next) : NULL;
+    }
+
+    as->last = NULL;
+    return 0;
+}
+
+int mm_handle_fault(mm_as_t *as, uint64_t addr, int write, int present)
+{
+    mm_vma_t *vma = mm_find_vma(as, addr);
+    bool file     = vma && (vma->flags & MM_VMA_FILE);
+    int ret;
+
+    if (!vma || !(vma->prot & MM_PROT_READ) || (write && !(vma->prot & MM_PROT_WRITE)))
+        return -EFAULT;
+
+    addr = ROUND_DOWN(addr, PAGE_SIZE);
+
+    /* a present page can only fault because of the protection */
+    if (present)
+        return write ? __break_cow(as, vma, addr) : -EFAULT;
+
+    if (file) {
+        if ((ret = __populate_file(as, vma, addr, write)) < 0)
+            return ret;
+    } else {
+        if (__populate_huge(as, vma, addr))
+            return 0;
+
+        if ((ret = __populate(as, vma, addr)) < 0)
+            return ret;
+    }
+
+    if (__fault_around <= 1)
+        return 0;
+
+    /* Populate the rest of the faulting page's window now: memory is usually touched
+     * sequentially and one fault is much cheaper than many. The pages of an object are
+     * mapped like for a read, a private copy is only made when it's written to.
+     * The window is best effort, it stops at the first page that can't be mapped */
+    uint64_t size  = __fault_around * PAGE_SIZE;
+    uint64_t start = MAX(addr - (addr % size), vma->start);
+    uint64_t end   = MIN(addr - (addr % size) + size, vma->end);
+
+    for (uint64_t vaddr = start; vaddr < end; vaddr += PAGE_SIZE) {
+        if (vaddr == addr || (amd64_lookup_page(as->pml4, vaddr, NULL) & MM_PRESENT))
+            continue;
+
+        if ((file ? __populate_file(as, vma, vaddr, 0) : __populate(as, vma, vaddr)) < 0)
+            break;
+    }
+
+    return 0;
+}
+
+uint64_t mm_get_user_page(mm_as_t *as, uint64_t addr, int write)
+{
+    size_t size;
+    uint64_t entry = amd64_lookup_page(as->pml4, addr, &size);
+
+    if (!(entry & MM_PRESENT) || (write && !(entry & MM_READWRITE))) {
+        if (mm_handle_fault(as, addr, write, !!(entry & MM_PRESENT)) < 0)
+            return INVALID_ADDRESS;
+
+        entry = amd64_lookup_page(as->pml4, addr, &size);
+    }
+
+    return ROUND_DOWN(MM_ENTRY_ADDR(entry), size) + (addr % size);
+}
+
+void mm_set_fault_around(size_t npages)
+{
+    __fault_around = npages;
+}
+
+void mm_set_thp(int enabled)
+{
+    __thp = !!enabled;
+}
+
+/* replace the 512 4 KB pages of window `window` with one huge page */
+static int __collapse_window(mm_as_t *as, mm_vma_t *vma, uint64_t window)
+{
+    uint64_t entry;
+    size_t size;
+
+    /* every page must be present and mapped like the VMA says */
+    for (uint64_t vaddr = window; vaddr < window + HUGE_SIZE; vaddr += PAGE_SIZE) {
+        entry = amd64_lookup_page(as->pml4, vaddr, &size);
+
+        if (!(entry & MM_PRESENT) || size != PAGE_SIZE)
+            return -EINVAL;
+
+        if ((entry & MM_READWRITE) != (__vma_flags(vma) & MM_READWRITE))
+            return -EINVAL;
+    }
+
+    uint64_t paddr = __alloc_huge();
+
+    if (paddr == INVALID_ADDRESS)
+        return -ENOMEM;
+
+    for (size_t i = 0; i < 512; ++i) {
+        uint64_t old = MM_ENTRY_ADDR(amd64_lookup_page(as->pml4, window + i * PAGE_SIZE, NULL));
+
+        kmemcpy((uint8_t *)amd64_p_to_v(paddr) + i * PAGE_SIZE, amd64_p_to_v(old), PAGE_SIZE);
+    }
+
+    /* the table is replaced in place, unmapping the pages first could free the
+     * page directory and mapping the huge page would then need memory */
+    amd64_merge_large_page(as->pml4, paddr, window, __vma_flags(vma), __put_frame);
+
+    return 0;
+}
+
+size_t mm_collapse(mm_as_t *as)
+{
+    size_t collapsed = 0;
+
+    if (!__thp)
+        return 0;
+
+    for (rb_node_t *n = rb_first(&as->vmas); n; n = rb_next(n)) {
+        mm_vma_t *vma = VMA(n);
+
+        /* the frames of an object are not the VMA's to move */
+        if (!(vma->flags & MM_VMA_ANON))
+            continue;
+
+        for (uint64_t window = ROUND_UP(vma->start, HUGE_SIZE);
+             window + HUGE_SIZE <= vma->end;
+             window += HUGE_SIZE)
+        {
+            if (__collapse_window(as, vma, window) == 0)
+                collapsed++;
+        }
+    }
+
+    return collapsed;
+}
@@ -0,0 +1,306 @@
+#include <arch/amd64/mmu.h>
+#include <kernel/common.h>
+#include <kernel/kassert.h>
+#include <kernel/kprint.h>
+#include <kernel/lock.h>
+#include <lib/rbtree.h>
+#include <mm/slab.h>
+#include <mm/vregion.h>
+#include <errno.h>
+#include <stdbool.h>
+
+/* Kernel virtual region allocator
+ *
+ * Hands out ranges of the I/O window (`KIOSTART`). Free ranges are kept in a red-black
+ * tree ordered by start address and each node stores the length of the largest free
+ * range in its subtree so the lowest range that fits the request is found in O(log n).
+ *
+ * Allocated ranges are kept in a separate tree so that they can be freed using
+ * only the start address. Both trees are protected by `__lock`. */
+
+typedef struct vregion {
+    rb_node_t node;
+    uint64_t start;
+    size_t len;
+    size_t max_len; /* largest free range of the subtree */
+} vregion_t;
+
+#define VR(n) container_of((n), vregion_t, node)
+
+static rb_tree_t  __free;
+static rb_tree_t  __used;
+static mm_cache_t *__cache;
+static spinlock_t __lock;
+
+static void __augment(rb_node_t *node)
+{
+    vregion_t *vr = VR(node);
+
+    vr->max_len = vr->len;
+
+    if (node->left && VR(node->left)->max_len > vr->max_len)
+        vr->max_len = VR(node->left)->max_len;
+
+    if (node->right && VR(node->right)->max_len > vr->max_len)
+        vr->max_len = VR(node->right)->max_len;
+}
+
+static void __insert(rb_tree_t *tree, vregion_t *vr)
+{
+    rb_node_t **link = &tree->root, *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        link   = (vr->start < VR(parent)->start) ? &parent->left : &parent->right;
+    }
+
+    rb_insert(tree, &vr->node, parent, link);
+}
+
+/* find the lowest free range that is at least `len` bytes long */
+static vregion_t *__find_free(size_t len)
+{
+    rb_node_t *n = __free.root;
+
+    if (!n || VR(n)->max_len < len)
+        return NULL;
+
+    for (;;) {
+        if (n->left && VR(n->left)->max_len >= len)
+            n = n->left;
+        else if (VR(n)->len >= len)
+            return VR(n);
+        else
+            n = n->right;
+    }
+}
+
+/* find the free range with the highest start address below `addr` */
+static vregion_t *__find_prev(uint64_t addr)
+{
+    rb_node_t *n   = __free.root;
+    vregion_t *ret = NULL;
+
+    while (n) {
+        if (VR(n)->start < addr) {
+            ret = VR(n);
+            n   = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+
+    return ret;
+}
+
+static vregion_t *__find_used(uint64_t addr)
+{
+    rb_node_t *n = __used.root;
+
+    while (n) {
+        if (addr < VR(n)->start)
+            n = n->left;
+        else if (addr > VR(n)->start)
+            n = n->right;
+        else
+            return VR(n);
+    }
+
+    return NULL;
+}
+
+int mm_vregion_init(void)
+{
+    rb_init(&__free, __augment);
+    rb_init(&__used, NULL);
+    spin_init(&__lock);
+
+    if (!(__cache = mm_cache_create(sizeof(vregion_t))))
+        return -errno;
+
+    vregion_t *vr = mm_cache_alloc_entry(__cache);
+
+    if (!vr)
+        return -errno;
+
+    vr->start = KIOSTART;
+    vr->len   = KIOSIZE;
+    __insert(&__free, vr);
+
+    return 0;
+}
+
+static uint64_t __alloc(size_t len, size_t align, uint64_t offset)
+{
+    /* any free range this long has a suitably aligned subrange */
+    vregion_t *vr = __find_free(len + align - PAGE_SIZE);
+    vregion_t *used;
+
+    if (!vr) {
+        errno = ENOMEM;
+        return INVALID_ADDRESS;
+    }
+
+    offset &= align - 1;
+
+    uint64_t start = ROUND_DOWN(vr->start, align) + offset;
+
+    if (start < vr->start)
+        start += align;
+
+    size_t head = start - vr->start;
+    size_t tail = vr->start + vr->len - (start + len);
+
+    if (head == 0 && tail == 0) {
+        /* exact fit, move the node to the used tree */
+        rb_remove(&__free, &vr->node);
+        used = vr;
+    } else {
+        if (!(used = mm_cache_alloc_entry(__cache)))
+            return INVALID_ADDRESS;
+
+        if (head == 0) {
+            /* the key changes but the order of the ranges stays the same */
+            vr->start += len;
+            vr->len   -= len;
+            rb_propagate(&__free, &vr->node);
+        } else {
+            vr->len = head;
+            rb_propagate(&__free, &vr->node);
+
+            if (tail > 0) {
+                vregion_t *rest = mm_cache_alloc_entry(__cache);
+
+                /* restore the original range */
+                if (!rest) {
+                    vr->len = head + len + tail;
+                    rb_propagate(&__free, &vr->node);
+                    (void)mm_cache_free_entry(__cache, used);
+                    return INVALID_ADDRESS;
+                }
+
+                rest->start = start + len;
+                rest->len   = tail;
+                __insert(&__free, rest);
+            }
+        }
+    }
+
+    used->start = start;
+    used->len   = len;
+    __insert(&__used, used);
+
+    return start;
+}
+
+static int __release(uint64_t addr)
+{
+    vregion_t *vr = __find_used(addr);
+
+    if (!vr)
+        return -EINVAL;
+
+    rb_remove(&__used, &vr->node);
+
+    /* merge the range with its free neighbours */
+    vregion_t *prev = __find_prev(vr->start);
+    rb_node_t *next = prev ? rb_next(&prev->node) : rb_first(&__free);
+
+    bool merge_prev = prev && prev->start + prev->len == vr->start;
+    bool merge_next = next && vr->start + vr->len == VR(next)->start;
+
+    if (merge_prev && merge_next) {
+        prev->len += vr->len + VR(next)->len;
+        rb_remove(&__free, next);
+        rb_propagate(&__free, &prev->node);
+
+        (void)mm_cache_free_entry(__cache, VR(next));
+        (void)mm_cache_free_entry(__cache, vr);
+    } else if (merge_prev) {
+        prev->len += vr->len;
+        rb_propagate(&__free, &prev->node);
+
+        (void)mm_cache_free_entry(__cache, vr);
+    } else if (merge_next) {
+        VR(next)->start  = vr->start;
+        VR(next)->len   += vr->len;
+        rb_propagate(&__free, next);
+
+        (void)mm_cache_free_entry(__cache, vr);
+    } else {
+        __insert(&__free, vr);
+    }
+
+    return 0;
+}
+
+uint64_t mm_vregion_alloc(size_t len, size_t align, uint64_t offset)
+{
+    if (len == 0 || !PAGE_ALIGNED(len) || align < PAGE_SIZE || (align & (align - 1))) {
+        errno = EINVAL;
+        return INVALID_ADDRESS;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&__lock);
+    uint64_t ret   = __alloc(len, align, offset);
+
+    spin_unlock_irqrestore(&__lock, flags);
+    return ret;
+}
+
+int mm_vregion_free(uint64_t addr)
+{
+    uint64_t flags = spin_lock_irqsave(&__lock);
+    int ret        = __release(addr);
+
+    spin_unlock_irqrestore(&__lock, flags);
+    return ret;
+}
+
+void *ioremap(uint64_t paddr, size_t len, int cache_mode)
+{
+    if (len == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uint64_t start = ROUND_DOWN(paddr, PAGE_SIZE);
+    size_t size    = ROUND_UP(paddr + len, PAGE_SIZE) - start;
+    size_t align   = PAGE_SIZE;
+
+    /* Align the virtual address like the physical address so that the
+     * mapping can use large pages (e.g. framebuffers are 2 MB aligned) */
+    if (size >= (1UL << 30))
+        align = 1UL << 30;
+    else if (size >= (1UL << 21))
+        align = 1UL << 21;
+
+    uint64_t vaddr = mm_vregion_alloc(size, align, start);
+
+    if (vaddr == INVALID_ADDRESS)
+        return NULL;
+
+    amd64_map_kernel_range(start, vaddr, size, MM_READWRITE | cache_mode);
+
+    return (void *)(vaddr + (paddr - start));
+}
+
+void iounmap(void *addr)
+{
+    uint64_t vaddr = ROUND_DOWN((uint64_t)addr, PAGE_SIZE);
+    uint64_t flags = spin_lock_irqsave(&__lock);
+    vregion_t *vr  = __find_used(vaddr);
+
+    if (!vr) {
+        spin_unlock_irqrestore(&__lock, flags);
+        kprint("vregion - iounmap() of unknown address 0x%x\n", vaddr);
+        return;
+    }
+
+    /* the region is found, unmapped and released under one lock hold: another iounmap()
+     * can't free it in between and ioremap() can't reuse the range while it's mapped */
+    amd64_unmap_kernel_range(vr->start, vr->len);
+    (void)__release(vr->start);
+
+    spin_unlock_irqrestore(&__lock, flags);
+}
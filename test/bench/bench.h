@@ -0,0 +1,42 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Host-side micro-benchmarks
+ *
+ * Every benchmark prints one line per measurement:
+ *
+ *   <suite> <operation> <implementation> <rate> <unit>
+ *
+ * so results of two runs can be compared with standard tools */
+
+static inline double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline void bench_report(const char *suite, const char *op, const char *impl,
+                                double amount, double seconds, const char *unit)
+{
+    printf("%s %s %s %.3e %s/s\n", suite, op, impl, amount / seconds, unit);
+}
+
+/* xorshift64, deterministic so that implementations see the same input */
+static inline uint64_t bench_rand(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    return (*state = x);
+}
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,100 @@
+#include <lib/bitmap.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "bitmap_old.h"
+
+/* Compare the 64-bit word bitmap with the old bit-at-a-time implementation on 1 Mbit maps
+ *
+ * - set/unset: random ranges of 1 - 4096 bits, rate is bits updated per second
+ * - find:      the only unset bit is in the last word, rate is bits scanned per second
+ * - range:     a fragmented map where the only 512-bit hole is at the end,
+ *              rate is bits scanned per second */
+
+#define NBITS  (1U << 20)
+#define NRANGE 4096
+
+#define BENCH_BOTH(name, amount, new_expr, old_expr)                  \
+    do {                                                              \
+        double start = bench_now();                                   \
+        new_expr;                                                     \
+        bench_report("bitmap", name, "new", amount, bench_now() - start, "bits"); \
+        start = bench_now();                                          \
+        old_expr;                                                     \
+        bench_report("bitmap", name, "old", amount, bench_now() - start, "bits"); \
+    } while (0)
+
+static volatile int sink;
+
+int main(void)
+{
+    bitmap_t *bm         = bm_alloc_bitmap(NBITS);
+    old_bitmap_t *old_bm = old_bm_alloc_bitmap(NBITS);
+    uint32_t starts[NRANGE], lens[NRANGE];
+    uint64_t seed = 0x5eed;
+    double bits = 0;
+
+    for (int i = 0; i < NRANGE; ++i) {
+        lens[i]   = 1 + bench_rand(&seed) % 4096;
+        starts[i] = bench_rand(&seed) % (NBITS - lens[i]);
+        bits     += lens[i];
+    }
+
+    BENCH_BOTH("set_range", bits * 16,
+        for (int r = 0; r < 16; ++r)
+            for (int i = 0; i < NRANGE; ++i)
+                bm_set_range(bm, starts[i], starts[i] + lens[i] - 1),
+        for (int r = 0; r < 16; ++r)
+            for (int i = 0; i < NRANGE; ++i)
+                old_bm_set_range(old_bm, starts[i], starts[i] + lens[i] - 1));
+
+    BENCH_BOTH("unset_range", bits * 16,
+        for (int r = 0; r < 16; ++r)
+            for (int i = 0; i < NRANGE; ++i)
+                bm_unset_range(bm, starts[i], starts[i] + lens[i] - 1),
+        for (int r = 0; r < 16; ++r)
+            for (int i = 0; i < NRANGE; ++i)
+                old_bm_unset_range(old_bm, starts[i], starts[i] + lens[i] - 1));
+
+    /* everything is set except the last bit */
+    bm_set_range(bm, 0, NBITS - 2);
+    old_bm_set_range(old_bm, 0, NBITS - 2);
+
+    BENCH_BOTH("find_first_unset", (double)NBITS * 64,
+        for (int r = 0; r < 64; ++r)
+            sink = bm_find_first_unset(bm, 0, NBITS - 1),
+        for (int r = 0; r < 64; ++r)
+            sink = old_bm_find_first_unset(old_bm, 0, NBITS - 1));
+
+    /* holes of 1 - 256 bits everywhere and one 512-bit hole at the end */
+    bm_set_range(bm, 0, NBITS - 1);
+    old_bm_set_range(old_bm, 0, NBITS - 1);
+
+    for (uint32_t pos = 0; pos < NBITS - 1024; ) {
+        uint32_t hole = 1 + bench_rand(&seed) % 256;
+
+        bm_unset_range(bm, pos, pos + hole - 1);
+        old_bm_unset_range(old_bm, pos, pos + hole - 1);
+        pos += hole + 1 + bench_rand(&seed) % 64;
+    }
+
+    bm_unset_range(bm, NBITS - 512, NBITS - 1);
+    old_bm_unset_range(old_bm, NBITS - 512, NBITS - 1);
+
+    BENCH_BOTH("find_unset_range", (double)NBITS * 16,
+        for (int r = 0; r < 16; ++r)
+            sink = bm_find_first_unset_range(bm, 0, NBITS - 1, 512),
+        for (int r = 0; r < 16; ++r)
+            sink = old_bm_find_first_unset_range(old_bm, 0, NBITS - 1, 512));
+
+    double start = bench_now();
+
+    for (int r = 0; r < 256; ++r)
+        sink = bm_weight(bm);
+
+    bench_report("bitmap", "weight", "new", (double)NBITS * 256, bench_now() - start, "bits");
+
+    bm_dealloc_bitmap(bm);
+    old_bm_dealloc_bitmap(old_bm);
+
+    return 0;
+}
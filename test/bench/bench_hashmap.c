@@ -0,0 +1,88 @@
+#include <lib/hashmap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/* Hashmap lookups with string keys at different load factors
+ *
+ * - hit:    look up keys that are in the map
+ * - miss:   look up keys that are not in the map
+ * - insert: grow an empty map to 1M elements and report the slowest single insert,
+ *           which shows that no insert pays for a full rehash */
+
+#define CAP      (1U << 16)
+#define NLOOKUPS (1U << 22)
+#define NGROW    (1U << 20)
+#define KEYLEN   24
+
+static volatile void *sink;
+
+static char *make_keys(const char *prefix, size_t n)
+{
+    char *keys = malloc(n * KEYLEN);
+
+    for (size_t i = 0; i < n; ++i)
+        snprintf(keys + i * KEYLEN, KEYLEN, "%s-%zu", prefix, i);
+
+    return keys;
+}
+
+static void bench_load(double load, char *keys, char *missing)
+{
+    hashmap_t *hm = hm_alloc_hashmap(CAP, HM_KEY_TYPE_STR);
+    size_t n      = load * CAP;
+    char op[32];
+    double start;
+
+    for (size_t i = 0; i < n; ++i)
+        hm_insert(hm, keys + i * KEYLEN, keys + i * KEYLEN);
+
+    start = bench_now();
+
+    for (size_t i = 0; i < NLOOKUPS; ++i)
+        sink = hm_get(hm, keys + (i % n) * KEYLEN);
+
+    snprintf(op, sizeof(op), "hit@%.2f", load);
+    bench_report("hashmap", op, "new", NLOOKUPS, bench_now() - start, "lookups");
+
+    start = bench_now();
+
+    for (size_t i = 0; i < NLOOKUPS; ++i)
+        sink = hm_get(hm, missing + (i % CAP) * KEYLEN);
+
+    snprintf(op, sizeof(op), "miss@%.2f", load);
+    bench_report("hashmap", op, "new", NLOOKUPS, bench_now() - start, "lookups");
+
+    hm_dealloc_hashmap(hm);
+}
+
+int main(void)
+{
+    static const double loads[] = { 0.25, 0.50, 0.75, 0.85 };
+    char *keys    = make_keys("file", NGROW);
+    char *missing = make_keys("missing", CAP);
+
+    for (size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); ++i)
+        bench_load(loads[i], keys, missing);
+
+    hashmap_t *hm = hm_alloc_hashmap(0, HM_KEY_TYPE_STR);
+    double worst  = 0, start = bench_now();
+
+    for (size_t i = 0; i < NGROW; ++i) {
+        double t = bench_now();
+
+        hm_insert(hm, keys + i * KEYLEN, NULL);
+
+        if ((t = bench_now() - t) > worst)
+            worst = t;
+    }
+
+    bench_report("hashmap", "insert", "new", NGROW, bench_now() - start, "inserts");
+    printf("hashmap insert_worst new %.3e s\n", worst);
+
+    hm_dealloc_hashmap(hm);
+    free(keys);
+    free(missing);
+
+    return 0;
+}
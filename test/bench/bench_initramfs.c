@@ -0,0 +1,105 @@
+#include <lib/lz4.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/* Plain and LZ4-compressed initramfs images (see src/fs/initramfs.c)
+ *
+ * Both images hold the same files, the kernel sources and the unit test binary
+ * (see Makefile). The boot loader reads the whole image into memory so its size
+ * is what the boot pays for I/O, how long that takes depends on the boot medium
+ * and is not measured here. Instead the benchmark reports:
+ *
+ * - the size of both images, the bytes the boot loader reads
+ * - how fast the kernel's decoder decompresses the image
+ * - the read bandwidth below which the compressed image boots faster, at that
+ *   bandwidth reading the saved bytes takes as long as decompressing them
+ * - the memory that the image holds after mount: the plain image is used in place,
+ *   the compressed one is freed once it's decompressed into pages of its own and
+ *   the pages past the end of the decompressed image are given back */
+
+#define PAGE_SIZE 4096
+#define NPASSES   20
+
+static uint8_t *__load(const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "r");
+    uint8_t *buf;
+
+    if (!fp) {
+        fprintf(stderr, "failed to open %s\n", path);
+        exit(1);
+    }
+
+    fseek(fp, 0L, SEEK_END);
+    *len = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+
+    if (!(buf = malloc(*len)) || fread(buf, 1, *len, fp) != *len)
+        exit(1);
+
+    fclose(fp);
+    return buf;
+}
+
+/* the block that initramfs_init() allocates for the decompressed image */
+static size_t __block_size(size_t len)
+{
+    size_t size = PAGE_SIZE;
+
+    while (size < len)
+        size *= 2;
+
+    return size;
+}
+
+int main(int argc, char **argv)
+{
+    const char *plain_path = argc > 2 ? argv[1] : "../build/bench_initrd.bin";
+    const char *lz4_path   = argc > 2 ? argv[2] : "../build/bench_initrd.lz4";
+    size_t plain_len, lz4_len;
+    uint8_t *plain = __load(plain_path, &plain_len);
+    uint8_t *lz4   = __load(lz4_path, &lz4_len);
+    ssize_t content;
+    uint8_t *out;
+    double start, t;
+
+    if ((content = lz4_frame_content_size(lz4, lz4_len)) != (ssize_t)plain_len) {
+        fprintf(stderr, "%s is not the compressed %s\n", lz4_path, plain_path);
+        return 1;
+    }
+
+    if (!(out = malloc(__block_size(content))))
+        return 1;
+
+    /* the first pass faults the output buffer in and checks the result */
+    if (lz4_frame_decompress(lz4, lz4_len, out, content) != content || memcmp(out, plain, content)) {
+        fprintf(stderr, "decompressed image doesn't match\n");
+        return 1;
+    }
+
+    start = bench_now();
+
+    for (int i = 0; i < NPASSES; ++i)
+        (void)lz4_frame_decompress(lz4, lz4_len, out, content);
+
+    t = (bench_now() - start) / NPASSES;
+
+    printf("initramfs image-size plain %zu KB\n", plain_len / 1024);
+    printf("initramfs image-size lz4 %zu KB (%.1f %% of plain)\n", lz4_len / 1024, 100.0 * lz4_len / plain_len);
+
+    bench_report("initramfs", "decompress", "lz4", (double)content / (1 << 20), t, "MB");
+    printf("initramfs decompress lz4 %.3f ms/image\n", t * 1e3);
+    printf("initramfs break-even lz4 %.3e MB/s read bandwidth\n",
+           (double)(plain_len - lz4_len) / (1 << 20) / t);
+
+    printf("initramfs resident plain %zu KB\n", plain_len / 1024);
+    printf("initramfs resident lz4 %zu KB (%zu KB during decompression)\n",
+           (size_t)(content + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE / 1024,
+           (__block_size(content) + lz4_len) / 1024);
+
+    free(plain);
+    free(lz4);
+    free(out);
+    return 0;
+}
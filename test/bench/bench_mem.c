@@ -0,0 +1,126 @@
+#include <arch/amd64/cpu.h>
+#include <kernel/util.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "mem_old.h"
+
+/* String and memory routines of kernel/util.c for sizes from 8 B to 1 MB
+ *
+ * - byte:  the old byte-at-a-time loops
+ * - words: word-at-a-time loops and `rep movsq`/`rep stosq`, used before kutil_init()
+ *          and on CPUs without ERMS
+ * - erms:  after kutil_init(), `rep movsb`/`rep stosb` from ERMS_THRESHOLD bytes up
+ * - fsrm:  after kutil_init(), `rep movsb`/`rep stosb` for all sizes
+ *
+ * Everything is compiled with -O0 like the kernel (see Makefile) so the compiler
+ * doesn't turn the byte loops into calls to libc */
+
+#define MAX_SIZE (1 << 20)
+#define PER_SIZE (1ULL << 28)  /* bytes processed per measurement */
+
+static const size_t sizes[] = { 8, 64, 512, 4096, 32768, 262144, MAX_SIZE };
+
+typedef struct impl {
+    const char *name;
+    void *(*memcpy)(void *restrict, const void *restrict, size_t);
+    void *(*memset)(void *, int, size_t);
+    void *(*memmove)(void *, const void *, size_t);
+    int (*memcmp)(void *, void *, size_t);
+    int (*strcmp)(const char *, const char *);
+    size_t (*strlen)(const char *);
+} impl_t;
+
+static volatile size_t sink;
+
+static void bench_size(impl_t *impl, size_t size, uint8_t *a, uint8_t *b)
+{
+    size_t iters = PER_SIZE / size;
+    char op[32];
+    double start;
+
+    snprintf(op, sizeof(op), "memcpy-%zu", size);
+    start = bench_now();
+    for (size_t i = 0; i < iters; ++i)
+        impl->memcpy(a, b, size);
+    bench_report("mem", op, impl->name, (double)iters * size, bench_now() - start, "B");
+
+    snprintf(op, sizeof(op), "memset-%zu", size);
+    start = bench_now();
+    for (size_t i = 0; i < iters; ++i)
+        impl->memset(a, (int)i, size);
+    bench_report("mem", op, impl->name, (double)iters * size, bench_now() - start, "B");
+
+    /* overlapping in both directions like the pipe and a scrolling console do */
+    snprintf(op, sizeof(op), "memmove-%zu", size);
+    start = bench_now();
+    for (size_t i = 0; i < iters; ++i)
+        impl->memmove(a + (i & 1) * 8, a + (~i & 1) * 8, size);
+    bench_report("mem", op, impl->name, (double)iters * size, bench_now() - start, "B");
+
+    memcpy(b, a, size);
+    snprintf(op, sizeof(op), "memcmp-%zu", size);
+    start = bench_now();
+    for (size_t i = 0; i < iters; ++i)
+        sink += impl->memcmp(a, b, size);
+    bench_report("mem", op, impl->name, (double)iters * size, bench_now() - start, "B");
+
+    memset(a, 'a', size - 1);
+    memset(b, 'a', size - 1);
+    a[size - 1] = b[size - 1] = '\0';
+
+    snprintf(op, sizeof(op), "strlen-%zu", size);
+    start = bench_now();
+    for (size_t i = 0; i < iters; ++i)
+        sink += impl->strlen((char *)a);
+    bench_report("mem", op, impl->name, (double)iters * size, bench_now() - start, "B");
+
+    snprintf(op, sizeof(op), "strcmp-%zu", size);
+    start = bench_now();
+    for (size_t i = 0; i < iters; ++i)
+        sink += impl->strcmp((char *)a, (char *)b);
+    bench_report("mem", op, impl->name, (double)iters * size, bench_now() - start, "B");
+}
+
+static void bench_impl(impl_t *impl, uint8_t *a, uint8_t *b)
+{
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+        bench_size(impl, sizes[i], a, b);
+}
+
+int main(void)
+{
+    uint8_t *a = aligned_alloc(4096, MAX_SIZE + 64);
+    uint8_t *b = aligned_alloc(4096, MAX_SIZE + 64);
+    uint32_t eax, ebx, ecx, edx;
+
+    impl_t old = {
+        "byte", old_kmemcpy, old_kmemset, old_kmemmove, old_kmemcmp, old_kstrcmp, old_kstrlen,
+    };
+    impl_t new = {
+        "words", kmemcpy, kmemset, kmemmove, kmemcmp, kstrcmp, kstrlen,
+    };
+
+    memset(a, 0, MAX_SIZE + 64);
+    memset(b, 0, MAX_SIZE + 64);
+
+    bench_impl(&old, a, b);
+    bench_impl(&new, a, b);
+
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+
+    if (eax >= 7) {
+        cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+
+        if (ebx & CPUID_7_EBX_ERMS) {
+            new.name = (edx & CPUID_7_EDX_FSRM) ? "fsrm" : "erms";
+            kutil_init();
+            bench_impl(&new, a, b);
+        }
+    }
+
+    free(a);
+    free(b);
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <mm/heap.h>
+#include <mm/page.h>
+#include <mm/slab.h>
+#include "bench.h"
+#include "host.h"
+
+/* Memory allocators of the hosted kernel (see test/host)
+ *
+ * - pair:  allocate and immediately free, the allocator's fast path
+ * - batch: allocate BATCH objects and then free all of them */
+
+#define NOPS  (1U << 12)
+#define BATCH 1024
+
+static void *objs[BATCH];
+static uint64_t pages[BATCH];
+
+static void bench_page(uint32_t order)
+{
+    char op[32];
+    double start;
+
+    snprintf(op, sizeof(op), "pair-order%u", order);
+    start = bench_now();
+
+    for (size_t i = 0; i < NOPS; ++i)
+        mm_block_free(mm_block_alloc(MM_ZONE_NORMAL, order, 0), order);
+
+    bench_report("mm", op, "page", NOPS, bench_now() - start, "op");
+
+    snprintf(op, sizeof(op), "batch-order%u", order);
+    start = bench_now();
+
+    for (size_t i = 0; i < NOPS / BATCH; ++i) {
+        for (size_t k = 0; k < BATCH; ++k)
+            pages[k] = mm_block_alloc(MM_ZONE_NORMAL, order, 0);
+
+        for (size_t k = 0; k < BATCH; ++k)
+            mm_block_free(pages[k], order);
+    }
+
+    bench_report("mm", op, "page", NOPS, bench_now() - start, "op");
+}
+
+static void bench_slab(size_t size)
+{
+    mm_cache_t *cache = mm_cache_create(size);
+    char op[32];
+    double start;
+
+    snprintf(op, sizeof(op), "pair-%zu", size);
+    start = bench_now();
+
+    for (size_t i = 0; i < NOPS; ++i)
+        mm_cache_free_entry(cache, mm_cache_alloc_entry(cache));
+
+    bench_report("mm", op, "slab", NOPS, bench_now() - start, "op");
+
+    snprintf(op, sizeof(op), "batch-%zu", size);
+    start = bench_now();
+
+    for (size_t i = 0; i < NOPS / BATCH; ++i) {
+        for (size_t k = 0; k < BATCH; ++k)
+            objs[k] = mm_cache_alloc_entry(cache);
+
+        for (size_t k = 0; k < BATCH; ++k)
+            mm_cache_free_entry(cache, objs[k]);
+    }
+
+    bench_report("mm", op, "slab", NOPS, bench_now() - start, "op");
+}
+
+static void bench_heap(size_t size)
+{
+    char op[32];
+    double start;
+
+    snprintf(op, sizeof(op), "pair-%zu", size);
+    start = bench_now();
+
+    for (size_t i = 0; i < NOPS; ++i)
+        kfree(kmalloc(size));
+
+    bench_report("mm", op, "heap", NOPS, bench_now() - start, "op");
+
+    snprintf(op, sizeof(op), "batch-%zu", size);
+    start = bench_now();
+
+    for (size_t i = 0; i < NOPS / BATCH; ++i) {
+        for (size_t k = 0; k < BATCH; ++k)
+            objs[k] = kmalloc(size);
+
+        for (size_t k = 0; k < BATCH; ++k)
+            kfree(objs[k]);
+    }
+
+    bench_report("mm", op, "heap", NOPS, bench_now() - start, "op");
+}
+
+int main(void)
+{
+    if (!host_mm_init())
+        return 1;
+
+    bench_page(0);
+    bench_page(4);
+
+    bench_slab(32);
+    bench_slab(256);
+
+    bench_heap(32);
+    bench_heap(256);
+    bench_heap(2048);
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <fs/dentry.h>
+#include <fs/file.h>
+#include <fs/fs.h>
+#include <fs/inode.h>
+#include <fs/pagecache.h>
+#include <mm/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "host.h"
+
+/* File reads of the hosted kernel (see test/host) through the page cache
+ *
+ * The file is backed by a buffer in memory like the files of the initramfs, reading it
+ * costs a copy and a counter is bumped for every call into the "file system"
+ *
+ * - direct: file_read() with only `read()` implemented, every read copies from the buffer
+ * - cached: file_read() with `readpage()` implemented, pages are copied from the cache
+ *
+ * Both read the file sequentially in 4 KB and 64 KB reads and at random 4 KB offsets.
+ * The page cache is dropped before the first pass over the file and kept for the second,
+ * the hit rate and the share of pages read ahead that were used are reported per pass */
+
+#define FILE_PAGES 1024
+#define FILE_SIZE  (FILE_PAGES * PAGE_SIZE)
+#define NRANDOM    (4 * FILE_PAGES)
+
+static uint8_t *backing;
+static uint64_t fs_calls;
+
+static ssize_t __read(file_t *file, off_t offset, size_t size, void *buf)
+{
+    int ret;
+
+    if ((ret = file_generic_seek(file, offset)) < 0)
+        return ret;
+
+    if (size > (size_t)(FILE_SIZE - file->f_pos))
+        return -1;
+
+    fs_calls++;
+    memcpy(buf, backing + file->f_pos, size);
+    return size;
+}
+
+static int __readpage(file_t *file, uint64_t index, void *page)
+{
+    fs_calls++;
+    memcpy(page, backing + index * PAGE_SIZE, PAGE_SIZE);
+    return 0;
+}
+
+static file_t *__file(const char *name, bool cached)
+{
+    inode_t *ino;
+    dentry_t *dntr;
+    file_t *file;
+
+    if (!(ino = inode_generic_alloc(T_IFREG)))
+        exit(1);
+
+    ino->i_size = FILE_SIZE;
+
+    if (!(dntr = dentry_alloc_orphan_ino((char *)name, ino, T_IFREG)) || !(file = file_generic_alloc()))
+        exit(1);
+
+    file->f_dentry = dntr;
+    file->f_ops->read = __read;
+
+    if (cached)
+        file->f_ops->readpage = __readpage;
+
+    return file;
+}
+
+/* read `n` chunks of `size` bytes, sequentially or at random chunk offsets */
+static double __pass(file_t *file, size_t size, size_t n, bool random)
+{
+    static uint8_t buf[64 * 1024];
+    uint64_t seed = 0x9e3779b97f4a7c15;
+    double start  = bench_now();
+
+    for (size_t i = 0; i < n; ++i) {
+        off_t pos = random ? (bench_rand(&seed) % (FILE_SIZE / size)) * size : (i * size) % FILE_SIZE;
+
+        if (file_read(file, pos - file->f_pos, size, buf) != (ssize_t)size)
+            exit(1);
+    }
+
+    return bench_now() - start;
+}
+
+static void __report_stats(const char *op, const char *pass, pagecache_stats_t *a, pagecache_stats_t *b)
+{
+    uint64_t hits = b->hits - a->hits, misses = b->misses - a->misses;
+    uint64_t ra   = b->ra_pages - a->ra_pages, used = b->ra_hits - a->ra_hits;
+
+    printf("pagecache %s-%s cached %.1f %% hit\n", op, pass, hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+    printf("pagecache %s-%s cached %.1f %% readahead-used (%lu pages read ahead)\n",
+           op, pass, ra ? 100.0 * used / ra : 0.0, (unsigned long)ra);
+}
+
+static void bench(const char *op, size_t size, size_t n, bool random)
+{
+    file_t *direct = __file("direct", false);
+    file_t *cached = __file("cached", true);
+    const char *pass[] = { "cold", "warm" };
+    pagecache_stats_t before, after;
+    char name[32];
+    double t;
+
+    for (int p = 0; p < 2; ++p) {
+        snprintf(name, sizeof(name), "%s-%s", op, pass[p]);
+
+        fs_calls = 0;
+        t = __pass(direct, size, n, random);
+        bench_report("pagecache", name, "direct", (double)size * n / (1 << 20), t, "MB");
+        printf("pagecache %s direct %.3f fs-calls/read\n", name, (double)fs_calls / n);
+
+        /* the cold pass starts with an empty cache and readahead state */
+        if (p == 0) {
+            pagecache_truncate(&cached->f_dentry->d_inode->i_mapping);
+            memset(&cached->f_ra, 0, sizeof(cached->f_ra));
+        }
+
+        fs_calls = 0;
+        pagecache_stats(&before);
+        t = __pass(cached, size, n, random);
+        pagecache_stats(&after);
+
+        bench_report("pagecache", name, "cached", (double)size * n / (1 << 20), t, "MB");
+        printf("pagecache %s cached %.3f fs-calls/read\n", name, (double)fs_calls / n);
+        __report_stats(op, pass[p], &before, &after);
+    }
+
+    pagecache_truncate(&cached->f_dentry->d_inode->i_mapping);
+}
+
+int main(void)
+{
+    void *info;
+
+    if (!(info = host_mm_init()) || host_vfs_init(info) < 0)
+        return 1;
+
+    if (!(backing = malloc(FILE_SIZE)))
+        return 1;
+
+    for (size_t i = 0; i < FILE_SIZE; ++i)
+        backing[i] = i * 31;
+
+    bench("seq-4k",  PAGE_SIZE,  FILE_PAGES,      false);
+    bench("seq-64k", 64 * 1024,  FILE_PAGES / 16, false);
+    bench("rand-4k", PAGE_SIZE,  NRANDOM,         true);
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <fs/dentry.h>
+#include <fs/fs.h>
+#include <mm/heap.h>
+#include <mm/slab.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "host.h"
+
+/* Path lookup of the hosted kernel (see test/host)
+ *
+ * /d1/d2/.../d16 is created in the dentry cache and every prefix of it is looked up
+ *
+ * - walk:   vfs_path_walk() into a path_t on the stack
+ * - lookup: vfs_path_lookup() which allocates the path_t
+ *
+ * The scaling test walks /d1/.../d8 from 1, 2 and 4 threads at the same time and reports
+ * the total rate, the threads only scale if the host has as many CPUs
+ *
+ * - walk:   vfs_path_walk(), lockless unless it has to fall back
+ * - locked: dentry_lookup() of each component, which takes the dentry cache lock
+ *           for every component like the walk did before it became lockless
+ *
+ * The binary is linked with --wrap for the kernel allocators so the allocations
+ * made per lookup are counted, results of the depth test are reported per lookup instead of as a rate */
+
+#define NOPS        (1U << 16)
+#define MAX_DEPTH   16
+#define SCALE_DEPTH 8
+#define MAX_THREADS 4
+
+static uint64_t nallocs;
+
+void *__real_kmalloc(size_t size);
+void *__real_kzalloc(size_t size);
+void *__real_mm_cache_alloc_entry(mm_cache_t *cache);
+
+void *__wrap_kmalloc(size_t size)
+{
+    nallocs++;
+    return __real_kmalloc(size);
+}
+
+void *__wrap_kzalloc(size_t size)
+{
+    nallocs++;
+    return __real_kzalloc(size);
+}
+
+void *__wrap_mm_cache_alloc_entry(mm_cache_t *cache)
+{
+    nallocs++;
+    return __real_mm_cache_alloc_entry(cache);
+}
+
+static void report(const char *op, const char *impl, double seconds, uint64_t allocs)
+{
+    printf("path %s %s %.1f ns/lookup\n", op, impl, seconds * 1e9 / NOPS);
+    printf("path %s %s %.2f alloc/lookup\n", op, impl, (double)allocs / NOPS);
+}
+
+static void bench_depth(const char *path, unsigned depth)
+{
+    char op[32];
+    uint64_t allocs;
+    double start;
+    path_t p;
+
+    snprintf(op, sizeof(op), "depth%u", depth);
+
+    allocs = nallocs;
+    start  = bench_now();
+
+    for (size_t i = 0; i < NOPS; ++i) {
+        if (vfs_path_walk(path, LOOKUP_OPEN, &p) < 0)
+            exit(1);
+        vfs_path_put(&p);
+    }
+
+    report(op, "walk", bench_now() - start, nallocs - allocs);
+
+    allocs = nallocs;
+    start  = bench_now();
+
+    for (size_t i = 0; i < NOPS; ++i)
+        vfs_path_release(vfs_path_lookup((char *)path, LOOKUP_OPEN));
+
+    report(op, "lookup", bench_now() - start, nallocs - allocs);
+}
+
+static char scale_path[SCALE_DEPTH * 4 + 1];
+static dentry_t *scale_root;
+static char scale_names[SCALE_DEPTH][8];
+
+static void *__scale_walk(void *arg)
+{
+    path_t p;
+
+    for (size_t i = 0; i < NOPS; ++i) {
+        if (vfs_path_walk(scale_path, LOOKUP_OPEN, &p) < 0)
+            exit(1);
+        vfs_path_put(&p);
+    }
+
+    return NULL;
+}
+
+static void *__scale_locked(void *arg)
+{
+    for (size_t i = 0; i < NOPS; ++i) {
+        dentry_t *dntr = scale_root;
+
+        for (int k = 0; k < SCALE_DEPTH && dntr; ++k)
+            dntr = dentry_lookup(dntr, scale_names[k]);
+
+        if (!dntr)
+            exit(1);
+    }
+
+    return NULL;
+}
+
+static void bench_scaling(void)
+{
+    pthread_t threads[MAX_THREADS];
+    char op[32];
+    double start;
+
+    for (int n = 1; n <= MAX_THREADS; n *= 2) {
+        snprintf(op, sizeof(op), "smp%d-depth%d", n, SCALE_DEPTH);
+
+        start = bench_now();
+        for (int i = 0; i < n; ++i)
+            pthread_create(&threads[i], NULL, __scale_walk, NULL);
+        for (int i = 0; i < n; ++i)
+            pthread_join(threads[i], NULL);
+        bench_report("path", op, "walk", (double)n * NOPS, bench_now() - start, "lookup");
+
+        start = bench_now();
+        for (int i = 0; i < n; ++i)
+            pthread_create(&threads[i], NULL, __scale_locked, NULL);
+        for (int i = 0; i < n; ++i)
+            pthread_join(threads[i], NULL);
+        bench_report("path", op, "locked", (double)n * NOPS, bench_now() - start, "lookup");
+    }
+}
+
+int main(void)
+{
+    char path[MAX_DEPTH * 4 + 1] = { 0 };
+    dentry_t *dntr;
+    void *info;
+    path_t root;
+
+    if (!(info = host_mm_init()) || host_vfs_init(info) < 0)
+        return 1;
+
+    if (vfs_path_walk("/", LOOKUP_OPEN, &root) < 0)
+        return 1;
+
+    dntr = root.p_dentry;
+
+    for (unsigned depth = 1; depth <= MAX_DEPTH; ++depth) {
+        char name[8];
+
+        snprintf(name, sizeof(name), "d%u", depth);
+        snprintf(path + strlen(path), sizeof(path) - strlen(path), "/%s", name);
+
+        if (!(dntr = dentry_alloc(dntr, name, T_IFDIR)))
+            return 1;
+
+        bench_depth(path, depth);
+
+        if (depth <= SCALE_DEPTH) {
+            strcpy(scale_path, path);
+            strcpy(scale_names[depth - 1], name);
+        }
+    }
+
+    scale_root = root.p_dentry;
+    bench_scaling();
+
+    vfs_path_put(&root);
+    return 0;
+}
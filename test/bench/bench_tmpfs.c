@@ -0,0 +1,113 @@
+#include <arch/amd64/mmu.h>
+#include <fs/dentry.h>
+#include <fs/file.h>
+#include <fs/fs.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "host.h"
+
+/* File reads and writes of tmpfs on the hosted kernel (see test/host)
+ *
+ * - tmpfs:  file_read() and file_write() of a file in /tmp
+ * - memcpy: the same copies to and from one flat buffer, the cost of the data alone
+ *
+ * The file is written sequentially in 4 KB writes twice, the first pass allocates the
+ * pages and the second one overwrites them, then it's read sequentially and both written
+ * and read at random 4 KB offsets. A sparse file of the same size is read to measure
+ * reading holes, which have no pages at all */
+
+#define FILE_PAGES 4096
+#define FILE_SIZE  (FILE_PAGES * PAGE_SIZE)
+#define NRANDOM    (4 * FILE_PAGES)
+
+static uint8_t *flat;
+
+static file_t *__open(const char *path)
+{
+    path_t p;
+    file_t *file;
+
+    if (vfs_create(path, 0) < 0 || vfs_path_walk(path, LOOKUP_OPEN, &p) < 0)
+        exit(1);
+
+    if (!(file = file_open(p.p_dentry, O_RDWR)))
+        exit(1);
+
+    vfs_path_put(&p);
+    return file;
+}
+
+/* read or write `n` pages, sequentially or at random page offsets */
+static double __pass(file_t *file, size_t n, bool write, bool random)
+{
+    static uint8_t buf[PAGE_SIZE];
+    uint64_t seed = 0x9e3779b97f4a7c15;
+    double start  = bench_now();
+
+    for (size_t i = 0; i < n; ++i) {
+        off_t pos = (random ? bench_rand(&seed) % FILE_PAGES : i % FILE_PAGES) * PAGE_SIZE;
+        ssize_t ret;
+
+        if (!file) {
+            if (write)
+                memcpy(flat + pos, buf, PAGE_SIZE);
+            else
+                memcpy(buf, flat + pos, PAGE_SIZE);
+
+            continue;
+        }
+
+        if (write)
+            ret = file_write(file, pos - file->f_pos, PAGE_SIZE, buf);
+        else
+            ret = file_read(file, pos - file->f_pos, PAGE_SIZE, buf);
+
+        if (ret != PAGE_SIZE)
+            exit(1);
+    }
+
+    return bench_now() - start;
+}
+
+static void bench(const char *op, file_t *file, size_t n, bool write, bool random)
+{
+    double mb = (double)n * PAGE_SIZE / (1 << 20);
+
+    bench_report("tmpfs", op, "tmpfs",  mb, __pass(file, n, write, random), "MB");
+    bench_report("tmpfs", op, "memcpy", mb, __pass(NULL, n, write, random), "MB");
+}
+
+int main(void)
+{
+    file_t *file, *sparse;
+    void *info;
+
+    if (!(info = host_mm_init()) || host_vfs_init(info) < 0)
+        return 1;
+
+    if (!(flat = malloc(FILE_SIZE)))
+        return 1;
+
+    memset(flat, 0, FILE_SIZE);
+    file = __open("/tmp/bench");
+
+    bench("seq-4k-write-alloc", file, FILE_PAGES, true,  false);
+    bench("seq-4k-write",       file, FILE_PAGES, true,  false);
+    bench("seq-4k-read",        file, FILE_PAGES, false, false);
+    bench("rand-4k-write",      file, NRANDOM,    true,  true);
+    bench("rand-4k-read",       file, NRANDOM,    false, true);
+
+    /* one byte at the end makes the rest of the file a hole */
+    sparse = __open("/tmp/sparse");
+
+    if (file_write(sparse, FILE_SIZE - 1, 1, "x") != 1)
+        return 1;
+
+    bench("seq-4k-read-hole", sparse, FILE_PAGES, false, false);
+
+    file_close(file);
+    file_close(sparse);
+
+    return vfs_unlink("/tmp/bench") < 0 || vfs_unlink("/tmp/sparse") < 0;
+}
@@ -0,0 +1,199 @@
+#include <lib/itree.h>
+#include <lib/list.h>
+#include <lib/rbtree.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/* Ordered lookups with 10, 1k and 100k elements
+ *
+ * - lookup: find the element with a given key (rb_find() vs. a list walk)
+ * - lower:  find the first element with a key not less than the given key
+ * - stab:   find the interval containing a point, like ktrace() resolving a return
+ *           address (itree_stab() vs. a scan over an array like the ELF symbol table) */
+
+#define NLOOKUPS (1U << 20)
+
+typedef struct item {
+    rb_node_t node;
+    list_head_t list;
+    uint64_t key;
+} item_t;
+
+typedef struct range {
+    itree_node_t node;
+    uint64_t start;
+    uint64_t last;
+} range_t;
+
+static void *volatile sink;
+
+static int __cmp(const void *key, const rb_node_t *node)
+{
+    uint64_t k = *(const uint64_t *)key, n = container_of(node, item_t, node)->key;
+
+    return (k > n) - (k < n);
+}
+
+static void __insert(rb_tree_t *tree, item_t *item)
+{
+    rb_node_t **link = &tree->root, *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        link   = item->key < container_of(parent, item_t, node)->key ? &parent->left : &parent->right;
+    }
+
+    rb_insert(tree, &item->node, parent, link);
+}
+
+static void bench_ordered(size_t n)
+{
+    item_t *items = calloc(n, sizeof(item_t));
+    uint64_t seed = 1;
+    size_t nlookups = NLOOKUPS / (n > 1000 ? 64 : 1);
+    list_head_t list;
+    rb_tree_t tree;
+    char op[32];
+    double start;
+
+    list_init(&list);
+    rb_init(&tree, NULL);
+
+    /* even keys so odd keys miss, list_append() inserts after the head so
+     * the list is built backwards to keep it sorted */
+    for (size_t i = n; i-- > 0; ) {
+        items[i].key = 2 * i;
+        list_append(&list, &items[i].list);
+        __insert(&tree, &items[i]);
+    }
+
+    start = bench_now();
+
+    for (size_t i = 0; i < nlookups; ++i) {
+        uint64_t key = 2 * (bench_rand(&seed) % n);
+
+        FOREACH(list, iter) {
+            if (container_of(iter, item_t, list)->key == key) {
+                sink = iter;
+                break;
+            }
+        }
+    }
+
+    snprintf(op, sizeof(op), "lookup-%zu", n);
+    bench_report("tree", op, "list", nlookups, bench_now() - start, "lookups");
+
+    start = bench_now();
+
+    for (size_t i = 0; i < NLOOKUPS; ++i) {
+        uint64_t key = 2 * (bench_rand(&seed) % n);
+
+        sink = rb_find(&tree, &key, __cmp);
+    }
+
+    bench_report("tree", op, "rbtree", NLOOKUPS, bench_now() - start, "lookups");
+
+    /* the list is sorted, stop at the first key that isn't less */
+    start = bench_now();
+
+    for (size_t i = 0; i < nlookups; ++i) {
+        uint64_t key = bench_rand(&seed) % (2 * n);
+
+        FOREACH(list, iter) {
+            if (container_of(iter, item_t, list)->key >= key) {
+                sink = iter;
+                break;
+            }
+        }
+    }
+
+    snprintf(op, sizeof(op), "lower-%zu", n);
+    bench_report("tree", op, "list", nlookups, bench_now() - start, "lookups");
+
+    start = bench_now();
+
+    for (size_t i = 0; i < NLOOKUPS; ++i) {
+        uint64_t key = bench_rand(&seed) % (2 * n);
+
+        sink = rb_lower_bound(&tree, &key, __cmp);
+    }
+
+    bench_report("tree", op, "rbtree", NLOOKUPS, bench_now() - start, "lookups");
+
+    free(items);
+}
+
+static void bench_intervals(size_t n)
+{
+    range_t *ranges = calloc(n, sizeof(range_t));
+    uint64_t seed = 2;
+    size_t nlookups = NLOOKUPS / (n > 1000 ? 64 : 1);
+    itree_t tree;
+    char op[32];
+    double start;
+
+    itree_init(&tree);
+
+    /* functions of 16 to 528 bytes with gaps between them, in random order */
+    for (size_t i = 0, addr = 0; i < n; ++i) {
+        ranges[i].start = addr;
+        ranges[i].last  = addr + 16 + bench_rand(&seed) % 512;
+        addr = ranges[i].last + 1 + bench_rand(&seed) % 64;
+    }
+
+    for (size_t i = n - 1; i > 0; --i) {
+        size_t k    = bench_rand(&seed) % (i + 1);
+        range_t tmp = ranges[i];
+
+        ranges[i] = ranges[k];
+        ranges[k] = tmp;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        ranges[i].node.start = ranges[i].start;
+        ranges[i].node.last  = ranges[i].last;
+        itree_insert(&tree, &ranges[i].node);
+    }
+
+    uint64_t end = ranges[0].last;
+
+    for (size_t i = 0; i < n; ++i)
+        end = ranges[i].last > end ? ranges[i].last : end;
+
+    start = bench_now();
+
+    for (size_t i = 0; i < nlookups; ++i) {
+        uint64_t addr = bench_rand(&seed) % end;
+
+        for (size_t k = 0; k < n; ++k) {
+            if (ranges[k].start <= addr && addr <= ranges[k].last) {
+                sink = &ranges[k];
+                break;
+            }
+        }
+    }
+
+    snprintf(op, sizeof(op), "stab-%zu", n);
+    bench_report("tree", op, "linear", nlookups, bench_now() - start, "lookups");
+
+    start = bench_now();
+
+    for (size_t i = 0; i < NLOOKUPS; ++i)
+        sink = itree_stab(&tree, bench_rand(&seed) % end);
+
+    bench_report("tree", op, "itree", NLOOKUPS, bench_now() - start, "lookups");
+
+    free(ranges);
+}
+
+int main(void)
+{
+    static const size_t sizes[] = { 10, 1000, 100000 };
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        bench_ordered(sizes[i]);
+        bench_intervals(sizes[i]);
+    }
+
+    return 0;
+}
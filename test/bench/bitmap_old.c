@@ -0,0 +1,152 @@
+/* bitmap implementation before the 64-bit rewrite, kept only as the baseline
+ * of bench_bitmap.c: identifiers are prefixed with `old_`, otherwise the code
+ * is unchanged */
+#include <kernel/kassert.h>
+#include <kernel/kprint.h>
+#include <mm/heap.h>
+#include <errno.h>
+#include "bitmap_old.h"
+
+old_bitmap_t *old_bm_alloc_bitmap(size_t nmemb)
+{
+    kassert(nmemb != 0);
+
+    old_bitmap_t *bm;
+    size_t num_bits;
+
+    if (!(bm = kzalloc(sizeof(old_bitmap_t))))
+        return NULL;
+
+    // round it up to nearest multiple of 32
+	num_bits = (nmemb % 32) ? ((nmemb / 32) + 1) : (nmemb / 32);
+    bm->len = num_bits * 32;
+
+    if (!(bm->bits = kzalloc(num_bits * sizeof(uint32_t)))) {
+        kfree(bm);
+        return NULL;
+    }
+
+    return bm;
+}
+
+void old_bm_dealloc_bitmap(old_bitmap_t *bm)
+{
+    kfree(bm->bits);
+    kfree(bm);
+}
+
+int old_bm_set_bit(old_bitmap_t *bm, uint32_t n)
+{
+    if (!bm)
+        return -EINVAL;
+
+    if (n / 32 > bm->len)
+        return -E2BIG;
+
+    bm->bits[n / 32] |= 1 << (n % 32);
+    return 0;
+}
+
+int old_bm_set_range(old_bitmap_t *bm, uint32_t n, uint32_t k)
+{
+    if (n >= bm->len || k >= bm->len)
+        return -E2BIG;
+
+    while (n <= k) {
+        bm->bits[n / 32] |= 1 << (n % 32);
+        n++;
+    }
+
+    return 0;
+}
+
+int old_bm_unset_bit(old_bitmap_t *bm, uint32_t n)
+{
+    if (n >= bm->len)
+        return -E2BIG;
+
+    bm->bits[n / 32] &= ~(1 << (n % 32));
+    return 0;
+}
+
+int old_bm_unset_range(old_bitmap_t *bm, uint32_t n, uint32_t k)
+{
+    if (n >= bm->len || k >= bm->len)
+        return -E2BIG;
+
+    while (n <= k) {
+        bm->bits[n / 32] &= ~(1 << (n % 32));
+        n++;
+    }
+
+    return 0;
+}
+
+int old_bm_test_bit(old_bitmap_t *bm, uint32_t n)
+{
+    if (n >= bm->len)
+        return -E2BIG;
+
+    return (bm->bits[n / 32] & (1 << (n % 32))) >> (n % 32);
+}
+
+static int old_bm_find_first(old_bitmap_t *bm, uint32_t n, uint32_t k, uint8_t bit_status)
+{
+    if (n >= bm->len || k >= bm->len)
+        return -E2BIG;
+
+    while (n <= k) {
+        if (((bm->bits[n / 32] & (1 << (n % 32))) >> (n % 32)) == bit_status)
+            return n;
+        n++;
+    }
+
+    return -ENOENT;
+}
+
+int old_bm_find_first_unset(old_bitmap_t *bm, uint32_t n, uint32_t k)
+{
+    return old_bm_find_first(bm, n, k, 0);
+}
+
+int old_bm_find_first_set(old_bitmap_t *bm, uint32_t n, uint32_t k)
+{
+    return old_bm_find_first(bm, n, k, 1);
+}
+
+static int old_bm_find_first_range(old_bitmap_t *bm, uint32_t n, uint32_t k, size_t len, uint8_t bit_status)
+{
+    if (n >= bm->len || k >= bm->len)
+        return -E2BIG;
+
+    int start = -ENOENT;
+    size_t cur_len = 0;
+
+    while (n <= k) {
+        if (((bm->bits[n / 32] & (1 << (n % 32))) >> (n % 32)) == bit_status) {
+
+            if (start == -ENOENT)
+                start = n;
+
+            if (++cur_len == len)
+                return start;
+
+        } else {
+            start   = -ENOENT;
+            cur_len = 0;
+        }
+        n++;
+    }
+
+    return -ENOENT;
+}
+
+int old_bm_find_first_set_range(old_bitmap_t *bm, uint32_t n, uint32_t k, size_t len)
+{
+    return old_bm_find_first_range(bm, n, k, len, 1);
+}
+
+int old_bm_find_first_unset_range(old_bitmap_t *bm, uint32_t n, uint32_t k, size_t len)
+{
+    return old_bm_find_first_range(bm, n, k, len, 0);
+}
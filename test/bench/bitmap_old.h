@@ -0,0 +1,24 @@
+#ifndef __BITMAP_OLD_H__
+#define __BITMAP_OLD_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct old_bitmap {
+    size_t len;
+    uint32_t *bits;
+} old_bitmap_t;
+
+old_bitmap_t *old_bm_alloc_bitmap(size_t nmemb);
+void old_bm_dealloc_bitmap(old_bitmap_t *bm);
+int old_bm_set_bit(old_bitmap_t *bm, uint32_t n);
+int old_bm_set_range(old_bitmap_t *bm, uint32_t n, uint32_t k);
+int old_bm_unset_bit(old_bitmap_t *bm, uint32_t n);
+int old_bm_unset_range(old_bitmap_t *bm, uint32_t n, uint32_t k);
+int old_bm_test_bit(old_bitmap_t *bm, uint32_t n);
+int old_bm_find_first_set(old_bitmap_t *bm, uint32_t n, uint32_t k);
+int old_bm_find_first_unset(old_bitmap_t *bm, uint32_t n, uint32_t k);
+int old_bm_find_first_set_range(old_bitmap_t *bm, uint32_t n, uint32_t k, size_t len);
+int old_bm_find_first_unset_range(old_bitmap_t *bm, uint32_t n, uint32_t k, size_t len);
+
+#endif /* __BITMAP_OLD_H__ */
@@ -0,0 +1,72 @@
+#include "mem_old.h"
+#include <stdint.h>
+
+size_t old_kstrlen(const char *str)
+{
+    size_t len = 0;
+
+    while (str[len] != '\0')
+        len++;
+
+    return len;
+}
+
+void *old_kmemcpy(void *restrict dstptr, const void *restrict srcptr, size_t size)
+{
+    unsigned char *dst = dstptr;
+    const unsigned char *src = srcptr;
+
+    for (size_t i = 0; i < size; ++i)
+        dst[i] = src[i];
+
+    return dstptr;
+}
+
+void *old_kmemset(void *buf, int c, size_t size)
+{
+    unsigned char *ptr = buf;
+
+    while (size--)
+        *ptr++ = c;
+
+    return buf;
+}
+
+int old_kmemcmp(void *s1, void *s2, size_t n)
+{
+    uint8_t *s1_ptr = s1;
+    uint8_t *s2_ptr = s2;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (s1_ptr[i] < s2_ptr[i])
+            return -1;
+
+        if (s1_ptr[i] > s2_ptr[i])
+            return 1;
+    }
+
+    return 0;
+}
+
+int old_kstrcmp(const char *s1, const char *s2)
+{
+    while (*s1 && (*s1 == *s2))
+        s1++, s2++;
+
+    return *(unsigned char *)s1 - *(unsigned char *)s2;
+}
+
+void *old_kmemmove(void *dstptr, const void *srcptr, size_t size)
+{
+    uint8_t *dst = dstptr;
+    const uint8_t *src = srcptr;
+
+    if (dst < src)
+        for (size_t i = 0; i < size; ++i)
+            dst[i] = src[i];
+    else
+        for (size_t i = size; i; --i)
+            dst[i-1] = src[i-1];
+
+    return dstptr;
+}
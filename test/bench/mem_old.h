@@ -0,0 +1,14 @@
+#ifndef __MEM_OLD_H__
+#define __MEM_OLD_H__
+
+#include <stddef.h>
+
+/* byte-at-a-time string and memory routines that kernel/util.c used to have */
+void *old_kmemcpy(void *restrict dstptr, const void *restrict srcptr, size_t size);
+void *old_kmemset(void *buf, int c, size_t size);
+void *old_kmemmove(void *dstptr, const void *srcptr, size_t size);
+int old_kmemcmp(void *s1, void *s2, size_t n);
+int old_kstrcmp(const char *s1, const char *s2);
+size_t old_kstrlen(const char *str);
+
+#endif /* __MEM_OLD_H__ */
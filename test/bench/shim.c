@@ -0,0 +1,34 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* minimal replacements for the kernel services used by the benchmarked code */
+
+void kprint(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
+void ktrace(void)
+{
+}
+
+void *kmalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void *kzalloc(size_t size)
+{
+    return calloc(1, size);
+}
+
+void kfree(void *ptr)
+{
+    free(ptr);
+}
@@ -0,0 +1,70 @@
+#include <kernel/kprint.h>
+#include <mm/types.h>
+#include <mm/vma.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* replacements for the kernel services that need real hardware */
+
+static int __verbose = -1;
+
+void vkprint(const char *fmt, va_list args)
+{
+    if (__verbose < 0)
+        __verbose = getenv("HOST_VERBOSE") != NULL;
+
+    if (__verbose)
+        vfprintf(stderr, fmt, args);
+}
+
+void kprint(const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    vkprint(fmt, args);
+    va_end(args);
+}
+
+void kpanic(const char *err)
+{
+    fprintf(stderr, "kernel panic: %s\n", err);
+    abort();
+}
+
+/* kassert() spins forever after printing the failed condition, abort instead */
+void ktrace(void)
+{
+    fprintf(stderr, "kassert failed, aborting\n");
+    abort();
+}
+
+int ktrace_register_sym(uint8_t *sym, size_t sym_size, uint8_t *str, size_t str_size)
+{
+    return 0;
+}
+
+/* user address spaces need the MMU, mapping files and loading segments isn't tested on the host */
+int mm_map_anon(mm_as_t *as, uint64_t addr, size_t len, int prot)
+{
+    return -ENOSYS;
+}
+
+int mm_map_file(mm_as_t *as, uint64_t addr, size_t len, int prot, int flags,
+                const mm_vma_ops_t *ops, void *private, uint64_t pgoff)
+{
+    return -ENOSYS;
+}
+
+int mm_unmap(mm_as_t *as, uint64_t addr, size_t len)
+{
+    return -ENOSYS;
+}
+
+uint64_t mm_get_user_page(mm_as_t *as, uint64_t addr, int write)
+{
+    return INVALID_ADDRESS;
+}
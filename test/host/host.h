@@ -0,0 +1,28 @@
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hosted kernel
+ *
+ * host_mm_init() maps the fake physical memory and initializes the memory
+ * allocators in the same order as mm_init() does, minus the native MMU setup.
+ * The memory map is given to the kernel in a fake multiboot2 information block
+ * which host_vfs_init() passes on to vfs_install_rootfs().
+ *
+ * Kernel log is discarded unless HOST_VERBOSE is set in the environment */
+
+/* bytes of fake physical memory in MM_ZONE_NORMAL, see mem.c */
+#define HOST_MEM_SIZE (256UL << 20)
+
+/* return pointer to the multiboot2 information on success
+ * return NULL if the fake physical memory couldn't be mapped */
+void *host_mm_init(void);
+
+/* initialize the VFS and mount the boot module (the image of ramfs.S) as rootfs
+ *
+ * return 0 on success, -1 on error */
+int host_vfs_init(void *info);
+
+#endif /* __HOST_H__ */
@@ -0,0 +1,40 @@
+# Hosted build of kernel code, included by test/Makefile and test/bench/Makefile
+#
+# Kernel sources are compiled for the Linux build host and linked against the shim
+# in this directory. The direct map is moved into user space so that physical
+# address `p` is host address `HOST_KDMSTART + p` which mem.c backs with an
+# anonymous mapping, the rest of the kernel code runs unmodified. CONFIG_HOSTED
+# turns interrupt masking into a no-op (see <arch/amd64/cpu.h>) so the kernel's
+# own locks are used.
+
+HOST_DIR   := $(patsubst %/,%,$(dir $(lastword $(MAKEFILE_LIST))))
+KERNEL_SRC := $(HOST_DIR)/../../src
+
+HOST_CC       ?= cc
+HOST_KDMSTART  = 0x100000000000
+
+HOST_KERNEL_CFLAGS  = -O2 -g -std=gnu11 -fcommon -fno-pie -I$(KERNEL_SRC)/include -D__amd64__ \
+                      -DKDMSTART=$(HOST_KDMSTART)ULL -DCONFIG_HOSTED -Wall -Wextra -Wno-unused-parameter \
+                      -Wno-unused-variable -Wno-unused-function -Wno-sign-compare \
+                      -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast -Wno-array-bounds
+HOST_KERNEL_LDFLAGS = -no-pie
+
+HOST_SHIM_SRCS = \
+	$(HOST_DIR)/host.c \
+	$(HOST_DIR)/mem.c
+
+# memory allocators and the libraries they need
+HOST_MM_SRCS = \
+	$(wildcard $(KERNEL_SRC)/lib/*.c) \
+	$(KERNEL_SRC)/mm/bootmem.c \
+	$(KERNEL_SRC)/mm/heap.c \
+	$(KERNEL_SRC)/mm/page.c \
+	$(KERNEL_SRC)/mm/slab.c \
+	$(KERNEL_SRC)/fs/multiboot2.c \
+	$(KERNEL_SRC)/kernel/lock.c \
+	$(KERNEL_SRC)/kernel/util.c
+
+# VFS and the file systems, these need an initramfs image (see ramfs.S)
+HOST_FS_SRCS = \
+	$(HOST_DIR)/vfs.c \
+	$(filter-out %/multiboot2.c, $(wildcard $(KERNEL_SRC)/fs/*.c))
@@ -0,0 +1,119 @@
+#include <fs/multiboot2.h>
+#include <mm/bootmem.h>
+#include <mm/heap.h>
+#include <mm/page.h>
+#include <mm/slab.h>
+#include <mm/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "host.h"
+
+/* Fake physical memory
+ *
+ * The memory map mimics a PC: boot memory comes from the low range like it does
+ * under QEMU and the page allocator gets `HOST_MEM_SIZE` bytes in MM_ZONE_NORMAL
+ *
+ *   [0x1000, 0x9f000)                     available (MM_ZONE_DMA)
+ *   [0x9f000, 16 MB)                      reserved
+ *   [16 MB, 16 MB + HOST_MEM_SIZE)        available (MM_ZONE_NORMAL)
+ *
+ * The initramfs image of ramfs.S is copied to `HOST_MODULE_START` and passed to the
+ * kernel as a boot module like GRUB does
+ *
+ * All of it is one anonymous mapping at `KDMSTART` so amd64_p_to_v() works as is */
+#define LOW_START  0x1000UL
+#define LOW_END    0x9f000UL
+#define HIGH_START MM_ZONE_NORMAL_START
+
+#define HOST_MODULE_START (HIGH_START + (1UL << 20))
+
+/* the kernel image ends below the available ranges, see bootmem.c */
+asm(".globl _kernel_physical_end\n\t.set _kernel_physical_end, 0x1000");
+
+/* benchmarks that don't mount the rootfs aren't linked with ramfs.S and have no module */
+extern uint8_t _ramfs_start __attribute__((weak)), _ramfs_end __attribute__((weak));
+
+/* the tags are in the order GRUB writes them */
+static struct {
+    uint32_t total_size;
+    uint32_t reserved;
+
+    struct {
+        uint32_t type;
+        uint32_t size;
+        char string[48];
+    } name;
+
+    struct {
+        uint32_t type;
+        uint32_t size;
+        uint32_t mod_start;
+        uint32_t mod_end;
+        char cmdline[16];
+    } module;
+
+    multiboot_tag_mmap_t mmap;
+    multiboot_memory_map_t entries[3];
+
+    struct multiboot_tag end;
+} __attribute__((packed, aligned(8))) __info;
+
+static void *__map_memory(void)
+{
+    size_t len = HIGH_START + HOST_MEM_SIZE;
+    void *mem  = mmap((void *)KDMSTART, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (mem != (void *)KDMSTART) {
+        perror("host - failed to map physical memory");
+        return NULL;
+    }
+
+    __info.total_size = sizeof(__info);
+
+    __info.name.type = MULTIBOOT_TAG_TYPE_BOOT_LOADER_NAME;
+    __info.name.size = sizeof(__info.name);
+    strcpy(__info.name.string, "smough host test");
+
+    __info.module.type      = MULTIBOOT_TAG_TYPE_MODULE;
+    __info.module.size      = sizeof(__info.module);
+    __info.module.mod_start = HOST_MODULE_START;
+    __info.module.mod_end   = HOST_MODULE_START + (&_ramfs_end - &_ramfs_start);
+    strcpy(__info.module.cmdline, "initramfs");
+
+    memcpy(amd64_p_to_v(HOST_MODULE_START), &_ramfs_start, &_ramfs_end - &_ramfs_start);
+
+    __info.mmap.type          = MULTIBOOT_TAG_TYPE_MMAP;
+    __info.mmap.size          = sizeof(__info.mmap) + sizeof(__info.entries);
+    __info.mmap.entry_size    = sizeof(multiboot_memory_map_t);
+    __info.mmap.entry_version = 0;
+
+    __info.entries[0] = (multiboot_memory_map_t){ LOW_START,  LOW_END - LOW_START,  MULTIBOOT_MEMORY_AVAILABLE, 0 };
+    __info.entries[1] = (multiboot_memory_map_t){ LOW_END,    HIGH_START - LOW_END, MULTIBOOT_MEMORY_RESERVED,  0 };
+    __info.entries[2] = (multiboot_memory_map_t){ HIGH_START, HOST_MEM_SIZE,        MULTIBOOT_MEMORY_AVAILABLE, 0 };
+
+    __info.end.type = MULTIBOOT_TAG_TYPE_END;
+    __info.end.size = sizeof(__info.end);
+
+    return &__info;
+}
+
+void *host_mm_init(void)
+{
+    void *info = __map_memory();
+
+    if (!info)
+        return NULL;
+
+    (void)mm_bootmem_init(info);
+    (void)mm_heap_preinit();
+    (void)mm_slab_preinit();
+
+    mm_zones_init(info);
+
+    (void)mm_heap_init();
+    (void)mm_slab_init();
+
+    return info;
+}
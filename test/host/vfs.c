@@ -0,0 +1,15 @@
+#include <fs/fs.h>
+#include <kernel/kprint.h>
+#include "host.h"
+
+int host_vfs_init(void *info)
+{
+    vfs_init();
+
+    if (vfs_install_rootfs("initramfs", info) < 0) {
+        kprint("host - failed to install rootfs\n");
+        return -1;
+    }
+
+    return 0;
+}
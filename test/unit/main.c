@@ -0,0 +1,83 @@
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "host.h"
+#include "unit.h"
+
+/* seconds a test may run before it's killed */
+#define TEST_TIMEOUT 10
+
+extern const unit_test_t __start_unit_tests[], __stop_unit_tests[];
+
+int unit_failures;
+
+static int __run(const unit_test_t *test)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+
+    if ((pid = fork()) < 0)
+        return -1;
+
+    if (pid == 0) {
+        alarm(TEST_TIMEOUT);
+        test->func();
+        fflush(stdout);
+        _exit(unit_failures ? 1 : 0);
+    }
+
+    if (waitpid(pid, &status, 0) < 0)
+        return -1;
+
+    if (WIFSIGNALED(status)) {
+        printf("# killed by signal %d (%s)\n", WTERMSIG(status), strsignal(WTERMSIG(status)));
+        return -1;
+    }
+
+    return WEXITSTATUS(status) ? -1 : 0;
+}
+
+/* usage: unit [filter]
+ *
+ * run all tests whose `suite.name` contains `filter` */
+int main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : "";
+    size_t ntests = 0, nfailed = 0, n = 0;
+    void *info;
+    char id[128];
+
+    if (!(info = host_mm_init()))
+        return 1;
+
+    if (host_vfs_init(info) < 0)
+        return 1;
+
+    for (const unit_test_t *t = __start_unit_tests; t < __stop_unit_tests; ++t) {
+        snprintf(id, sizeof(id), "%s.%s", t->suite, t->name);
+        ntests += strstr(id, filter) != NULL;
+    }
+
+    printf("TAP version 13\n1..%zu\n", ntests);
+
+    for (const unit_test_t *t = __start_unit_tests; t < __stop_unit_tests; ++t) {
+        snprintf(id, sizeof(id), "%s.%s", t->suite, t->name);
+
+        if (!strstr(id, filter))
+            continue;
+
+        if (__run(t) < 0) {
+            printf("not ok %zu - %s\n", ++n, id);
+            nfailed++;
+        } else {
+            printf("ok %zu - %s\n", ++n, id);
+        }
+    }
+
+    printf("# %zu tests, %zu failed\n", ntests, nfailed);
+
+    return nfailed != 0;
+}
@@ -0,0 +1,65 @@
+#include <lib/bitmap.h>
+#include <errno.h>
+#include "unit.h"
+
+TEST(bitmap, set_and_test)
+{
+    bitmap_t *bm = bm_alloc_bitmap(200);
+
+    ASSERT(bm != NULL);
+
+    for (uint32_t i = 0; i < 200; i += 3)
+        EXPECT_EQ(bm_set_bit(bm, i), 0);
+
+    for (uint32_t i = 0; i < 200; ++i)
+        EXPECT_EQ(bm_test_bit(bm, i), i % 3 == 0);
+
+    EXPECT_EQ(bm_weight(bm), 67);
+
+    /* the length is rounded up to whole words */
+    EXPECT_EQ(bm_set_bit(bm, 255), 0);
+    EXPECT(bm_set_bit(bm, 256) < 0);
+
+    bm_dealloc_bitmap(bm);
+}
+
+TEST(bitmap, ranges_across_words)
+{
+    bitmap_t *bm = bm_alloc_bitmap(1000);
+
+    ASSERT(bm != NULL);
+
+    EXPECT_EQ(bm_set_range(bm, 3, 130), 0);
+    EXPECT_EQ(bm_weight(bm), 128);
+    EXPECT_EQ(bm_find_next_set(bm, 0), 3);
+    EXPECT_EQ(bm_find_next_unset(bm, 3), 131);
+    EXPECT_EQ(bm_find_first_set(bm, 64, 999), 64);
+
+    EXPECT_EQ(bm_unset_range(bm, 60, 70), 0);
+    EXPECT_EQ(bm_weight(bm), 117);
+    EXPECT_EQ(bm_find_first_unset(bm, 3, 999), 60);
+    EXPECT_EQ(bm_find_next_set(bm, 131), -ENOENT);
+
+    bm_dealloc_bitmap(bm);
+}
+
+TEST(bitmap, find_ranges)
+{
+    bitmap_t *bm = bm_alloc_bitmap(512);
+
+    ASSERT(bm != NULL);
+
+    /* holes of 10, 70 and 200 bits */
+    bm_set_range(bm, 0, 511);
+    bm_unset_range(bm, 20, 29);
+    bm_unset_range(bm, 100, 169);
+    bm_unset_range(bm, 300, 499);
+
+    EXPECT_EQ(bm_find_first_unset_range(bm, 0, 511, 10), 20);
+    EXPECT_EQ(bm_find_first_unset_range(bm, 0, 511, 11), 100);
+    EXPECT_EQ(bm_find_first_unset_range(bm, 0, 511, 71), 300);
+    EXPECT_EQ(bm_find_first_unset_range(bm, 0, 511, 201), -ENOENT);
+    EXPECT_EQ(bm_find_first_set_range(bm, 30, 511, 100), 170);
+
+    bm_dealloc_bitmap(bm);
+}
@@ -0,0 +1,257 @@
+#include <fs/dentry.h>
+#include <fs/file.h>
+#include <fs/fs.h>
+#include <mm/page.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "unit.h"
+
+#define NREADERS  3
+#define NWALKS    (1 << 14)
+#define NNEGATIVE 512
+
+/* the initramfs image is built from unit/fixtures, see test/Makefile */
+
+TEST(dentry, hit_after_miss)
+{
+    dcache_stats_t before, after;
+    path_t *path;
+
+    dentry_cache_stats(&before);
+
+    path = vfs_path_lookup("/etc/hello", LOOKUP_OPEN);
+    ASSERT(path->p_dentry != NULL);
+    vfs_path_release(path);
+
+    path = vfs_path_lookup("/etc/hello", LOOKUP_OPEN);
+    ASSERT(path->p_dentry != NULL);
+    vfs_path_release(path);
+
+    dentry_cache_stats(&after);
+
+    /* "etc" and "hello" miss once and then hit */
+    EXPECT_EQ(after.misses - before.misses, 2);
+    EXPECT_EQ(after.hits - before.hits, 2);
+}
+
+TEST(dentry, negative)
+{
+    dcache_stats_t before, after;
+
+    ASSERT(vfs_path_lookup("/etc/missing", LOOKUP_OPEN)->p_dentry == NULL);
+
+    dentry_cache_stats(&before);
+    ASSERT(vfs_path_lookup("/etc/missing", LOOKUP_OPEN)->p_dentry == NULL);
+    dentry_cache_stats(&after);
+
+    EXPECT_EQ(after.negative_hits - before.negative_hits, 1);
+    EXPECT_EQ(after.misses - before.misses, 0);
+}
+
+/* creating a name replaces its negative dentry */
+TEST(dentry, create_over_negative)
+{
+    path_t *path = vfs_path_lookup("/etc", LOOKUP_OPEN);
+    dentry_t *dntr;
+
+    ASSERT(path->p_dentry != NULL);
+    ASSERT(dentry_lookup(path->p_dentry, "new") == NULL);
+    EXPECT_EQ(errno, ENOENT);
+    EXPECT(dentry_cache_lookup(path->p_dentry, "new") != NULL);
+
+    ASSERT((dntr = dentry_alloc(path->p_dentry, "new", T_IFREG)) != NULL);
+    EXPECT(dentry_lookup(path->p_dentry, "new") == dntr);
+}
+
+/* a move that fails puts back the dentry it would have replaced */
+TEST(dentry, replace_failed_move)
+{
+    path_t *path = vfs_path_lookup("/etc", LOOKUP_OPEN);
+    dentry_t *target, *neg;
+
+    ASSERT(path->p_dentry != NULL);
+    ASSERT((target = dentry_alloc(path->p_dentry, "target", T_IFREG)) != NULL);
+
+    /* a negative dentry isn't linked to its parent so moving it fails */
+    ASSERT(dentry_lookup(path->p_dentry, "absent") == NULL);
+    ASSERT((neg = dentry_cache_lookup(path->p_dentry, "absent")) != NULL);
+
+    EXPECT_EQ(dentry_replace(neg, target, 0), -ENOENT);
+    EXPECT(hm_get(path->p_dentry->d_children, "target") == target);
+    EXPECT(target->d_state & DCACHE_HASHED);
+    EXPECT(strcmp(neg->d_name, "absent") == 0);
+
+    EXPECT_EQ(dentry_dealloc(target), 0);
+    vfs_path_release(path);
+}
+
+TEST(dentry, shrink_unused)
+{
+    path_t *path = vfs_path_lookup("/etc/hello", LOOKUP_OPEN);
+    dcache_stats_t stats;
+    char buf[16] = { 0 };
+    file_t *file;
+
+    ASSERT(path->p_dentry != NULL);
+
+    /* in use, nothing to evict */
+    (void)dentry_cache_shrink(SIZE_MAX);
+    EXPECT(dentry_cache_lookup(path->p_dentry->d_parent, "hello") == path->p_dentry);
+
+    vfs_path_release(path);
+
+    /* "hello" and then "etc" become unused, the first pass only clears the referenced bits */
+    while (dentry_cache_shrink(SIZE_MAX))
+        ;
+
+    dentry_cache_stats(&stats);
+    EXPECT_EQ(stats.unused, 0);
+    EXPECT(stats.evictions >= 2);
+
+    /* evicted dentries are instantiated again */
+    path = vfs_path_lookup("/etc/hello", LOOKUP_OPEN);
+    ASSERT(path->p_dentry != NULL);
+    ASSERT((file = file_open(path->p_dentry, O_RDONLY)) != NULL);
+    EXPECT_EQ(file_read(file, 0, 5, buf), 5);
+    EXPECT(strcmp(buf, "hello") == 0);
+}
+
+/* under memory pressure the dcache evicts unused dentries until their slab pages
+ * have been returned to the page allocator */
+TEST(dentry, shrinker_releases_pages)
+{
+    path_t *path = vfs_path_lookup("/etc", LOOKUP_OPEN);
+    dcache_stats_t before, after;
+    char name[16];
+
+    ASSERT(path->p_dentry != NULL);
+
+    for (int i = 0; i < NNEGATIVE; ++i) {
+        snprintf(name, sizeof(name), "neg%d", i);
+        ASSERT(dentry_lookup(path->p_dentry, name) == NULL);
+    }
+
+    dentry_cache_stats(&before);
+    EXPECT(mm_shrink(1) >= 1);
+    dentry_cache_stats(&after);
+
+    EXPECT(after.evictions > before.evictions);
+    vfs_path_release(path);
+}
+
+static dentry_t *walk_expect;
+
+static void *__walker(void *arg)
+{
+    intptr_t bad = 0;
+    path_t path;
+
+    for (int i = 0; i < NWALKS; ++i) {
+        if (vfs_path_walk("/etc/hello", LOOKUP_OPEN, &path) < 0 || path.p_dentry != walk_expect)
+            bad++;
+
+        vfs_path_put(&path);
+    }
+
+    return (void *)bad;
+}
+
+/* lockless walks stay correct while dentries next to them are created and evicted */
+TEST(dentry, walk_concurrent_evict)
+{
+    pthread_t threads[NREADERS];
+    dentry_t *etc, *dntr;
+    path_t path;
+    char name[16];
+
+    ASSERT(vfs_path_walk("/etc/hello", LOOKUP_OPEN, &path) == 0);
+    walk_expect = path.p_dentry;
+    etc         = walk_expect->d_parent;
+
+    for (int i = 0; i < NREADERS; ++i)
+        ASSERT(pthread_create(&threads[i], NULL, __walker, NULL) == 0);
+
+    for (int i = 0; i < 512; ++i) {
+        snprintf(name, sizeof(name), "tmp%d", i);
+
+        /* leaves a negative dentry in the chains the walkers read */
+        EXPECT(dentry_lookup(etc, name) == NULL);
+
+        if ((dntr = dentry_cache_lookup(etc, name)))
+            EXPECT_EQ(dentry_cache_evict(dntr), 0);
+    }
+
+    for (int i = 0; i < NREADERS; ++i) {
+        void *bad;
+
+        pthread_join(threads[i], &bad);
+        EXPECT_EQ((intptr_t)bad, 0);
+    }
+
+    vfs_path_put(&path);
+}
+
+static dentry_t *evict_parent;
+
+static void *__pinner(void *arg)
+{
+    dname_t name = { "hello", 5, dname_hash("hello", 5) };
+    intptr_t bad = 0;
+
+    for (int i = 0; i < NWALKS; ++i) {
+        uint32_t start = dentry_walk_begin(), seq;
+        dentry_t *dntr = dentry_lookup_lockless(evict_parent, &name, &seq);
+
+        if (!dntr || dentry_walk_get(dntr, start, seq) < 0)
+            continue;
+
+        /* a pinned dentry can't be evicted until it's released */
+        if (!(dntr->d_state & DCACHE_HASHED) || strcmp(dntr->d_name, "hello") != 0)
+            bad++;
+
+        dentry_put(dntr);
+    }
+
+    return (void *)bad;
+}
+
+/* evicting the dentry a lockless walk ends at either fails or happens before the walk
+ * takes its reference, never after */
+TEST(dentry, walk_evict_target)
+{
+    pthread_t threads[NREADERS];
+    dentry_t *dntr;
+    path_t path;
+    int evicted = 0;
+
+    ASSERT(vfs_path_walk("/etc", LOOKUP_OPEN, &path) == 0);
+    evict_parent = path.p_dentry;
+
+    ASSERT(dentry_lookup(evict_parent, "hello") != NULL);
+
+    for (int i = 0; i < NREADERS; ++i)
+        ASSERT(pthread_create(&threads[i], NULL, __pinner, NULL) == 0);
+
+    /* only this thread instantiates and evicts the dentry */
+    for (int i = 0; i < NWALKS; ++i) {
+        if (!(dntr = dentry_cache_lookup(evict_parent, "hello")))
+            ASSERT((dntr = dentry_lookup(evict_parent, "hello")) != NULL);
+
+        int ret = dentry_cache_evict(dntr);
+
+        EXPECT(ret == 0 || ret == -EBUSY);
+        evicted += ret == 0;
+    }
+
+    for (int i = 0; i < NREADERS; ++i) {
+        void *bad;
+
+        pthread_join(threads[i], &bad);
+        EXPECT_EQ((intptr_t)bad, 0);
+    }
+
+    EXPECT(evicted > 0);
+    vfs_path_put(&path);
+}
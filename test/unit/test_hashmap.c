@@ -0,0 +1,74 @@
+#include <lib/hashmap.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "unit.h"
+
+#define NKEYS 5000
+
+static char keys[NKEYS][16];
+
+TEST(hashmap, insert_get_remove)
+{
+    hashmap_t *hm = hm_alloc_hashmap(16, HM_KEY_TYPE_STR);
+
+    ASSERT(hm != NULL);
+
+    /* the map has to grow many times */
+    for (int i = 0; i < NKEYS; ++i) {
+        snprintf(keys[i], sizeof(keys[i]), "key-%d", i);
+        EXPECT_EQ(hm_insert(hm, keys[i], &keys[i]), 0);
+    }
+
+    EXPECT_EQ(hm_get_size(hm), NKEYS);
+
+    for (int i = 0; i < NKEYS; ++i)
+        EXPECT(hm_get(hm, keys[i]) == &keys[i]);
+
+    EXPECT(hm_get(hm, "key-missing") == NULL);
+
+    for (int i = 0; i < NKEYS; i += 2)
+        EXPECT_EQ(hm_remove(hm, keys[i]), 0);
+
+    for (int i = 0; i < NKEYS; ++i)
+        EXPECT(hm_get(hm, keys[i]) == ((i % 2) ? &keys[i] : NULL));
+
+    EXPECT_EQ(hm_get_size(hm), NKEYS / 2);
+    EXPECT_EQ(hm_remove(hm, keys[0]), -ENOENT);
+
+    hm_dealloc_hashmap(hm);
+}
+
+TEST(hashmap, duplicate_key)
+{
+    hashmap_t *hm = hm_alloc_hashmap(16, HM_KEY_TYPE_STR);
+    int a, b;
+
+    ASSERT(hm != NULL);
+
+    EXPECT_EQ(hm_insert(hm, "dup", &a), 0);
+    EXPECT_EQ(hm_insert(hm, "dup", &b), -EEXIST);
+    EXPECT(hm_get(hm, "dup") == &a);
+
+    hm_dealloc_hashmap(hm);
+}
+
+TEST(hashmap, numeric_keys)
+{
+    hashmap_t *hm = hm_alloc_hashmap(16, HM_KEY_TYPE_NUM);
+    uint32_t nums[256];
+
+    ASSERT(hm != NULL);
+
+    for (uint32_t i = 0; i < 256; ++i) {
+        nums[i] = i * 7919;
+        EXPECT_EQ(hm_insert(hm, &nums[i], &nums[i]), 0);
+    }
+
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t key = i * 7919;
+        EXPECT(hm_get(hm, &key) == &nums[i]);
+    }
+
+    hm_dealloc_hashmap(hm);
+}
@@ -0,0 +1,95 @@
+#include <mm/heap.h>
+#include <stdint.h>
+#include <string.h>
+#include "unit.h"
+
+#define NALLOCS 256
+
+TEST(heap, no_overlap)
+{
+    uint8_t *ptr[NALLOCS];
+    size_t size[NALLOCS];
+
+    for (int i = 0; i < NALLOCS; ++i) {
+        size[i] = 1 + (i * 37) % 1500;
+        ASSERT((ptr[i] = kmalloc(size[i])) != NULL);
+        memset(ptr[i], i, size[i]);
+    }
+
+    for (int i = 0; i < NALLOCS; ++i) {
+        for (size_t k = 0; k < size[i]; ++k) {
+            if (ptr[i][k] != (uint8_t)i) {
+                EXPECT_EQ(ptr[i][k], (uint8_t)i);
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < NALLOCS; i += 2)
+        kfree(ptr[i]);
+
+    for (int i = 1; i < NALLOCS; i += 2)
+        kfree(ptr[i]);
+}
+
+TEST(heap, kzalloc_zeroed)
+{
+    uint8_t *mem = kmalloc(4000);
+
+    memset(mem, 0xff, 4000);
+    kfree(mem);
+
+    mem = kzalloc(4000);
+
+    for (int i = 0; i < 4000; ++i)
+        EXPECT_EQ(mem[i], 0);
+
+    kfree(mem);
+}
+
+/* freed neighbours are merged so a freed block can satisfy a larger request */
+TEST(heap, coalesce)
+{
+    void *a = kmalloc(1000);
+    void *b = kmalloc(1000);
+    void *c = kmalloc(1000);
+
+    kfree(a);
+    kfree(b);
+
+    EXPECT(kmalloc(2000) == a);
+
+    kfree(c);
+}
+
+/* requests larger than an arena get an arena of their own */
+TEST(heap, large)
+{
+    size_t size = 200 * 1024;
+    uint8_t *mem;
+
+    ASSERT((mem = kmalloc(size)) != NULL);
+
+    memset(mem, 0xab, size);
+    EXPECT_EQ(mem[size - 1], 0xab);
+
+    kfree(mem);
+}
+
+/* allocations that leave no usable space in an arena, the heap has to grow every
+ * ~30 allocations, also when growing needs more memory from the heap itself */
+TEST(heap, many_arenas)
+{
+    static uint64_t *ptr[8192];
+
+    for (int i = 0; i < 8192; ++i) {
+        ASSERT((ptr[i] = kmalloc(520)) != NULL);
+        *ptr[i] = i;
+    }
+
+    for (int i = 0; i < 8192; ++i)
+        EXPECT_EQ(*ptr[i], i);
+
+    for (int i = 0; i < 8192; ++i)
+        kfree(ptr[i]);
+}
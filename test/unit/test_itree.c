@@ -0,0 +1,88 @@
+#include <lib/itree.h>
+#include "unit.h"
+
+#define NNODES 1000
+#define SPACE  10000
+
+static itree_node_t nodes[NNODES];
+
+/* the overlap query must return exactly the intervals a linear scan finds, in order */
+static void __check_query(itree_t *tree, uint64_t start, uint64_t last)
+{
+    itree_node_t *n = itree_first_overlap(tree, start, last);
+    uint64_t prev   = 0;
+    size_t found    = 0, expected = 0;
+
+    for (; n; n = itree_next_overlap(n, start, last), ++found) {
+        EXPECT(n->start <= last && n->last >= start);
+        EXPECT(n->start >= prev);
+        prev = n->start;
+    }
+
+    for (int i = 0; i < NNODES; ++i) {
+        if (nodes[i].node.parent || tree->tree.root == &nodes[i].node)
+            expected += nodes[i].start <= last && nodes[i].last >= start;
+    }
+
+    EXPECT_EQ(found, expected);
+}
+
+TEST(itree, overlap_matches_linear_scan)
+{
+    uint32_t seed = 7;
+    itree_t tree;
+
+    itree_init(&tree);
+
+    for (int i = 0; i < NNODES; ++i) {
+        seed = seed * 1103515245 + 12345;
+        nodes[i].start = (seed >> 8) % SPACE;
+        seed = seed * 1103515245 + 12345;
+        nodes[i].last = nodes[i].start + (seed >> 8) % 200;
+        itree_insert(&tree, &nodes[i]);
+    }
+
+    for (uint64_t q = 0; q < SPACE + 300; q += 37) {
+        __check_query(&tree, q, q);
+        __check_query(&tree, q, q + 50);
+    }
+
+    /* remove half and check that the subtree maxima were updated */
+    for (int i = 0; i < NNODES; i += 2) {
+        itree_remove(&tree, &nodes[i]);
+        nodes[i].node.parent = NULL;
+    }
+
+    for (uint64_t q = 0; q < SPACE + 300; q += 37)
+        __check_query(&tree, q, q + 10);
+}
+
+TEST(itree, lower_bound_and_stab)
+{
+    itree_t tree;
+
+    itree_init(&tree);
+
+    /* [0, 9], [10, 19], ..., [90, 99] */
+    for (int i = 0; i < 10; ++i) {
+        nodes[i].start = i * 10;
+        nodes[i].last  = i * 10 + 9;
+        itree_insert(&tree, &nodes[i]);
+    }
+
+    EXPECT(itree_lower_bound(&tree, 35) == &nodes[4]);
+    EXPECT(itree_lower_bound(&tree, 40) == &nodes[4]);
+    EXPECT(itree_lower_bound(&tree, 91) == NULL);
+
+    EXPECT(itree_stab(&tree, 0)   == &nodes[0]);
+    EXPECT(itree_stab(&tree, 55)  == &nodes[5]);
+    EXPECT(itree_stab(&tree, 99)  == &nodes[9]);
+    EXPECT(itree_stab(&tree, 100) == NULL);
+
+    size_t n = 0;
+
+    for (itree_node_t *it = itree_first(&tree); it; it = itree_next(it))
+        EXPECT_EQ(it->start, n++ * 10);
+
+    EXPECT_EQ(n, 10);
+}
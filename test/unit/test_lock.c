@@ -0,0 +1,268 @@
+#include <kernel/lock.h>
+#include <pthread.h>
+#include <sched.h>
+#include "unit.h"
+
+#define NTHREADS 4
+#define NITERS   (1 << 16)
+
+/* a writer is waiting for a rwlock, see kernel/lock.c */
+#define RW_WAITING (1U << 30)
+
+/* the order in which threads got a lock, appended to while holding it */
+static int __order[NTHREADS];
+static int __norder;
+
+static void __wait_until(volatile uint32_t *word, uint32_t mask)
+{
+    while (!(__atomic_load_n(word, __ATOMIC_ACQUIRE) & mask))
+        sched_yield();
+}
+
+static spinlock_t __spin;
+static uint64_t __counter;
+
+static void *__spin_worker(void *arg)
+{
+    for (int i = 0; i < NITERS; ++i) {
+        spin_lock(&__spin);
+        __counter++;
+        spin_unlock(&__spin);
+    }
+
+    return NULL;
+}
+
+TEST(lock, spin_exclusion)
+{
+    pthread_t threads[NTHREADS];
+
+    spin_init(&__spin);
+
+    for (int i = 0; i < NTHREADS; ++i)
+        ASSERT(pthread_create(&threads[i], NULL, __spin_worker, NULL) == 0);
+
+    for (int i = 0; i < NTHREADS; ++i)
+        pthread_join(threads[i], NULL);
+
+    EXPECT_EQ(__counter, NTHREADS * NITERS);
+
+    /* a held lock can't be taken again */
+    spin_lock(&__spin);
+    EXPECT(!spin_trylock(&__spin));
+    spin_unlock(&__spin);
+
+    EXPECT(spin_trylock(&__spin));
+    spin_unlock(&__spin);
+}
+
+static ticket_t __ticket;
+
+static void *__ticket_worker(void *arg)
+{
+    ticket_lock(&__ticket);
+    __order[__norder++] = (int)(intptr_t)arg;
+    ticket_unlock(&__ticket);
+
+    return NULL;
+}
+
+/* waiters get the lock in the order they took their tickets */
+TEST(lock, ticket_fifo)
+{
+    pthread_t threads[NTHREADS];
+
+    ticket_init(&__ticket);
+    ticket_lock(&__ticket);
+
+    /* start the next waiter only once the previous one holds its ticket */
+    for (int i = 0; i < NTHREADS; ++i) {
+        ASSERT(pthread_create(&threads[i], NULL, __ticket_worker, (void *)(intptr_t)i) == 0);
+
+        while (__atomic_load_n(&__ticket.next, __ATOMIC_ACQUIRE) != i + 2)
+            sched_yield();
+    }
+
+    EXPECT_EQ(__norder, 0);
+    ticket_unlock(&__ticket);
+
+    for (int i = 0; i < NTHREADS; ++i)
+        pthread_join(threads[i], NULL);
+
+    ASSERT(__norder == NTHREADS);
+
+    for (int i = 0; i < NTHREADS; ++i)
+        EXPECT_EQ(__order[i], i);
+}
+
+static mcs_lock_t __mcs;
+
+static void *__mcs_worker(void *arg)
+{
+    mcs_node_t node;
+
+    mcs_lock(&__mcs, &node);
+    __order[__norder++] = (int)(intptr_t)arg;
+    mcs_unlock(&__mcs, &node);
+
+    return NULL;
+}
+
+/* the lock is handed to the queued waiters in order and is free again afterwards */
+TEST(lock, mcs_handoff)
+{
+    pthread_t threads[NTHREADS];
+    mcs_node_t node, *tail = &node;
+
+    mcs_init(&__mcs);
+    mcs_lock(&__mcs, &node);
+
+    /* start the next waiter only once the previous one has queued itself */
+    for (int i = 0; i < NTHREADS; ++i) {
+        ASSERT(pthread_create(&threads[i], NULL, __mcs_worker, (void *)(intptr_t)i) == 0);
+
+        while (__atomic_load_n(&__mcs.tail, __ATOMIC_ACQUIRE) == tail)
+            sched_yield();
+
+        tail = __atomic_load_n(&__mcs.tail, __ATOMIC_ACQUIRE);
+    }
+
+    EXPECT_EQ(__norder, 0);
+    mcs_unlock(&__mcs, &node);
+
+    for (int i = 0; i < NTHREADS; ++i)
+        pthread_join(threads[i], NULL);
+
+    ASSERT(__norder == NTHREADS);
+
+    for (int i = 0; i < NTHREADS; ++i)
+        EXPECT_EQ(__order[i], i);
+
+    EXPECT(__mcs.tail == NULL);
+}
+
+static rwlock_t __rw;
+static int __readers_in;
+
+static void *__rw_writer(void *arg)
+{
+    write_lock(&__rw);
+    __order[__norder++] = 1;
+    write_unlock(&__rw);
+
+    return NULL;
+}
+
+static void *__rw_reader(void *arg)
+{
+    read_lock(&__rw);
+    __atomic_fetch_add(&__readers_in, 1, __ATOMIC_RELAXED);
+    __order[__atomic_fetch_add(&__norder, 1, __ATOMIC_RELAXED)] = 2;
+    read_unlock(&__rw);
+
+    return NULL;
+}
+
+/* readers share the lock but a waiting writer keeps new readers out */
+TEST(lock, rwlock_writer_preference)
+{
+    pthread_t writer, reader;
+
+    rwlock_init(&__rw);
+
+    read_lock(&__rw);
+    read_lock(&__rw);
+    read_unlock(&__rw);
+
+    ASSERT(pthread_create(&writer, NULL, __rw_writer, NULL) == 0);
+    __wait_until(&__rw.state, RW_WAITING);
+
+    ASSERT(pthread_create(&reader, NULL, __rw_reader, NULL) == 0);
+
+    /* the reader would get in right away without the waiting writer, the yields give
+     * it time to run even on a single CPU */
+    for (int i = 0; i < 50; ++i)
+        sched_yield();
+
+    EXPECT_EQ(__atomic_load_n(&__readers_in, __ATOMIC_RELAXED), 0);
+    EXPECT_EQ(__norder, 0);
+
+    read_unlock(&__rw);
+
+    pthread_join(writer, NULL);
+    pthread_join(reader, NULL);
+
+    ASSERT(__norder == 2);
+    EXPECT_EQ(__order[0], 1);
+    EXPECT_EQ(__order[1], 2);
+    EXPECT_EQ(__rw.state, 0);
+}
+
+TEST(lock, seqcount_retry)
+{
+    seqcount_t sc;
+    uint32_t seq;
+
+    seqcount_init(&sc);
+
+    seq = read_seqcount_begin(&sc);
+    EXPECT(!read_seqcount_retry(&sc, seq));
+
+    /* an update that completed since the read started */
+    write_seqcount_begin(&sc);
+    write_seqcount_end(&sc);
+    EXPECT(read_seqcount_retry(&sc, seq));
+
+    /* an update in progress */
+    write_seqcount_begin(&sc);
+    seq = raw_read_seqcount(&sc);
+    EXPECT(seq & 1);
+    EXPECT(read_seqcount_retry(&sc, seq));
+    write_seqcount_end(&sc);
+
+    seq = read_seqcount_begin(&sc);
+    EXPECT(!read_seqcount_retry(&sc, seq));
+}
+
+static seqcount_t __sc;
+static volatile uint64_t __pair[2];
+static int __done;
+
+static void *__seq_writer(void *arg)
+{
+    for (uint64_t i = 1; i <= NITERS; ++i) {
+        write_seqcount_begin(&__sc);
+        __pair[0] = i;
+        __pair[1] = i;
+        write_seqcount_end(&__sc);
+    }
+
+    __atomic_store_n(&__done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* a read that isn't retried never sees half an update */
+TEST(lock, seqcount_consistent)
+{
+    pthread_t writer;
+    uint64_t a, b, torn = 0;
+    uint32_t seq;
+
+    seqcount_init(&__sc);
+    ASSERT(pthread_create(&writer, NULL, __seq_writer, NULL) == 0);
+
+    while (!__atomic_load_n(&__done, __ATOMIC_ACQUIRE)) {
+        do {
+            seq = read_seqcount_begin(&__sc);
+            a   = __pair[0];
+            b   = __pair[1];
+        } while (read_seqcount_retry(&__sc, seq));
+
+        torn += a != b;
+    }
+
+    pthread_join(writer, NULL);
+
+    EXPECT_EQ(torn, 0);
+    EXPECT_EQ(__pair[0], NITERS);
+}
@@ -0,0 +1,109 @@
+#include <lib/lz4.h>
+#include <errno.h>
+#include <string.h>
+#include "unit.h"
+
+/* 16 lines "line N: the quick brown fox jumps over the lazy dog\n" with N = 0..3,
+ * compressed with the reference tool: `lz4 --content-size -BX -B4`, so the frame
+ * has the content size, a block checksum and the content checksum */
+static const uint8_t frame[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x7c, 0x40, 0x40, 0x03, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0xa6, 0x51, 0x00, 0x00, 0x00, 0xf1, 0x17, 0x6c, 0x69, 0x6e,
+    0x65, 0x20, 0x30, 0x3a, 0x20, 0x74, 0x68, 0x65, 0x20, 0x71, 0x75, 0x69,
+    0x63, 0x6b, 0x20, 0x62, 0x72, 0x6f, 0x77, 0x6e, 0x20, 0x66, 0x6f, 0x78,
+    0x20, 0x6a, 0x75, 0x6d, 0x70, 0x73, 0x20, 0x6f, 0x76, 0x65, 0x72, 0x1f,
+    0x00, 0x91, 0x6c, 0x61, 0x7a, 0x79, 0x20, 0x64, 0x6f, 0x67, 0x0a, 0x34,
+    0x00, 0x1f, 0x31, 0x34, 0x00, 0x20, 0x1f, 0x32, 0x34, 0x00, 0x20, 0x1f,
+    0x33, 0x34, 0x00, 0x20, 0x0f, 0xd0, 0x00, 0xff, 0xff, 0x55, 0x50, 0x20,
+    0x64, 0x6f, 0x67, 0x0a, 0xd1, 0x97, 0xde, 0x1a, 0x00, 0x00, 0x00, 0x00,
+    0x78, 0x53, 0x21, 0x18,
+};
+
+#define CONTENT_SIZE 832
+
+static void __expected(char *buf)
+{
+    for (int i = 0; i < 16; ++i)
+        buf += sprintf(buf, "line %d: the quick brown fox jumps over the lazy dog\n", i % 4);
+}
+
+TEST(lz4, xxh32)
+{
+    const char *s = "Nobody inspects the spammish repetition";
+
+    /* the content checksums the reference tool writes for these inputs */
+    EXPECT_EQ(lz4_xxh32("", 0, 0), 0x02cc5d05);
+    EXPECT_EQ(lz4_xxh32("abc", 3, 0), 0x32d153ff);
+    EXPECT_EQ(lz4_xxh32(s, strlen(s), 0), 0xe2293b2f);
+}
+
+TEST(lz4, frame_decompress)
+{
+    static char expected[CONTENT_SIZE + 1], out[CONTENT_SIZE + 16];
+
+    __expected(expected);
+
+    EXPECT(lz4_frame_detect(frame, sizeof(frame)));
+    EXPECT(!lz4_frame_detect(expected, sizeof(expected)));
+    EXPECT_EQ(lz4_frame_content_size(frame, sizeof(frame)), CONTENT_SIZE);
+
+    ASSERT(lz4_frame_decompress(frame, sizeof(frame), out, sizeof(out)) == CONTENT_SIZE);
+    EXPECT(memcmp(out, expected, CONTENT_SIZE) == 0);
+
+    /* exactly enough space is enough, one byte less is not */
+    EXPECT_EQ(lz4_frame_decompress(frame, sizeof(frame), out, CONTENT_SIZE), CONTENT_SIZE);
+    EXPECT_EQ(lz4_frame_decompress(frame, sizeof(frame), out, CONTENT_SIZE - 1), -E2BIG);
+}
+
+/* a skippable frame before the LZ4 frame is ignored */
+TEST(lz4, skippable_frame)
+{
+    static uint8_t buf[sizeof(frame) + 12];
+    static char out[CONTENT_SIZE];
+    const uint8_t skip[] = { 0x5a, 0x2a, 0x4d, 0x18, 0x04, 0x00, 0x00, 0x00, 'a', 'b', 'c', 'd' };
+
+    memcpy(buf, skip, sizeof(skip));
+    memcpy(buf + sizeof(skip), frame, sizeof(frame));
+
+    EXPECT(lz4_frame_detect(buf, sizeof(buf)));
+    EXPECT_EQ(lz4_frame_content_size(buf, sizeof(buf)), CONTENT_SIZE);
+    EXPECT_EQ(lz4_frame_decompress(buf, sizeof(buf), out, sizeof(out)), CONTENT_SIZE);
+
+    /* a skippable frame longer than the input */
+    buf[4] = 0xff;
+    EXPECT_EQ(lz4_frame_decompress(buf, sizeof(buf), out, sizeof(out)), -EINVAL);
+}
+
+/* every damaged byte and every truncation is caught, none of them reads or writes out of bounds */
+TEST(lz4, corrupted_frame)
+{
+    static uint8_t buf[sizeof(frame)];
+    static char out[CONTENT_SIZE];
+
+    for (size_t i = 0; i < sizeof(frame); ++i) {
+        memcpy(buf, frame, sizeof(frame));
+        buf[i] ^= 0x41;
+
+        if (lz4_frame_decompress(buf, sizeof(buf), out, sizeof(out)) >= 0)
+            __UNIT_FAIL("byte %zu was changed but the frame was decompressed", i);
+    }
+
+    for (size_t len = 0; len < sizeof(frame); ++len) {
+        if (lz4_frame_decompress(frame, len, out, sizeof(out)) >= 0)
+            __UNIT_FAIL("frame was truncated to %zu bytes but it was decompressed", len);
+    }
+}
+
+TEST(lz4, block_prefix)
+{
+    /* a match of 4 bytes 2 bytes back and then one literal */
+    const uint8_t block[] = { 0x00, 0x02, 0x00, 0x10, 'x' };
+    char buf[16] = "ab";
+
+    EXPECT_EQ(lz4_block_decompress(block, sizeof(block), buf + 2, sizeof(buf) - 2, 2), 5);
+    EXPECT(memcmp(buf, "abababx", 7) == 0);
+
+    /* without the prefix the match points before the output */
+    EXPECT_EQ(lz4_block_decompress(block, sizeof(block), buf + 2, sizeof(buf) - 2, 0), -EINVAL);
+    EXPECT_EQ(lz4_block_decompress(block, sizeof(block), buf + 2, 4, 2), -E2BIG);
+}
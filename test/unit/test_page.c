@@ -0,0 +1,99 @@
+#include <mm/page.h>
+#include <mm/types.h>
+#include <errno.h>
+#include <string.h>
+#include "unit.h"
+
+#define NBLOCKS 64
+
+TEST(page, alloc_free_page_array)
+{
+    uint64_t page = mm_page_alloc(MM_ZONE_NORMAL, 0);
+
+    ASSERT(page != INVALID_ADDRESS);
+    EXPECT(page % PAGE_SIZE == 0);
+    EXPECT(page >= MM_ZONE_NORMAL_START && page < MM_ZONE_NORMAL_END);
+    EXPECT_EQ(mm_get_page(page)->type, MM_PT_IN_USE);
+
+    EXPECT_EQ(mm_page_free(page), 0);
+    EXPECT_EQ(mm_get_page(page)->type, MM_PT_FREE);
+}
+
+/* blocks of different orders must not overlap and must be fully usable */
+TEST(page, blocks_disjoint)
+{
+    uint64_t start[NBLOCKS];
+    uint32_t order[NBLOCKS];
+
+    for (int i = 0; i < NBLOCKS; ++i) {
+        order[i] = i % 5;
+        start[i] = mm_block_alloc(MM_ZONE_NORMAL, order[i], 0);
+
+        ASSERT(start[i] != INVALID_ADDRESS);
+        memset(amd64_p_to_v(start[i]), i, PAGE_SIZE << order[i]);
+    }
+
+    for (int i = 0; i < NBLOCKS; ++i) {
+        uint8_t *mem = (uint8_t *)amd64_p_to_v(start[i]);
+
+        for (size_t k = 0; k < (PAGE_SIZE << order[i]); k += 512)
+            EXPECT_EQ(mem[k], (uint8_t)i);
+
+        for (int j = 0; j < i; ++j) {
+            EXPECT(start[i] + (PAGE_SIZE << order[i]) <= start[j] ||
+                   start[j] + (PAGE_SIZE << order[j]) <= start[i]);
+        }
+    }
+
+    for (int i = 0; i < NBLOCKS; ++i)
+        EXPECT_EQ(mm_block_free(start[i], order[i]), 0);
+}
+
+/* freeing pages needs block descriptors, growing their cache must not recurse into
+ * the allocator while only single pages are free */
+TEST(page, free_many_pages)
+{
+    static uint64_t pages[4096];
+
+    for (int i = 0; i < 4096; ++i)
+        ASSERT((pages[i] = mm_page_alloc(MM_ZONE_NORMAL, 0)) != INVALID_ADDRESS);
+
+    for (int i = 0; i < 4096; ++i)
+        EXPECT_EQ(mm_page_free(pages[i]), 0);
+
+    for (int i = 0; i < 4096; ++i)
+        ASSERT(mm_page_alloc(MM_ZONE_NORMAL, 0) != INVALID_ADDRESS);
+}
+
+TEST(page, exhaustion)
+{
+    size_t total = 0;
+    uint64_t block;
+
+    while ((block = mm_block_try_alloc(MM_ZONE_NORMAL, 10, 0)) != INVALID_ADDRESS)
+        total += PAGE_SIZE << 10;
+
+    EXPECT_EQ(errno, ENOMEM);
+    EXPECT(total > 0 && total <= (256UL << 20));
+}
+
+/* the pages cut by the unaligned edges of a range are not freed */
+TEST(page, free_range)
+{
+    uint64_t block = mm_block_alloc(MM_ZONE_NORMAL, 6, 0);
+
+    ASSERT(block != INVALID_ADDRESS);
+
+    /* pages [2, 62) of the 64 */
+    mm_free_range(block + PAGE_SIZE + 100, 61 * PAGE_SIZE);
+
+    EXPECT_EQ(mm_get_page(block + PAGE_SIZE)->type,      MM_PT_IN_USE);
+    EXPECT_EQ(mm_get_page(block + 2 * PAGE_SIZE)->type,  MM_PT_FREE);
+    EXPECT_EQ(mm_get_page(block + 61 * PAGE_SIZE)->type, MM_PT_FREE);
+    EXPECT_EQ(mm_get_page(block + 62 * PAGE_SIZE)->type, MM_PT_IN_USE);
+
+    EXPECT_EQ(mm_page_free(block), 0);
+    EXPECT_EQ(mm_page_free(block + PAGE_SIZE), 0);
+    EXPECT_EQ(mm_page_free(block + 62 * PAGE_SIZE), 0);
+    EXPECT_EQ(mm_page_free(block + 63 * PAGE_SIZE), 0);
+}
@@ -0,0 +1,162 @@
+#include <fs/dentry.h>
+#include <fs/file.h>
+#include <fs/fs.h>
+#include <fs/inode.h>
+#include <fs/pagecache.h>
+#include <mm/types.h>
+#include <errno.h>
+#include <string.h>
+#include "unit.h"
+
+#define NPAGES 64
+
+static int readpages;
+
+/* every byte of a page holds its index so a copy from the wrong page is noticed */
+static int __readpage(file_t *file, uint64_t index, void *page)
+{
+    readpages++;
+    memset(page, (uint8_t)index, PAGE_SIZE);
+    return 0;
+}
+
+static file_t *__file(size_t npages)
+{
+    inode_t *ino;
+    dentry_t *dntr;
+    file_t *file;
+
+    ASSERT((ino = inode_generic_alloc(T_IFREG)) != NULL);
+    ino->i_size = npages * PAGE_SIZE;
+
+    ASSERT((dntr = dentry_alloc_orphan_ino("cached", ino, T_IFREG)) != NULL);
+    ASSERT((file = file_generic_alloc()) != NULL);
+
+    file->f_dentry        = dntr;
+    file->f_ops->readpage = __readpage;
+
+    readpages = 0;
+    return file;
+}
+
+/* read page `index` with file_read(), the offset is relative to the file position */
+static void __read_page(file_t *file, uint64_t index)
+{
+    static uint8_t buf[PAGE_SIZE];
+
+    ASSERT(file_read(file, (off_t)(index * PAGE_SIZE) - file->f_pos, PAGE_SIZE, buf) == PAGE_SIZE);
+    EXPECT_EQ(buf[0], (uint8_t)index);
+    EXPECT_EQ(buf[PAGE_SIZE - 1], (uint8_t)index);
+}
+
+TEST(pagecache, hit_skips_readpage)
+{
+    file_t *file = __file(NPAGES);
+    pagecache_stats_t before, after;
+
+    /* a random read only reads the page it needs */
+    __read_page(file, 10);
+    EXPECT_EQ(readpages, 1);
+
+    pagecache_stats(&before);
+    __read_page(file, 10);
+    pagecache_stats(&after);
+
+    EXPECT_EQ(readpages, 1);
+    EXPECT_EQ(after.hits - before.hits, 1);
+    EXPECT_EQ(after.misses - before.misses, 0);
+}
+
+/* a sequential reader misses once, the rest is read ahead in growing windows */
+TEST(pagecache, sequential_readahead)
+{
+    file_t *file = __file(NPAGES);
+    pagecache_stats_t before, after;
+
+    pagecache_stats(&before);
+
+    for (uint64_t i = 0; i < NPAGES; ++i)
+        __read_page(file, i);
+
+    pagecache_stats(&after);
+
+    EXPECT_EQ(readpages, NPAGES);
+    EXPECT_EQ(after.misses - before.misses, 1);
+    EXPECT_EQ(after.hits - before.hits, NPAGES - 1);
+    EXPECT_EQ(after.ra_pages - before.ra_pages, NPAGES - 1);
+    EXPECT_EQ(after.ra_hits - before.ra_hits, NPAGES - 1);
+    EXPECT_EQ(file->f_ra.size, PAGECACHE_RA_MAX);
+    EXPECT_EQ(file->f_dentry->d_inode->i_mapping.nrpages, NPAGES);
+}
+
+TEST(pagecache, random_no_readahead)
+{
+    file_t *file = __file(NPAGES);
+    pagecache_stats_t before, after;
+    uint64_t pages[] = { 40, 3, 17, 60, 8, 33 };
+
+    pagecache_stats(&before);
+
+    for (size_t i = 0; i < 6; ++i)
+        __read_page(file, pages[i]);
+
+    pagecache_stats(&after);
+
+    EXPECT_EQ(readpages, 6);
+    EXPECT_EQ(after.misses - before.misses, 6);
+    EXPECT_EQ(after.ra_pages - before.ra_pages, 0);
+}
+
+/* reads that span pages and the end of the file */
+TEST(pagecache, unaligned_and_eof)
+{
+    file_t *file = __file(4);
+    uint8_t buf[PAGE_SIZE + 16];
+
+    file->f_dentry->d_inode->i_size -= 100;
+
+    EXPECT_EQ(file_read(file, PAGE_SIZE - 8, PAGE_SIZE + 16, buf), PAGE_SIZE + 16);
+    EXPECT_EQ(buf[7], 0);
+    EXPECT_EQ(buf[8], 1);
+    EXPECT_EQ(buf[PAGE_SIZE + 7], 1);
+    EXPECT_EQ(buf[PAGE_SIZE + 8], 2);
+
+    /* the last page is partial, it's read up to the end of the file */
+    EXPECT_EQ(file_read(file, 3 * PAGE_SIZE - (PAGE_SIZE - 8), PAGE_SIZE - 100, buf), PAGE_SIZE - 100);
+    EXPECT_EQ(buf[PAGE_SIZE - 101], 3);
+    EXPECT_EQ(file_read(file, 0, PAGE_SIZE - 99, buf), -E2BIG);
+    EXPECT_EQ(file_read(file, 0, SIZE_MAX, buf), -E2BIG);
+}
+
+TEST(pagecache, truncate_and_shrink)
+{
+    file_t *file = __file(NPAGES);
+    address_space_t *mapping = &file->f_dentry->d_inode->i_mapping;
+    pagecache_stats_t before, after;
+
+    for (uint64_t i = 0; i < 8; ++i)
+        __read_page(file, i);
+
+    pagecache_stats(&before);
+    EXPECT(mapping->nrpages >= 8);
+
+    /* referenced pages get a second chance, the second scan evicts them */
+    EXPECT_EQ(pagecache_shrink(before.pages), before.pages);
+    pagecache_stats(&after);
+
+    EXPECT_EQ(after.pages, 0);
+    EXPECT_EQ(mapping->nrpages, 0);
+    EXPECT_EQ(after.evictions - before.evictions, before.pages);
+
+    /* evicted pages are read again */
+    readpages = 0;
+    __read_page(file, 5);
+    EXPECT_EQ(readpages, 1);
+
+    pagecache_truncate(mapping);
+    pagecache_stats(&after);
+
+    EXPECT_EQ(after.pages, 0);
+    EXPECT_EQ(mapping->nrpages, 0);
+    EXPECT(radix_lookup(&mapping->pages, 5) == NULL);
+}
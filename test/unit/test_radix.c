@@ -0,0 +1,138 @@
+#include <lib/radix.h>
+#include <errno.h>
+#include "unit.h"
+
+#define NITEMS 4096
+
+static uint64_t __index(uint32_t i)
+{
+    /* spread the indices over several levels */
+    return (uint64_t)i * 2654435761u % (1ull << 30);
+}
+
+TEST(radix, insert_lookup_grow)
+{
+    static uint32_t items[NITEMS];
+    radix_tree_t tree;
+
+    radix_init(&tree);
+    EXPECT(radix_lookup(&tree, 0) == NULL);
+    EXPECT_EQ(radix_insert(&tree, 0, NULL), -EINVAL);
+
+    /* a single small index needs one level */
+    ASSERT(radix_insert(&tree, 5, &items[0]) == 0);
+    EXPECT_EQ(tree.height, 1);
+    EXPECT_EQ(radix_insert(&tree, 5, &items[1]), -EEXIST);
+
+    /* a large index grows the tree and keeps the old items */
+    ASSERT(radix_insert(&tree, 1ull << 20, &items[1]) == 0);
+    EXPECT_EQ(tree.height, 4);
+    EXPECT(radix_lookup(&tree, 5) == &items[0]);
+    EXPECT(radix_lookup(&tree, 1ull << 20) == &items[1]);
+    EXPECT(radix_lookup(&tree, 6) == NULL);
+    EXPECT(radix_lookup(&tree, 1ull << 40) == NULL);
+
+    radix_destroy(&tree, NULL, NULL);
+    EXPECT(tree.root == NULL);
+
+    for (uint32_t i = 0; i < NITEMS; ++i)
+        ASSERT(radix_insert(&tree, __index(i), &items[i]) == 0);
+
+    for (uint32_t i = 0; i < NITEMS; ++i)
+        EXPECT(radix_lookup(&tree, __index(i)) == &items[i]);
+
+    radix_destroy(&tree, NULL, NULL);
+}
+
+/* emptied nodes are freed until the tree is empty again */
+TEST(radix, delete_shrinks)
+{
+    static uint32_t items[NITEMS];
+    radix_tree_t tree;
+
+    radix_init(&tree);
+
+    for (uint32_t i = 0; i < NITEMS; ++i)
+        ASSERT(radix_insert(&tree, __index(i), &items[i]) == 0);
+
+    EXPECT(radix_delete(&tree, __index(NITEMS) + 1) == NULL);
+
+    for (uint32_t i = 0; i < NITEMS; i += 2)
+        EXPECT(radix_delete(&tree, __index(i)) == &items[i]);
+
+    for (uint32_t i = 0; i < NITEMS; ++i)
+        EXPECT(radix_lookup(&tree, __index(i)) == ((i & 1) ? &items[i] : NULL));
+
+    for (uint32_t i = 1; i < NITEMS; i += 2)
+        EXPECT(radix_delete(&tree, __index(i)) == &items[i]);
+
+    EXPECT(tree.root == NULL);
+    EXPECT_EQ(tree.height, 0);
+
+    /* and usable afterwards */
+    ASSERT(radix_insert(&tree, 3, &items[0]) == 0);
+    EXPECT(radix_lookup(&tree, 3) == &items[0]);
+    radix_destroy(&tree, NULL, NULL);
+}
+
+static void __collect(void *item, void *arg)
+{
+    uint64_t **out = arg;
+
+    *(*out)++ = *(uint64_t *)item;
+}
+
+TEST(radix, destroy_in_order)
+{
+    static uint64_t items[] = { 700000, 3, 64, 4095, 63, 1 << 18 };
+    uint64_t seen[6], *out = seen;
+    radix_tree_t tree;
+
+    radix_init(&tree);
+
+    for (size_t i = 0; i < 6; ++i)
+        ASSERT(radix_insert(&tree, items[i], &items[i]) == 0);
+
+    radix_destroy(&tree, __collect, &out);
+
+    EXPECT_EQ(out - seen, 6);
+    for (size_t i = 1; i < 6; ++i)
+        EXPECT(seen[i - 1] < seen[i]);
+
+    EXPECT(tree.root == NULL);
+    EXPECT(radix_lookup(&tree, 3) == NULL);
+}
+
+TEST(radix, next_in_order)
+{
+    static uint64_t items[] = { 3, 63, 64, 4095, 1 << 18, 700000 };
+    radix_tree_t tree;
+    uint64_t index = 0;
+    size_t n = 0;
+    void *item;
+
+    radix_init(&tree);
+    EXPECT(radix_next(&tree, 0, &index) == NULL);
+
+    for (size_t i = 0; i < 6; ++i)
+        ASSERT(radix_insert(&tree, items[i], &items[i]) == 0);
+
+    /* every item is visited once, in index order */
+    while ((item = radix_next(&tree, index, &index))) {
+        ASSERT(n < 6);
+        EXPECT(item == &items[n]);
+        EXPECT_EQ(index, items[n]);
+        index++, n++;
+    }
+
+    EXPECT_EQ(n, 6);
+
+    /* the search starts in the middle of a node and skips empty subtrees */
+    EXPECT(radix_next(&tree, 65, &index) == &items[3]);
+    EXPECT_EQ(index, 4095);
+    EXPECT(radix_next(&tree, 4096, &index) == &items[4]);
+    EXPECT(radix_next(&tree, 700001, &index) == NULL);
+    EXPECT(radix_next(&tree, 1ull << 40, &index) == NULL);
+
+    radix_destroy(&tree, NULL, NULL);
+}
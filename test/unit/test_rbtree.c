@@ -0,0 +1,116 @@
+#include <lib/rbtree.h>
+#include "unit.h"
+
+#define NNODES 2000
+
+typedef struct item {
+    rb_node_t node;
+    int key;
+} item_t;
+
+static item_t items[NNODES];
+
+static void __insert(rb_tree_t *tree, item_t *item)
+{
+    rb_node_t **link = &tree->root, *parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        link   = item->key < container_of(parent, item_t, node)->key ? &parent->left : &parent->right;
+    }
+
+    rb_insert(tree, &item->node, parent, link);
+}
+
+/* return the black height of the subtree or -1 if the red-black properties don't hold */
+static int __check(rb_node_t *node)
+{
+    if (!node)
+        return 1;
+
+    if (node->color == RB_RED &&
+        ((node->left && node->left->color == RB_RED) || (node->right && node->right->color == RB_RED)))
+        return -1;
+
+    int left  = __check(node->left);
+    int right = __check(node->right);
+
+    if (left < 0 || left != right)
+        return -1;
+
+    return left + (node->color == RB_BLACK);
+}
+
+static size_t __count_sorted(rb_tree_t *tree)
+{
+    size_t n = 0;
+    int prev = -1;
+
+    for (rb_node_t *n_ = rb_first(tree); n_; n_ = rb_next(n_), ++n) {
+        int key = container_of(n_, item_t, node)->key;
+
+        EXPECT(key >= prev);
+        prev = key;
+    }
+
+    return n;
+}
+
+TEST(rbtree, insert_remove_balanced)
+{
+    rb_tree_t tree;
+    uint32_t seed = 1;
+
+    rb_init(&tree, NULL);
+
+    for (int i = 0; i < NNODES; ++i) {
+        seed = seed * 1103515245 + 12345;
+        items[i].key = (seed >> 8) % 100000;
+        __insert(&tree, &items[i]);
+    }
+
+    EXPECT(__check(tree.root) > 0);
+    EXPECT_EQ(__count_sorted(&tree), NNODES);
+
+    for (int i = 0; i < NNODES; i += 2)
+        rb_remove(&tree, &items[i].node);
+
+    EXPECT(__check(tree.root) > 0);
+    EXPECT_EQ(__count_sorted(&tree), NNODES / 2);
+
+    for (int i = 1; i < NNODES; i += 2)
+        rb_remove(&tree, &items[i].node);
+
+    EXPECT(tree.root == NULL);
+}
+
+static int __cmp(const void *key, const rb_node_t *node)
+{
+    int k = *(const int *)key, n = container_of(node, item_t, node)->key;
+
+    return (k > n) - (k < n);
+}
+
+TEST(rbtree, find_lower_bound)
+{
+    rb_tree_t tree;
+    int key;
+
+    rb_init(&tree, NULL);
+
+    /* keys 0, 10, ..., 990 */
+    for (int i = 0; i < 100; ++i) {
+        items[i].key = i * 10;
+        __insert(&tree, &items[i]);
+    }
+
+    key = 500;
+    EXPECT(rb_find(&tree, &key, __cmp) == &items[50].node);
+    key = 505;
+    EXPECT(rb_find(&tree, &key, __cmp) == NULL);
+    EXPECT(rb_lower_bound(&tree, &key, __cmp) == &items[51].node);
+    key = -5;
+    EXPECT(rb_lower_bound(&tree, &key, __cmp) == &items[0].node);
+    key = 991;
+    EXPECT(rb_lower_bound(&tree, &key, __cmp) == NULL);
+}
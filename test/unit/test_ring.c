@@ -0,0 +1,159 @@
+#include <lib/ring.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include "unit.h"
+
+#define NPRODUCERS 4
+#define NRECORDS   (1 << 16)
+
+TEST(ring, init_rejects_bad_count)
+{
+    uint8_t mem[64];
+    ring_t ring;
+
+    EXPECT_EQ(ring_init(&ring, mem, 48, 1, RING_SPSC), -EINVAL);
+    EXPECT_EQ(ring_init(&ring, mem, 0,  1, RING_SPSC), -EINVAL);
+    EXPECT_EQ(ring_init(&ring, mem, 64, 1, RING_SPSC), 0);
+    EXPECT_EQ(ring_capacity(&ring), 64);
+    EXPECT(ring_empty(&ring));
+}
+
+/* burst and bulk operations across the wrap point */
+TEST(ring, bytes_wrap)
+{
+    ring_t *ring = ring_alloc(16, 1, RING_SPSC);
+    uint8_t in[32], out[32];
+
+    ASSERT(ring != NULL);
+
+    for (int i = 0; i < 32; ++i)
+        in[i] = i;
+
+    EXPECT_EQ(ring_enqueue(ring, in, 10), 10);
+    EXPECT_EQ(ring_dequeue(ring, out, 10), 10);
+
+    /* only 16 fit, bulk is all or nothing */
+    EXPECT_EQ(ring_enqueue_bulk(ring, in, 17), 0);
+    EXPECT_EQ(ring_enqueue(ring, in, 32), 16);
+    EXPECT_EQ(ring_free_count(ring), 0);
+    EXPECT_EQ(ring_enqueue(ring, in, 1), 0);
+
+    EXPECT_EQ(ring_dequeue_bulk(ring, out, 17), 0);
+    EXPECT_EQ(ring_dequeue(ring, out, 32), 16);
+
+    for (int i = 0; i < 16; ++i)
+        EXPECT_EQ(out[i], i);
+
+    EXPECT(ring_empty(ring));
+    ring_free(ring);
+}
+
+TEST(ring, reserve_commit_peek_release)
+{
+    ring_t *ring = ring_alloc(8, sizeof(uint64_t), RING_MPSC);
+    uint64_t *ptr, val;
+
+    ASSERT(ring != NULL);
+
+    /* advance the positions so the reservation hits the end of the storage */
+    for (uint64_t i = 0; i < 6; ++i)
+        EXPECT_EQ(ring_enqueue(ring, &i, 1), 1);
+    EXPECT_EQ(ring_dequeue(ring, &val, 1), 1);
+    EXPECT_EQ(ring_dequeue(ring, &val, 1), 1);
+    EXPECT_EQ(ring_dequeue(ring, &val, 1), 1);
+    EXPECT_EQ(ring_dequeue(ring, &val, 1), 1);
+    EXPECT_EQ(ring_dequeue(ring, &val, 1), 1);
+    EXPECT_EQ(ring_dequeue(ring, &val, 1), 1);
+
+    /* slots 6 and 7 are contiguous, the rest wraps */
+    EXPECT_EQ(ring_reserve(ring, 5, (void **)&ptr), 2);
+    ptr[0] = 100;
+    ptr[1] = 101;
+
+    /* nothing is visible before the commit */
+    EXPECT_EQ(ring_peek(ring, 8, (void **)&ptr), 0);
+
+    void *first = ptr;
+    EXPECT_EQ(ring_reserve(ring, 3, (void **)&ptr), 3);
+    ptr[0] = 102;
+    ptr[1] = 103;
+    ptr[2] = 104;
+
+    ring_commit(ring, first, 2);
+    ring_commit(ring, ptr, 3);
+
+    EXPECT_EQ(ring_count(ring), 5);
+    EXPECT_EQ(ring_peek(ring, 8, (void **)&ptr), 2);
+    EXPECT_EQ(ptr[0], 100);
+    EXPECT_EQ(ptr[1], 101);
+    ring_release(ring, 2);
+
+    EXPECT_EQ(ring_peek(ring, 8, (void **)&ptr), 3);
+    EXPECT_EQ(ptr[2], 104);
+    ring_release(ring, 3);
+
+    EXPECT(ring_empty(ring));
+    ring_free(ring);
+}
+
+static void *__producer(void *arg)
+{
+    ring_t *ring = arg;
+    static uint32_t id;
+    uint32_t self = __atomic_fetch_add(&id, 1, __ATOMIC_RELAXED);
+
+    for (uint32_t seq = 0; seq < NRECORDS; ) {
+        uint64_t rec[2] = {
+            ((uint64_t)self << 32) | seq,
+            ((uint64_t)self << 32) | (seq + 1),
+        };
+
+        uint32_t n = ring_enqueue(ring, rec, 2);
+
+        /* the host may have a single CPU, let the consumer run */
+        if (!n)
+            sched_yield();
+
+        seq += n;
+    }
+
+    return NULL;
+}
+
+/* every producer's records arrive exactly once and in order */
+TEST(ring, mpsc_threads)
+{
+    ring_t *ring = ring_alloc(64, sizeof(uint64_t), RING_MPSC);
+    uint32_t next[NPRODUCERS] = { 0 };
+    pthread_t threads[NPRODUCERS];
+    uint64_t recs[16];
+
+    ASSERT(ring != NULL);
+
+    for (int i = 0; i < NPRODUCERS; ++i)
+        ASSERT(pthread_create(&threads[i], NULL, __producer, ring) == 0);
+
+    for (uint32_t total = 0; total < NPRODUCERS * NRECORDS; ) {
+        uint32_t n = ring_dequeue(ring, recs, 16);
+
+        if (!n)
+            sched_yield();
+
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t self = recs[i] >> 32;
+
+            ASSERT(self < NPRODUCERS);
+            ASSERT((uint32_t)recs[i] == next[self]);
+            next[self]++;
+        }
+
+        total += n;
+    }
+
+    for (int i = 0; i < NPRODUCERS; ++i)
+        pthread_join(threads[i], NULL);
+
+    EXPECT(ring_empty(ring));
+    ring_free(ring);
+}
@@ -0,0 +1,134 @@
+#include <arch/amd64/mmu.h>
+#include <mm/page.h>
+#include <mm/slab.h>
+#include <mm/types.h>
+#include <stdint.h>
+#include <string.h>
+#include "unit.h"
+
+#define NENTRIES 1000
+
+TEST(slab, alloc_zeroed_distinct)
+{
+    mm_cache_t *cache = mm_cache_create(48);
+    uint8_t *entries[NENTRIES];
+
+    ASSERT(cache != NULL);
+
+    for (int i = 0; i < NENTRIES; ++i) {
+        ASSERT((entries[i] = mm_cache_alloc_entry(cache)) != NULL);
+
+        for (int k = 0; k < 48; ++k)
+            EXPECT_EQ(entries[i][k], 0);
+
+        memset(entries[i], i, 48);
+    }
+
+    for (int i = 0; i < NENTRIES; ++i) {
+        for (int k = 0; k < 48; ++k)
+            EXPECT_EQ(entries[i][k], (uint8_t)i);
+    }
+}
+
+TEST(slab, free_reuses)
+{
+    mm_cache_t *cache = mm_cache_create(64);
+    void *first;
+
+    ASSERT(cache != NULL);
+    ASSERT((first = mm_cache_alloc_entry(cache)) != NULL);
+
+    EXPECT_EQ(mm_cache_free_entry(cache, first), 0);
+    EXPECT(mm_cache_alloc_entry(cache) == first);
+}
+
+/* freed entries are reused last freed first and zeroed like new ones */
+TEST(slab, reuse_zeroed)
+{
+    mm_cache_t *cache = mm_cache_create(24);
+    uint8_t *a, *b;
+
+    ASSERT(cache != NULL);
+    ASSERT((a = mm_cache_alloc_entry(cache)) != NULL);
+    ASSERT((b = mm_cache_alloc_entry(cache)) != NULL);
+
+    memset(a, 0xff, 24);
+    memset(b, 0xff, 24);
+
+    EXPECT_EQ(mm_cache_free_entry(cache, a), 0);
+    EXPECT_EQ(mm_cache_free_entry(cache, b), 0);
+
+    EXPECT(mm_cache_alloc_entry(cache) == b);
+    EXPECT(mm_cache_alloc_entry(cache) == a);
+
+    for (int i = 0; i < 24; ++i) {
+        EXPECT_EQ(a[i], 0);
+        EXPECT_EQ(b[i], 0);
+    }
+}
+
+/* a cache that grows past its first pages must not write over memory it doesn't own,
+ * pages are handed out top down so a page allocated before the cache is overrun first */
+TEST(slab, grow_stays_in_pages)
+{
+    uint8_t *sentinel, *entry;
+    mm_cache_t *cache;
+    uint64_t block;
+
+    ASSERT((block = mm_block_try_alloc(MM_ZONE_NORMAL, 0, 0)) != INVALID_ADDRESS);
+
+    sentinel = (uint8_t *)amd64_p_to_v(block);
+    memset(sentinel, 0xa5, PAGE_SIZE);
+
+    ASSERT((cache = mm_cache_create(64)) != NULL);
+
+    for (int i = 0; i < NENTRIES; ++i) {
+        ASSERT((entry = mm_cache_alloc_entry(cache)) != NULL);
+        memset(entry, 0, 64);
+    }
+
+    for (int i = 0; i < PAGE_SIZE; ++i)
+        ASSERT(sentinel[i] == 0xa5);
+}
+
+/* a page whose entries have all been freed goes back to the page allocator,
+ * the page new entries are carved from is kept */
+TEST(slab, empty_pages_released)
+{
+    size_t per_page = PAGE_SIZE / 64;
+    uint8_t *entries[3 * (PAGE_SIZE / 64)];
+    mm_cache_t *cache;
+
+    ASSERT((cache = mm_cache_create(64)) != NULL);
+
+    for (size_t i = 0; i < 3 * per_page; ++i)
+        ASSERT((entries[i] = mm_cache_alloc_entry(cache)) != NULL);
+
+    EXPECT_EQ(mm_cache_pages(cache), 3);
+
+    /* one entry left on the first page keeps it */
+    for (size_t i = 1; i < per_page; ++i)
+        EXPECT_EQ(mm_cache_free_entry(cache, entries[i]), 0);
+
+    EXPECT_EQ(mm_cache_pages(cache), 3);
+
+    for (size_t i = per_page; i < 2 * per_page; ++i)
+        EXPECT_EQ(mm_cache_free_entry(cache, entries[i]), 0);
+
+    EXPECT_EQ(mm_cache_pages(cache), 2);
+
+    /* freed entries are used before a new page is allocated */
+    for (size_t i = 1; i < per_page; ++i)
+        ASSERT((entries[i] = mm_cache_alloc_entry(cache)) != NULL);
+
+    EXPECT_EQ(mm_cache_pages(cache), 2);
+
+    for (size_t i = 0; i < per_page; ++i)
+        EXPECT_EQ(mm_cache_free_entry(cache, entries[i]), 0);
+
+    for (size_t i = 2 * per_page; i < 3 * per_page; ++i)
+        EXPECT_EQ(mm_cache_free_entry(cache, entries[i]), 0);
+
+    EXPECT_EQ(mm_cache_pages(cache), 0);
+    EXPECT_EQ(mm_cache_destroy(cache), 0);
+}
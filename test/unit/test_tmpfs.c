@@ -0,0 +1,334 @@
+#include <arch/amd64/mmu.h>
+#include <fs/dentry.h>
+#include <fs/file.h>
+#include <fs/fs.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "unit.h"
+
+/* vfs_init() mounts tmpfs on /tmp, every test works in a directory of its own */
+
+static file_t *__open(const char *path, int mode)
+{
+    path_t p;
+    file_t *file;
+
+    if (vfs_path_walk(path, LOOKUP_OPEN, &p) < 0)
+        return NULL;
+
+    file = file_open(p.p_dentry, mode);
+    vfs_path_put(&p);
+
+    return file;
+}
+
+static int __size(const char *path)
+{
+    path_t p;
+    int size;
+
+    if (vfs_path_walk(path, LOOKUP_OPEN, &p) < 0)
+        return -1;
+
+    size = p.p_dentry->d_inode->i_size;
+    vfs_path_put(&p);
+
+    return size;
+}
+
+static bool __exists(const char *path)
+{
+    path_t p;
+
+    if (vfs_path_walk(path, LOOKUP_OPEN, &p) < 0)
+        return false;
+
+    vfs_path_put(&p);
+    return true;
+}
+
+TEST(tmpfs, mounted)
+{
+    path_t p;
+
+    ASSERT(vfs_path_walk("/tmp", LOOKUP_OPEN, &p) == 0);
+    EXPECT(p.p_dentry->d_flags & T_IFDIR);
+    EXPECT(p.p_dentry->d_inode->i_iops->create != NULL);
+    vfs_path_put(&p);
+}
+
+TEST(tmpfs, create_write_read)
+{
+    static char data[3 * PAGE_SIZE + 100], buf[sizeof(data)];
+    file_t *file;
+
+    for (size_t i = 0; i < sizeof(data); ++i)
+        data[i] = i * 7;
+
+    ASSERT(vfs_mkdir("/tmp/rw", 0) == 0);
+    ASSERT(vfs_create("/tmp/rw/file", 0) == 0);
+    EXPECT_EQ(vfs_create("/tmp/rw/file", 0), -EEXIST);
+    EXPECT_EQ(vfs_create("/tmp/missing/file", 0), -ENOENT);
+    EXPECT_EQ(__size("/tmp/rw/file"), 0);
+
+    ASSERT((file = __open("/tmp/rw/file", O_RDWR)) != NULL);
+
+    /* a write across page boundaries, then one in the middle of it */
+    EXPECT_EQ(file_write(file, 0, sizeof(data), data), (ssize_t)sizeof(data));
+    EXPECT_EQ(__size("/tmp/rw/file"), (int)sizeof(data));
+    EXPECT_EQ(file_write(file, PAGE_SIZE - 2, 4, "abcd"), 4);
+    memcpy(data + PAGE_SIZE - 2, "abcd", 4);
+
+    EXPECT_EQ(file_read(file, -file->f_pos, sizeof(buf), buf), (ssize_t)sizeof(buf));
+    EXPECT(memcmp(buf, data, sizeof(data)) == 0);
+
+    /* reading past the end fails like it does on initramfs */
+    EXPECT_EQ(file_read(file, sizeof(data) - 10, 11, buf), -E2BIG);
+
+    file_close(file);
+
+    /* a file opened for reading can't be written */
+    ASSERT((file = __open("/tmp/rw/file", O_RDONLY)) != NULL);
+    EXPECT_EQ(file_write(file, 0, 4, "abcd"), -EINVAL);
+    file_close(file);
+
+    /* the data is kept after the file is closed */
+    ASSERT((file = __open("/tmp/rw/file", O_RDONLY)) != NULL);
+    EXPECT_EQ(file_read(file, 0, sizeof(buf), buf), (ssize_t)sizeof(buf));
+    EXPECT(memcmp(buf, data, sizeof(data)) == 0);
+    file_close(file);
+
+    /* O_TRUNC empties the file */
+    ASSERT((file = __open("/tmp/rw/file", O_WRONLY | O_TRUNC)) != NULL);
+    EXPECT_EQ(__size("/tmp/rw/file"), 0);
+    file_close(file);
+}
+
+TEST(tmpfs, append)
+{
+    char buf[8] = { 0 };
+    file_t *file;
+
+    ASSERT(vfs_create("/tmp/append", 0) == 0);
+    ASSERT((file = __open("/tmp/append", O_WRONLY | O_APPEND)) != NULL);
+
+    EXPECT_EQ(file_write(file, 0, 3, "abc"), 3);
+    EXPECT_EQ(file_write(file, -file->f_pos, 3, "def"), 3);
+    EXPECT_EQ(__size("/tmp/append"), 6);
+    EXPECT_EQ(file_read(file, -file->f_pos, 6, buf), 6);
+    EXPECT(strcmp(buf, "abcdef") == 0);
+
+    file_close(file);
+    EXPECT_EQ(vfs_unlink("/tmp/append"), 0);
+}
+
+/* a write past the end leaves a hole that reads as zeros */
+TEST(tmpfs, sparse)
+{
+    static char buf[4 * PAGE_SIZE];
+    file_t *file;
+
+    ASSERT(vfs_create("/tmp/sparse", 0) == 0);
+    ASSERT((file = __open("/tmp/sparse", O_RDWR)) != NULL);
+
+    EXPECT_EQ(file_write(file, 10 * PAGE_SIZE, 5, "hello"), 5);
+    EXPECT_EQ(__size("/tmp/sparse"), 10 * PAGE_SIZE + 5);
+
+    memset(buf, 0xff, sizeof(buf));
+    EXPECT_EQ(file_read(file, -file->f_pos, sizeof(buf), buf), (ssize_t)sizeof(buf));
+
+    for (size_t i = 0; i < sizeof(buf); ++i)
+        ASSERT(buf[i] == 0);
+
+    EXPECT_EQ(file_read(file, 10 * PAGE_SIZE - file->f_pos, 5, buf), 5);
+    EXPECT(memcmp(buf, "hello", 5) == 0);
+
+    file_close(file);
+}
+
+TEST(tmpfs, truncate)
+{
+    static char data[2 * PAGE_SIZE], buf[2 * PAGE_SIZE];
+    file_t *file;
+
+    memset(data, 'x', sizeof(data));
+
+    ASSERT(vfs_create("/tmp/trunc", 0) == 0);
+    ASSERT((file = __open("/tmp/trunc", O_RDWR)) != NULL);
+    EXPECT_EQ(file_write(file, 0, sizeof(data), data), (ssize_t)sizeof(data));
+
+    /* shrink into the middle of the first page and grow back */
+    EXPECT_EQ(vfs_truncate("/tmp/trunc", 100), 0);
+    EXPECT_EQ(__size("/tmp/trunc"), 100);
+    EXPECT_EQ(file_read(file, -file->f_pos, 101, buf), -E2BIG);
+
+    EXPECT_EQ(vfs_truncate("/tmp/trunc", sizeof(buf)), 0);
+    EXPECT_EQ(file_read(file, -file->f_pos, sizeof(buf), buf), (ssize_t)sizeof(buf));
+
+    for (size_t i = 0; i < sizeof(buf); ++i)
+        ASSERT(buf[i] == (i < 100 ? 'x' : 0));
+
+    EXPECT_EQ(vfs_truncate("/tmp/trunc", -1), -EINVAL);
+    EXPECT_EQ(vfs_truncate("/tmp", 0), -EISDIR);
+
+    file_close(file);
+}
+
+TEST(tmpfs, mkdir_rmdir)
+{
+    ASSERT(vfs_mkdir("/tmp/dir", 0) == 0);
+    ASSERT(vfs_mkdir("/tmp/dir/sub", 0) == 0);
+    ASSERT(vfs_create("/tmp/dir/sub/file", 0) == 0);
+    EXPECT_EQ(vfs_mkdir("/tmp/dir", 0), -EEXIST);
+
+    /* a lookup of a missing name leaves a negative dentry below the directory */
+    EXPECT(!__exists("/tmp/dir/sub/missing"));
+
+    EXPECT_EQ(vfs_rmdir("/tmp/dir"), -ENOTEMPTY);
+    EXPECT_EQ(vfs_rmdir("/tmp/dir/sub/file"), -ENOTDIR);
+    EXPECT_EQ(vfs_unlink("/tmp/dir/sub"), -EISDIR);
+
+    EXPECT_EQ(vfs_unlink("/tmp/dir/sub/file"), 0);
+    EXPECT(!__exists("/tmp/dir/sub/file"));
+    EXPECT_EQ(vfs_rmdir("/tmp/dir/sub"), 0);
+    EXPECT_EQ(vfs_rmdir("/tmp/dir"), 0);
+    EXPECT(!__exists("/tmp/dir"));
+
+    /* the root of the file system can't be removed */
+    EXPECT_EQ(vfs_rmdir("/tmp"), -EBUSY);
+
+    /* the name can be used again */
+    EXPECT_EQ(vfs_mkdir("/tmp/dir", 0), 0);
+    EXPECT_EQ(vfs_rmdir("/tmp/dir"), 0);
+}
+
+TEST(tmpfs, unlink_open_file)
+{
+    file_t *file;
+    int count;
+
+    ASSERT(vfs_create("/tmp/open", 0) == 0);
+    ASSERT((file = __open("/tmp/open", O_RDWR)) != NULL);
+    count = file->f_dentry->d_count;
+
+    /* a failed unlink drops the reference the walk took */
+    EXPECT_EQ(vfs_unlink("/tmp/open"), -EBUSY);
+    EXPECT_EQ(file->f_dentry->d_count, count);
+    file_close(file);
+
+    EXPECT_EQ(vfs_unlink("/tmp/open"), 0);
+    EXPECT_EQ(vfs_unlink("/tmp/open"), -ENOENT);
+}
+
+TEST(tmpfs, rename_file)
+{
+    char buf[8] = { 0 };
+    file_t *file;
+
+    ASSERT(vfs_mkdir("/tmp/mv", 0) == 0);
+    ASSERT(vfs_mkdir("/tmp/mv/a", 0) == 0);
+    ASSERT(vfs_create("/tmp/mv/file", 0) == 0);
+    ASSERT((file = __open("/tmp/mv/file", O_WRONLY)) != NULL);
+    EXPECT_EQ(file_write(file, 0, 4, "data"), 4);
+    file_close(file);
+
+    /* the new name is looked up once before it exists */
+    EXPECT(!__exists("/tmp/mv/a/moved"));
+
+    EXPECT_EQ(vfs_rename("/tmp/mv/file", "/tmp/mv/a/moved"), 0);
+    EXPECT(!__exists("/tmp/mv/file"));
+
+    ASSERT((file = __open("/tmp/mv/a/moved", O_RDONLY)) != NULL);
+    EXPECT_EQ(file_read(file, 0, 4, buf), 4);
+    EXPECT(strcmp(buf, "data") == 0);
+    file_close(file);
+
+    /* an existing file is replaced */
+    ASSERT(vfs_create("/tmp/mv/other", 0) == 0);
+    EXPECT_EQ(vfs_rename("/tmp/mv/other", "/tmp/mv/a/moved"), 0);
+    EXPECT_EQ(__size("/tmp/mv/a/moved"), 0);
+    EXPECT(!__exists("/tmp/mv/other"));
+
+    EXPECT_EQ(vfs_rename("/tmp/mv/a/moved", "/tmp/mv/a"), -EISDIR);
+    EXPECT_EQ(vfs_rename("/tmp/mv/a/moved", "/etc/moved"), -EXDEV);
+    EXPECT_EQ(vfs_rename("/tmp/mv/missing", "/tmp/mv/new"), -ENOENT);
+}
+
+/* a rename that fails leaves both the file and the one it would replace as they were */
+TEST(tmpfs, rename_over_busy)
+{
+    char buf[8] = { 0 };
+    file_t *src, *dst;
+    int count;
+
+    ASSERT(vfs_mkdir("/tmp/busy", 0) == 0);
+    ASSERT(vfs_create("/tmp/busy/src", 0) == 0);
+    ASSERT(vfs_create("/tmp/busy/dst", 0) == 0);
+    ASSERT((src = __open("/tmp/busy/src", O_WRONLY)) != NULL);
+    ASSERT((dst = __open("/tmp/busy/dst", O_RDWR)) != NULL);
+    EXPECT_EQ(file_write(src, 0, 3, "src"), 3);
+    EXPECT_EQ(file_write(dst, 0, 6, "target"), 6);
+    file_close(src);
+    count = dst->f_dentry->d_count;
+
+    /* the target is open */
+    EXPECT_EQ(vfs_rename("/tmp/busy/src", "/tmp/busy/dst"), -EBUSY);
+    EXPECT_EQ(dst->f_dentry->d_count, count);
+    EXPECT_EQ(__size("/tmp/busy/src"), 3);
+    EXPECT_EQ(__size("/tmp/busy/dst"), 6);
+    EXPECT_EQ(file_read(dst, -dst->f_pos, 6, buf), 6);
+    EXPECT(strcmp(buf, "target") == 0);
+    file_close(dst);
+
+    /* and can be replaced once it's closed */
+    EXPECT_EQ(vfs_rename("/tmp/busy/src", "/tmp/busy/dst"), 0);
+    EXPECT(!__exists("/tmp/busy/src"));
+    EXPECT_EQ(__size("/tmp/busy/dst"), 3);
+
+    /* renaming a file to itself keeps no reference that would keep it busy */
+    EXPECT_EQ(vfs_rename("/tmp/busy/dst", "/tmp/busy/dst"), 0);
+    EXPECT_EQ(vfs_unlink("/tmp/busy/dst"), 0);
+}
+
+TEST(tmpfs, rename_dir)
+{
+    path_t p;
+
+    ASSERT(vfs_mkdir("/tmp/src", 0) == 0);
+    ASSERT(vfs_mkdir("/tmp/src/sub", 0) == 0);
+    ASSERT(vfs_create("/tmp/src/sub/file", 0) == 0);
+    ASSERT(vfs_mkdir("/tmp/dst", 0) == 0);
+
+    EXPECT_EQ(vfs_rename("/tmp/src", "/tmp/src/sub/below"), -EINVAL);
+
+    /* the children move with the directory and ".." follows it */
+    EXPECT_EQ(vfs_rename("/tmp/src/sub", "/tmp/dst/sub"), 0);
+    EXPECT(__exists("/tmp/dst/sub/file"));
+    EXPECT(!__exists("/tmp/src/sub/file"));
+    EXPECT(!__exists("/tmp/src/sub"));
+
+    ASSERT(vfs_path_walk("/tmp/dst/sub", LOOKUP_OPEN, &p) == 0);
+    EXPECT(((dentry_t *)hm_get(p.p_dentry->d_children, ".."))->d_parent == p.p_dentry->d_parent);
+    EXPECT(strcmp(p.p_dentry->d_parent->d_name, "dst") == 0);
+    vfs_path_put(&p);
+
+    /* an empty directory can be replaced, a full one can't */
+    EXPECT_EQ(vfs_rename("/tmp/dst", "/tmp/src"), 0);
+    EXPECT_EQ(vfs_mkdir("/tmp/dst", 0), 0);
+    EXPECT_EQ(vfs_rename("/tmp/dst", "/tmp/src"), -ENOTEMPTY);
+    EXPECT_EQ(vfs_rename("/tmp/src/sub/file", "/tmp/dst"), -EISDIR);
+}
+
+TEST(tmpfs, mount_another)
+{
+    ASSERT(vfs_mkdir("/tmp/mnt", 0) == 0);
+    ASSERT(vfs_mount(NULL, "/tmp/mnt", "tmpfs", 0) == 0);
+
+    /* a new instance is empty and separate from /tmp */
+    EXPECT_EQ(vfs_create("/tmp/mnt/file", 0), 0);
+    EXPECT(__exists("/tmp/mnt/file"));
+    EXPECT_EQ(vfs_rename("/tmp/mnt/file", "/tmp/file"), -EXDEV);
+    EXPECT_EQ(vfs_rmdir("/tmp/mnt"), -EBUSY);
+}
@@ -0,0 +1,75 @@
+#include <kernel/util.h>
+#include <stdint.h>
+#include <string.h>
+#include "unit.h"
+
+static int __sign(int v)
+{
+    return (v > 0) - (v < 0);
+}
+
+TEST(util, kmemmove_overlap)
+{
+    uint8_t buf[512], ref[512];
+
+    for (size_t size = 0; size < 200; size += 7) {
+        for (int shift = -20; shift <= 20; ++shift) {
+            for (size_t i = 0; i < sizeof(buf); ++i)
+                buf[i] = ref[i] = i * 31;
+
+            kmemmove(buf + 100 + shift, buf + 100, size);
+            memmove(ref + 100 + shift, ref + 100, size);
+
+            EXPECT(memcmp(buf, ref, sizeof(buf)) == 0);
+        }
+    }
+}
+
+TEST(util, kmemcpy_kmemset)
+{
+    uint8_t src[300], dst[300], ref[300];
+
+    for (size_t i = 0; i < sizeof(src); ++i)
+        src[i] = i ^ 0x5a;
+
+    for (size_t off = 0; off < 8; ++off) {
+        for (size_t size = 0; size < 280; size += 13) {
+            memset(dst, 0, sizeof(dst));
+            memset(ref, 0, sizeof(ref));
+
+            kmemcpy(dst + off, src + 7, size);
+            memcpy(ref + off, src + 7, size);
+            EXPECT(memcmp(dst, ref, sizeof(dst)) == 0);
+
+            kmemset(dst + off, 0xa5, size);
+            memset(ref + off, 0xa5, size);
+            EXPECT(memcmp(dst, ref, sizeof(dst)) == 0);
+        }
+    }
+}
+
+TEST(util, strings)
+{
+    char a[64], b[64];
+
+    for (size_t off = 0; off < 8; ++off) {
+        for (size_t len = 0; len < 40; ++len) {
+            memset(a, 'x', sizeof(a));
+            a[off + len] = '\0';
+
+            EXPECT_EQ(kstrlen(a + off), len);
+
+            memcpy(b, a, sizeof(a));
+            EXPECT_EQ(kstrcmp(a + off, b + off), 0);
+
+            if (len) {
+                b[off + len - 1] = 'y';
+                EXPECT(kstrcmp(a + off, b + off) < 0);
+                EXPECT_EQ(__sign(kmemcmp(a + off, b + off, len)), -1);
+            }
+
+            /* differently aligned strings are compared a byte at a time */
+            EXPECT_EQ(__sign(kstrcmp(a + off, b + 1)), __sign(strcmp(a + off, b + 1)));
+        }
+    }
+}
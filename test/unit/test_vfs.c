@@ -0,0 +1,173 @@
+#include <fs/dentry.h>
+#include <fs/devfs.h>
+#include <fs/file.h>
+#include <fs/fs.h>
+#include <fs/super.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "unit.h"
+
+/* the initramfs image is built from unit/fixtures, see test/Makefile */
+
+TEST(vfs, lookup_and_read)
+{
+    path_t *path = vfs_path_lookup("/etc/hello", LOOKUP_OPEN);
+    char buf[32] = { 0 };
+    file_t *file;
+
+    ASSERT(path->p_dentry != NULL);
+    EXPECT_EQ(path->p_status, LOOKUP_STAT_SUCCESS);
+
+    ASSERT((file = file_open(path->p_dentry, O_RDONLY)) != NULL);
+    EXPECT_EQ(file_read(file, 0, 13, buf), 13);
+    EXPECT(strcmp(buf, "hello, world\n") == 0);
+
+    file_close(file);
+}
+
+TEST(vfs, lookup_missing)
+{
+    path_t *path = vfs_path_lookup("/etc/missing", LOOKUP_OPEN);
+
+    EXPECT(path->p_dentry == NULL);
+    EXPECT_EQ(path->p_status, LOOKUP_STAT_ENOENT);
+}
+
+TEST(vfs, lookup_cached)
+{
+    path_t *p1 = vfs_path_lookup("/etc/hello", LOOKUP_OPEN);
+    path_t *p2 = vfs_path_lookup("/etc/hello", LOOKUP_OPEN);
+
+    ASSERT(p1->p_dentry != NULL);
+    EXPECT(p1->p_dentry == p2->p_dentry);
+}
+
+TEST(vfs, lookup_deep_path)
+{
+    path_t *path = vfs_path_lookup("/usr/share/doc/smough/hello", LOOKUP_OPEN);
+    char buf[32] = { 0 };
+    file_t *file;
+
+    ASSERT(path->p_dentry != NULL);
+    EXPECT(path->p_dentry->d_parent->d_inode->i_flags & T_IFDIR);
+
+    ASSERT((file = file_open(path->p_dentry, O_RDONLY)) != NULL);
+    EXPECT_EQ(file_read(file, 0, 13, buf), 13);
+    EXPECT(strcmp(buf, "hello, world\n") == 0);
+
+    file_close(file);
+
+    EXPECT(vfs_path_lookup("/usr/share/doc/hello", LOOKUP_OPEN)->p_dentry == NULL);
+}
+
+/* every name of a directory with many entries is found, names next to them are not */
+TEST(vfs, lookup_large_dir)
+{
+    char name[32];
+
+    for (int i = 1; i <= 200; ++i) {
+        snprintf(name, sizeof(name), "/many/file%d", i);
+        ASSERT(vfs_path_lookup(name, LOOKUP_OPEN)->p_dentry != NULL);
+    }
+
+    EXPECT(vfs_path_lookup("/many/file0",   LOOKUP_OPEN)->p_dentry == NULL);
+    EXPECT(vfs_path_lookup("/many/file201", LOOKUP_OPEN)->p_dentry == NULL);
+    EXPECT(vfs_path_lookup("/many/file1x",  LOOKUP_OPEN)->p_dentry == NULL);
+    EXPECT(vfs_path_lookup("/many/file",    LOOKUP_OPEN)->p_dentry == NULL);
+}
+
+TEST(vfs, devfs_mounted)
+{
+    path_t *path = vfs_path_lookup("/dev", LOOKUP_OPEN);
+
+    ASSERT(path->p_dentry != NULL);
+    EXPECT(path->p_dentry->d_flags & T_IFDIR);
+}
+
+TEST(vfs, register_fs_twice)
+{
+    fs_type_t fs = { .fs_name = "devfs", .get_sb = devfs_get_sb, .kill_sb = devfs_kill_sb };
+
+    EXPECT_EQ(vfs_register_fs(&fs), -EEXIST);
+}
+
+/* repeated and trailing slashes don't add components */
+TEST(vfs, walk_normalizes_slashes)
+{
+    path_t p1, p2;
+
+    ASSERT(vfs_path_walk("/etc/hello", LOOKUP_OPEN, &p1) == 0);
+    ASSERT(vfs_path_walk("//etc///hello/", LOOKUP_OPEN, &p2) == 0);
+    EXPECT(p1.p_dentry == p2.p_dentry);
+    EXPECT_EQ(p2.p_status, LOOKUP_STAT_SUCCESS);
+
+    vfs_path_put(&p1);
+    vfs_path_put(&p2);
+    EXPECT(p1.p_dentry == NULL);
+}
+
+TEST(vfs, walk_parent_and_errors)
+{
+    path_t path, etc;
+
+    ASSERT(vfs_path_walk("/etc", LOOKUP_OPEN, &etc) == 0);
+    ASSERT(vfs_path_walk("/etc/new", LOOKUP_PARENT | LOOKUP_CREATE, &path) == 0);
+    EXPECT(path.p_dentry == etc.p_dentry);
+    EXPECT_EQ(path.p_status, LOOKUP_STAT_ENOENT);
+    vfs_path_put(&path);
+
+    EXPECT_EQ(vfs_path_walk("/etc/missing", LOOKUP_OPEN, &path), -ENOENT);
+    EXPECT_EQ(path.p_status, LOOKUP_STAT_ENOENT);
+    EXPECT_EQ(vfs_path_walk("/etc/hello", LOOKUP_CREATE, &path), 0);
+    EXPECT_EQ(path.p_status, LOOKUP_STAT_EEXISTS);
+    vfs_path_put(&path);
+
+    EXPECT_EQ(vfs_path_walk("", LOOKUP_OPEN, &path), -EINVAL);
+    EXPECT_EQ(path.p_status, LOOKUP_STAT_EINVAL);
+
+    vfs_path_put(&etc);
+}
+
+static dentry_t *test_root;
+static superblock_t test_sb;
+
+static superblock_t *test_get_sb(fs_type_t *type, char *source, int flags, void *data)
+{
+    test_sb.s_root = test_root;
+    return &test_sb;
+}
+
+static int test_kill_sb(superblock_t *sb)
+{
+    return 0;
+}
+
+/* a file system mounted below the top level directory is crossed by the walk */
+TEST(vfs, nested_mount)
+{
+    fs_type_t fs = { .fs_name = "testfs", .get_sb = test_get_sb, .kill_sb = test_kill_sb };
+    dentry_t *file;
+    path_t path;
+
+    ASSERT((test_root = dentry_alloc_orphan("testfs", T_IFDIR)) != NULL);
+    ASSERT((file = dentry_alloc(test_root, "file", T_IFREG)) != NULL);
+    ASSERT(vfs_register_fs(&fs) == 0);
+
+    EXPECT_EQ(vfs_mount("/etc/hello", "/dev/missing", "testfs", 0), -ENOENT);
+    ASSERT(vfs_mount("/etc/hello", "/dev/char", "testfs", 0) == 0);
+    EXPECT_EQ(vfs_mount("/etc/hello", "/dev/char", "testfs", 0), -EBUSY);
+
+    ASSERT(vfs_path_walk("/dev/char/file", LOOKUP_OPEN, &path) == 0);
+    EXPECT(path.p_dentry == file);
+    vfs_path_put(&path);
+
+    ASSERT(vfs_path_walk("/dev/char", LOOKUP_OPEN, &path) == 0);
+    EXPECT(path.p_dentry == test_root);
+    vfs_path_put(&path);
+
+    ASSERT(vfs_path_walk("/dev/char", LOOKUP_MOUNTPOINT, &path) == 0);
+    EXPECT(path.p_dentry->d_flags & DNTR_MOUNTPOINT);
+    EXPECT(strcmp(path.p_dentry->d_name, "char") == 0);
+    vfs_path_put(&path);
+}
@@ -0,0 +1,60 @@
+#ifndef __UNIT_H__
+#define __UNIT_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Unit tests of the hosted kernel
+ *
+ * A test is defined with TEST() anywhere in unit/ and registered automatically:
+ *
+ *   TEST(bitmap, set_range)
+ *   {
+ *       EXPECT(...);
+ *   }
+ *
+ * Every test runs in its own process so a crash or a failed kassert() only fails
+ * that test. Results are printed in TAP format (https://testanything.org). */
+
+typedef struct unit_test {
+    const char *suite;
+    const char *name;
+    void (*func)(void);
+} unit_test_t;
+
+#define TEST(suite, name)                                                      \
+    static void __test_##suite##_##name(void);                                 \
+    static const unit_test_t __unit_##suite##_##name                           \
+        __attribute__((used, section("unit_tests"), aligned(sizeof(void *)))) = \
+        { #suite, #name, __test_##suite##_##name };                            \
+    static void __test_##suite##_##name(void)
+
+/* number of failed expectations of the running test */
+extern int unit_failures;
+
+#define __UNIT_FAIL(fmt, ...) do {                                             \
+    printf("# %s:%d: " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__);          \
+    unit_failures++;                                                           \
+} while (0)
+
+/* record a failure and continue the test */
+#define EXPECT(cond) do {                                                      \
+    if (!(cond))                                                               \
+        __UNIT_FAIL("expected %s", #cond);                                     \
+} while (0)
+
+#define EXPECT_EQ(a, b) do {                                                   \
+    long long __a = (long long)(a), __b = (long long)(b);                      \
+    if (__a != __b)                                                            \
+        __UNIT_FAIL("expected %s == %s (%lld != %lld)", #a, #b, __a, __b);     \
+} while (0)
+
+/* record a failure and end the test */
+#define ASSERT(cond) do {                                                      \
+    if (!(cond)) {                                                             \
+        __UNIT_FAIL("assertion %s failed", #cond);                             \
+        exit(1);                                                               \
+    }                                                                          \
+} while (0)
+
+#endif /* __UNIT_H__ */
@@ -1,4 +1,3 @@
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -7,341 +6,583 @@
 
 /* how to use this:
  *
- * gcc -o mkinitrd mkinitrd.c && ./mkinitrd -f <file1> "/sbin/init" -f <file2> "/bin/cat"
+ * gcc -o mkinitrd mkinitrd.c && ./mkinitrd -f <file1> "/sbin/init" -f <file2> "/usr/bin/cat"
+ *
+ * Every -f option copies a file of the build host to the given absolute path of the
+ * image. Directories on the path are created as needed and they can be nested to any
+ * depth. The image is written to initrd.bin in the working directory unless another
+ * name is given with -o.
  *
- * Maximum depth for directories is limited to 2 (f.ex. /usr/bin/...) because initial
- * ramdisk should only contain the necessary files for booting. Thus supporting complex
- * directory hiearchies is unnecessary (for now at least)
+ * With -c the image is compressed into an LZ4 frame which the kernel decompresses
+ * when it mounts the image. The frame stores the size of the image and a checksum of it.
  *
  * Example of initrd with following files:
  *      - /sbin/init
  *      - /sbin/dsh
- *      - /bin/echo
- *      - /bin/cat
+ *      - /usr/bin/echo
  *      - /test
  *
- *  /         [dir,  2 items]
- *    sbin/   [dir,  2 items]
- *      init  [file, N bytes]
- *      dsh   [file, N bytes]
- *    bin/    [dir,  2 items]
- *      echo  [file, N bytes]
- *      cat   [file, N bytes]
- *
+ *  /           [dir,  3 items]
+ *    sbin/     [dir,  2 items]
+ *      init    [file, N bytes]
+ *      dsh     [file, N bytes]
+ *    usr/      [dir,  1 item]
+ *      bin/    [dir,  1 item]
+ *        echo  [file, N bytes]
+ *    test      [file, N bytes]
  *
- * Right now this program is NOT very flexible so give the parameters in correct order. So for example
- * if you wanted to create folder structure defined above (and you have directory called 'programs')
- * you'd call mkinitrd like this:
- *
- * ./mkinitrd -f programs/file1.bin "/sbin/init" -f programs/file2.bin "/sbin/sh"
- *            -f programs/file3.bin "/bin/echo"  -f programs/file4.bin "/bin/cat"
+ * ./mkinitrd -f programs/file1.bin "/sbin/init" -f programs/file2.bin "/sbin/dsh"
+ *            -f programs/file3.bin "/usr/bin/echo" -f programs/file4.bin "/test"
  *
  *  Remember that all binary files must be compiled with a cross-compiler and linked against
- *  libc/libk.a instead of the default libc provided by the compiler */
+ *  libc/libk.a instead of the default libc provided by the compiler
+ *
+ * The image format is described in src/fs/initramfs.c, the structures below must match it */
+
+#define INITRD_MAGIC     0x13371339
+#define INITRD_DIR_MAGIC 0xcafebabf
+#define INITRD_VERSION   2
+#define INITRD_ROOT_INO  1
+
+#define PAGE_SIZE        4096
+#define NAME_MAXLEN      127  /* DENTRY_NAME_MAXLEN of the kernel without the NUL */
+
+/* LZ4 frame format, see src/lib/lz4.c */
+#define LZ4_FRAME_MAGIC  0x184d2204
+#define LZ4_FLG          ((1 << 6) | (1 << 5) | (1 << 3) | (1 << 2)) /* independent blocks, content size and checksum */
+#define LZ4_BD           (7 << 4)                                    /* 4 MB blocks */
+#define LZ4_BLOCK_SIZE   (4 << 20)
+#define LZ4_HASH_BITS    16
+#define LZ4_MIN_MATCH    4
+#define LZ4_MAX_OFFSET   65535
+#define LZ4_LAST_LITERALS 5   /* a block ends with at least this many literals */
+#define LZ4_MFLIMIT      12   /* and its last match starts at least this far from the end */
+
+enum {
+    INITRD_IFREG = 1,
+    INITRD_IFDIR = 2,
+};
+
+typedef struct initrd_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;        /* size of the image in bytes */
+    uint64_t inodes;      /* offset of the inode table */
+    uint32_t num_inodes;  /* number of entries in the inode table, including inode 0 */
+    uint32_t align;       /* alignment of file data */
+} initrd_header_t;
+
+typedef struct initrd_inode {
+    uint64_t offset;      /* offset of the file data or the directory table */
+    uint64_t size;        /* size of the file or the directory table in bytes */
+    uint32_t mode;        /* INITRD_IFREG or INITRD_IFDIR */
+    uint32_t reserved;
+} initrd_inode_t;
+
+typedef struct initrd_dir {
+    uint32_t magic;
+    uint32_t num_entries;
+} initrd_dir_t;
 
-#define HEADER_MAGIC  0x13371338
-#define FILE_MAGIC    0xdeadbeef
-#define DIR_MAGIC     0xcafebabe
+typedef struct initrd_dirent {
+    uint32_t hash;        /* dname_hash() of the name */
+    uint32_t ino;
+    uint32_t name;        /* offset of the name relative to the directory table */
+    uint32_t name_len;    /* length of the name without the NUL */
+} initrd_dirent_t;
 
-#define NAME_MAXLEN   64
-#define MAX_FILES     5
-#define MAX_DIRS      5
+typedef struct node {
+    char *name;
+    uint32_t mode;
+    uint32_t ino;
 
-typedef struct disk_header {
-    /* how much is the total size of initrd */
-    uint32_t size;
+    const char *path;     /* file of the build host */
+    uint64_t offset;
+    uint64_t size;
 
-    /* directory magic number (for verification) */
-    uint32_t magic;
+    struct node **children;
+    size_t num_children;
+    size_t max_children;
+} node_t;
 
-    /* how many directories initrd has */
-    uint32_t num_dir;
+#define ALIGN_UP(value, align) (((value) + (align) - 1) & ~((uint64_t)(align) - 1))
 
-    /* directory offsets (relative to disk's address) */
-    uint32_t dir_offsets[MAX_DIRS];
-} disk_header_t;
+static node_t **inodes;
+static uint32_t num_inodes = INITRD_ROOT_INO;
+
+/* the hash of the dentry cache, see dname_hash() in src/include/fs/dentry.h */
+static uint32_t dname_hash(const char *name, size_t len)
+{
+    uint32_t hash = 5381;
 
-typedef struct dir_header {
-    char name[NAME_MAXLEN];
+    while (len--)
+        hash = ((hash << 5) + hash) + (uint8_t)*name++;
 
-    /* how many bytes directory takes in total:
-     *  sizeof(dir_header_t) + num_files * sizeof(file_header_t) + file sizes */
-    uint32_t size;
+    return hash;
+}
 
-    /* how many files the directory has (1 <= num_files <= 5) */
-    uint32_t num_files;
+static void *xalloc(size_t size)
+{
+    void *ptr = calloc(1, size);
 
-    uint32_t inode;
-    uint32_t magic;
+    if (!ptr) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
 
-    uint32_t file_offsets[MAX_FILES];
-} dir_header_t;
+    return ptr;
+}
 
-typedef struct file_header {
-    char name[NAME_MAXLEN];
+static node_t *node_alloc(const char *name, size_t len, uint32_t mode)
+{
+    node_t *node = xalloc(sizeof(node_t));
 
-    /* file size in bytes (header size excluded) */
-    uint32_t size;
+    node->name = xalloc(len + 1);
+    node->mode = mode;
 
-    uint32_t inode;
-    uint32_t magic;
-} file_header_t;
+    memcpy(node->name, name, len);
+    return node;
+}
 
-uint32_t get_file_size(FILE *fp)
+static node_t *node_find(node_t *dir, const char *name, size_t len)
 {
-    uint32_t fsize = 0;
+    for (size_t i = 0; i < dir->num_children; ++i) {
+        if (strlen(dir->children[i]->name) == len && !strncmp(dir->children[i]->name, name, len))
+            return dir->children[i];
+    }
+
+    return NULL;
+}
+
+static void node_add(node_t *dir, node_t *child)
+{
+    if (dir->num_children == dir->max_children) {
+        dir->max_children = dir->max_children ? dir->max_children * 2 : 8;
+
+        if (!(dir->children = realloc(dir->children, dir->max_children * sizeof(node_t *)))) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    dir->children[dir->num_children++] = child;
+}
+
+static uint64_t get_file_size(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    long fsize;
+
+    if (!fp) {
+        fprintf(stderr, "failed to open %s\n", path);
+        exit(1);
+    }
 
     fseek(fp, 0L, SEEK_END);
-    fsize = (uint32_t)ftell(fp);
-    fseek(fp, 0L, SEEK_SET);
+    fsize = ftell(fp);
+    fclose(fp);
 
-    return fsize;
+    return (uint64_t)fsize;
 }
 
-uint32_t alloc_inode(void)
+/* add file `src` of the host as `path` of the image, return -1 on error */
+static int add_file(node_t *root, const char *src, const char *path)
 {
-    static int inode = 1;
-    return inode++;
+    node_t *dir = root, *node;
+    const char *name = path, *end;
+    size_t len;
+
+    if (*path != '/') {
+        fprintf(stderr, "%s: path must be absolute\n", path);
+        return -1;
+    }
+
+    for (;;) {
+        while (*name == '/')
+            name++;
+
+        if (!(end = strchr(name, '/')))
+            break;
+
+        if ((len = end - name) > NAME_MAXLEN) {
+            fprintf(stderr, "%s: name is too long\n", path);
+            return -1;
+        }
+
+        if (!(node = node_find(dir, name, len))) {
+            node = node_alloc(name, len, INITRD_IFDIR);
+            node_add(dir, node);
+        } else if (node->mode != INITRD_IFDIR) {
+            fprintf(stderr, "%s: %.*s is not a directory\n", path, (int)len, name);
+            return -1;
+        }
+
+        dir  = node;
+        name = end;
+    }
+
+    if (!(len = strlen(name)) || len > NAME_MAXLEN) {
+        fprintf(stderr, "%s: invalid file name\n", path);
+        return -1;
+    }
+
+    if (node_find(dir, name, len)) {
+        fprintf(stderr, "%s already exists\n", path);
+        return -1;
+    }
+
+    node       = node_alloc(name, len, INITRD_IFREG);
+    node->path = src;
+    node->size = get_file_size(src);
+
+    node_add(dir, node);
+    return 0;
 }
 
-void parse_path(char *path, char *dir, char **fname)
+/* number the inodes in depth-first order, the root is INITRD_ROOT_INO */
+static void assign_inodes(node_t *node)
 {
-    *fname = strdup(strrchr(path, '/') + 1);
+    node->ino = num_inodes++;
 
-    char *path_ptr = path + 1;
-    char *dir_ptr  = dir;
+    for (size_t i = 0; i < node->num_children; ++i)
+        assign_inodes(node->children[i]);
+}
 
-    while (*path_ptr != '/')
-        *dir_ptr++ = *path_ptr++;
-    *dir_ptr = '\0';
+static void collect_inodes(node_t *node)
+{
+    inodes[node->ino] = node;
 
-#ifdef __DEBUG__
-    printf("bin name: %s\n", *fname);
-    printf("dir name: %s\n", dir);
-#endif
+    for (size_t i = 0; i < node->num_children; ++i)
+        collect_inodes(node->children[i]);
 }
 
-int main(int argc, char **argv)
+static uint64_t dir_table_size(node_t *dir)
 {
-    if (argc == 1)
-        return -1;
+    uint64_t size = sizeof(initrd_dir_t) + dir->num_children * sizeof(initrd_dirent_t);
 
-    FILE *disk_fp = fopen("initrd.bin", "w"), *tmp;
-    char *fname;
-    int c, dir_count = 0, dir_ptr = 0;
-    uint32_t cur_offset = 0;
+    for (size_t i = 0; i < dir->num_children; ++i)
+        size += strlen(dir->children[i]->name) + 1;
 
-    disk_header_t disk_header = {
-        .size    = 0,
-        .num_dir = 0,
-        .magic   = HEADER_MAGIC
-    };
+    return size;
+}
 
-    memset(disk_header.dir_offsets, 0, sizeof(disk_header.dir_offsets));
+static int dirent_cmp(const void *a, const void *b)
+{
+    const initrd_dirent_t *d1 = a, *d2 = b;
 
-    dir_header_t root = {
-        .name      = "/",
-        .num_files = 0,
-        .size      = 0,
-        .inode     = alloc_inode(),
-        .magic     = DIR_MAGIC
-    };
+    if (d1->hash != d2->hash)
+        return d1->hash < d2->hash ? -1 : 1;
 
-    memset(root.file_offsets, 0, sizeof(root.file_offsets));
+    return d1->ino < d2->ino ? -1 : (d1->ino > d2->ino);
+}
 
-    char prev_dir[NAME_MAXLEN], cur_dir[NAME_MAXLEN];
+static void write_dir_table(node_t *dir, uint8_t *image)
+{
+    initrd_dir_t *hdr      = (initrd_dir_t *)(image + dir->offset);
+    initrd_dirent_t *ents  = (initrd_dirent_t *)(hdr + 1);
+    uint32_t name_off      = sizeof(initrd_dir_t) + dir->num_children * sizeof(initrd_dirent_t);
 
-    memset(prev_dir, 0, NAME_MAXLEN);
-    memset(cur_dir,  0, NAME_MAXLEN);
+    hdr->magic       = INITRD_DIR_MAGIC;
+    hdr->num_entries = dir->num_children;
 
-    /* MAX_FILES and MAX_DIRS can be adjusted according to
-     * current needs. If you decide to change them, remember
-     * to update them in kernel/fs/initrd.c too */
-    struct {
-        dir_header_t dir;
+    for (size_t i = 0; i < dir->num_children; ++i) {
+        node_t *child = dir->children[i];
+        size_t len    = strlen(child->name);
 
-        size_t file_ptr;
-        size_t file_count;
+        ents[i].hash     = dname_hash(child->name, len);
+        ents[i].ino      = child->ino;
+        ents[i].name     = name_off;
+        ents[i].name_len = len;
 
-        struct {
-            file_header_t file;
-            const char *file_path;
-        } files[MAX_FILES];
-    } data[MAX_DIRS];
+        memcpy((uint8_t *)hdr + name_off, child->name, len + 1);
+        name_off += len + 1;
+    }
 
-    memset(&data, 0, sizeof(data));
+    qsort(ents, dir->num_children, sizeof(initrd_dirent_t), dirent_cmp);
+}
 
-    while ((c = getopt(argc, argv, "f:")) != -1) {
-        if (c == 'f') {
-            parse_path(argv[optind], cur_dir, &fname);
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
 
-            if (strcmp(cur_dir, prev_dir)) {
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
 
-                /* check if dir already exists */
-                for (int i = 0; i < MAX_DIRS; ++i) {
-                    if (!strcmp(cur_dir, data[i].dir.name)) {
-#ifdef __DEBUG__
-                        printf("dir already exists\n");
-#endif
-                        dir_ptr = i;
-                        goto save_dir_data;
-                    }
-                }
+static uint8_t *write32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i)
+        *p++ = v >> (8 * i);
 
-                if (dir_count == MAX_DIRS) {
-                    printf("maximum number of directories reached!\n");
-                    printf("aborting...");
-                    return -1;
-                }
+    return p;
+}
 
-#ifdef __DEBUG__
-                printf("dir %s does not exist!\n", cur_dir);
-#endif
+static uint32_t rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
 
-                dir_ptr = dir_count++;
-                data[dir_ptr].dir.inode = alloc_inode();
-                data[dir_ptr].dir.magic = DIR_MAGIC;
-                data[dir_ptr].dir.num_files = 0;
-                strncpy(data[dir_ptr].dir.name, cur_dir, NAME_MAXLEN);
-            }
+/* 32-bit xxHash, the checksum of the LZ4 frame format */
+static uint32_t xxh32(const uint8_t *p, size_t len, uint32_t seed)
+{
+    const uint32_t P1 = 2654435761U, P2 = 2246822519U, P3 = 3266489917U;
+    const uint32_t P4 = 668265263U,  P5 = 374761393U;
+    const uint8_t *end = p + len;
+    uint32_t h;
 
-save_dir_data:
-            tmp = fopen(argv[optind - 1], "r");
-            uint32_t nwritten = get_file_size(tmp);
-            fclose(tmp);
+    if (len >= 16) {
+        uint32_t v[4] = { seed + P1 + P2, seed + P2, seed, seed - P1 };
 
-#ifdef __DEBUG__
-            printf("save file %s (%u) to dir %s %s\n", fname, nwritten,
-                    data[dir_ptr].dir.name, argv[optind - 1]);
-#endif
+        for (; p + 16 <= end; p += 16) {
+            for (int i = 0; i < 4; ++i)
+                v[i] = rotl32(v[i] + read32(p + 4 * i) * P2, 13) * P1;
+        }
 
-            data[dir_ptr].dir.size += nwritten + sizeof(file_header_t);
-            data[dir_ptr].dir.num_files++;
+        h = rotl32(v[0], 1) + rotl32(v[1], 7) + rotl32(v[2], 12) + rotl32(v[3], 18);
+    } else {
+        h = seed + P5;
+    }
 
-            size_t fcount = data[dir_ptr].file_count,
-                   fptr   = data[dir_ptr].file_ptr;
+    h += (uint32_t)len;
 
-            for (int i = 0; i < MAX_FILES; ++i) {
-                if (strncmp(fname, data[dir_ptr].files[i].file.name, NAME_MAXLEN) == 0) {
-                    printf("%s already exists in dir %s\n", fname, data[dir_ptr].dir.name);
-                    goto end;
-                }
-            }
+    for (; p + 4 <= end; p += 4)
+        h = rotl32(h + read32(p) * P3, 17) * P4;
 
-            if (fcount == MAX_FILES) {
-                printf("maximum number of files per dir reached!");
-                goto end;
-            }
+    for (; p < end; ++p)
+        h = rotl32(h + *p * P5, 11) * P1;
+
+    h ^= h >> 15; h *= P2;
+    h ^= h >> 13; h *= P3;
+    h ^= h >> 16;
+
+    return h;
+}
+
+static uint8_t *lz4_write_length(uint8_t *op, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+
+    *op++ = length;
+    return op;
+}
+
+/* write a sequence of the literals [anchor, anchor + nlit) and a match of `mlen` bytes
+ * `offset` bytes back, a sequence without a match (`mlen` 0) ends the block */
+static uint8_t *lz4_write_sequence(uint8_t *op, const uint8_t *anchor, size_t nlit, size_t offset, size_t mlen)
+{
+    uint8_t *token = op++;
+    size_t ml      = mlen ? mlen - LZ4_MIN_MATCH : 0;
+
+    *token = ((nlit >= 15 ? 15 : nlit) << 4) | (ml >= 15 ? 15 : ml);
+
+    if (nlit >= 15)
+        op = lz4_write_length(op, nlit - 15);
+
+    memcpy(op, anchor, nlit);
+    op += nlit;
+
+    if (!mlen)
+        return op;
+
+    *op++ = offset;
+    *op++ = offset >> 8;
+
+    if (ml >= 15)
+        op = lz4_write_length(op, ml - 15);
 
-            fptr = fcount++;
-            data[dir_ptr].files[fptr].file_path  = argv[optind - 1];
-            data[dir_ptr].files[fptr].file.size  = nwritten;
-            data[dir_ptr].files[fptr].file.inode = alloc_inode();
-            data[dir_ptr].files[fptr].file.magic = FILE_MAGIC;
-
-            if (fptr == 0)
-                cur_offset = sizeof(dir_header_t);
-            else
-                cur_offset += sizeof(file_header_t)
-                           +  data[dir_ptr].files[fptr - 1].file.size;
-
-            /* for the first file the offset is sizeof(dir_header_t)
-             *
-             * for all subsequent files it's sizeof(file_header_t) +
-             * previous file's offset and its size */
-            strncpy(data[dir_ptr].files[fptr].file.name, fname, NAME_MAXLEN);
-            data[dir_ptr].dir.file_offsets[fptr] = 0;
-            data[dir_ptr].dir.file_offsets[fptr] = cur_offset;
-
-            data[dir_ptr].file_count++;
-            data[dir_ptr].file_ptr++;
-end:
-            strncpy(prev_dir, cur_dir, NAME_MAXLEN);
+    return op;
+}
+
+/* greedy LZ4 compression of one block, `dst` must have room for `lz4_bound(len)` bytes
+ *
+ * every position is hashed so matches are found across the whole 64 KB window,
+ * return the size of the compressed block */
+static size_t lz4_compress_block(const uint8_t *src, size_t len, uint8_t *dst)
+{
+    static uint32_t table[1 << LZ4_HASH_BITS];  /* position + 1 of the last sequence with the hash */
+    const uint8_t *ip = src, *anchor = src, *end = src + len;
+    uint8_t *op = dst;
+
+    memset(table, 0, sizeof(table));
+
+    while (len > LZ4_MFLIMIT && ip <= end - LZ4_MFLIMIT) {
+        uint32_t seq   = read32(ip);
+        uint32_t hash  = (seq * 2654435761U) >> (32 - LZ4_HASH_BITS);
+        uint32_t prev  = table[hash];
+        const uint8_t *ref = src + prev - 1;
+
+        table[hash] = ip - src + 1;
+
+        if (!prev || ip - ref > LZ4_MAX_OFFSET || read32(ref) != seq) {
+            ip++;
+            continue;
         }
+
+        const uint8_t *m = ip + LZ4_MIN_MATCH, *r = ref + LZ4_MIN_MATCH;
+
+        while (m < end - LZ4_LAST_LITERALS && *m == *r)
+            m++, r++;
+
+        op = lz4_write_sequence(op, anchor, ip - anchor, ip - ref, m - ip);
+
+        for (ip++; ip < m && ip <= end - LZ4_MFLIMIT; ++ip)
+            table[(read32(ip) * 2654435761U) >> (32 - LZ4_HASH_BITS)] = ip - src + 1;
+
+        ip = anchor = m;
     }
 
-    /* header must be written after files because
-     * its info depends on file data
-     *
-     * skip sizeof(disk_header_t) bytes from
-     * the beginning of disk to save space for header */
-    fseek(disk_fp, sizeof(disk_header_t), SEEK_SET);
+    return lz4_write_sequence(op, anchor, end - anchor, 0, 0) - dst;
+}
 
-    /* skip root directory also because we don't know at this point
-     * how many directories/files it shall contain.
-     *
-     * This info is filled out later */
-    fseek(disk_fp, sizeof(dir_header_t), SEEK_CUR);
+static size_t lz4_bound(size_t len)
+{
+    return len + len / 255 + 16;
+}
 
-    for (int dir_iter = 0; dir_iter < dir_count; ++dir_iter) {
-#ifdef __DEBUG__
-        puts("--------");
+/* compress `image` into an LZ4 frame, return the frame and its size in `out_size` */
+static uint8_t *lz4_compress_frame(const uint8_t *image, uint64_t size, uint64_t *out_size)
+{
+    uint8_t *frame = xalloc(19 + (size / LZ4_BLOCK_SIZE + 1) * (4 + lz4_bound(LZ4_BLOCK_SIZE)) + 8);
+    uint8_t *op    = write32(frame, LZ4_FRAME_MAGIC);
+    uint8_t *desc  = op;
 
-        for (int i = 0; i < data[dir_iter].dir.num_files; ++i)
-            printf("%d. file's offset: %d\n", i, data[dir_iter].dir.file_offsets[i]);
+    *op++ = LZ4_FLG;
+    *op++ = LZ4_BD;
 
-        printf("disk: %zu\n", sizeof(disk_header_t));
-        printf("dir:  %zu\n", sizeof(dir_header_t));
-        printf("file: %zu\n", sizeof(file_header_t));
+    for (int i = 0; i < 8; ++i)
+        *op++ = size >> (8 * i);
 
-        printf("name:       %s\n"
-               "item count: %u\n"
-               "num bytes:  %u\n"
-               "inode:      %u\n"
-               "\ndirectory contents:\n",
-               data[dir_iter].dir.name, data[dir_iter].dir.num_files,
-               data[dir_iter].dir.size, data[dir_iter].dir.inode);
+    *op = (xxh32(desc, op - desc, 0) >> 8) & 0xff;
+    op++;
 
-#endif
-        fwrite(&data[dir_iter].dir, sizeof(dir_header_t), 1, disk_fp);
-        disk_header.size += data[dir_iter].dir.size;
-
-        for (int file_iter = 0; file_iter < data[dir_iter].dir.num_files; ++file_iter) {
-
-            /* disk_header.file_count++; */
-            fwrite(&data[dir_iter].files[file_iter].file, sizeof(file_header_t), 1, disk_fp);
-            tmp = fopen(data[dir_iter].files[file_iter].file_path, "r");
-
-            while ((c = fgetc(tmp)) != EOF)
-                putc(c, disk_fp);
-
-            fclose(tmp);
-
-#if __DEBUG__
-            printf("\tpath:   %s\n"
-                   "\tname:   %s\n"
-                   "\tsize:   %u\n"
-                   "\tinode:  %u\n\n",
-                data[dir_iter].files[file_iter].file_path,
-                data[dir_iter].files[file_iter].file.name,
-                data[dir_iter].files[file_iter].file.size,
-                data[dir_iter].files[file_iter].file.inode,
-                data[dir_iter].files[file_iter].file.magic);
-#endif
+    for (uint64_t off = 0; off < size; off += LZ4_BLOCK_SIZE) {
+        size_t len = size - off < LZ4_BLOCK_SIZE ? size - off : LZ4_BLOCK_SIZE;
+        size_t clen = lz4_compress_block(image + off, len, op + 4);
+
+        /* a block that doesn't compress is stored as is */
+        if (clen >= len) {
+            memcpy(op + 4, image + off, len);
+            op = write32(op, len | (1U << 31)) + len;
+        } else {
+            op = write32(op, clen) + clen;
+        }
+    }
+
+    op = write32(op, 0);
+    op = write32(op, xxh32(image, size, 0));
+
+    *out_size = op - frame;
+    return frame;
+}
+
+static void read_file(node_t *file, uint8_t *image)
+{
+    FILE *fp = fopen(file->path, "r");
+
+    if (!fp || fread(image + file->offset, 1, file->size, fp) != file->size) {
+        fprintf(stderr, "failed to read %s\n", file->path);
+        exit(1);
+    }
+
+    fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = "initrd.bin";
+    node_t *root = node_alloc("/", 1, INITRD_IFDIR);
+    int c, compress = 0;
+    FILE *disk_fp;
+
+    if (argc == 1)
+        return -1;
+
+    while ((c = getopt(argc, argv, "cf:o:")) != -1) {
+        if (c == 'c') {
+            compress = 1;
+        } else if (c == 'o') {
+            output = optarg;
+        } else if (c == 'f') {
+            if (optind >= argc) {
+                fprintf(stderr, "-f %s: path of the file in the image is missing\n", optarg);
+                return -1;
+            }
+
+            if (add_file(root, optarg, argv[optind++]) < 0)
+                return -1;
+        } else {
+            return -1;
         }
     }
 
-    root.num_files = dir_count;
-    root.size      = sizeof(dir_header_t) * dir_count;
+    assign_inodes(root);
+    inodes = xalloc(num_inodes * sizeof(node_t *));
+    collect_inodes(root);
 
-    root.file_offsets[0] = sizeof(dir_header_t);
+    /* directory tables come right after the inode table and file data
+     * after them, each file starting at a page boundary */
+    uint64_t offset = sizeof(initrd_header_t) + num_inodes * sizeof(initrd_inode_t);
+
+    for (uint32_t i = INITRD_ROOT_INO; i < num_inodes; ++i) {
+        if (inodes[i]->mode == INITRD_IFDIR) {
+            inodes[i]->offset = offset = ALIGN_UP(offset, 8);
+            inodes[i]->size   = dir_table_size(inodes[i]);
+            offset += inodes[i]->size;
+        }
+    }
 
-    for (size_t i = 1; i < dir_count; ++i) {
-        root.file_offsets[i] =
-            root.file_offsets[i - 1]
-            + sizeof(dir_header_t)
-            + data[dir_ptr - 1].dir.size;
+    for (uint32_t i = INITRD_ROOT_INO; i < num_inodes; ++i) {
+        if (inodes[i]->mode == INITRD_IFREG) {
+            inodes[i]->offset = offset = ALIGN_UP(offset, PAGE_SIZE);
+            offset += inodes[i]->size;
+        }
     }
 
-#if __DEBUG__
-    printf("root dir offsets:\n");
-    for (size_t i = 0; i < dir_count; ++i)
-        printf("\t%d. dir offset: %u\n", i + 1, root.file_offsets[i]);
+    uint64_t size           = ALIGN_UP(offset, PAGE_SIZE);
+    uint8_t *image          = xalloc(size);
+    initrd_header_t *header = (initrd_header_t *)image;
+    initrd_inode_t *table   = (initrd_inode_t *)(header + 1);
+
+    header->magic      = INITRD_MAGIC;
+    header->version    = INITRD_VERSION;
+    header->size       = size;
+    header->inodes     = sizeof(initrd_header_t);
+    header->num_inodes = num_inodes;
+    header->align      = PAGE_SIZE;
+
+    for (uint32_t i = INITRD_ROOT_INO; i < num_inodes; ++i) {
+        table[i].offset = inodes[i]->offset;
+        table[i].size   = inodes[i]->size;
+        table[i].mode   = inodes[i]->mode;
+
+        if (inodes[i]->mode == INITRD_IFDIR)
+            write_dir_table(inodes[i], image);
+        else
+            read_file(inodes[i], image);
+
+#ifdef __DEBUG__
+        printf("inode %u: %s [%s, %lu bytes at 0x%lx]\n", i, inodes[i]->name,
+               inodes[i]->mode == INITRD_IFDIR ? "dir" : "file",
+               (unsigned long)inodes[i]->size, (unsigned long)inodes[i]->offset);
 #endif
+    }
+
+    if (compress) {
+        uint64_t csize;
+        uint8_t *frame = lz4_compress_frame(image, size, &csize);
+
+        printf("%s: %lu bytes compressed to %lu bytes\n", output, (unsigned long)size, (unsigned long)csize);
 
-    fseek(disk_fp, 0L, SEEK_SET);
-    fwrite(&disk_header, sizeof(disk_header_t), 1, disk_fp);
-    fwrite(&root,        sizeof(dir_header_t),  1, disk_fp);
+        free(image);
+        image = frame;
+        size  = csize;
+    }
+
+    if (!(disk_fp = fopen(output, "w")) || fwrite(image, 1, size, disk_fp) != size) {
+        fprintf(stderr, "failed to write %s\n", output);
+        return -1;
+    }
 
     fclose(disk_fp);
     return 0;
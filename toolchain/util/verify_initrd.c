@@ -5,137 +5,214 @@
 
 /* how to use this:
  *
- * gcc -o verify verify_mkinitrd.c && ./verify <file1> <file2> ... <file4> 
+ * gcc -o verify verify_initrd.c && ./verify [initrd.bin]
  *
- * This program shall verify that the generated initrd is valid.
- * initrd verification is used only for debugging */
+ * This program shall verify that the generated initrd is valid: every offset
+ * is inside the image, file data is page-aligned, every inode is reachable
+ * exactly once from the root directory and every directory table is sorted by
+ * hash with no duplicate names. The tree is printed as it's walked.
+ *
+ * Exit status is 0 if the image is valid and 1 otherwise.
+ *
+ * The image format is described in src/fs/initramfs.c, the structures below must match it */
 
-#define HEADER_MAGIC  0x13371338
-#define FILE_MAGIC    0xdeadbeef
-#define DIR_MAGIC     0xcafebabe
+#define INITRD_MAGIC     0x13371339
+#define INITRD_DIR_MAGIC 0xcafebabf
+#define INITRD_VERSION   2
+#define INITRD_ROOT_INO  1
 
-#define NAME_MAXLEN   64
-#define MAX_FILES     5
-#define MAX_DIRS      5
+#define PAGE_SIZE        4096
+#define NAME_MAXLEN      127
 
-typedef struct disk_header {
-    /* how much is the total size of initrd */
-    uint32_t size;
+enum {
+    INITRD_IFREG = 1,
+    INITRD_IFDIR = 2,
+};
 
-    /* directory magic number (for verification) */
+typedef struct initrd_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;        /* size of the image in bytes */
+    uint64_t inodes;      /* offset of the inode table */
+    uint32_t num_inodes;  /* number of entries in the inode table, including inode 0 */
+    uint32_t align;       /* alignment of file data */
+} initrd_header_t;
+
+typedef struct initrd_inode {
+    uint64_t offset;      /* offset of the file data or the directory table */
+    uint64_t size;        /* size of the file or the directory table in bytes */
+    uint32_t mode;        /* INITRD_IFREG or INITRD_IFDIR */
+    uint32_t reserved;
+} initrd_inode_t;
+
+typedef struct initrd_dir {
     uint32_t magic;
+    uint32_t num_entries;
+} initrd_dir_t;
+
+typedef struct initrd_dirent {
+    uint32_t hash;        /* dname_hash() of the name */
+    uint32_t ino;
+    uint32_t name;        /* offset of the name relative to the directory table */
+    uint32_t name_len;    /* length of the name without the NUL */
+} initrd_dirent_t;
+
+static uint8_t *image;
+static initrd_header_t *header;
+static initrd_inode_t *table;
+static uint8_t *seen;
+static int errors;
+
+#define FAIL(...) do { fprintf(stderr, "error: " __VA_ARGS__); errors++; } while (0)
+
+/* the hash of the dentry cache, see dname_hash() in src/include/fs/dentry.h */
+static uint32_t dname_hash(const char *name, size_t len)
+{
+    uint32_t hash = 5381;
 
-    /* how many directories initrd has */
-    uint32_t num_dir;
+    while (len--)
+        hash = ((hash << 5) + hash) + (uint8_t)*name++;
 
-    /* directory offsets (relative to disk's address) */
-    uint32_t dir_offsets[MAX_DIRS];
-} disk_header_t;
+    return hash;
+}
 
-typedef struct dir_header {
-    char name[NAME_MAXLEN];
+/* check inode `ino` and everything below it, return 0 if the inode can be walked */
+static int verify_inode(uint32_t ino, const char *name, int depth)
+{
+    if (ino < INITRD_ROOT_INO || ino >= header->num_inodes) {
+        FAIL("%s: inode %u is out of range\n", name, ino);
+        return -1;
+    }
 
-    /* how many bytes directory takes in total:
-     *  sizeof(dir_header_t) + num_files * sizeof(file_header_t) + file sizes */
-    uint32_t size;
+    if (seen[ino]++) {
+        FAIL("%s: inode %u is linked more than once\n", name, ino);
+        return -1;
+    }
 
-    /* how many files the directory has (1 <= num_files <= 5) */
-    uint32_t num_files;
+    initrd_inode_t *rec = &table[ino];
 
-    uint32_t inode;
-    uint32_t magic;
+    if (rec->offset > header->size || rec->size > header->size - rec->offset) {
+        FAIL("%s: inode %u is outside of the image\n", name, ino);
+        return -1;
+    }
 
-    uint32_t file_offsets[MAX_FILES];
-} dir_header_t;
+    if (rec->mode == INITRD_IFREG) {
+        printf("%*s%s [file, inode %u, %lu bytes]\n", depth * 2, "", name, ino, (unsigned long)rec->size);
 
-typedef struct file_header {
-    char name[NAME_MAXLEN];
+        if (rec->offset % header->align)
+            FAIL("%s: file data is not aligned\n", name);
 
-    /* file size in bytes (header size excluded) */
-    uint32_t size;
+        return 0;
+    }
 
-    uint32_t inode;
-    uint32_t magic;
-} file_header_t;
+    if (rec->mode != INITRD_IFDIR) {
+        FAIL("%s: inode %u has invalid mode %u\n", name, ino, rec->mode);
+        return -1;
+    }
 
-uint32_t get_file_size(FILE *fp)
-{
-    uint32_t fsize = 0;
+    initrd_dir_t *dir      = (initrd_dir_t *)(image + rec->offset);
+    initrd_dirent_t *ents  = (initrd_dirent_t *)(dir + 1);
 
-    fseek(fp, 0L, SEEK_END);
-    fsize = (uint32_t)ftell(fp);
-    fseek(fp, 0L, SEEK_SET);
+    if (rec->size < sizeof(initrd_dir_t) || dir->magic != INITRD_DIR_MAGIC) {
+        FAIL("%s: invalid directory table\n", name);
+        return -1;
+    }
 
-    return fsize;
-}
+    if (dir->num_entries > (rec->size - sizeof(initrd_dir_t)) / sizeof(initrd_dirent_t)) {
+        FAIL("%s: directory entries don't fit the table\n", name);
+        return -1;
+    }
 
-int main(int argc, char **argv)
-{
-    FILE *disk_fp = fopen("initrd.bin", "r"), *tmp;
+    printf("%*s%s/ [dir, inode %u, %u items]\n", depth * 2, "", name, ino, dir->num_entries);
 
-    disk_header_t disk_header;
-    dir_header_t  root_header;
+    for (uint32_t i = 0; i < dir->num_entries; ++i) {
+        char *ename = (char *)dir + ents[i].name;
 
-    uint8_t  file_count;
-    uint32_t disk_size;
-    uint32_t magic;
+        if (ents[i].name >= rec->size || ents[i].name_len > NAME_MAXLEN ||
+            ents[i].name_len >= rec->size - ents[i].name || ename[ents[i].name_len] != '\0') {
+            FAIL("%s: entry %u has an invalid name\n", name, i);
+            continue;
+        }
+
+        if (ents[i].name_len == 0 || memchr(ename, '/', ents[i].name_len))
+            FAIL("%s: entry %u has an invalid name\n", name, i);
 
-    fread(&disk_header, sizeof(disk_header_t), 1, disk_fp);
+        if (dname_hash(ename, ents[i].name_len) != ents[i].hash)
+            FAIL("%s/%s: hash doesn't match the name\n", name, ename);
 
-    printf("disk_size:  %u\n"
-           "num_dir:    %u\n"
-           "magic:      0x%x\n", disk_header.size,
-           disk_header.num_dir, disk_header.magic);
+        if (i > 0 && ents[i - 1].hash > ents[i].hash)
+            FAIL("%s/%s: directory table is not sorted\n", name, ename);
+
+        for (uint32_t k = 0; k < i; ++k) {
+            if (ents[k].hash == ents[i].hash && ents[k].name_len == ents[i].name_len &&
+                !memcmp((char *)dir + ents[k].name, ename, ents[i].name_len))
+                FAIL("%s/%s: duplicate name\n", name, ename);
+        }
 
-    puts("\n------------");
+        (void)verify_inode(ents[i].ino, ename, depth + 1);
+    }
 
-    fread(&root_header, sizeof(dir_header_t), 1, disk_fp);
+    return 0;
+}
 
-    printf("name:       %s\n"
-           "item count: %u\n"
-           "num bytes:  %u\n"
-           "inode:      %u\n\n",
-           root_header.name, root_header.num_files,
-           root_header.size, root_header.inode);
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "initrd.bin";
+    FILE *disk_fp    = fopen(path, "r");
+    long len;
 
-    printf("file/dir offsets:\n");
-    for (int i = 0; i < root_header.num_files; ++i) {
-        printf("\t%d. item offset: %u\n", i + 1, root_header.file_offsets[i]);
+    if (!disk_fp) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return 1;
     }
 
-    printf("\ndirectory contents:\n");
+    fseek(disk_fp, 0L, SEEK_END);
+    len = ftell(disk_fp);
+    fseek(disk_fp, 0L, SEEK_SET);
 
-    dir_header_t dir;
-    file_header_t file;
+    if (len < (long)sizeof(initrd_header_t) || !(image = malloc(len)) ||
+        fread(image, 1, len, disk_fp) != (size_t)len) {
+        fprintf(stderr, "failed to read %s\n", path);
+        return 1;
+    }
 
-    for (int dir_iter = 0; dir_iter < root_header.num_files; ++dir_iter) {
-        fread(&dir, sizeof(dir_header_t), 1, disk_fp);
+    fclose(disk_fp);
+    header = (initrd_header_t *)image;
 
-        printf("\n------------\n"
-               "name:       %s\n"
-               "item count: %u\n"
-               "num bytes:  %u\n"
-               "inode:      %u\n",
-               dir.name, dir.num_files,
-               dir.size, dir.inode);
+    printf("disk_size:  %lu\n"
+           "version:    %u\n"
+           "inodes:     %u\n"
+           "magic:      0x%x\n\n", (unsigned long)header->size,
+           header->version, header->num_inodes, header->magic);
 
-        printf("\nfile/dir offsets:\n");
-        for (int i = 0; i < root_header.num_files; ++i) {
-            printf("\t%d. item offset: %u\n", i + 1, dir.file_offsets[i]);
-        }
+    if (header->magic != INITRD_MAGIC || header->version != INITRD_VERSION) {
+        fprintf(stderr, "error: not a version %u initrd\n", INITRD_VERSION);
+        return 1;
+    }
 
-        printf("\ndirectory contents:\n");
+    if (header->size > (uint64_t)len || header->inodes > header->size ||
+        header->num_inodes <= INITRD_ROOT_INO || header->align == 0 ||
+        header->num_inodes > (header->size - header->inodes) / sizeof(initrd_inode_t)) {
+        fprintf(stderr, "error: invalid header\n");
+        return 1;
+    }
 
-        for (int file_iter = 0; file_iter < dir.num_files; ++file_iter) {
-            fread(&file, sizeof(file_header_t), 1, disk_fp);
-            printf("\tname:  %s\n"
-                   "\tsize:  %u\n"
-                   "\tinode: %u\n\n",
-                file.name, file.size,
-                file.inode, file.magic);
-            fseek(disk_fp, file.size, SEEK_CUR);
-        }
+    table = (initrd_inode_t *)(image + header->inodes);
+    seen  = calloc(header->num_inodes, 1);
+
+    if (!seen)
+        return 1;
+
+    if (table[INITRD_ROOT_INO].mode != INITRD_IFDIR)
+        FAIL("root inode is not a directory\n");
+    else
+        (void)verify_inode(INITRD_ROOT_INO, "", 0);
+
+    for (uint32_t i = INITRD_ROOT_INO; i < header->num_inodes; ++i) {
+        if (!seen[i])
+            FAIL("inode %u is not linked to any directory\n", i);
     }
 
-    return 0;
+    printf("\n%s: %d errors\n", path, errors);
+    return errors ? 1 : 0;
 }